@@ -19,6 +19,7 @@
 pub use rustc_target::spec::abi::Abi;
 
 use libc::c_uint;
+use smallvec::SmallVec;
 
 macro_rules! for_each_kind {
     ($flags: ident, $f: ident, $($kind: ident),+) => ({
@@ -41,13 +42,16 @@ fn for_each_kind<F>(&self, mut f: F)
     }
 }
 
+/// The attributes of a function or call site, gathered so that they can be added with a single
+/// call.
+type AttributeSpecs<'ll> = SmallVec<[llvm::AttributeSpec<'ll>; 16]>;
+
 pub trait ArgAttributesExt {
-    fn apply_attrs_to_llfn(&self, idx: AttributePlace, cx: &CodegenCx<'_, '_>, llfn: &Value);
-    fn apply_attrs_to_callsite(
+    fn collect_attrs<'ll>(
         &self,
         idx: AttributePlace,
-        cx: &CodegenCx<'_, '_>,
-        callsite: &Value,
+        cx: &CodegenCx<'ll, '_>,
+        specs: &mut AttributeSpecs<'ll>,
     );
 }
 
@@ -64,77 +68,38 @@ fn should_use_mutable_noalias(cx: &CodegenCx<'_, '_>) -> bool {
 }
 
 impl ArgAttributesExt for ArgAttributes {
-    fn apply_attrs_to_llfn(&self, idx: AttributePlace, cx: &CodegenCx<'_, '_>, llfn: &Value) {
-        let mut regular = self.regular;
-        unsafe {
-            let deref = self.pointee_size.bytes();
-            if deref != 0 {
-                if regular.contains(ArgAttribute::NonNull) {
-                    llvm::LLVMRustAddDereferenceableAttr(llfn, idx.as_uint(), deref);
-                } else {
-                    llvm::LLVMRustAddDereferenceableOrNullAttr(llfn, idx.as_uint(), deref);
-                }
-                regular -= ArgAttribute::NonNull;
-            }
-            if let Some(align) = self.pointee_align {
-                llvm::LLVMRustAddAlignmentAttr(llfn, idx.as_uint(), align.bytes() as u32);
-            }
-            regular.for_each_kind(|attr| attr.apply_llfn(idx, llfn));
-            if regular.contains(ArgAttribute::NoAliasMutRef) && should_use_mutable_noalias(cx) {
-                llvm::Attribute::NoAlias.apply_llfn(idx, llfn);
-            }
-            match self.arg_ext {
-                ArgExtension::None => {}
-                ArgExtension::Zext => {
-                    llvm::Attribute::ZExt.apply_llfn(idx, llfn);
-                }
-                ArgExtension::Sext => {
-                    llvm::Attribute::SExt.apply_llfn(idx, llfn);
-                }
-            }
-        }
-    }
-
-    fn apply_attrs_to_callsite(
+    fn collect_attrs<'ll>(
         &self,
         idx: AttributePlace,
-        cx: &CodegenCx<'_, '_>,
-        callsite: &Value,
+        cx: &CodegenCx<'ll, '_>,
+        specs: &mut AttributeSpecs<'ll>,
     ) {
         let mut regular = self.regular;
-        unsafe {
-            let deref = self.pointee_size.bytes();
-            if deref != 0 {
-                if regular.contains(ArgAttribute::NonNull) {
-                    llvm::LLVMRustAddDereferenceableCallSiteAttr(callsite, idx.as_uint(), deref);
-                } else {
-                    llvm::LLVMRustAddDereferenceableOrNullCallSiteAttr(
-                        callsite,
-                        idx.as_uint(),
-                        deref,
-                    );
-                }
-                regular -= ArgAttribute::NonNull;
-            }
-            if let Some(align) = self.pointee_align {
-                llvm::LLVMRustAddAlignmentCallSiteAttr(
-                    callsite,
-                    idx.as_uint(),
-                    align.bytes() as u32,
-                );
-            }
-            regular.for_each_kind(|attr| attr.apply_callsite(idx, callsite));
-            if regular.contains(ArgAttribute::NoAliasMutRef) && should_use_mutable_noalias(cx) {
-                llvm::Attribute::NoAlias.apply_callsite(idx, callsite);
+        let deref = self.pointee_size.bytes();
+        if deref != 0 {
+            let kind = if regular.contains(ArgAttribute::NonNull) {
+                llvm::AttributeSpecKind::Dereferenceable
+            } else {
+                llvm::AttributeSpecKind::DereferenceableOrNull
+            };
+            specs.push(llvm::AttributeSpec::int_attr(idx, kind, deref));
+            regular -= ArgAttribute::NonNull;
+        }
+        if let Some(align) = self.pointee_align {
+            let kind = llvm::AttributeSpecKind::Alignment;
+            specs.push(llvm::AttributeSpec::int_attr(idx, kind, align.bytes()));
+        }
+        regular.for_each_kind(|attr| specs.push(llvm::AttributeSpec::enum_attr(idx, attr)));
+        if regular.contains(ArgAttribute::NoAliasMutRef) && should_use_mutable_noalias(cx) {
+            specs.push(llvm::AttributeSpec::enum_attr(idx, llvm::Attribute::NoAlias));
+        }
+        match self.arg_ext {
+            ArgExtension::None => {}
+            ArgExtension::Zext => {
+                specs.push(llvm::AttributeSpec::enum_attr(idx, llvm::Attribute::ZExt));
             }
-            match self.arg_ext {
-                ArgExtension::None => {}
-                ArgExtension::Zext => {
-                    llvm::Attribute::ZExt.apply_callsite(idx, callsite);
-                }
-                ArgExtension::Sext => {
-                    llvm::Attribute::SExt.apply_callsite(idx, callsite);
-                }
+            ArgExtension::Sext => {
+                specs.push(llvm::AttributeSpec::enum_attr(idx, llvm::Attribute::SExt));
             }
         }
     }
@@ -436,98 +401,100 @@ fn llvm_cconv(&self) -> llvm::CallConv {
     }
 
     fn apply_attrs_llfn(&self, cx: &CodegenCx<'ll, 'tcx>, llfn: &'ll Value) {
+        let mut specs = AttributeSpecs::new();
+
         // FIXME(eddyb) can this also be applied to callsites?
         if self.ret.layout.abi.is_uninhabited() {
-            llvm::Attribute::NoReturn.apply_llfn(llvm::AttributePlace::Function, llfn);
+            let attr = llvm::Attribute::NoReturn;
+            specs.push(llvm::AttributeSpec::enum_attr(llvm::AttributePlace::Function, attr));
         }
 
         // FIXME(eddyb, wesleywiser): apply this to callsites as well?
         if !self.can_unwind {
-            llvm::Attribute::NoUnwind.apply_llfn(llvm::AttributePlace::Function, llfn);
+            let attr = llvm::Attribute::NoUnwind;
+            specs.push(llvm::AttributeSpec::enum_attr(llvm::AttributePlace::Function, attr));
         }
 
         let mut i = 0;
-        let mut apply = |attrs: &ArgAttributes| {
-            attrs.apply_attrs_to_llfn(llvm::AttributePlace::Argument(i), cx, llfn);
+        let mut apply = |specs: &mut AttributeSpecs<'ll>, attrs: &ArgAttributes| {
+            attrs.collect_attrs(llvm::AttributePlace::Argument(i), cx, specs);
             i += 1;
             i - 1
         };
         match self.ret.mode {
             PassMode::Direct(ref attrs) => {
-                attrs.apply_attrs_to_llfn(llvm::AttributePlace::ReturnValue, cx, llfn);
+                attrs.collect_attrs(llvm::AttributePlace::ReturnValue, cx, &mut specs);
             }
             PassMode::Indirect { ref attrs, extra_attrs: _, on_stack } => {
                 assert!(!on_stack);
-                let i = apply(attrs);
-                unsafe {
-                    llvm::LLVMRustAddStructRetAttr(
-                        llfn,
-                        llvm::AttributePlace::Argument(i).as_uint(),
-                        self.ret.layout.llvm_type(cx),
-                    );
-                }
+                let i = apply(&mut specs, attrs);
+                specs.push(llvm::AttributeSpec::type_attr(
+                    llvm::AttributePlace::Argument(i),
+                    llvm::AttributeSpecKind::StructRet,
+                    self.ret.layout.llvm_type(cx),
+                ));
             }
             _ => {}
         }
         for arg in &self.args {
             if arg.pad.is_some() {
-                apply(&ArgAttributes::new());
+                apply(&mut specs, &ArgAttributes::new());
             }
             match arg.mode {
                 PassMode::Ignore => {}
                 PassMode::Indirect { ref attrs, extra_attrs: None, on_stack: true } => {
-                    let i = apply(attrs);
-                    unsafe {
-                        llvm::LLVMRustAddByValAttr(
-                            llfn,
-                            llvm::AttributePlace::Argument(i).as_uint(),
-                            arg.layout.llvm_type(cx),
-                        );
-                    }
+                    let i = apply(&mut specs, attrs);
+                    specs.push(llvm::AttributeSpec::type_attr(
+                        llvm::AttributePlace::Argument(i),
+                        llvm::AttributeSpecKind::ByVal,
+                        arg.layout.llvm_type(cx),
+                    ));
                 }
                 PassMode::Direct(ref attrs)
                 | PassMode::Indirect { ref attrs, extra_attrs: None, on_stack: false } => {
-                    apply(attrs);
+                    apply(&mut specs, attrs);
                 }
                 PassMode::Indirect { ref attrs, extra_attrs: Some(ref extra_attrs), on_stack } => {
                     assert!(!on_stack);
-                    apply(attrs);
-                    apply(extra_attrs);
+                    apply(&mut specs, attrs);
+                    apply(&mut specs, extra_attrs);
                 }
                 PassMode::Pair(ref a, ref b) => {
-                    apply(a);
-                    apply(b);
+                    apply(&mut specs, a);
+                    apply(&mut specs, b);
                 }
                 PassMode::Cast(_) => {
-                    apply(&ArgAttributes::new());
+                    apply(&mut specs, &ArgAttributes::new());
                 }
             }
         }
+
+        llvm::add_function_attributes(llfn, &specs);
     }
 
     fn apply_attrs_callsite(&self, bx: &mut Builder<'a, 'll, 'tcx>, callsite: &'ll Value) {
         // FIXME(wesleywiser, eddyb): We should apply `nounwind` and `noreturn` as appropriate to this callsite.
 
+        let mut specs = AttributeSpecs::new();
         let mut i = 0;
-        let mut apply = |cx: &CodegenCx<'_, '_>, attrs: &ArgAttributes| {
-            attrs.apply_attrs_to_callsite(llvm::AttributePlace::Argument(i), cx, callsite);
-            i += 1;
-            i - 1
-        };
+        let mut apply =
+            |cx: &CodegenCx<'ll, '_>, specs: &mut AttributeSpecs<'ll>, attrs: &ArgAttributes| {
+                attrs.collect_attrs(llvm::AttributePlace::Argument(i), cx, specs);
+                i += 1;
+                i - 1
+            };
         match self.ret.mode {
             PassMode::Direct(ref attrs) => {
-                attrs.apply_attrs_to_callsite(llvm::AttributePlace::ReturnValue, &bx.cx, callsite);
+                attrs.collect_attrs(llvm::AttributePlace::ReturnValue, &bx.cx, &mut specs);
             }
             PassMode::Indirect { ref attrs, extra_attrs: _, on_stack } => {
                 assert!(!on_stack);
-                let i = apply(bx.cx, attrs);
-                unsafe {
-                    llvm::LLVMRustAddStructRetCallSiteAttr(
-                        callsite,
-                        llvm::AttributePlace::Argument(i).as_uint(),
-                        self.ret.layout.llvm_type(bx),
-                    );
-                }
+                let i = apply(bx.cx, &mut specs, attrs);
+                specs.push(llvm::AttributeSpec::type_attr(
+                    llvm::AttributePlace::Argument(i),
+                    llvm::AttributeSpecKind::StructRet,
+                    self.ret.layout.llvm_type(bx),
+                ));
             }
             _ => {}
         }
@@ -546,41 +513,40 @@ fn apply_attrs_callsite(&self, bx: &mut Builder<'a, 'll, 'tcx>, callsite: &'ll V
         }
         for arg in &self.args {
             if arg.pad.is_some() {
-                apply(bx.cx, &ArgAttributes::new());
+                apply(bx.cx, &mut specs, &ArgAttributes::new());
             }
             match arg.mode {
                 PassMode::Ignore => {}
                 PassMode::Indirect { ref attrs, extra_attrs: None, on_stack: true } => {
-                    let i = apply(bx.cx, attrs);
-                    unsafe {
-                        llvm::LLVMRustAddByValCallSiteAttr(
-                            callsite,
-                            llvm::AttributePlace::Argument(i).as_uint(),
-                            arg.layout.llvm_type(bx),
-                        );
-                    }
+                    let i = apply(bx.cx, &mut specs, attrs);
+                    specs.push(llvm::AttributeSpec::type_attr(
+                        llvm::AttributePlace::Argument(i),
+                        llvm::AttributeSpecKind::ByVal,
+                        arg.layout.llvm_type(bx),
+                    ));
                 }
                 PassMode::Direct(ref attrs)
                 | PassMode::Indirect { ref attrs, extra_attrs: None, on_stack: false } => {
-                    apply(bx.cx, attrs);
+                    apply(bx.cx, &mut specs, attrs);
                 }
                 PassMode::Indirect {
                     ref attrs,
                     extra_attrs: Some(ref extra_attrs),
                     on_stack: _,
                 } => {
-                    apply(bx.cx, attrs);
-                    apply(bx.cx, extra_attrs);
+                    apply(bx.cx, &mut specs, attrs);
+                    apply(bx.cx, &mut specs, extra_attrs);
                 }
                 PassMode::Pair(ref a, ref b) => {
-                    apply(bx.cx, a);
-                    apply(bx.cx, b);
+                    apply(bx.cx, &mut specs, a);
+                    apply(bx.cx, &mut specs, b);
                 }
                 PassMode::Cast(_) => {
-                    apply(bx.cx, &ArgAttributes::new());
+                    apply(bx.cx, &mut specs, &ArgAttributes::new());
                 }
             }
         }
+        llvm::add_callsite_attributes(callsite, &specs);
 
         let cconv = self.llvm_cconv();
         if cconv != llvm::CCallConv {
@@ -227,9 +227,12 @@ fn inject_dll_import_lib(
             dll_imports.iter().map(|import| import.name.to_string()).collect::<Vec<_>>().join(", "),
         );
 
-        let ffi_exports: Vec<LLVMRustCOFFShortExport> = import_name_vector
+        let ffi_exports: Vec<LLVMRustCOFFShortExport> = dll_imports
             .iter()
-            .map(|name_z| LLVMRustCOFFShortExport::from_name(name_z.as_ptr()))
+            .zip(&import_name_vector)
+            .map(|(import, name_z)| {
+                LLVMRustCOFFShortExport::new(name_z.as_ptr(), import.ordinal, !import.is_fn)
+            })
             .collect();
         let result = unsafe {
             crate::llvm::LLVMRustWriteImportLibrary(
@@ -266,7 +269,9 @@ fn src_archive(&mut self) -> Option<&ArchiveRO> {
             return a.as_ref();
         }
         let src = self.config.src.as_ref()?;
-        self.src_archive = Some(ArchiveRO::open(src).ok());
+        // This is usually the archive being rebuilt, which isn't worth caching.
+        let mode = self.config.sess.opts.debugging_opts.archive_read_mode;
+        self.src_archive = Some(ArchiveRO::open_with_options(src, mode, false).ok());
         self.src_archive.as_ref().unwrap().as_ref()
     }
 
@@ -274,10 +279,10 @@ fn add_archive<F>(&mut self, archive: &Path, skip: F) -> io::Result<()>
     where
         F: FnMut(&str) -> bool + 'static,
     {
-        let archive_ro = match ArchiveRO::open(archive) {
-            Ok(ar) => ar,
-            Err(e) => return Err(io::Error::new(io::ErrorKind::Other, e)),
-        };
+        let opts = &self.config.sess.opts.debugging_opts;
+        let archive_ro =
+            ArchiveRO::open_with_options(archive, opts.archive_read_mode, opts.archive_cache)
+                .map_err(|e| io::Error::new(io::ErrorKind::Other, e))?;
         if self.additions.iter().any(|ar| ar.path() == archive) {
             return Ok(());
         }
@@ -295,6 +300,7 @@ fn llvm_archive_kind(&self) -> Result<ArchiveKind, &str> {
     }
 
     fn build_with_llvm(&mut self, kind: ArchiveKind) -> io::Result<()> {
+        let _timer = self.config.sess.prof.generic_activity("LLVM_build_archive");
         let removals = mem::take(&mut self.removals);
         let mut additions = mem::take(&mut self.additions);
         let mut strings = Vec::new();
@@ -369,12 +375,14 @@ fn build_with_llvm(&mut self, kind: ArchiveKind) -> io::Result<()> {
                 }
             }
 
-            let r = llvm::LLVMRustWriteArchive(
+            let r = llvm::LLVMRustWriteArchiveParallel(
                 dst.as_ptr(),
                 members.len() as libc::size_t,
                 members.as_ptr() as *const &_,
                 should_update_symbols,
                 kind,
+                self.config.sess.opts.debugging_opts.llvm_threads as libc::c_uint,
+                self.config.sess.opts.debugging_opts.reuse_archive_symbols,
             );
             let ret = if r.into_result().is_err() {
                 let err = llvm::LLVMRustGetLastError();
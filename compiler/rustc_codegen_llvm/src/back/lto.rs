@@ -1,9 +1,10 @@
 use crate::back::write::{
-    self, save_temp_bitcode, to_llvm_opt_settings, with_llvm_pmb, DiagnosticHandlers,
+    self, save_temp_bitcode, to_llvm_opt_settings, with_llvm_pmb, CodegenDiagnosticsStage,
+    DiagnosticHandlers,
 };
 use crate::llvm::archive_ro::ArchiveRO;
 use crate::llvm::{self, build_string, False, True};
-use crate::{LlvmCodegenBackend, ModuleLlvm};
+use crate::{create_context, llvm_util, LlvmCodegenBackend, ModuleLlvm};
 use rustc_codegen_ssa::back::lto::{LtoModuleCodegen, SerializedModule, ThinModule, ThinShared};
 use rustc_codegen_ssa::back::symbol_export;
 use rustc_codegen_ssa::back::write::{
@@ -13,6 +14,7 @@
 use rustc_codegen_ssa::{looks_like_rust_object_file, ModuleCodegen, ModuleKind};
 use rustc_data_structures::fx::FxHashMap;
 use rustc_errors::{FatalError, Handler};
+use rustc_fs_util::path_to_c_string;
 use rustc_hir::def_id::LOCAL_CRATE;
 use rustc_middle::bug;
 use rustc_middle::dep_graph::WorkProduct;
@@ -21,8 +23,9 @@
 use rustc_session::config::{self, CrateType, Lto};
 use tracing::{debug, info};
 
+use libc::{c_char, c_uint, c_void, size_t};
 use std::ffi::{CStr, CString};
-use std::fs::File;
+use std::fs::{self, File};
 use std::io;
 use std::iter;
 use std::path::Path;
@@ -34,6 +37,10 @@
 /// session to determine which CGUs we can reuse.
 pub const THIN_LTO_KEYS_INCR_COMP_FILE_NAME: &str = "thin-lto-past-keys.bin";
 
+/// With `-Z incremental-thinlto-index`, the ThinLTO index of the previous
+/// session is stored in this file of the incremental session directory.
+pub const THIN_LTO_INDEX_INCR_COMP_FILE_NAME: &str = "thin-lto-index.bin";
+
 pub fn crate_type_allows_lto(crate_type: CrateType) -> bool {
     match crate_type {
         CrateType::Executable | CrateType::Staticlib | CrateType::Cdylib => true,
@@ -109,14 +116,17 @@ fn prepare_lto(
                     .extend(exported_symbols[&cnum].iter().filter_map(symbol_filter));
             }
 
-            let archive = ArchiveRO::open(&path).expect("wanted an rlib");
+            let opts = &cgcx.opts.debugging_opts;
+            let archive =
+                ArchiveRO::open_with_options(&path, opts.archive_read_mode, opts.archive_cache)
+                    .expect("wanted an rlib");
             let obj_files = archive
-                .iter()
-                .filter_map(|child| child.ok().and_then(|c| c.name().map(|name| (name, c))))
+                .child_infos()
+                .filter_map(|child| child.ok().and_then(|c| c.name.map(|name| (name, c.data))))
                 .filter(|&(name, _)| looks_like_rust_object_file(name));
-            for (name, child) in obj_files {
+            for (name, data) in obj_files {
                 info!("adding bitcode from {}", name);
-                match get_bitcode_slice_from_object_data(child.data()) {
+                match get_bitcode_slice_from_object_data(data) {
                     Ok(data) => {
                         let module = SerializedModule::FromRlib(data.to_vec());
                         upstream_modules.push((module, CString::new(name).unwrap()));
@@ -132,8 +142,9 @@ fn prepare_lto(
 
 fn get_bitcode_slice_from_object_data(obj: &[u8]) -> Result<&[u8], String> {
     let mut len = 0;
-    let data =
-        unsafe { llvm::LLVMRustGetBitcodeSliceFromObjectData(obj.as_ptr(), obj.len(), &mut len) };
+    let data = unsafe {
+        llvm::LLVMRustGetBitcodeSliceFromObjectDataFast(obj.as_ptr(), obj.len(), &mut len)
+    };
     if !data.is_null() {
         assert!(len != 0);
         let bc = unsafe { slice::from_raw_parts(data, len) };
@@ -199,9 +210,17 @@ pub(crate) fn run_thin(
     )
 }
 
-pub(crate) fn prepare_thin(module: ModuleCodegen<ModuleLlvm>) -> (String, ThinBuffer) {
+pub(crate) fn prepare_thin(
+    cgcx: &CodegenContext<LlvmCodegenBackend>,
+    module: ModuleCodegen<ModuleLlvm>,
+) -> (String, ThinBuffer) {
     let name = module.name.clone();
-    let buffer = ThinBuffer::new(module.module_llvm.llmod());
+    // These buffers are only read by our own ThinLTO, so they can be split.
+    let buffer = if cgcx.opts.debugging_opts.split_thinlto_buffers {
+        ThinBuffer::new_split(module.module_llvm.llmod())
+    } else {
+        ThinBuffer::new(module.module_llvm.llmod())
+    };
     (name, buffer)
 }
 
@@ -256,8 +275,9 @@ fn fat_lto(
         .enumerate()
         .filter(|&(_, module)| module.kind == ModuleKind::Regular)
         .map(|(i, module)| {
-            let cost = unsafe { llvm::LLVMRustModuleCost(module.module_llvm.llmod()) };
-            (cost, i)
+            let mut cost = llvm::ModuleCostInfo::default();
+            unsafe { llvm::LLVMRustModuleGetCost(module.module_llvm.llmod(), &mut cost) };
+            (cost.weighted_cost, i)
         })
         .max();
 
@@ -290,18 +310,26 @@ fn fat_lto(
         // The linking steps below may produce errors and diagnostics within LLVM
         // which we'd like to handle and print, so set up our diagnostic handlers
         // (which get unregistered when they go out of scope below).
-        let _handler = DiagnosticHandlers::new(cgcx, diag_handler, llcx);
+        let _handler = DiagnosticHandlers::new(
+            cgcx,
+            diag_handler,
+            llcx,
+            &module.name,
+            CodegenDiagnosticsStage::Lto,
+        );
 
         // For all other modules we codegened we'll need to link them into our own
         // bitcode. All modules were codegened in their own LLVM context, however,
         // and we want to move everything to the same LLVM context. Currently the
         // way we know of to do that is to serialize them to a string and them parse
         // them later. Not great but hey, that's why it's "fat" LTO, right?
+        let serialize_timer = cgcx.prof.generic_activity("LLVM_fat_lto_serialize_modules");
         for module in in_memory {
             let buffer = ModuleBuffer::new(module.module_llvm.llmod());
             let llmod_id = CString::new(&module.name[..]).unwrap();
             serialized_modules.push((SerializedModule::Local(buffer), llmod_id));
         }
+        drop(serialize_timer);
         // Sort the modules to ensure we produce deterministic results.
         serialized_modules.sort_by(|module1, module2| module1.1.cmp(&module2.1));
 
@@ -310,17 +338,31 @@ fn fat_lto(
         // know much about the memory management here so we err on the side of being
         // save and persist everything with the original module.
         let mut linker = Linker::new(llmod);
-        for (bc_decoded, name) in serialized_modules {
-            let _timer = cgcx
-                .prof
-                .generic_activity_with_arg("LLVM_fat_lto_link_module", format!("{:?}", name));
-            info!("linking {:?}", name);
-            let data = bc_decoded.data();
-            linker.add(&data).map_err(|()| {
-                let msg = format!("failed to load bc of {:?}", name);
-                write::llvm_err(&diag_handler, &msg)
+        // Linking in groups gives a module that differs from linking one by one in the order of
+        // its globals and the names of renamed types, which is why `-Z llvm-threads` is tracked.
+        let num_threads = cgcx.opts.debugging_opts.llvm_threads;
+        if num_threads != 1 {
+            let _timer = cgcx.prof.generic_activity("LLVM_fat_lto_link_modules");
+            info!("linking {} modules on {} threads", serialized_modules.len(), num_threads);
+            let data: Vec<_> = serialized_modules.iter().map(|(bc, _)| bc.data()).collect();
+            linker.add_batch(&data, num_threads).map_err(|()| {
+                write::llvm_err(&diag_handler, "failed to load bc of the modules to link")
             })?;
-            serialized_bitcode.push(bc_decoded);
+            drop(data);
+            serialized_bitcode.extend(serialized_modules.into_iter().map(|(bc, _)| bc));
+        } else {
+            for (bc_decoded, name) in serialized_modules {
+                let _timer = cgcx
+                    .prof
+                    .generic_activity_with_arg("LLVM_fat_lto_link_module", format!("{:?}", name));
+                info!("linking {:?}", name);
+                let data = bc_decoded.data();
+                linker.add(&data).map_err(|()| {
+                    let msg = format!("failed to load bc of {:?}", name);
+                    write::llvm_err(&diag_handler, &msg)
+                })?;
+                serialized_bitcode.push(bc_decoded);
+            }
         }
         drop(linker);
         save_temp_bitcode(&cgcx, &module, "lto.input");
@@ -337,9 +379,8 @@ fn fat_lto(
         }
 
         if cgcx.no_landing_pads {
-            unsafe {
-                llvm::LLVMRustMarkAllFunctionsNounwind(llmod);
-            }
+            let removed = unsafe { llvm::LLVMRustMarkAllFunctionsNounwind(llmod) };
+            info!("removed {} invokes", removed);
             save_temp_bitcode(&cgcx, &module, "lto.after-nounwind");
         }
     }
@@ -354,9 +395,31 @@ impl Linker<'a> {
         unsafe { Linker(llvm::LLVMRustLinkerNew(llmod)) }
     }
 
+    /// Links all of `bytecodes` at once, as if added one by one, by linking groups of them on
+    /// up to `num_threads` threads first. The grouping, and so the result, doesn't depend on
+    /// `num_threads`.
+    crate fn add_batch(&mut self, bytecodes: &[&[u8]], num_threads: usize) -> Result<(), ()> {
+        let ptrs: Vec<_> = bytecodes.iter().map(|bc| bc.as_ptr() as *const libc::c_char).collect();
+        let lens: Vec<_> = bytecodes.iter().map(|bc| bc.len()).collect();
+        unsafe {
+            if llvm::LLVMRustLinkerAddBatch(
+                self.0,
+                ptrs.as_ptr(),
+                lens.as_ptr(),
+                ptrs.len(),
+                num_threads as c_uint,
+            ) {
+                Ok(())
+            } else {
+                Err(())
+            }
+        }
+    }
+
+    /// Links `bytecode` into the module. LLVM only reads it during the call.
     crate fn add(&mut self, bytecode: &[u8]) -> Result<(), ()> {
         unsafe {
-            if llvm::LLVMRustLinkerAdd(
+            if llvm::LLVMRustLinkerAddBorrowed(
                 self.0,
                 bytecode.as_ptr() as *const libc::c_char,
                 bytecode.len(),
@@ -478,18 +541,67 @@ fn thin_lto(
         // tried-and-true interface we may wish to try to upstream some of this
         // to LLVM itself, right now we reimplement a lot of what they do
         // upstream...
-        let data = llvm::LLVMRustCreateThinLTOData(
-            thin_modules.as_ptr(),
-            thin_modules.len() as u32,
-            symbols_below_threshold.as_ptr(),
-            symbols_below_threshold.len() as u32,
-        )
+        let create_data_timer = cgcx.prof.verbose_generic_activity("LLVM_thin_lto_create_data");
+        let num_threads = cgcx.opts.debugging_opts.llvm_threads as c_uint;
+        let index_cache_path = cgcx
+            .incr_comp_session_dir
+            .as_ref()
+            .filter(|_| cgcx.opts.debugging_opts.incremental_thinlto_index)
+            .map(|dir| path_to_c_string(&dir.join(THIN_LTO_INDEX_INCR_COMP_FILE_NAME)));
+        // The on-disk index cache doesn't record devirtualization results, so it isn't used with
+        // `-Z thinlto-whole-program-devirt`.
+        let data = if cgcx.opts.debugging_opts.thinlto_whole_program_devirt {
+            llvm::LLVMRustCreateThinLTODataWithOptions(
+                thin_modules.as_ptr(),
+                thin_modules.len() as u32,
+                symbols_below_threshold.as_ptr(),
+                symbols_below_threshold.len() as u32,
+                num_threads,
+                true,
+            )
+        } else if let Some(index_cache_path) = index_cache_path {
+            let mut cache_hit = false;
+            let data = llvm::LLVMRustCreateThinLTODataCached(
+                thin_modules.as_ptr(),
+                thin_modules.len() as u32,
+                symbols_below_threshold.as_ptr(),
+                symbols_below_threshold.len() as u32,
+                num_threads,
+                index_cache_path.as_ptr(),
+                &mut cache_hit,
+            );
+            info!("thin LTO index reused from the previous session: {}", cache_hit);
+            data
+        } else {
+            llvm::LLVMRustCreateThinLTODataParallel(
+                thin_modules.as_ptr(),
+                thin_modules.len() as u32,
+                symbols_below_threshold.as_ptr(),
+                symbols_below_threshold.len() as u32,
+                num_threads,
+            )
+        }
         .ok_or_else(|| write::llvm_err(&diag_handler, "failed to prepare thin LTO context"))?;
+        drop(create_data_timer);
 
-        let data = ThinData(data);
+        let mut data = ThinData(data);
+
+        // The budget has to be applied before anything reads the import
+        // lists, including the cache keys below.
+        if let Some(max_instrs) = cgcx.opts.debugging_opts.thinlto_import_budget {
+            llvm::LLVMRustThinLTOApplyImportBudget(&mut *data.0, max_instrs);
+        }
+        if cgcx.opts.debugging_opts.print_thinlto_import_costs {
+            print_thin_lto_import_costs(&data);
+        }
+        if let Some(ref dir) = cgcx.opts.debugging_opts.thinlto_index_dir {
+            write_thin_lto_index_files(&data, &module_names, dir, diag_handler);
+        }
 
         info!("thin LTO data created");
 
+        let module_costs = thin_lto_module_costs(&data, &module_names);
+
         let (key_map_path, prev_key_map, curr_key_map) = if let Some(ref incr_comp_session_dir) =
             cgcx.incr_comp_session_dir
         {
@@ -499,7 +611,18 @@ fn thin_lto(
             // prev_key_map, which will force the code to be recompiled.
             let prev =
                 if path.exists() { ThinLTOKeysMap::load_from_file(&path).ok() } else { None };
-            let curr = ThinLTOKeysMap::from_thin_lto_modules(&data, &thin_modules, &module_names);
+            let hash = if cgcx.opts.debugging_opts.thinlto_fast_cache_keys {
+                llvm::LTOCacheKeyHash::Fast
+            } else {
+                llvm::LTOCacheKeyHash::SHA1
+            };
+            let curr = ThinLTOKeysMap::from_thin_lto_modules(
+                &data,
+                &thin_modules,
+                &module_names,
+                hash,
+                num_threads,
+            );
             (Some(path), prev, curr)
         } else {
             // If we don't compile incrementally, we don't need to load the
@@ -521,6 +644,7 @@ fn thin_lto(
             thin_buffers,
             serialized_modules: serialized,
             module_names,
+            module_costs,
         });
 
         let mut copy_jobs = vec![];
@@ -572,6 +696,7 @@ pub(crate) fn run_pass_manager(
     module: &ModuleCodegen<ModuleLlvm>,
     config: &ModuleConfig,
     thin: bool,
+    thin_lto_data: Option<&llvm::ThinLTOData>,
 ) -> Result<(), FatalError> {
     let _timer = cgcx.prof.extra_verbose_generic_activity("LLVM_lto_optimize", &module.name[..]);
 
@@ -592,13 +717,24 @@ pub(crate) fn run_pass_manager(
                 config,
                 opt_level,
                 opt_stage,
+                thin_lto_data,
             )?;
             debug!("lto done");
             return Ok(());
         }
 
+        // Only the new pass manager's ThinLTO pipeline applies the resolutions recorded in the
+        // combined index.
+        if thin_lto_data.is_some() {
+            diag_handler
+                .warn("`-Z thinlto-whole-program-devirt` requires `-Z new-llvm-pass-manager`");
+        }
+
+        write::downgrade_cold_functions(cgcx, module);
+
+        llvm_util::init_passes();
         let pm = llvm::LLVMCreatePassManager();
-        llvm::LLVMAddAnalysisPasses(module.module_llvm.tm, pm);
+        llvm::LLVMAddAnalysisPasses(&module.module_llvm.tm, pm);
 
         if config.verify_llvm_ir {
             let pass = llvm::LLVMRustFindAndCreatePass("verify\0".as_ptr().cast());
@@ -631,7 +767,11 @@ pub(crate) fn run_pass_manager(
             llvm::LLVMRustAddPass(pm, pass.unwrap());
         }
 
+        let remark_summary = write::begin_remark_summary(cgcx, module);
+        let stats = write::begin_llvm_stats(cgcx);
         llvm::LLVMRunPassManager(pm, module.module_llvm.llmod());
+        write::finish_llvm_stats(cgcx, diag_handler, module, stats);
+        write::finish_remark_summary(cgcx, diag_handler, module, remark_summary);
 
         llvm::LLVMDisposePassManager(pm);
     }
@@ -648,6 +788,12 @@ impl ModuleBuffer {
     pub fn new(m: &llvm::Module) -> ModuleBuffer {
         ModuleBuffer(unsafe { llvm::LLVMRustModuleBufferCreate(m) })
     }
+
+    /// Replaces the contents of the buffer with the bitcode of `m`, reusing
+    /// its memory.
+    pub fn refill(&mut self, m: &llvm::Module) {
+        unsafe { llvm::LLVMRustModuleBufferRefill(self.0, m) }
+    }
 }
 
 impl ModuleBufferMethods for ModuleBuffer {
@@ -693,6 +839,15 @@ pub fn new(m: &llvm::Module) -> ThinBuffer {
             ThinBuffer(buffer)
         }
     }
+
+    /// A buffer whose summary is kept apart from the rest of the module, which can only be read
+    /// by the ThinLTO entry points of the wrapper, and is not a bitcode file.
+    pub fn new_split(m: &llvm::Module) -> ThinBuffer {
+        unsafe {
+            let buffer = llvm::LLVMRustThinLTOBufferCreateSplit(m);
+            ThinBuffer(buffer)
+        }
+    }
 }
 
 impl ThinBufferMethods for ThinBuffer {
@@ -725,15 +880,16 @@ pub unsafe fn optimize_thin_module(
         (cgcx.tm_factory)(tm_factory_config).map_err(|e| write::llvm_err(&diag_handler, &e))?;
 
     // Right now the implementation we've got only works over serialized
-    // modules, so we create a fresh new LLVM context and parse the module
-    // into that context. One day, however, we may do this for upstream
-    // crates but for locally codegened modules we may be able to reuse
-    // that LLVM Context and Module.
-    let llcx = llvm::LLVMRustContextCreate(cgcx.fewer_names);
+    // modules, so we create a fresh new LLVM context, or take one from the
+    // pool, and parse the module into that context. One day, however, we may
+    // do this for upstream crates but for locally codegened modules we may be
+    // able to reuse that LLVM Context and Module.
+    let (llcx, context_pool) =
+        create_context(cgcx.backend.context_pool.as_ref(), cgcx.fewer_names);
     let llmod_raw =
         parse_module(llcx, &module_name, thin_module.data(), &diag_handler)? as *const _;
     let module = ModuleCodegen {
-        module_llvm: ModuleLlvm { llmod_raw, llcx, tm },
+        module_llvm: ModuleLlvm { llmod_raw, llcx, tm, context_pool },
         name: thin_module.name().to_string(),
         kind: ModuleKind::Regular,
     };
@@ -760,7 +916,8 @@ pub unsafe fn optimize_thin_module(
             let _timer = cgcx
                 .prof
                 .generic_activity_with_arg("LLVM_thin_lto_remove_landing_pads", thin_module.name());
-            llvm::LLVMRustMarkAllFunctionsNounwind(llmod);
+            let removed = llvm::LLVMRustMarkAllFunctionsNounwind(llmod);
+            info!("removed {} invokes from {}", removed, thin_module.name());
             save_temp_bitcode(&cgcx, &module, "thin-lto-after-nounwind");
         }
 
@@ -843,11 +1000,26 @@ pub unsafe fn optimize_thin_module(
         // not too much) but for now at least gets LLVM to emit valid DWARF (or
         // so it appears). Hopefully we can remove this once upstream bugs are
         // fixed in LLVM.
+        //
+        // With `-Z thinlto-fast-debuginfo-patching`, only the subprograms of
+        // the function definitions and of their inlined calls are rewritten,
+        // instead of all those found in the module's metadata. This is enough
+        // for the debuginfo rustc emits, where types are scoped to namespaces
+        // rather than to subprograms.
         {
             let _timer = cgcx
                 .prof
                 .generic_activity_with_arg("LLVM_thin_lto_patch_debuginfo", thin_module.name());
-            llvm::LLVMRustThinLTOPatchDICompileUnit(llmod, cu1);
+            if let Some(threads) = cgcx.opts.debugging_opts.thinlto_fast_debuginfo_patching {
+                let patched = llvm::LLVMRustThinLTOPatchDICompileUnitFast(
+                    llmod,
+                    cu1,
+                    threads.max(1) as c_uint,
+                );
+                info!("moved {} subprograms of {} to its compile unit", patched, module.name);
+            } else {
+                llvm::LLVMRustThinLTOPatchDICompileUnit(llmod, cu1);
+            }
             save_temp_bitcode(cgcx, &module, "thin-lto-after-patch");
         }
 
@@ -859,7 +1031,14 @@ pub unsafe fn optimize_thin_module(
         {
             info!("running thin lto passes over {}", module.name);
             let config = cgcx.config(module.kind);
-            run_pass_manager(cgcx, &diag_handler, &module, config, true)?;
+            // The whole program devirtualization resolutions are recorded in the combined index,
+            // the pipeline needs it to apply them.
+            let thin_lto_data = cgcx
+                .opts
+                .debugging_opts
+                .thinlto_whole_program_devirt
+                .then(|| &*thin_module.shared.data.0);
+            run_pass_manager(cgcx, &diag_handler, &module, config, true, thin_lto_data)?;
             save_temp_bitcode(cgcx, &module, "thin-lto-after-pm");
         }
     }
@@ -903,20 +1082,136 @@ fn from_thin_lto_modules(
         data: &ThinData,
         modules: &[llvm::ThinLTOModule],
         names: &[CString],
+        hash: llvm::LTOCacheKeyHash,
+        num_threads: c_uint,
     ) -> Self {
-        let keys = iter::zip(modules, names)
-            .map(|(module, name)| {
-                let key = build_string(|rust_str| unsafe {
-                    llvm::LLVMRustComputeLTOCacheKey(rust_str, module.identifier, data.0);
-                })
-                .expect("Invalid ThinLTO module key");
-                (name.clone().into_string().unwrap(), key)
+        let mod_ids: Vec<_> = modules.iter().map(|module| module.identifier).collect();
+        let mut offsets = vec![0; mod_ids.len() + 1];
+        let all_keys = build_string(|rust_str| unsafe {
+            llvm::LLVMRustComputeLTOCacheKeys(
+                rust_str,
+                offsets.as_mut_ptr(),
+                mod_ids.as_ptr(),
+                mod_ids.len(),
+                data.0,
+                hash,
+                num_threads,
+            );
+        })
+        .expect("Invalid ThinLTO module key");
+        let keys = iter::zip(names, offsets.windows(2))
+            .map(|(name, range)| {
+                (name.clone().into_string().unwrap(), all_keys[range[0]..range[1]].to_string())
             })
             .collect();
         Self { keys }
     }
 }
 
+/// Returns the estimated instruction count of the functions each ThinLTO
+/// module defines and imports, in the order of `module_names`. These come from
+/// the summaries, so they are known before any of the modules is loaded, and
+/// let the largest modules be optimized first.
+fn thin_lto_module_costs(data: &ThinData, module_names: &[CString]) -> Vec<u64> {
+    unsafe extern "C" fn module_cost_callback(
+        payload: *mut c_void,
+        module_name: *const c_char,
+        defined_instrs: u64,
+        imported_instrs: u64,
+    ) {
+        let costs = &mut *(payload as *mut FxHashMap<CString, u64>);
+        costs.insert(CStr::from_ptr(module_name).to_owned(), defined_instrs + imported_instrs);
+    }
+
+    let mut costs: FxHashMap<CString, u64> = FxHashMap::default();
+    unsafe {
+        llvm::LLVMRustGetThinLTOModuleCosts(
+            data.0,
+            module_cost_callback,
+            &mut costs as *mut _ as *mut c_void,
+        );
+    }
+    module_names.iter().map(|name| costs.get(name).copied().unwrap_or(0)).collect()
+}
+
+/// Writes the summary index shard and the list of modules it imports from of
+/// each ThinLTO module to `dir`, as `<module>.thinlto.bc` and `<module>.imports`
+/// respectively, like the index-only mode of LLVM's distributed ThinLTO does.
+fn write_thin_lto_index_files(
+    data: &ThinData,
+    module_names: &[CString],
+    dir: &Path,
+    diag_handler: &Handler,
+) {
+    if let Err(err) = fs::create_dir_all(dir) {
+        diag_handler.warn(&format!(
+            "failed to create ThinLTO index directory `{}`: {}",
+            dir.display(),
+            err
+        ));
+        return;
+    }
+    for name in module_names {
+        let name_str = module_name_to_str(name);
+        let index_path = path_to_c_string(&dir.join(format!("{}.thinlto.bc", name_str)));
+        let imports_path = path_to_c_string(&dir.join(format!("{}.imports", name_str)));
+        let result = unsafe {
+            llvm::LLVMRustThinLTOWriteIndexFiles(
+                data.0,
+                name.as_ptr(),
+                index_path.as_ptr(),
+                imports_path.as_ptr(),
+            )
+        };
+        if result.into_result().is_err() {
+            let err = llvm::last_error().unwrap_or_else(|| "unknown error".to_string());
+            diag_handler.warn(&format!(
+                "failed to write the ThinLTO index files of `{}`: {}",
+                name_str, err
+            ));
+        }
+    }
+}
+
+/// Prints how many functions each ThinLTO module imports from each other
+/// module, along with their estimated instruction count.
+fn print_thin_lto_import_costs(data: &ThinData) {
+    unsafe extern "C" fn import_cost_callback(
+        payload: *mut c_void,
+        importing_module_name: *const c_char,
+        imported_module_name: *const c_char,
+        num_functions: size_t,
+        num_instrs: u64,
+    ) {
+        let costs = &mut *(payload as *mut Vec<(String, String, usize, u64)>);
+        let importing_module_name = CStr::from_ptr(importing_module_name);
+        let imported_module_name = CStr::from_ptr(imported_module_name);
+        costs.push((
+            module_name_to_str(importing_module_name).to_string(),
+            module_name_to_str(imported_module_name).to_string(),
+            num_functions,
+            num_instrs,
+        ));
+    }
+
+    let mut costs: Vec<(String, String, usize, u64)> = Vec::new();
+    unsafe {
+        llvm::LLVMRustGetThinLTOImportCosts(
+            data.0,
+            import_cost_callback,
+            &mut costs as *mut _ as *mut c_void,
+        );
+    }
+    // The edges come out of a hash map, sort them to get a stable output.
+    costs.sort();
+    for (importing_module_name, imported_module_name, num_functions, num_instrs) in costs {
+        println!(
+            "thinlto-import: {} <- {}: {} functions, {} instructions",
+            importing_module_name, imported_module_name, num_functions, num_instrs
+        );
+    }
+}
+
 fn module_name_to_str(c_str: &CStr) -> &str {
     c_str.to_str().unwrap_or_else(|e| {
         bug!("Encountered non-utf8 LLVM module name `{}`: {}", c_str.to_string_lossy(), e)
@@ -1,11 +1,11 @@
 use measureme::{event_id::SEPARATOR_BYTE, EventId, StringComponent, StringId};
 use rustc_data_structures::profiling::{SelfProfiler, TimingGuard};
-use std::ffi::{c_void, CStr};
+use std::ffi::c_void;
 use std::os::raw::c_char;
 use std::sync::Arc;
+use std::{slice, str};
 
-fn llvm_args_to_string_id(profiler: &SelfProfiler, pass_name: &str, ir_name: &str) -> EventId {
-    let pass_name = profiler.get_or_alloc_cached_string(pass_name);
+fn llvm_args_to_string_id(profiler: &SelfProfiler, pass_name: StringId, ir_name: &str) -> EventId {
     let mut components = vec![StringComponent::Ref(pass_name)];
     // handle that LazyCallGraph::SCC is a comma separated list within parentheses
     let parentheses: &[_] = &['(', ')'];
@@ -23,15 +23,22 @@ pub struct LlvmSelfProfiler<'a> {
     profiler: Arc<SelfProfiler>,
     stack: Vec<TimingGuard<'a>>,
     llvm_pass_event_kind: StringId,
+    // The interned pass names, indexed by the ids LLVM assigned to them.
+    pass_names: Vec<StringId>,
 }
 
 impl<'a> LlvmSelfProfiler<'a> {
     pub fn new(profiler: Arc<SelfProfiler>) -> Self {
         let llvm_pass_event_kind = profiler.alloc_string("LLVM Pass");
-        Self { profiler, stack: Vec::default(), llvm_pass_event_kind }
+        Self { profiler, stack: Vec::default(), llvm_pass_event_kind, pass_names: Vec::new() }
     }
 
-    fn before_pass_callback(&'a mut self, pass_name: &str, ir_name: &str) {
+    fn register_pass_callback(&mut self, id: u32, pass_name: &str) {
+        debug_assert_eq!(id as usize, self.pass_names.len());
+        self.pass_names.push(self.profiler.get_or_alloc_cached_string(pass_name));
+    }
+    fn before_pass_callback(&'a mut self, id: u32, ir_name: &str) {
+        let pass_name = self.pass_names[id as usize];
         let event_id = llvm_args_to_string_id(&self.profiler, pass_name, ir_name);
 
         self.stack.push(TimingGuard::start(&self.profiler, self.llvm_pass_event_kind, event_id));
@@ -41,15 +48,30 @@ fn after_pass_callback(&mut self) {
     }
 }
 
-pub unsafe extern "C" fn selfprofile_before_pass_callback(
+unsafe fn str_from_raw_parts<'a>(ptr: *const c_char, len: usize) -> &'a str {
+    str::from_utf8(slice::from_raw_parts(ptr as *const u8, len)).expect("valid UTF-8")
+}
+
+pub unsafe extern "C" fn selfprofile_register_pass_callback(
     llvm_self_profiler: *mut c_void,
+    id: u32,
     pass_name: *const c_char,
+    pass_name_len: usize,
+) {
+    let llvm_self_profiler = &mut *(llvm_self_profiler as *mut LlvmSelfProfiler<'_>);
+    let pass_name = str_from_raw_parts(pass_name, pass_name_len);
+    llvm_self_profiler.register_pass_callback(id, pass_name);
+}
+
+pub unsafe extern "C" fn selfprofile_before_pass_callback(
+    llvm_self_profiler: *mut c_void,
+    id: u32,
     ir_name: *const c_char,
+    ir_name_len: usize,
 ) {
     let llvm_self_profiler = &mut *(llvm_self_profiler as *mut LlvmSelfProfiler<'_>);
-    let pass_name = CStr::from_ptr(pass_name).to_str().expect("valid UTF-8");
-    let ir_name = CStr::from_ptr(ir_name).to_str().expect("valid UTF-8");
-    llvm_self_profiler.before_pass_callback(pass_name, ir_name);
+    let ir_name = str_from_raw_parts(ir_name, ir_name_len);
+    llvm_self_profiler.before_pass_callback(id, ir_name);
 }
 
 pub unsafe extern "C" fn selfprofile_after_pass_callback(llvm_self_profiler: *mut c_void) {
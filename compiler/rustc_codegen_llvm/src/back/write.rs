@@ -1,6 +1,7 @@
 use crate::back::lto::ThinBuffer;
 use crate::back::profiling::{
-    selfprofile_after_pass_callback, selfprofile_before_pass_callback, LlvmSelfProfiler,
+    selfprofile_after_pass_callback, selfprofile_before_pass_callback,
+    selfprofile_register_pass_callback, LlvmSelfProfiler,
 };
 use crate::base;
 use crate::common;
@@ -33,6 +34,7 @@
 use std::ffi::CString;
 use std::fs;
 use std::io::{self, Write};
+use std::ops::Deref;
 use std::path::{Path, PathBuf};
 use std::slice;
 use std::str;
@@ -83,13 +85,13 @@ pub fn write_output_file(
     }
 }
 
-pub fn create_informational_target_machine(sess: &Session) -> &'static mut llvm::TargetMachine {
+pub fn create_informational_target_machine(sess: &Session) -> OwnedTargetMachine {
     let config = TargetMachineFactoryConfig { split_dwarf_file: None };
     target_machine_factory(sess, config::OptLevel::No)(config)
         .unwrap_or_else(|err| llvm_err(sess.diagnostic(), &err).raise())
 }
 
-pub fn create_target_machine(tcx: TyCtxt<'_>, mod_name: &str) -> &'static mut llvm::TargetMachine {
+pub fn create_target_machine(tcx: TyCtxt<'_>, mod_name: &str) -> OwnedTargetMachine {
     let split_dwarf_file = if tcx.sess.target_can_use_split_dwarf() {
         tcx.output_filenames(()).split_dwarf_path(tcx.sess.split_debuginfo(), Some(mod_name))
     } else {
@@ -188,38 +190,178 @@ pub fn target_machine_factory(
     let use_init_array =
         !sess.opts.debugging_opts.use_ctors_section.unwrap_or(sess.target.use_ctors_section);
 
+    let debug_compression = match sess.opts.debugging_opts.debuginfo_compression {
+        config::DebugInfoCompression::None => llvm::DebugCompression::None,
+        config::DebugInfoCompression::Zlib => llvm::DebugCompression::Zlib,
+        config::DebugInfoCompression::Zstd => llvm::DebugCompression::Zstd,
+    };
+
+    // The configuration is validated once, and then shared by all the target
+    // machines created for the session.
+    let factory = unsafe {
+        llvm::LLVMRustCreateTargetMachineFactory(
+            triple.as_ptr(),
+            cpu.as_ptr(),
+            features.as_ptr(),
+            abi.as_ptr(),
+            code_model,
+            reloc_model,
+            opt_level,
+            use_softfp,
+            ffunction_sections,
+            fdata_sections,
+            trap_unreachable,
+            singlethread,
+            asm_comments,
+            emit_stack_size_section,
+            relax_elf_relocations,
+            use_init_array,
+            debug_compression,
+        )
+    };
+
+    let target_machine_error = move || {
+        let msg =
+            format!("Could not create LLVM TargetMachine for triple: {}", triple.to_str().unwrap());
+        match llvm::last_error() {
+            Some(err) => format!("{}: {}", msg, err),
+            None => msg,
+        }
+    };
+    let factory = factory.map(TargetMachineFactory).ok_or_else(&target_machine_error);
+
+    let split_machine_functions = sess.opts.debugging_opts.split_machine_functions;
+    let (bb_sections, bb_cluster_file) = match sess.opts.debugging_opts.basic_block_sections {
+        config::BasicBlockSections::None => (llvm::BasicBlockSections::None, None),
+        config::BasicBlockSections::All => (llvm::BasicBlockSections::All, None),
+        config::BasicBlockSections::Labels => (llvm::BasicBlockSections::Labels, None),
+        config::BasicBlockSections::List(ref path) => {
+            (llvm::BasicBlockSections::List, Some(path_to_c_string(path)))
+        }
+    };
+    let factory = factory.and_then(|factory| {
+        if !split_machine_functions && bb_sections == llvm::BasicBlockSections::None {
+            return Ok(factory);
+        }
+        let ok = unsafe {
+            llvm::LLVMRustTargetMachineFactorySetCodeLayoutOptions(
+                &*factory.0,
+                split_machine_functions,
+                bb_sections,
+                bb_cluster_file.as_ref().map_or(std::ptr::null(), |s| s.as_ptr()),
+            )
+        };
+        if ok { Ok(factory) } else { Err(target_machine_error()) }
+    });
+
+    let factory = factory.map(|factory| {
+        if let Some(enable) = sess.opts.debugging_opts.machine_outliner {
+            let mode = if enable {
+                llvm::MachineOutliner::TargetDefault
+            } else {
+                llvm::MachineOutliner::Never
+            };
+            unsafe { llvm::LLVMRustTargetMachineFactorySetMachineOutliner(&*factory.0, mode) };
+        }
+        factory
+    });
+
+    let factory = factory.map(Arc::new);
     Arc::new(move |config: TargetMachineFactoryConfig| {
+        let factory = factory.as_ref().map_err(|err| err.clone())?;
         let split_dwarf_file = config.split_dwarf_file.unwrap_or_default();
         let split_dwarf_file = CString::new(split_dwarf_file.to_str().unwrap()).unwrap();
 
         let tm = unsafe {
-            llvm::LLVMRustCreateTargetMachine(
-                triple.as_ptr(),
-                cpu.as_ptr(),
-                features.as_ptr(),
-                abi.as_ptr(),
-                code_model,
-                reloc_model,
-                opt_level,
-                use_softfp,
-                ffunction_sections,
-                fdata_sections,
-                trap_unreachable,
-                singlethread,
-                asm_comments,
-                emit_stack_size_section,
-                relax_elf_relocations,
-                use_init_array,
-                split_dwarf_file.as_ptr(),
-            )
+            llvm::LLVMRustCreateTargetMachineFromFactory(&*factory.0, split_dwarf_file.as_ptr())
         };
-
-        tm.ok_or_else(|| {
-            format!("Could not create LLVM TargetMachine for triple: {}", triple.to_str().unwrap())
-        })
+        let tm = tm.ok_or_else(&target_machine_error)?;
+        Ok(OwnedTargetMachine { tm, factory: factory.clone() })
     })
 }
 
+/// The target machine configuration of a session, see `target_machine_factory`.
+struct TargetMachineFactory(&'static mut llvm::TargetMachineFactory);
+
+unsafe impl Send for TargetMachineFactory {}
+unsafe impl Sync for TargetMachineFactory {}
+
+impl Drop for TargetMachineFactory {
+    fn drop(&mut self) {
+        unsafe {
+            llvm::LLVMRustFreeTargetMachineFactory(&mut *(self.0 as *mut _));
+        }
+    }
+}
+
+/// A target machine created by a `TargetMachineFactory`. Once dropped, it's given back to the
+/// factory, which hands it out again instead of creating a new one. The factory is kept alive
+/// until all of its target machines are gone.
+pub struct OwnedTargetMachine {
+    tm: &'static mut llvm::TargetMachine,
+    factory: Arc<TargetMachineFactory>,
+}
+
+unsafe impl Send for OwnedTargetMachine {}
+unsafe impl Sync for OwnedTargetMachine {}
+
+impl Deref for OwnedTargetMachine {
+    type Target = llvm::TargetMachine;
+
+    fn deref(&self) -> &llvm::TargetMachine {
+        &*self.tm
+    }
+}
+
+impl Drop for OwnedTargetMachine {
+    fn drop(&mut self) {
+        unsafe {
+            llvm::LLVMRustReleaseTargetMachineToFactory(
+                &*self.factory.0,
+                &mut *(self.tm as *mut _),
+            );
+        }
+    }
+}
+
+/// The call graph profile of the modules codegened for a crate, see
+/// `-Z call-graph-ordering-file`.
+pub(crate) struct CallGraphProfile(&'static mut llvm::CallGraphProfile);
+
+unsafe impl Send for CallGraphProfile {}
+unsafe impl Sync for CallGraphProfile {}
+
+impl CallGraphProfile {
+    pub(crate) fn new() -> Self {
+        CallGraphProfile(unsafe { llvm::LLVMRustCreateCallGraphProfile() })
+    }
+}
+
+impl Drop for CallGraphProfile {
+    fn drop(&mut self) {
+        unsafe {
+            llvm::LLVMRustFreeCallGraphProfile(&mut *(self.0 as *mut _));
+        }
+    }
+}
+
+/// Writes the functions of the modules in `profile` that ran during profiling, hottest first, to
+/// `path`. This needs to happen after all modules were codegened, and before linking.
+pub(crate) fn write_call_graph_ordering_file(
+    sess: &Session,
+    profile: &CallGraphProfile,
+    path: &Path,
+) {
+    let c_path = path_to_c_string(path);
+    let result = unsafe {
+        llvm::LLVMRustCallGraphProfileWriteOrderingFile(&*profile.0, c_path.as_ptr())
+    };
+    if result.into_result().is_err() {
+        let err = llvm::last_error().unwrap_or_else(|| "unknown error".to_string());
+        sess.err(&format!("failed to write symbol ordering file `{}`: {}", path.display(), err));
+    }
+}
+
 pub(crate) fn save_temp_bitcode(
     cgcx: &CodegenContext<LlvmCodegenBackend>,
     module: &ModuleCodegen<ModuleLlvm>,
@@ -241,6 +383,15 @@ pub(crate) fn save_temp_bitcode(
 pub struct DiagnosticHandlers<'a> {
     data: *mut (&'a CodegenContext<LlvmCodegenBackend>, &'a Handler),
     llcx: &'a llvm::Context,
+    remark_file: Option<&'static mut llvm::RemarkFile>,
+}
+
+/// The step of the LLVM pipeline that a `DiagnosticHandlers` is installed for, which names the
+/// file its remarks are written to with `-Z remark-dir`.
+pub enum CodegenDiagnosticsStage {
+    Opt,
+    Lto,
+    Codegen,
 }
 
 impl<'a> DiagnosticHandlers<'a> {
@@ -248,20 +399,72 @@ pub fn new(
         cgcx: &'a CodegenContext<LlvmCodegenBackend>,
         handler: &'a Handler,
         llcx: &'a llvm::Context,
+        module_name: &str,
+        stage: CodegenDiagnosticsStage,
     ) -> Self {
         let data = Box::into_raw(Box::new((cgcx, handler)));
         unsafe {
             llvm::LLVMRustSetInlineAsmDiagnosticHandler(llcx, inline_asm_handler, data.cast());
             llvm::LLVMContextSetDiagnosticHandler(llcx, diagnostic_handler, data.cast());
         }
-        DiagnosticHandlers { data, llcx }
+        let remark_file = cgcx
+            .remark_dir
+            .as_ref()
+            .and_then(|dir| setup_remark_file(cgcx, handler, llcx, dir, module_name, stage));
+        DiagnosticHandlers { data, llcx, remark_file }
     }
 }
 
+/// Streams the remarks of the passes selected by `-C remark` to a YAML file in `dir`, instead of
+/// reporting each of them as a note.
+fn setup_remark_file(
+    cgcx: &CodegenContext<LlvmCodegenBackend>,
+    handler: &Handler,
+    llcx: &llvm::Context,
+    dir: &Path,
+    module_name: &str,
+    stage: CodegenDiagnosticsStage,
+) -> Option<&'static mut llvm::RemarkFile> {
+    let passes = match cgcx.remark {
+        Passes::All => ".*".to_string(),
+        Passes::Some(ref passes) if passes.is_empty() => return None,
+        Passes::Some(ref passes) => format!("^({})$", passes.join("|")),
+    };
+    let stage = match stage {
+        CodegenDiagnosticsStage::Opt => "opt",
+        CodegenDiagnosticsStage::Lto => "lto",
+        CodegenDiagnosticsStage::Codegen => "codegen",
+    };
+    let path = dir.join(format!("{}.{}.opt.yaml", module_name, stage));
+    if let Err(err) = fs::create_dir_all(dir) {
+        handler.warn(&format!("failed to create remark directory `{}`: {}", dir.display(), err));
+        return None;
+    }
+    let path_c = path_to_c_string(&path);
+    let passes = CString::new(passes).unwrap();
+    let file = unsafe {
+        llvm::LLVMRustContextSetupRemarks(
+            llcx,
+            path_c.as_ptr(),
+            passes.as_ptr(),
+            "yaml\0".as_ptr().cast(),
+            false,
+        )
+    };
+    if file.is_none() {
+        let err = llvm::last_error().unwrap_or_else(|| "unknown error".to_string());
+        handler.warn(&format!("failed to open remark file `{}`: {}", path.display(), err));
+    }
+    file
+}
+
 impl<'a> Drop for DiagnosticHandlers<'a> {
     fn drop(&mut self) {
         use std::ptr::null_mut;
         unsafe {
+            if self.remark_file.is_some() {
+                llvm::LLVMRustContextFinishRemarks(self.llcx, self.remark_file.take());
+            }
             llvm::LLVMRustSetInlineAsmDiagnosticHandler(self.llcx, inline_asm_handler, null_mut());
             llvm::LLVMContextSetDiagnosticHandler(self.llcx, diagnostic_handler, null_mut());
             drop(Box::from_raw(self.data));
@@ -337,6 +540,12 @@ fn report_inline_asm(
     }
     let (cgcx, diag_handler) = *(user as *const (&CodegenContext<LlvmCodegenBackend>, &Handler));
 
+    // With `-Z remark-dir` the remarks are streamed to the remark file, so there is no need to
+    // unpack them.
+    if cgcx.remark_dir.is_some() && llvm::diagnostic::is_optimization_remark(info) {
+        return;
+    }
+
     match llvm::diagnostic::Diagnostic::unpack(info) {
         llvm::diagnostic::InlineAsm(inline) => {
             report_inline_asm(
@@ -406,6 +615,131 @@ fn get_pgo_use_path(config: &ModuleConfig) -> Option<CString> {
         .map(|path_buf| CString::new(path_buf.to_string_lossy().as_bytes()).unwrap())
 }
 
+fn get_pgo_sample_use_path(config: &ModuleConfig) -> Option<CString> {
+    config
+        .pgo_sample_use
+        .as_ref()
+        .map(|path_buf| CString::new(path_buf.to_string_lossy().as_bytes()).unwrap())
+}
+
+/// Describes the PGO settings of `config` in full, which is needed for sample profiles and debug
+/// info for profiling, as the plain profile paths only cover instrumentation. The returned options
+/// borrow the given paths.
+fn get_pgo_options(
+    config: &ModuleConfig,
+    pgo_gen_path: &Option<CString>,
+    pgo_use_path: &Option<CString>,
+    pgo_sample_use_path: &Option<CString>,
+) -> Option<llvm::PGOOptions> {
+    if pgo_sample_use_path.is_none() && !config.debug_info_for_profiling {
+        return None;
+    }
+    let (action, profile_file) = if let Some(path) = pgo_gen_path {
+        (llvm::PGOAction::IRInstr, path.as_ptr())
+    } else if let Some(path) = pgo_use_path {
+        (llvm::PGOAction::IRUse, path.as_ptr())
+    } else if let Some(path) = pgo_sample_use_path {
+        (llvm::PGOAction::SampleUse, path.as_ptr())
+    } else {
+        (llvm::PGOAction::None, std::ptr::null())
+    };
+    Some(llvm::PGOOptions {
+        action,
+        cs_action: llvm::CSPGOAction::None,
+        profile_file,
+        cs_profile_gen_file: std::ptr::null(),
+        profile_remapping_file: std::ptr::null(),
+        debug_info_for_profiling: config.debug_info_for_profiling,
+    })
+}
+
+/// Marks the cold functions of `module` `minsize` or `optnone` before it's optimized, with
+/// `-Z downgrade-cold-functions`.
+pub(crate) unsafe fn downgrade_cold_functions(
+    cgcx: &CodegenContext<LlvmCodegenBackend>,
+    module: &ModuleCodegen<ModuleLlvm>,
+) {
+    if cgcx.opts.debugging_opts.downgrade_cold_functions {
+        let mut stats = llvm::ColdDowngradeStats::default();
+        llvm::LLVMRustDowngradeColdFunctions(module.module_llvm.llmod(), &mut stats);
+        debug!(
+            "{}: marked {} cold functions minsize and {} optnone",
+            module.name, stats.min_size, stats.opt_none
+        );
+    }
+}
+
+/// Starts counting the missed remarks of the passes run on `module` with
+/// `-Z llvm-remark-summary`, until `finish_remark_summary`. Returns whether it did.
+pub(crate) unsafe fn begin_remark_summary(
+    cgcx: &CodegenContext<LlvmCodegenBackend>,
+    module: &ModuleCodegen<ModuleLlvm>,
+) -> bool {
+    if !cgcx.opts.debugging_opts.llvm_remark_summary {
+        return false;
+    }
+    // The summarized remarks only have to reach the diagnostic handler if they're going to be
+    // reported anyway.
+    let forward = match cgcx.remark {
+        Passes::All => true,
+        Passes::Some(ref v) => !v.is_empty(),
+    };
+    llvm::LLVMRustContextEnableMissedRemarkSummary(&*module.module_llvm.llcx, forward);
+    true
+}
+
+/// Writes the summary of the remarks counted since `begin_remark_summary` to
+/// `<codegen unit>.remark-summary.json`, if it was started.
+pub(crate) unsafe fn finish_remark_summary(
+    cgcx: &CodegenContext<LlvmCodegenBackend>,
+    diag_handler: &Handler,
+    module: &ModuleCodegen<ModuleLlvm>,
+    started: bool,
+) {
+    if !started {
+        return;
+    }
+    let llcx = &*module.module_llvm.llcx;
+    let summary =
+        llvm::build_string(|s| llvm::LLVMRustContextFinishMissedRemarkSummary(llcx, 10, s))
+            .expect("non-UTF8 remark summary");
+    let out = cgcx.output_filenames.temp_path_ext("remark-summary.json", Some(&module.name));
+    if let Err(err) = fs::write(&out, summary) {
+        diag_handler.warn(&format!("failed to write {}: {}", out.display(), err));
+    }
+}
+
+/// Takes a snapshot of LLVM's statistics counters with `-Z llvm-stats`, to be compared against
+/// by `finish_llvm_stats` once the passes of `module` ran.
+pub(crate) fn begin_llvm_stats(
+    cgcx: &CodegenContext<LlvmCodegenBackend>,
+) -> Option<&'static mut llvm::StatisticsSnapshot> {
+    if cgcx.opts.debugging_opts.llvm_stats {
+        Some(unsafe { llvm::LLVMRustStatisticsBegin() })
+    } else {
+        None
+    }
+}
+
+/// Writes the statistics counters which changed since `begin_llvm_stats` to
+/// `<codegen unit>.llvm-stats.json`. As the counters are global, `-Z llvm-stats` makes the LLVM
+/// work of the codegen units run one at a time, see `build_session_options`.
+pub(crate) fn finish_llvm_stats(
+    cgcx: &CodegenContext<LlvmCodegenBackend>,
+    diag_handler: &Handler,
+    module: &ModuleCodegen<ModuleLlvm>,
+    stats: Option<&'static mut llvm::StatisticsSnapshot>,
+) {
+    if let Some(stats) = stats {
+        let stats = llvm::build_string(|s| unsafe { llvm::LLVMRustStatisticsEnd(stats, s) })
+            .expect("non-UTF8 LLVM statistics");
+        let out = cgcx.output_filenames.temp_path_ext("llvm-stats.json", Some(&module.name));
+        if let Err(err) = fs::write(&out, stats) {
+            diag_handler.warn(&format!("failed to write {}: {}", out.display(), err));
+        }
+    }
+}
+
 pub(crate) fn should_use_new_llvm_pass_manager(config: &ModuleConfig) -> bool {
     // The new pass manager is disabled by default.
     config.new_llvm_pass_manager.unwrap_or(false)
@@ -418,13 +752,23 @@ pub(crate) unsafe fn optimize_with_new_llvm_pass_manager(
     config: &ModuleConfig,
     opt_level: config::OptLevel,
     opt_stage: llvm::OptStage,
+    thin_lto_data: Option<&llvm::ThinLTOData>,
 ) -> Result<(), FatalError> {
     let unroll_loops =
         opt_level != config::OptLevel::Size && opt_level != config::OptLevel::SizeMin;
     let using_thin_buffers = opt_stage == llvm::OptStage::PreLinkThinLTO || config.bitcode_needed();
     let pgo_gen_path = get_pgo_gen_path(config);
     let pgo_use_path = get_pgo_use_path(config);
+    let pgo_sample_use_path = get_pgo_sample_use_path(config);
+    let pgo_options = get_pgo_options(config, &pgo_gen_path, &pgo_use_path, &pgo_sample_use_path);
+    // The full options replace the plain profile paths when present.
+    let (pgo_gen_path, pgo_use_path) =
+        if pgo_options.is_some() { (None, None) } else { (pgo_gen_path, pgo_use_path) };
     let is_lto = opt_stage == llvm::OptStage::ThinLTO || opt_stage == llvm::OptStage::FatLTO;
+    let mut sanitizer_tuning = llvm::SanitizerTuningOptions::new();
+    if let Some(use_after_scope) = cgcx.opts.debugging_opts.sanitizer_address_use_after_scope {
+        sanitizer_tuning.address_use_after_scope = use_after_scope as c_int;
+    }
     // Sanitizer instrumentation is only inserted during the pre-link optimization stage.
     let sanitizer_options = if !is_lto {
         Some(llvm::SanitizerOptions {
@@ -436,23 +780,49 @@ pub(crate) unsafe fn optimize_with_new_llvm_pass_manager(
             sanitize_thread: config.sanitizer.contains(SanitizerSet::THREAD),
             sanitize_hwaddress: config.sanitizer.contains(SanitizerSet::HWADDRESS),
             sanitize_hwaddress_recover: config.sanitizer_recover.contains(SanitizerSet::HWADDRESS),
+            tuning: &sanitizer_tuning,
         })
     } else {
         None
     };
 
-    let llvm_selfprofiler = if cgcx.prof.llvm_recording_enabled() {
-        let mut llvm_profiler = LlvmSelfProfiler::new(cgcx.prof.get_self_profiler().unwrap());
-        &mut llvm_profiler as *mut _ as *mut c_void
-    } else {
-        std::ptr::null_mut()
-    };
+    // The profiler has to outlive the call below, LLVM only keeps a pointer to it.
+    let mut llvm_profiler = cgcx
+        .prof
+        .llvm_recording_enabled()
+        .then(|| LlvmSelfProfiler::new(cgcx.prof.get_self_profiler().unwrap()));
+    let llvm_selfprofiler =
+        llvm_profiler.as_mut().map(|s| s as *mut _ as *mut c_void).unwrap_or(std::ptr::null_mut());
 
     let extra_passes = config.passes.join(",");
 
-    // FIXME: NewPM doesn't provide a facility to pass custom InlineParams.
-    // We would have to add upstream support for this first, before we can support
-    // config.inline_threshold and our more aggressive default thresholds.
+    // Code generation still uses the legacy pass manager, and plugins may
+    // register legacy passes too.
+    llvm_util::init_passes();
+
+    downgrade_cold_functions(cgcx, module);
+
+    // The new pass manager only takes an inliner threshold since LLVM 12. Our more aggressive
+    // default thresholds aren't supported there.
+    let mut tuning_options = llvm::TuningOptions::new();
+    if let Some(threshold) = config.inline_threshold {
+        if llvm_util::get_version() >= (12, 0, 0) {
+            tuning_options.inliner_threshold = threshold as c_int;
+        }
+    }
+    if let Some(rate) = cgcx.opts.debugging_opts.verify_llvm_ir_sample {
+        tuning_options.verify_sample_rate = rate as c_int;
+        tuning_options.verify_sample_min =
+            cgcx.opts.debugging_opts.verify_llvm_ir_sample_min as c_int;
+    }
+
+    let remark_summary = begin_remark_summary(cgcx, module);
+    let stats = begin_llvm_stats(cgcx);
+    let pass_stats = if cgcx.opts.debugging_opts.llvm_pass_stats {
+        Some(llvm::LLVMRustCreatePassStatistics())
+    } else {
+        None
+    };
     let result = llvm::LLVMRustOptimizeWithNewPassManager(
         module.module_llvm.llmod(),
         &*module.module_llvm.tm,
@@ -470,17 +840,57 @@ pub(crate) unsafe fn optimize_with_new_llvm_pass_manager(
         sanitizer_options.as_ref(),
         pgo_gen_path.as_ref().map_or(std::ptr::null(), |s| s.as_ptr()),
         pgo_use_path.as_ref().map_or(std::ptr::null(), |s| s.as_ptr()),
+        pgo_options.as_ref(),
+        Some(&tuning_options),
         config.instrument_coverage,
         config.instrument_gcov,
         llvm_selfprofiler,
+        selfprofile_register_pass_callback,
         selfprofile_before_pass_callback,
         selfprofile_after_pass_callback,
+        pass_stats.as_deref(),
         extra_passes.as_ptr().cast(),
         extra_passes.len(),
+        thin_lto_data,
     );
+    finish_remark_summary(cgcx, diag_handler, module, remark_summary);
+    finish_llvm_stats(cgcx, diag_handler, module, stats);
+    if let Some(pass_stats) = pass_stats {
+        let pass_stats = llvm::build_string(|s| llvm::LLVMRustPassStatisticsEnd(pass_stats, s))
+            .expect("non-UTF8 pass statistics");
+        let out = cgcx.output_filenames.temp_path_ext("llvm-pass-stats.json", Some(&module.name));
+        if let Err(err) = fs::write(&out, pass_stats) {
+            diag_handler.warn(&format!("failed to write {}: {}", out.display(), err));
+        }
+    }
     result.into_result().map_err(|()| llvm_err(diag_handler, "failed to run LLVM passes"))
 }
 
+/// Prints the estimated size of the IR of `module`, and the memory allocated by the whole
+/// process, for `-Z print-llvm-module-stats`.
+pub(crate) fn print_module_stats(module: &ModuleCodegen<ModuleLlvm>, stage: &str) {
+    let mut stats = llvm::ModuleMemoryStats::default();
+    let malloc_usage = unsafe {
+        llvm::LLVMRustModuleGetMemoryStats(module.module_llvm.llmod(), &mut stats);
+        llvm::LLVMRustGetMallocUsage()
+    };
+    println!(
+        "llvm-module-stats: {} ({}): {} globals, {} basic blocks, {} instructions ({} bytes), \
+        {} metadata nodes ({} bytes), {} constants ({} bytes), {} bytes allocated by the process",
+        module.name,
+        stage,
+        stats.globals,
+        stats.basic_blocks,
+        stats.instructions,
+        stats.ir_bytes,
+        stats.metadata_nodes,
+        stats.metadata_bytes,
+        stats.constants,
+        stats.constant_bytes,
+        malloc_usage,
+    );
+}
+
 // Unsafe due to LLVM calls.
 pub(crate) unsafe fn optimize(
     cgcx: &CodegenContext<LlvmCodegenBackend>,
@@ -493,7 +903,13 @@ pub(crate) unsafe fn optimize(
     let llmod = module.module_llvm.llmod();
     let llcx = &*module.module_llvm.llcx;
     let tm = &*module.module_llvm.tm;
-    let _handlers = DiagnosticHandlers::new(cgcx, diag_handler, llcx);
+    let _handlers = DiagnosticHandlers::new(
+        cgcx,
+        diag_handler,
+        llcx,
+        &module.name,
+        CodegenDiagnosticsStage::Opt,
+    );
 
     let module_name = module.name.clone();
     let module_name = Some(&module_name[..]);
@@ -519,6 +935,7 @@ pub(crate) unsafe fn optimize(
                 config,
                 opt_level,
                 opt_stage,
+                None,
             );
         }
 
@@ -526,11 +943,17 @@ pub(crate) unsafe fn optimize(
             diag_handler
                 .warn("`-Z self-profile-events = llvm` requires `-Z new-llvm-pass-manager`");
         }
+        if cgcx.opts.debugging_opts.llvm_pass_stats {
+            diag_handler.warn("`-Z llvm-pass-stats` requires `-Z new-llvm-pass-manager`");
+        }
+
+        downgrade_cold_functions(cgcx, module);
 
         // Create the two optimizing pass managers. These mirror what clang
         // does, and are by populated by LLVM's default PassManagerBuilder.
         // Each manager has a different set of passes, but they also share
         // some common passes.
+        llvm_util::init_passes();
         let fpm = llvm::LLVMCreateFunctionPassManagerForModule(llmod);
         let mpm = llvm::LLVMCreatePassManager();
 
@@ -578,7 +1001,7 @@ pub(crate) unsafe fn optimize(
                 llvm::LLVMRustAddPass(mpm, find_pass("instrprof").unwrap());
             }
 
-            add_sanitizer_passes(config, &mut extra_passes);
+            add_sanitizer_passes(cgcx, config, &mut extra_passes);
 
             // Some options cause LLVM bitcode to be emitted, which uses ThinLTOBuffers, so we need
             // to make sure we run LLVM's NameAnonGlobals pass when emitting bitcode; otherwise
@@ -635,6 +1058,8 @@ pub(crate) unsafe fn optimize(
         diag_handler.abort_if_errors();
 
         // Finally, run the actual optimization passes
+        let remark_summary = begin_remark_summary(cgcx, module);
+        let stats = begin_llvm_stats(cgcx);
         {
             let _timer = cgcx.prof.extra_verbose_generic_activity(
                 "LLVM_module_optimize_function_passes",
@@ -649,6 +1074,8 @@ pub(crate) unsafe fn optimize(
             );
             llvm::LLVMRunPassManager(mpm, llmod);
         }
+        finish_llvm_stats(cgcx, diag_handler, module, stats);
+        finish_remark_summary(cgcx, diag_handler, module, remark_summary);
 
         // Deallocate managers that we're now done with
         llvm::LLVMDisposePassManager(fpm);
@@ -657,10 +1084,16 @@ pub(crate) unsafe fn optimize(
     Ok(())
 }
 
-unsafe fn add_sanitizer_passes(config: &ModuleConfig, passes: &mut Vec<&'static mut llvm::Pass>) {
+unsafe fn add_sanitizer_passes(
+    cgcx: &CodegenContext<LlvmCodegenBackend>,
+    config: &ModuleConfig,
+    passes: &mut Vec<&'static mut llvm::Pass>,
+) {
     if config.sanitizer.contains(SanitizerSet::ADDRESS) {
         let recover = config.sanitizer_recover.contains(SanitizerSet::ADDRESS);
-        passes.push(llvm::LLVMRustCreateAddressSanitizerFunctionPass(recover));
+        let use_after_scope =
+            cgcx.opts.debugging_opts.sanitizer_address_use_after_scope.unwrap_or(true);
+        passes.push(llvm::LLVMRustCreateAddressSanitizerFunctionPass(recover, use_after_scope));
         passes.push(llvm::LLVMRustCreateModuleAddressSanitizerPass(recover));
     }
     if config.sanitizer.contains(SanitizerSet::MEMORY) {
@@ -689,11 +1122,18 @@ pub(crate) fn link(
         modules.split_first().expect("Bug! modules must contain at least one module.");
 
     let mut linker = Linker::new(first.module_llvm.llmod());
+    // The linker copies what it needs out of the bitcode, so a single buffer
+    // is reused for all modules.
+    let mut buffer: Option<ModuleBuffer> = None;
     for module in elements {
         let _timer =
             cgcx.prof.generic_activity_with_arg("LLVM_link_module", format!("{:?}", module.name));
-        let buffer = ModuleBuffer::new(module.module_llvm.llmod());
-        linker.add(&buffer.data()).map_err(|()| {
+        let llmod = module.module_llvm.llmod();
+        match &mut buffer {
+            Some(buffer) => buffer.refill(llmod),
+            None => buffer = Some(ModuleBuffer::new(llmod)),
+        }
+        linker.add(&buffer.as_ref().unwrap().data()).map_err(|()| {
             let msg = format!("failed to serialize module {:?}", module.name);
             llvm_err(&diag_handler, &msg)
         })?;
@@ -715,12 +1155,22 @@ pub(crate) unsafe fn codegen(
         let tm = &*module.module_llvm.tm;
         let module_name = module.name.clone();
         let module_name = Some(&module_name[..]);
-        let handlers = DiagnosticHandlers::new(cgcx, diag_handler, llcx);
+        let handlers = DiagnosticHandlers::new(
+            cgcx,
+            diag_handler,
+            llcx,
+            &module.name,
+            CodegenDiagnosticsStage::Codegen,
+        );
 
         if cgcx.msvc_imps_needed {
             create_msvc_imps(cgcx, llcx, llmod);
         }
 
+        if let Some(profile) = &cgcx.backend.call_graph_profile {
+            llvm::LLVMRustCallGraphProfileAddModule(&*profile.0, llmod);
+        }
+
         // A codegen-specific pass manager is used to generate object
         // files for an LLVM module.
         //
@@ -738,6 +1188,7 @@ unsafe fn with_codegen<'ll, F, R>(
         where
             F: FnOnce(&'ll mut PassManager<'ll>) -> R,
         {
+            llvm_util::init_passes();
             let cpm = llvm::LLVMCreatePassManager();
             llvm::LLVMAddAnalysisPasses(tm, cpm);
             llvm::LLVMRustAddLibraryInfo(cpm, llmod, no_builtins);
@@ -754,7 +1205,43 @@ unsafe fn with_codegen<'ll, F, R>(
         let bc_out = cgcx.output_filenames.temp_path(OutputType::Bitcode, module_name);
         let obj_out = cgcx.output_filenames.temp_path(OutputType::Object, module_name);
 
-        if config.bitcode_needed() {
+        let split_dwarf =
+            cgcx.split_debuginfo == SplitDebuginfo::Unpacked && cgcx.target_can_use_split_dwarf;
+
+        // When both assembly and object code are requested, codegen can run once
+        // and the object file be assembled from the printed assembly, instead of
+        // running it a second time on a clone of the module. This is opt-in, as
+        // the object only matches a direct emission as far as the assembly
+        // round-trips through the target's assembler.
+        let emit_asm_and_obj = config.emit_asm
+            && cgcx.opts.debugging_opts.asm_round_trip
+            && matches!(config.emit_obj, EmitObj::ObjectCode(_))
+            && !split_dwarf
+            && llvm::LLVMRustTargetMachineCanAssemble(tm);
+
+        // Embedded bitcode is written into the object file while it's emitted,
+        // rather than first copied into a constant of the module, unless the
+        // object file is assembled from the printed assembly.
+        let embed_bitcode_at_emission = config.emit_obj
+            == EmitObj::ObjectCode(BitcodeSection::Full)
+            && !emit_asm_and_obj
+            && llvm::LLVMRustTargetMachineCanEmbedBitcode(tm);
+        let mut embedded_bitcode = None;
+
+        if config.bitcode_needed() && config.emit_obj != EmitObj::ObjectCode(BitcodeSection::Full) {
+            // The bitcode is only written out, so it can be streamed straight
+            // to the file rather than going through a buffer.
+            let _timer = cgcx
+                .prof
+                .generic_activity_with_arg("LLVM_module_codegen_emit_bitcode", &module.name[..]);
+            let bc_out_c = path_to_c_string(&bc_out);
+            llvm::LLVMRustThinLTOBufferWriteToFile(llmod, bc_out_c.as_ptr())
+                .into_result()
+                .map_err(|()| {
+                    let msg = format!("failed to write bytecode to {}", bc_out.display());
+                    llvm_err(diag_handler, &msg)
+                })?;
+        } else if config.bitcode_needed() {
             let _timer = cgcx
                 .prof
                 .generic_activity_with_arg("LLVM_module_codegen_make_bitcode", &module.name[..]);
@@ -772,7 +1259,9 @@ unsafe fn with_codegen<'ll, F, R>(
                 }
             }
 
-            if config.emit_obj == EmitObj::ObjectCode(BitcodeSection::Full) {
+            if embed_bitcode_at_emission {
+                embedded_bitcode = Some(thin);
+            } else if config.emit_obj == EmitObj::ObjectCode(BitcodeSection::Full) {
                 let _timer = cgcx.prof.generic_activity_with_arg(
                     "LLVM_module_codegen_embed_bitcode",
                     &module.name[..],
@@ -827,7 +1316,30 @@ extern "C" fn demangle_callback(
             })?;
         }
 
-        if config.emit_asm {
+        let mut emit_obj = config.emit_obj;
+        if emit_asm_and_obj {
+            let _timer = cgcx
+                .prof
+                .generic_activity_with_arg("LLVM_module_codegen_emit_asm_obj", &module.name[..]);
+            let path = cgcx.output_filenames.temp_path(OutputType::Assembly, module_name);
+            let path_c = path_to_c_string(&path);
+            let obj_out_c = path_to_c_string(&obj_out);
+            with_codegen(tm, llmod, config.no_builtins, |cpm| {
+                llvm::LLVMRustWriteAssemblyAndObjectFile(
+                    tm,
+                    cpm,
+                    llmod,
+                    path_c.as_ptr(),
+                    obj_out_c.as_ptr(),
+                )
+                .into_result()
+                .map_err(|()| {
+                    let msg = format!("could not write output to {}", obj_out.display());
+                    llvm_err(diag_handler, &msg)
+                })
+            })?;
+            emit_obj = EmitObj::None;
+        } else if config.emit_asm {
             let _timer = cgcx
                 .prof
                 .generic_activity_with_arg("LLVM_module_codegen_emit_asm", &module.name[..]);
@@ -855,7 +1367,7 @@ extern "C" fn demangle_callback(
             })?;
         }
 
-        match config.emit_obj {
+        match emit_obj {
             EmitObj::ObjectCode(_) => {
                 let _timer = cgcx
                     .prof
@@ -876,15 +1388,38 @@ extern "C" fn demangle_callback(
                 };
 
                 with_codegen(tm, llmod, config.no_builtins, |cpm| {
-                    write_output_file(
-                        diag_handler,
-                        tm,
-                        cpm,
-                        llmod,
-                        &obj_out,
-                        dwo_out,
-                        llvm::FileType::ObjectFile,
-                    )
+                    if let Some(bitcode) = &embedded_bitcode {
+                        let data = bitcode.data();
+                        let obj_out_c = path_to_c_string(&obj_out);
+                        let dwo_out_c = dwo_out.map(path_to_c_string);
+                        llvm::LLVMRustWriteOutputFileWithEmbeddedBitcode(
+                            tm,
+                            cpm,
+                            llmod,
+                            obj_out_c.as_ptr(),
+                            dwo_out_c.as_ref().map_or(std::ptr::null(), |c| c.as_ptr()),
+                            llvm::FileType::ObjectFile,
+                            data.as_ptr().cast(),
+                            data.len(),
+                            config.bc_cmdline.as_ptr().cast(),
+                            config.bc_cmdline.len(),
+                        )
+                        .into_result()
+                        .map_err(|()| {
+                            let msg = format!("could not write output to {}", obj_out.display());
+                            llvm_err(diag_handler, &msg)
+                        })
+                    } else {
+                        write_output_file(
+                            diag_handler,
+                            tm,
+                            cpm,
+                            llmod,
+                            &obj_out,
+                            dwo_out,
+                            llvm::FileType::ObjectFile,
+                        )
+                    }
                 })?;
             }
 
@@ -1046,6 +1581,13 @@ pub unsafe fn with_llvm_pmb(
         pgo_use_path.as_ref().map_or(ptr::null(), |s| s.as_ptr()),
     );
 
+    // Only sample profiles need the full PGO options here, the instrumentation paths were already
+    // configured above.
+    let pgo_sample_use_path = get_pgo_sample_use_path(config);
+    if let Some(pgo_options) = get_pgo_options(config, &None, &None, &pgo_sample_use_path) {
+        llvm::LLVMRustConfigurePassManagerBuilderPGO(builder, &pgo_options);
+    }
+
     llvm::LLVMPassManagerBuilderSetSizeLevel(builder, opt_size as u32);
 
     if opt_size != llvm::CodeGenOptSizeNone {
@@ -1181,6 +1181,62 @@ pub fn maxnum(&mut self, lhs: &'ll Value, rhs: &'ll Value) -> &'ll Value {
         unsafe { llvm::LLVMRustBuildMaxNum(self.llbuilder, lhs, rhs) }
     }
 
+    pub fn masked_gather(
+        &mut self,
+        ty: &'ll Type,
+        ptrs: &'ll Value,
+        align: Align,
+        mask: &'ll Value,
+        pass_thru: &'ll Value,
+    ) -> &'ll Value {
+        unsafe {
+            llvm::LLVMRustBuildMaskedGather(
+                self.llbuilder,
+                ty,
+                ptrs,
+                align.bytes() as c_uint,
+                mask,
+                pass_thru,
+            )
+        }
+    }
+
+    pub fn masked_scatter(
+        &mut self,
+        val: &'ll Value,
+        ptrs: &'ll Value,
+        align: Align,
+        mask: &'ll Value,
+    ) -> &'ll Value {
+        unsafe {
+            llvm::LLVMRustBuildMaskedScatter(
+                self.llbuilder,
+                val,
+                ptrs,
+                align.bytes() as c_uint,
+                mask,
+            )
+        }
+    }
+
+    pub fn funnel_shift(
+        &mut self,
+        hi: &'ll Value,
+        lo: &'ll Value,
+        amt: &'ll Value,
+        right: bool,
+    ) -> &'ll Value {
+        unsafe { llvm::LLVMRustBuildFunnelShift(self.llbuilder, hi, lo, amt, right) }
+    }
+
+    pub fn saturating_add(&mut self, lhs: &'ll Value, rhs: &'ll Value, signed: bool) -> &'ll Value {
+        unsafe { llvm::LLVMRustBuildSaturatingAdd(self.llbuilder, lhs, rhs, signed) }
+    }
+
+    pub fn saturating_sub(&mut self, lhs: &'ll Value, rhs: &'ll Value, signed: bool) -> &'ll Value {
+        unsafe { llvm::LLVMRustBuildSaturatingSub(self.llbuilder, lhs, rhs, signed) }
+    }
+
     pub fn insert_element(
         &mut self,
         vec: &'ll Value,
@@ -1205,19 +1261,11 @@ pub fn vector_reduce_fadd(&mut self, acc: &'ll Value, src: &'ll Value) -> &'ll V
     pub fn vector_reduce_fmul(&mut self, acc: &'ll Value, src: &'ll Value) -> &'ll Value {
         unsafe { llvm::LLVMRustBuildVectorReduceFMul(self.llbuilder, acc, src) }
     }
-    pub fn vector_reduce_fadd_fast(&mut self, acc: &'ll Value, src: &'ll Value) -> &'ll Value {
-        unsafe {
-            let instr = llvm::LLVMRustBuildVectorReduceFAdd(self.llbuilder, acc, src);
-            llvm::LLVMRustSetFastMath(instr);
-            instr
-        }
+    pub fn vector_reduce_fadd_reassoc(&mut self, acc: &'ll Value, src: &'ll Value) -> &'ll Value {
+        unsafe { llvm::LLVMRustBuildVectorReduceFAddUnordered(self.llbuilder, acc, src) }
     }
-    pub fn vector_reduce_fmul_fast(&mut self, acc: &'ll Value, src: &'ll Value) -> &'ll Value {
-        unsafe {
-            let instr = llvm::LLVMRustBuildVectorReduceFMul(self.llbuilder, acc, src);
-            llvm::LLVMRustSetFastMath(instr);
-            instr
-        }
+    pub fn vector_reduce_fmul_reassoc(&mut self, acc: &'ll Value, src: &'ll Value) -> &'ll Value {
+        unsafe { llvm::LLVMRustBuildVectorReduceFMulUnordered(self.llbuilder, acc, src) }
     }
     pub fn vector_reduce_add(&mut self, src: &'ll Value) -> &'ll Value {
         unsafe { llvm::LLVMRustBuildVectorReduceAdd(self.llbuilder, src) }
@@ -7,11 +7,11 @@
 use rustc_codegen_ssa::traits::{ConstMethods, CoverageInfoMethods};
 use rustc_data_structures::fx::{FxHashMap, FxHashSet, FxIndexSet};
 use rustc_hir::def_id::{DefId, DefIdSet};
-use rustc_llvm::RustString;
 use rustc_middle::mir::coverage::CodeRegion;
 use rustc_span::Symbol;
 
 use std::ffi::CString;
+use std::iter;
 
 use tracing::debug;
 
@@ -59,7 +59,8 @@ pub fn finalize<'ll, 'tcx>(cx: &CodegenCx<'ll, 'tcx>) {
 
     let mut mapgen = CoverageMapGenerator::new();
 
-    // Encode coverage mappings and generate function records
+    // Collect coverage mappings and generate function records
+    let mut mappings = Vec::new();
     let mut function_data = Vec::new();
     for (instance, function_coverage) in function_coverage_map {
         debug!("Generate function coverage for {}, {:?}", cx.codegen_unit.name(), instance);
@@ -69,17 +70,26 @@ pub fn finalize<'ll, 'tcx>(cx: &CodegenCx<'ll, 'tcx>) {
         let (expressions, counter_regions) =
             function_coverage.get_expressions_and_counter_regions();
 
-        let coverage_mapping_buffer = llvm::build_byte_buffer(|coverage_mapping_buffer| {
-            mapgen.write_coverage_mapping(expressions, counter_regions, coverage_mapping_buffer);
-        });
+        let mapping = mapgen.collect_coverage_mapping(expressions, counter_regions);
         debug_assert!(
-            coverage_mapping_buffer.len() > 0,
+            mapping.is_some(),
             "Every `FunctionCoverage` should have at least one counter"
         );
+        let mapping_index = mapping.map(|mapping| {
+            mappings.push(mapping);
+            mappings.len() - 1
+        });
 
-        function_data.push((mangled_function_name, source_hash, is_used, coverage_mapping_buffer));
+        function_data.push((mangled_function_name, source_hash, is_used, mapping_index));
     }
 
+    // Encode the coverage mappings of all functions at once
+    let mut mapping_offsets = Vec::new();
+    let coverage_mappings_buffer = llvm::build_byte_buffer(|coverage_mappings_buffer| {
+        mapping_offsets =
+            coverageinfo::write_mappings_to_buffer(&mappings, coverage_mappings_buffer);
+    });
+
     // Encode all filenames referenced by counters/expressions in this module
     let filenames_buffer = llvm::build_byte_buffer(|filenames_buffer| {
         coverageinfo::write_filenames_section_to_buffer(&mapgen.filenames, filenames_buffer);
@@ -92,13 +102,22 @@ pub fn finalize<'ll, 'tcx>(cx: &CodegenCx<'ll, 'tcx>) {
     // Generate the LLVM IR representation of the coverage map and store it in a well-known global
     let cov_data_val = mapgen.generate_coverage_map(cx, version, filenames_size, filenames_val);
 
-    for (mangled_function_name, source_hash, is_used, coverage_mapping_buffer) in function_data {
+    // Hash all the function names at once
+    let func_name_hashes =
+        coverageinfo::hash_strs(function_data.iter().map(|(name, ..)| &name[..]));
+
+    for ((_, source_hash, is_used, mapping_index), func_name_hash) in
+        iter::zip(function_data, func_name_hashes)
+    {
+        let coverage_mapping = mapping_index.map_or(&[][..], |i| {
+            &coverage_mappings_buffer[mapping_offsets[i]..mapping_offsets[i + 1]]
+        });
         save_function_record(
             cx,
-            mangled_function_name,
+            func_name_hash,
             source_hash,
             filenames_ref,
-            coverage_mapping_buffer,
+            coverage_mapping,
             is_used,
         );
     }
@@ -117,18 +136,18 @@ fn new() -> Self {
     }
 
     /// Using the `expressions` and `counter_regions` collected for the current function, generate
-    /// the `mapping_regions` and `virtual_file_mapping`, and capture any new filenames. Then use
-    /// LLVM APIs to encode the `virtual_file_mapping`, `expressions`, and `mapping_regions` into
-    /// the given `coverage_mapping` byte buffer, compliant with the LLVM Coverage Mapping format.
-    fn write_coverage_mapping(
+    /// the `mapping_regions` and `virtual_file_mapping`, and capture any new filenames. These are
+    /// then encoded together with the `expressions`, compliant with the LLVM Coverage Mapping
+    /// format, by `coverageinfo::write_mappings_to_buffer`. Returns `None` if the function has no
+    /// counter regions.
+    fn collect_coverage_mapping(
         &mut self,
         expressions: Vec<CounterExpression>,
         counter_regions: impl Iterator<Item = (Counter, &'a CodeRegion)>,
-        coverage_mapping_buffer: &RustString,
-    ) {
+    ) -> Option<coverageinfo::FunctionMappingData> {
         let mut counter_regions = counter_regions.collect::<Vec<_>>();
         if counter_regions.is_empty() {
-            return;
+            return None;
         }
 
         let mut virtual_file_mapping = Vec::new();
@@ -167,13 +186,11 @@ fn write_coverage_mapping(
             ));
         }
 
-        // Encode and append the current function's coverage mapping data
-        coverageinfo::write_mapping_to_buffer(
+        Some(coverageinfo::FunctionMappingData {
             virtual_file_mapping,
             expressions,
             mapping_regions,
-            coverage_mapping_buffer,
-        );
+        })
     }
 
     /// Construct coverage map header and the array of function records, and combine them into the
@@ -209,17 +226,16 @@ fn generate_coverage_map(
 /// specific, well-known section and name.
 fn save_function_record(
     cx: &CodegenCx<'ll, 'tcx>,
-    mangled_function_name: String,
+    func_name_hash: u64,
     source_hash: u64,
     filenames_ref: u64,
-    coverage_mapping_buffer: Vec<u8>,
+    coverage_mapping: &[u8],
     is_used: bool,
 ) {
     // Concatenate the encoded coverage mappings
-    let coverage_mapping_size = coverage_mapping_buffer.len();
-    let coverage_mapping_val = cx.const_bytes(&coverage_mapping_buffer[..]);
+    let coverage_mapping_size = coverage_mapping.len();
+    let coverage_mapping_val = cx.const_bytes(coverage_mapping);
 
-    let func_name_hash = coverageinfo::hash_str(&mangled_function_name);
     let func_name_hash_val = cx.const_u64(func_name_hash);
     let coverage_mapping_size_val = cx.const_u32(coverage_mapping_size as u32);
     let source_hash_val = cx.const_u64(source_hash);
@@ -4,7 +4,6 @@
 use crate::builder::Builder;
 use crate::common::CodegenCx;
 
-use libc::c_uint;
 use llvm::coverageinfo::CounterMappingRegion;
 use rustc_codegen_ssa::coverageinfo::map::{CounterExpression, FunctionCoverage};
 use rustc_codegen_ssa::traits::{
@@ -293,28 +292,57 @@ pub(crate) fn write_filenames_section_to_buffer<'a>(
     }
 }
 
-pub(crate) fn write_mapping_to_buffer(
-    virtual_file_mapping: Vec<u32>,
-    expressions: Vec<CounterExpression>,
-    mapping_regions: Vec<CounterMappingRegion>,
+/// The `virtual_file_mapping`, `expressions` and `mapping_regions` of one function, as encoded
+/// by `write_mappings_to_buffer`.
+pub(crate) struct FunctionMappingData {
+    pub(crate) virtual_file_mapping: Vec<u32>,
+    pub(crate) expressions: Vec<CounterExpression>,
+    pub(crate) mapping_regions: Vec<CounterMappingRegion>,
+}
+
+/// Encodes the coverage mappings of all of `mappings` one after the other into `buffer`, and
+/// returns the offsets at which each of them starts, followed by the end of the last one.
+pub(crate) fn write_mappings_to_buffer(
+    mappings: &[FunctionMappingData],
     buffer: &RustString,
-) {
+) -> Vec<usize> {
+    let functions: Vec<_> = mappings
+        .iter()
+        .map(|mapping| llvm::coverageinfo::FunctionMapping {
+            virtual_file_mapping_ids: mapping.virtual_file_mapping.as_ptr(),
+            num_virtual_file_mapping_ids: mapping.virtual_file_mapping.len() as u32,
+            expressions: mapping.expressions.as_ptr(),
+            num_expressions: mapping.expressions.len() as u32,
+            mapping_regions: mapping.mapping_regions.as_ptr(),
+            num_mapping_regions: mapping.mapping_regions.len() as u32,
+        })
+        .collect();
+    let mut offsets = vec![0; functions.len() + 1];
     unsafe {
-        llvm::LLVMRustCoverageWriteMappingToBuffer(
-            virtual_file_mapping.as_ptr(),
-            virtual_file_mapping.len() as c_uint,
-            expressions.as_ptr(),
-            expressions.len() as c_uint,
-            mapping_regions.as_ptr(),
-            mapping_regions.len() as c_uint,
+        llvm::LLVMRustCoverageWriteMappingsToBuffer(
+            functions.as_ptr(),
+            functions.len(),
+            offsets.as_mut_ptr(),
             buffer,
         );
     }
+    offsets
 }
 
-pub(crate) fn hash_str(strval: &str) -> u64 {
-    let strval = CString::new(strval).expect("null error converting hashable str to C string");
-    unsafe { llvm::LLVMRustCoverageHashCString(strval.as_ptr()) }
+/// Hashes each of `strvals` as `LLVMRustCoverageHashByteArray` would, with a single call.
+pub(crate) fn hash_strs<'a>(strvals: impl Iterator<Item = &'a str>) -> Vec<u64> {
+    let (ptrs, lens): (Vec<*const libc::c_char>, Vec<usize>) =
+        strvals.map(|strval| (strval.as_ptr().cast(), strval.len())).unzip();
+    let mut hashes = vec![0; ptrs.len()];
+    unsafe {
+        llvm::LLVMRustCoverageHashByteArrays(
+            ptrs.as_ptr(),
+            lens.as_ptr(),
+            ptrs.len(),
+            hashes.as_mut_ptr(),
+        );
+    }
+    hashes
 }
 
 pub(crate) fn hash_bytes(bytes: Vec<u8>) -> u64 {
@@ -12,8 +12,8 @@
 use crate::common::CodegenCx;
 use crate::llvm;
 use crate::llvm::debuginfo::{
-    DIArray, DICompositeType, DIDescriptor, DIFile, DIFlags, DILexicalBlock, DIScope, DIType,
-    DebugEmissionKind,
+    DIArray, DICompositeType, DIDescriptor, DIEnumeratorInfo, DIFile, DIFlags, DILexicalBlock,
+    DIMemberInfo, DIScope, DIType, DebugEmissionKind,
 };
 use crate::value::Value;
 
@@ -46,6 +46,7 @@
 use std::fmt::{self, Write};
 use std::hash::{Hash, Hasher};
 use std::iter;
+use std::ops::Deref;
 use std::path::{Path, PathBuf};
 use std::ptr;
 
@@ -1668,37 +1669,22 @@ fn create_member_descriptions(&self, cx: &CodegenCx<'ll, 'tcx>) -> Vec<MemberDes
                         .iter_enumerated()
                         .filter_map(|(variant_idx, _)| {
                             calculate_niche_value(variant_idx).map(|tag| {
-                                let variant = variant_info_for(variant_idx);
-                                let name = variant.variant_name();
-
-                                Some(unsafe {
-                                    llvm::LLVMRustDIBuilderCreateEnumerator(
-                                        DIB(cx),
-                                        name.as_ptr().cast(),
-                                        name.len(),
-                                        tag as i64,
-                                        !discr_enum_ty.is_signed(),
-                                    )
-                                })
+                                (variant_info_for(variant_idx).variant_name(), tag as i64)
                             })
                         })
                         .collect();
+                    let is_unsigned = !discr_enum_ty.is_signed();
 
-                    let discr_enum = unsafe {
-                        llvm::LLVMRustDIBuilderCreateEnumerationType(
-                            DIB(cx),
-                            self_metadata,
-                            "Discriminant$".as_ptr().cast(),
-                            "Discriminant$".len(),
-                            unknown_file_metadata(cx),
-                            UNKNOWN_LINE_NUMBER,
-                            tag.value.size(cx).bits(),
-                            tag.value.align(cx).abi.bits() as u32,
-                            create_DIArray(DIB(cx), &tags),
-                            type_metadata(cx, discr_enum_ty, self.span),
-                            true,
-                        )
-                    };
+                    let discr_enum = create_enumeration_type(
+                        cx,
+                        self_metadata,
+                        "Discriminant$",
+                        unknown_file_metadata(cx),
+                        tag.value.size(cx),
+                        tag.value.align(cx).abi,
+                        tags.iter().map(|(name, tag)| (&name[..], *tag, is_unsigned)),
+                        type_metadata(cx, discr_enum_ty, self.span),
+                    );
 
                     let variant_info = variant_info_for(dataful_variant);
                     let (variant_type_metadata, member_desc_factory) = describe_enum_variant(
@@ -1949,48 +1935,6 @@ fn prepare_enum_metadata(
     let file_metadata = unknown_file_metadata(cx);
 
     let discriminant_type_metadata = |discr: Primitive| {
-        let enumerators_metadata: Vec<_> = match enum_type.kind() {
-            ty::Adt(def, _) => iter::zip(def.discriminants(tcx), &def.variants)
-                .map(|((_, discr), v)| {
-                    let name = v.ident.as_str();
-                    let is_unsigned = match discr.ty.kind() {
-                        ty::Int(_) => false,
-                        ty::Uint(_) => true,
-                        _ => bug!("non integer discriminant"),
-                    };
-                    unsafe {
-                        Some(llvm::LLVMRustDIBuilderCreateEnumerator(
-                            DIB(cx),
-                            name.as_ptr().cast(),
-                            name.len(),
-                            // FIXME: what if enumeration has i128 discriminant?
-                            discr.val as i64,
-                            is_unsigned,
-                        ))
-                    }
-                })
-                .collect(),
-            ty::Generator(_, substs, _) => substs
-                .as_generator()
-                .variant_range(enum_def_id, tcx)
-                .map(|variant_index| {
-                    debug_assert_eq!(tcx.types.u32, substs.as_generator().discr_ty(tcx));
-                    let name = GeneratorSubsts::variant_name(variant_index);
-                    unsafe {
-                        Some(llvm::LLVMRustDIBuilderCreateEnumerator(
-                            DIB(cx),
-                            name.as_ptr().cast(),
-                            name.len(),
-                            // Generators use u32 as discriminant type, verified above.
-                            variant_index.as_u32().into(),
-                            true, // IsUnsigned
-                        ))
-                    }
-                })
-                .collect(),
-            _ => bug!(),
-        };
-
         let disr_type_key = (enum_def_id, discr);
         let cached_discriminant_type_metadata =
             debug_context(cx).created_enum_disr_types.borrow().get(&disr_type_key).cloned();
@@ -2011,20 +1955,46 @@ fn prepare_enum_metadata(
                     _ => bug!(),
                 };
 
-                let discriminant_type_metadata = unsafe {
-                    llvm::LLVMRustDIBuilderCreateEnumerationType(
-                        DIB(cx),
+                let discriminant_type_metadata = match enum_type.kind() {
+                    ty::Adt(def, _) => create_enumeration_type(
+                        cx,
                         containing_scope,
-                        discriminant_name.as_ptr().cast(),
-                        discriminant_name.len(),
+                        discriminant_name,
                         file_metadata,
-                        UNKNOWN_LINE_NUMBER,
-                        discriminant_size.bits(),
-                        discriminant_align.abi.bits() as u32,
-                        create_DIArray(DIB(cx), &enumerators_metadata),
+                        discriminant_size,
+                        discriminant_align.abi,
+                        iter::zip(def.discriminants(tcx), &def.variants).map(|((_, discr), v)| {
+                            let is_unsigned = match discr.ty.kind() {
+                                ty::Int(_) => false,
+                                ty::Uint(_) => true,
+                                _ => bug!("non integer discriminant"),
+                            };
+                            // FIXME: what if enumeration has i128 discriminant?
+                            (v.ident.as_str(), discr.val as i64, is_unsigned)
+                        }),
                         discriminant_base_type_metadata,
-                        true,
-                    )
+                    ),
+                    ty::Generator(_, substs, _) => create_enumeration_type(
+                        cx,
+                        containing_scope,
+                        discriminant_name,
+                        file_metadata,
+                        discriminant_size,
+                        discriminant_align.abi,
+                        substs.as_generator().variant_range(enum_def_id, tcx).map(
+                            |variant_index| {
+                                debug_assert_eq!(
+                                    tcx.types.u32,
+                                    substs.as_generator().discr_ty(tcx)
+                                );
+                                // Generators use u32 as discriminant type, verified above.
+                                let value = variant_index.as_u32().into();
+                                (GeneratorSubsts::variant_name(variant_index), value, true)
+                            },
+                        ),
+                        discriminant_base_type_metadata,
+                    ),
+                    _ => bug!(),
                 };
 
                 debug_context(cx)
@@ -2285,6 +2255,47 @@ fn composite_type_metadata(
     composite_type_metadata
 }
 
+/// Creates an enumeration type and its `enumerators`, given as their name,
+/// value and whether the value is unsigned, with a single call into LLVM.
+fn create_enumeration_type<'ll, S: Deref<Target = str>>(
+    cx: &CodegenCx<'ll, '_>,
+    scope: &'ll DIScope,
+    name: &str,
+    file: &'ll DIFile,
+    size: Size,
+    align: Align,
+    enumerators: impl Iterator<Item = (S, i64, bool)>,
+    base_type: &'ll DIType,
+) -> &'ll DIType {
+    // The names have to stay alive until the enumerators are created.
+    let enumerators: Vec<_> = enumerators.collect();
+    let infos: Vec<_> = enumerators
+        .iter()
+        .map(|(name, value, is_unsigned)| DIEnumeratorInfo {
+            name: name.as_ptr().cast(),
+            name_len: name.len(),
+            value: *value,
+            is_unsigned: *is_unsigned,
+        })
+        .collect();
+    unsafe {
+        llvm::LLVMRustDIBuilderCreateEnumerationTypeWithEnumerators(
+            DIB(cx),
+            scope,
+            name.as_ptr().cast(),
+            name.len(),
+            file,
+            UNKNOWN_LINE_NUMBER,
+            size.bits(),
+            align.bits() as u32,
+            infos.as_ptr(),
+            infos.len(),
+            base_type,
+            true,
+        )
+    }
+}
+
 fn set_members_of_composite_type(
     cx: &CodegenCx<'ll, 'tcx>,
     composite_type: Ty<'tcx>,
@@ -2309,21 +2320,39 @@ fn set_members_of_composite_type(
         }
     }
 
-    let mut member_metadata: Vec<_> = member_descriptions
-        .into_iter()
-        .map(|desc| Some(desc.into_metadata(cx, composite_type_metadata)))
+    let unknown_file = unknown_file_metadata(cx);
+    let members: Vec<_> = member_descriptions
+        .iter()
+        .map(|desc| {
+            let (file, line) = desc
+                .source_info
+                .as_ref()
+                .map_or((unknown_file, UNKNOWN_LINE_NUMBER), |info| (info.file, info.line));
+            DIMemberInfo {
+                name: desc.name.as_ptr().cast(),
+                name_len: desc.name.len(),
+                file,
+                line_no: line,
+                size_in_bits: desc.size.bits(),
+                align_in_bits: desc.align.bits() as u32,
+                offset_in_bits: desc.offset.bits(),
+                discriminant: desc.discriminant.map(|v| cx.const_u64(v)),
+                flags: desc.flags,
+                ty: desc.type_metadata,
+            }
+        })
         .collect();
-    if let Some(other_members) = common_members {
-        member_metadata.extend(other_members.iter());
-    }
+    let other_members = common_members.map_or(&[][..], |members| &members[..]);
 
     let type_params = compute_type_parameters(cx, composite_type);
     unsafe {
-        let type_array = create_DIArray(DIB(cx), &member_metadata[..]);
-        llvm::LLVMRustDICompositeTypeReplaceArrays(
+        llvm::LLVMRustDICompositeTypeReplaceMembers(
             DIB(cx),
             composite_type_metadata,
-            Some(type_array),
+            members.as_ptr(),
+            members.len(),
+            other_members.as_ptr(),
+            other_members.len(),
             Some(type_params),
         );
     }
@@ -264,23 +264,16 @@ fn codegen_intrinsic_call(
                             let val = args[0].immediate();
                             let raw_shift = args[1].immediate();
                             // rotate = funnel shift with first two args the same
-                            let llvm_name =
-                                &format!("llvm.fsh{}.i{}", if is_left { 'l' } else { 'r' }, width);
-                            let llfn = self.get_intrinsic(llvm_name);
-                            self.call(llfn, &[val, val, raw_shift], None)
+                            self.funnel_shift(val, val, raw_shift, !is_left)
                         }
                         sym::saturating_add | sym::saturating_sub => {
-                            let is_add = name == sym::saturating_add;
                             let lhs = args[0].immediate();
                             let rhs = args[1].immediate();
-                            let llvm_name = &format!(
-                                "llvm.{}{}.sat.i{}",
-                                if signed { 's' } else { 'u' },
-                                if is_add { "add" } else { "sub" },
-                                width
-                            );
-                            let llfn = self.get_intrinsic(llvm_name);
-                            self.call(llfn, &[lhs, rhs], None)
+                            if name == sym::saturating_add {
+                                self.saturating_add(lhs, rhs, signed)
+                            } else {
+                                self.saturating_sub(lhs, rhs, signed)
+                            }
                         }
                         _ => bug!(),
                     },
@@ -1141,19 +1134,6 @@ macro_rules! return_error {
         return simd_simple_float_intrinsic(name, in_elem, in_ty, in_len, bx, span, args);
     }
 
-    // FIXME: use:
-    //  https://github.com/llvm-mirror/llvm/blob/master/include/llvm/IR/Function.h#L182
-    //  https://github.com/llvm-mirror/llvm/blob/master/include/llvm/IR/Intrinsics.h#L81
-    fn llvm_vector_str(elem_ty: Ty<'_>, vec_len: u64, no_pointers: usize) -> String {
-        let p0s: String = "p0".repeat(no_pointers);
-        match *elem_ty.kind() {
-            ty::Int(v) => format!("v{}{}i{}", vec_len, p0s, v.bit_width().unwrap()),
-            ty::Uint(v) => format!("v{}{}i{}", vec_len, p0s, v.bit_width().unwrap()),
-            ty::Float(v) => format!("v{}{}f{}", vec_len, p0s, v.bit_width()),
-            _ => unreachable!(),
-        }
-    }
-
     fn llvm_vector_ty(
         cx: &CodegenCx<'ll, '_>,
         elem_ty: Ty<'_>,
@@ -1271,36 +1251,26 @@ fn non_ptr(t: Ty<'_>) -> Ty<'_> {
             }
         }
 
-        // Alignment of T, must be a constant integer value:
-        let alignment_ty = bx.type_i32();
-        let alignment = bx.const_i32(bx.align_of(in_elem).bytes() as i32);
+        // Alignment of T:
+        let alignment = bx.align_of(in_elem);
 
         // Truncate the mask vector to a vector of i1s:
-        let (mask, mask_ty) = {
+        let mask = {
             let i1 = bx.type_i1();
             let i1xn = bx.type_vector(i1, in_len);
-            (bx.trunc(args[2].immediate(), i1xn), i1xn)
+            bx.trunc(args[2].immediate(), i1xn)
         };
 
-        // Type of the vector of pointers:
-        let llvm_pointer_vec_ty = llvm_vector_ty(bx, underlying_ty, in_len, pointer_count);
-        let llvm_pointer_vec_str = llvm_vector_str(underlying_ty, in_len, pointer_count);
-
         // Type of the vector of elements:
         let llvm_elem_vec_ty = llvm_vector_ty(bx, underlying_ty, in_len, pointer_count - 1);
-        let llvm_elem_vec_str = llvm_vector_str(underlying_ty, in_len, pointer_count - 1);
-
-        let llvm_intrinsic =
-            format!("llvm.masked.gather.{}.{}", llvm_elem_vec_str, llvm_pointer_vec_str);
-        let f = bx.declare_cfn(
-            &llvm_intrinsic,
-            llvm::UnnamedAddr::No,
-            bx.type_func(
-                &[llvm_pointer_vec_ty, alignment_ty, mask_ty, llvm_elem_vec_ty],
-                llvm_elem_vec_ty,
-            ),
+
+        let v = bx.masked_gather(
+            llvm_elem_vec_ty,
+            args[1].immediate(),
+            alignment,
+            mask,
+            args[0].immediate(),
         );
-        let v = bx.call(f, &[args[1].immediate(), alignment, mask, args[0].immediate()], None);
         return Ok(v);
     }
 
@@ -1399,35 +1369,17 @@ fn non_ptr(t: Ty<'_>) -> Ty<'_> {
             }
         }
 
-        // Alignment of T, must be a constant integer value:
-        let alignment_ty = bx.type_i32();
-        let alignment = bx.const_i32(bx.align_of(in_elem).bytes() as i32);
+        // Alignment of T:
+        let alignment = bx.align_of(in_elem);
 
         // Truncate the mask vector to a vector of i1s:
-        let (mask, mask_ty) = {
+        let mask = {
             let i1 = bx.type_i1();
             let i1xn = bx.type_vector(i1, in_len);
-            (bx.trunc(args[2].immediate(), i1xn), i1xn)
+            bx.trunc(args[2].immediate(), i1xn)
         };
 
-        let ret_t = bx.type_void();
-
-        // Type of the vector of pointers:
-        let llvm_pointer_vec_ty = llvm_vector_ty(bx, underlying_ty, in_len, pointer_count);
-        let llvm_pointer_vec_str = llvm_vector_str(underlying_ty, in_len, pointer_count);
-
-        // Type of the vector of elements:
-        let llvm_elem_vec_ty = llvm_vector_ty(bx, underlying_ty, in_len, pointer_count - 1);
-        let llvm_elem_vec_str = llvm_vector_str(underlying_ty, in_len, pointer_count - 1);
-
-        let llvm_intrinsic =
-            format!("llvm.masked.scatter.{}.{}", llvm_elem_vec_str, llvm_pointer_vec_str);
-        let f = bx.declare_cfn(
-            &llvm_intrinsic,
-            llvm::UnnamedAddr::No,
-            bx.type_func(&[llvm_elem_vec_ty, llvm_pointer_vec_ty, alignment_ty, mask_ty], ret_t),
-        );
-        let v = bx.call(f, &[args[0].immediate(), args[1].immediate(), alignment, mask], None);
+        let v = bx.masked_scatter(args[0].immediate(), args[1].immediate(), alignment, mask);
         return Ok(v);
     }
 
@@ -1491,14 +1443,14 @@ macro_rules! arith_red {
     arith_red!(simd_reduce_mul_ordered: vector_reduce_mul, vector_reduce_fmul, true, mul, 1.0);
     arith_red!(
         simd_reduce_add_unordered: vector_reduce_add,
-        vector_reduce_fadd_fast,
+        vector_reduce_fadd_reassoc,
         false,
         add,
         0.0
     );
     arith_red!(
         simd_reduce_mul_unordered: vector_reduce_mul,
-        vector_reduce_fmul_fast,
+        vector_reduce_fmul_reassoc,
         false,
         mul,
         1.0
@@ -1727,10 +1679,9 @@ macro_rules! arith_unary {
         let lhs = args[0].immediate();
         let rhs = args[1].immediate();
         let is_add = name == sym::simd_saturating_add;
-        let ptr_bits = bx.tcx().data_layout.pointer_size.bits() as _;
-        let (signed, elem_width, elem_ty) = match *in_elem.kind() {
-            ty::Int(i) => (true, i.bit_width().unwrap_or(ptr_bits), bx.cx.type_int_from_ty(i)),
-            ty::Uint(i) => (false, i.bit_width().unwrap_or(ptr_bits), bx.cx.type_uint_from_ty(i)),
+        let signed = match *in_elem.kind() {
+            ty::Int(_) => true,
+            ty::Uint(_) => false,
             _ => {
                 return_error!(
                     "expected element type `{}` of vector type `{}` \
@@ -1740,21 +1691,11 @@ macro_rules! arith_unary {
                 );
             }
         };
-        let llvm_intrinsic = &format!(
-            "llvm.{}{}.sat.v{}i{}",
-            if signed { 's' } else { 'u' },
-            if is_add { "add" } else { "sub" },
-            in_len,
-            elem_width
-        );
-        let vec_ty = bx.cx.type_vector(elem_ty, in_len as u64);
-
-        let f = bx.declare_cfn(
-            &llvm_intrinsic,
-            llvm::UnnamedAddr::No,
-            bx.type_func(&[vec_ty, vec_ty], vec_ty),
-        );
-        let v = bx.call(f, &[lhs, rhs], None);
+        let v = if is_add {
+            bx.saturating_add(lhs, rhs, signed)
+        } else {
+            bx.saturating_sub(lhs, rhs, signed)
+        };
         return Ok(v);
     }
 
@@ -12,9 +12,10 @@
 #![feature(in_band_lifetimes)]
 #![feature(iter_zip)]
 #![feature(nll)]
+#![feature(once_cell)]
 #![recursion_limit = "256"]
 
-use back::write::{create_informational_target_machine, create_target_machine};
+use back::write::{create_informational_target_machine, create_target_machine, OwnedTargetMachine};
 
 pub use llvm_util::target_features;
 use rustc_ast::expand::allocator::AllocatorKind;
@@ -36,6 +37,7 @@
 
 use std::any::Any;
 use std::ffi::CStr;
+use std::sync::Arc;
 
 mod back {
     pub mod archive;
@@ -74,7 +76,13 @@ pub mod llvm {
 mod value;
 
 #[derive(Clone)]
-pub struct LlvmCodegenBackend(());
+pub struct LlvmCodegenBackend {
+    /// The call graph profile of the modules codegened for the crate, shared by the clones of
+    /// the backend in the codegen threads, see `-Z call-graph-ordering-file`.
+    call_graph_profile: Option<Arc<back::write::CallGraphProfile>>,
+    /// The contexts reused by the codegen units of the crate, see `-Z reuse-llvm-contexts`.
+    context_pool: Option<Arc<ContextPool>>,
+}
 
 impl ExtraBackendMethods for LlvmCodegenBackend {
     fn new_metadata(&self, tcx: TyCtxt<'_>, mod_name: &str) -> ModuleLlvm {
@@ -103,7 +111,7 @@ fn compile_codegen_unit(
         tcx: TyCtxt<'_>,
         cgu_name: Symbol,
     ) -> (ModuleCodegen<ModuleLlvm>, u64) {
-        base::compile_codegen_unit(tcx, cgu_name)
+        base::compile_codegen_unit(tcx, cgu_name, self.context_pool.clone())
     }
     fn target_machine_factory(
         &self,
@@ -118,13 +126,37 @@ fn target_cpu<'b>(&self, sess: &'b Session) -> &'b str {
     fn tune_cpu<'b>(&self, sess: &'b Session) -> Option<&'b str> {
         llvm_util::tune_cpu(sess)
     }
+
+    fn spawn_thread<F, T>(time_trace: bool, f: F) -> std::thread::JoinHandle<T>
+    where
+        F: FnOnce() -> T,
+        F: Send + 'static,
+        T: Send + 'static,
+    {
+        std::thread::spawn(move || llvm_util::with_time_trace_profiler(time_trace, f))
+    }
+
+    fn spawn_named_thread<F, T>(
+        time_trace: bool,
+        name: String,
+        f: F,
+    ) -> std::io::Result<std::thread::JoinHandle<T>>
+    where
+        F: FnOnce() -> T,
+        F: Send + 'static,
+        T: Send + 'static,
+    {
+        std::thread::Builder::new()
+            .name(name)
+            .spawn(move || llvm_util::with_time_trace_profiler(time_trace, f))
+    }
 }
 
 impl WriteBackendMethods for LlvmCodegenBackend {
     type Module = ModuleLlvm;
     type ModuleBuffer = back::lto::ModuleBuffer;
     type Context = llvm::Context;
-    type TargetMachine = &'static mut llvm::TargetMachine;
+    type TargetMachine = OwnedTargetMachine;
     type ThinData = back::lto::ThinData;
     type ThinBuffer = back::lto::ThinBuffer;
     fn print_pass_timings(&self) {
@@ -159,7 +191,15 @@ unsafe fn optimize(
         module: &ModuleCodegen<Self::Module>,
         config: &ModuleConfig,
     ) -> Result<(), FatalError> {
-        back::write::optimize(cgcx, diag_handler, module, config)
+        let print_stats = cgcx.opts.debugging_opts.print_llvm_module_stats;
+        if print_stats {
+            back::write::print_module_stats(module, "before optimization");
+        }
+        let result = back::write::optimize(cgcx, diag_handler, module, config);
+        if print_stats {
+            back::write::print_module_stats(module, "after optimization");
+        }
+        result
     }
     unsafe fn optimize_thin(
         cgcx: &CodegenContext<Self>,
@@ -175,8 +215,11 @@ unsafe fn codegen(
     ) -> Result<CompiledModule, FatalError> {
         back::write::codegen(cgcx, diag_handler, module, config)
     }
-    fn prepare_thin(module: ModuleCodegen<Self::Module>) -> (String, Self::ThinBuffer) {
-        back::lto::prepare_thin(module)
+    fn prepare_thin(
+        cgcx: &CodegenContext<Self>,
+        module: ModuleCodegen<Self::Module>,
+    ) -> (String, Self::ThinBuffer) {
+        back::lto::prepare_thin(cgcx, module)
     }
     fn serialize_module(module: ModuleCodegen<Self::Module>) -> (String, Self::ModuleBuffer) {
         (module.name, back::lto::ModuleBuffer::new(module.module_llvm.llmod()))
@@ -188,7 +231,7 @@ fn run_lto_pass_manager(
         thin: bool,
     ) -> Result<(), FatalError> {
         let diag_handler = cgcx.create_diag_handler();
-        back::lto::run_pass_manager(cgcx, &diag_handler, module, config, thin)
+        back::lto::run_pass_manager(cgcx, &diag_handler, module, config, thin, None)
     }
 }
 
@@ -197,7 +240,7 @@ unsafe impl Sync for LlvmCodegenBackend {}
 
 impl LlvmCodegenBackend {
     pub fn new() -> Box<dyn CodegenBackend> {
-        Box::new(LlvmCodegenBackend(()))
+        Box::new(LlvmCodegenBackend { call_graph_profile: None, context_pool: None })
     }
 }
 
@@ -253,8 +296,21 @@ fn codegen_crate<'tcx>(
         metadata: EncodedMetadata,
         need_metadata_module: bool,
     ) -> Box<dyn Any> {
+        let call_graph_profile = tcx
+            .sess
+            .opts
+            .debugging_opts
+            .call_graph_ordering_file
+            .as_ref()
+            .map(|_| Arc::new(back::write::CallGraphProfile::new()));
+        let context_pool = tcx
+            .sess
+            .opts
+            .debugging_opts
+            .reuse_llvm_contexts
+            .map(|max_uses| Arc::new(ContextPool::new(max_uses)));
         Box::new(rustc_codegen_ssa::base::codegen_crate(
-            LlvmCodegenBackend(()),
+            LlvmCodegenBackend { call_graph_profile, context_pool },
             tcx,
             crate::llvm_util::target_cpu(tcx.sess).to_string(),
             metadata,
@@ -267,10 +323,11 @@ fn join_codegen(
         ongoing_codegen: Box<dyn Any>,
         sess: &Session,
     ) -> Result<(CodegenResults, FxHashMap<WorkProductId, WorkProduct>), ErrorReported> {
-        let (codegen_results, work_products) = ongoing_codegen
+        let ongoing_codegen = ongoing_codegen
             .downcast::<rustc_codegen_ssa::back::write::OngoingCodegen<LlvmCodegenBackend>>()
-            .expect("Expected LlvmCodegenBackend's OngoingCodegen, found Box<Any>")
-            .join(sess);
+            .expect("Expected LlvmCodegenBackend's OngoingCodegen, found Box<Any>");
+        let call_graph_profile = ongoing_codegen.backend.call_graph_profile.clone();
+        let (codegen_results, work_products) = ongoing_codegen.join(sess);
 
         sess.time("llvm_dump_timing_file", || {
             if sess.opts.debugging_opts.llvm_time_trace {
@@ -278,6 +335,12 @@ fn join_codegen(
             }
         });
 
+        if let (Some(path), Some(profile)) =
+            (&sess.opts.debugging_opts.call_graph_ordering_file, call_graph_profile)
+        {
+            back::write::write_call_graph_ordering_file(sess, &profile, path);
+        }
+
         Ok((codegen_results, work_products))
     }
 
@@ -292,25 +355,70 @@ fn link(
 
         // Run the linker on any artifacts that resulted from the LLVM run.
         // This should produce either a finished executable or library.
-        link_binary::<LlvmArchiveBuilder<'_>>(sess, &codegen_results, outputs)
+        let result = link_binary::<LlvmArchiveBuilder<'_>>(sess, &codegen_results, outputs);
+        if sess.opts.debugging_opts.archive_cache {
+            unsafe { llvm::LLVMRustClearArchiveCache() };
+        }
+        result
     }
 }
 
 pub struct ModuleLlvm {
     llcx: &'static mut llvm::Context,
     llmod_raw: *const llvm::Module,
-    tm: &'static mut llvm::TargetMachine,
+    tm: OwnedTargetMachine,
+    /// The pool `llcx` is given back to once the module is dropped, see `-Z reuse-llvm-contexts`.
+    context_pool: Option<Arc<ContextPool>>,
 }
 
 unsafe impl Send for ModuleLlvm {}
 unsafe impl Sync for ModuleLlvm {}
 
+/// The contexts reused by the codegen units of a crate. It's freed once codegen is done and the
+/// last module created in one of its contexts is dropped.
+pub struct ContextPool(&'static mut llvm::ContextPool);
+
+unsafe impl Send for ContextPool {}
+unsafe impl Sync for ContextPool {}
+
+/// The most idle contexts the pool keeps, each holding on to everything it has created.
+const MAX_IDLE_CONTEXTS: usize = 16;
+
+impl ContextPool {
+    fn new(max_uses: u32) -> Self {
+        ContextPool(unsafe { llvm::LLVMRustCreateContextPool(max_uses, MAX_IDLE_CONTEXTS) })
+    }
+}
+
+impl Drop for ContextPool {
+    fn drop(&mut self) {
+        unsafe {
+            llvm::LLVMRustFreeContextPool(&mut *(self.0 as *mut _));
+        }
+    }
+}
+
+/// Creates the context of a codegen unit, taken from `context_pool` if there is one.
+fn create_context(
+    context_pool: Option<&Arc<ContextPool>>,
+    fewer_names: bool,
+) -> (&'static mut llvm::Context, Option<Arc<ContextPool>>) {
+    unsafe {
+        match context_pool {
+            Some(pool) => {
+                (llvm::LLVMRustContextPoolAcquire(&*pool.0, fewer_names), Some(pool.clone()))
+            }
+            None => (llvm::LLVMRustContextCreate(fewer_names), None),
+        }
+    }
+}
+
 impl ModuleLlvm {
-    fn new(tcx: TyCtxt<'_>, mod_name: &str) -> Self {
+    fn new(tcx: TyCtxt<'_>, mod_name: &str, context_pool: Option<&Arc<ContextPool>>) -> Self {
         unsafe {
-            let llcx = llvm::LLVMRustContextCreate(tcx.sess.fewer_names());
+            let (llcx, context_pool) = create_context(context_pool, tcx.sess.fewer_names());
             let llmod_raw = context::create_module(tcx, llcx, mod_name) as *const _;
-            ModuleLlvm { llmod_raw, llcx, tm: create_target_machine(tcx, mod_name) }
+            ModuleLlvm { llmod_raw, llcx, tm: create_target_machine(tcx, mod_name), context_pool }
         }
     }
 
@@ -318,7 +426,12 @@ fn new_metadata(tcx: TyCtxt<'_>, mod_name: &str) -> Self {
         unsafe {
             let llcx = llvm::LLVMRustContextCreate(tcx.sess.fewer_names());
             let llmod_raw = context::create_module(tcx, llcx, mod_name) as *const _;
-            ModuleLlvm { llmod_raw, llcx, tm: create_informational_target_machine(tcx.sess) }
+            ModuleLlvm {
+                llmod_raw,
+                llcx,
+                tm: create_informational_target_machine(tcx.sess),
+                context_pool: None,
+            }
         }
     }
 
@@ -340,7 +453,7 @@ fn parse(
                 }
             };
 
-            Ok(ModuleLlvm { llmod_raw, llcx, tm })
+            Ok(ModuleLlvm { llmod_raw, llcx, tm, context_pool: None })
         }
     }
 
@@ -352,8 +465,13 @@ fn llmod(&self) -> &llvm::Module {
 impl Drop for ModuleLlvm {
     fn drop(&mut self) {
         unsafe {
-            llvm::LLVMContextDispose(&mut *(self.llcx as *mut _));
-            llvm::LLVMRustDisposeTargetMachine(&mut *(self.tm as *mut _));
+            match &self.context_pool {
+                Some(pool) => {
+                    llvm::LLVMDisposeModule(self.llmod());
+                    llvm::LLVMRustContextPoolRelease(&*pool.0, &mut *(self.llcx as *mut _));
+                }
+                None => llvm::LLVMContextDispose(&mut *(self.llcx as *mut _)),
+            }
         }
     }
 }
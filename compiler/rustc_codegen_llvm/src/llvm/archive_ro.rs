@@ -1,6 +1,7 @@
 //! A wrapper around LLVM's archive (.a) code
 
 use rustc_fs_util::path_to_c_string;
+use rustc_session::config::ArchiveReadMode;
 use std::path::Path;
 use std::slice;
 use std::str;
@@ -19,6 +20,23 @@ pub struct Child<'a> {
     pub raw: &'a mut super::ArchiveChild<'a>,
 }
 
+/// Iterates over the names and data of the children of an archive, which are read in batches
+/// of `CHILD_INFO_BATCH` without allocating anything for each child.
+pub struct ChildInfos<'a> {
+    iter: Iter<'a>,
+    batch: Vec<super::ArchiveChildInfo>,
+    pos: usize,
+    error: Option<String>,
+    done: bool,
+}
+
+pub struct ChildInfo<'a> {
+    pub name: Option<&'a str>,
+    pub data: &'a [u8],
+}
+
+const CHILD_INFO_BATCH: usize = 64;
+
 impl ArchiveRO {
     /// Opens a static archive for read-only purposes. This is more optimized
     /// than the `open` method because it uses LLVM's internal `Archive` class
@@ -36,9 +54,42 @@ pub fn open(dst: &Path) -> Result<ArchiveRO, String> {
         }
     }
 
+    /// Same as `open`, but reads the archive as given by `-Z archive-read-mode`, and with
+    /// `use_cache` only once per process, however often it's opened.
+    pub fn open_with_options(
+        dst: &Path,
+        mode: ArchiveReadMode,
+        use_cache: bool,
+    ) -> Result<ArchiveRO, String> {
+        let mode = match mode {
+            ArchiveReadMode::Default => super::ArchiveMapMode::Default,
+            ArchiveReadMode::Read => super::ArchiveMapMode::Read,
+            ArchiveReadMode::Mmap => super::ArchiveMapMode::Mmap,
+        };
+        unsafe {
+            let s = path_to_c_string(dst);
+            let ar = super::LLVMRustOpenArchiveWithOptions(s.as_ptr(), mode, use_cache)
+                .ok_or_else(|| {
+                    super::last_error().unwrap_or_else(|| "failed to open archive".to_owned())
+                })?;
+            Ok(ArchiveRO { raw: ar })
+        }
+    }
+
     pub fn iter(&self) -> Iter<'_> {
         unsafe { Iter { raw: super::LLVMRustArchiveIteratorNew(self.raw) } }
     }
+
+    /// Same as `iter`, for when only the names and data of the children are needed.
+    pub fn child_infos(&self) -> ChildInfos<'_> {
+        ChildInfos {
+            iter: self.iter(),
+            batch: Vec::with_capacity(CHILD_INFO_BATCH),
+            pos: 0,
+            error: None,
+            done: false,
+        }
+    }
 }
 
 impl Drop for ArchiveRO {
@@ -62,6 +113,48 @@ fn next(&mut self) -> Option<Result<Child<'a>, String>> {
     }
 }
 
+impl<'a> Iterator for ChildInfos<'a> {
+    type Item = Result<ChildInfo<'a>, String>;
+
+    fn next(&mut self) -> Option<Result<ChildInfo<'a>, String>> {
+        if self.pos == self.batch.len() {
+            if self.done {
+                return self.error.take().map(Err);
+            }
+            self.batch.clear();
+            self.pos = 0;
+            unsafe {
+                let mut num_read = 0;
+                let result = super::LLVMRustArchiveIteratorNextBatch(
+                    self.iter.raw,
+                    self.batch.as_mut_ptr(),
+                    self.batch.capacity(),
+                    &mut num_read,
+                );
+                self.batch.set_len(num_read);
+                if result.into_result().is_err() {
+                    self.error = Some(
+                        super::last_error().unwrap_or_else(|| "failed to read archive".to_owned()),
+                    );
+                    self.done = true;
+                } else if num_read < self.batch.capacity() {
+                    self.done = true;
+                }
+            }
+            if self.batch.is_empty() {
+                return self.error.take().map(Err);
+            }
+        }
+        let info = self.batch[self.pos];
+        self.pos += 1;
+        unsafe {
+            let name = slice::from_raw_parts(info.name as *const u8, info.name_len);
+            let data = slice::from_raw_parts(info.data as *const u8, info.data_len);
+            Some(Ok(ChildInfo { name: str::from_utf8(name).ok().map(|s| s.trim()), data }))
+        }
+    }
+}
+
 impl<'a> Drop for Iter<'a> {
     fn drop(&mut self) {
         unsafe {
@@ -166,3 +166,18 @@ pub unsafe fn unpack(di: &'ll DiagnosticInfo) -> Self {
         }
     }
 }
+
+/// Whether `di` is one of the diagnostics unpacked as `Diagnostic::Optimization`.
+pub unsafe fn is_optimization_remark(di: &DiagnosticInfo) -> bool {
+    use super::DiagnosticKind as Dk;
+    matches!(
+        super::LLVMRustGetDiagInfoKind(di),
+        Dk::OptimizationRemark
+            | Dk::OptimizationRemarkOther
+            | Dk::OptimizationRemarkMissed
+            | Dk::OptimizationRemarkAnalysis
+            | Dk::OptimizationRemarkAnalysisFPCommute
+            | Dk::OptimizationRemarkAnalysisAliasing
+            | Dk::OptimizationFailure
+    )
+}
@@ -5,9 +5,9 @@
 
 use super::debuginfo::{
     DIArray, DIBasicType, DIBuilder, DICompositeType, DIDerivedType, DIDescriptor, DIEnumerator,
-    DIFile, DIFlags, DIGlobalVariableExpression, DILexicalBlock, DILocation, DINameSpace,
-    DISPFlags, DIScope, DISubprogram, DISubrange, DITemplateTypeParameter, DIType, DIVariable,
-    DebugEmissionKind,
+    DIEnumeratorInfo, DIFile, DIFlags, DIGlobalVariableExpression, DILexicalBlock, DILocation,
+    DIMemberInfo, DINameSpace, DISPFlags, DIScope, DISubprogram, DISubrange,
+    DITemplateTypeParameter, DIType, DIVariable, DebugEmissionKind,
 };
 
 use libc::{c_char, c_int, c_uint, size_t};
@@ -34,11 +34,21 @@ pub enum LLVMRustResult {
 #[repr(C)]
 pub struct LLVMRustCOFFShortExport {
     pub name: *const c_char,
+    pub ordinal_present: bool,
+    // value of `ordinal` only important when `ordinal_present` is true
+    pub ordinal: u16,
+    // whether the symbol is a variable rather than a function
+    pub data: bool,
 }
 
 impl LLVMRustCOFFShortExport {
-    pub fn from_name(name: *const c_char) -> LLVMRustCOFFShortExport {
-        LLVMRustCOFFShortExport { name }
+    pub fn new(name: *const c_char, ordinal: Option<u16>, data: bool) -> LLVMRustCOFFShortExport {
+        LLVMRustCOFFShortExport {
+            name,
+            ordinal_present: ordinal.is_some(),
+            ordinal: ordinal.unwrap_or(0),
+            data,
+        }
     }
 }
 
@@ -161,6 +171,32 @@ pub enum Attribute {
     WillReturn = 29,
 }
 
+/// LLVMRustAttributeSpecKind
+#[derive(Copy, Clone, PartialEq, Debug)]
+#[repr(C)]
+pub enum AttributeSpecKind {
+    Enum,
+    Alignment,
+    Dereferenceable,
+    DereferenceableOrNull,
+    ByVal,
+    StructRet,
+}
+
+/// LLVMRustAttributeSpec
+///
+/// `attr` is only used by `Enum` attributes, `value` by the alignment and
+/// dereferenceable ones, and `ty` by `ByVal` and `StructRet`.
+#[derive(Copy, Clone)]
+#[repr(C)]
+pub struct AttributeSpec<'a> {
+    pub index: c_uint,
+    pub kind: AttributeSpecKind,
+    pub attr: Attribute,
+    pub value: u64,
+    pub ty: Option<&'a Type>,
+}
+
 /// LLVMIntPredicate
 #[derive(Copy, Clone)]
 #[repr(C)]
@@ -433,6 +469,139 @@ pub enum OptStage {
     FatLTO,
 }
 
+/// LLVMRustModuleMemoryStats
+#[derive(Copy, Clone, Default, Debug)]
+#[repr(C)]
+pub struct ModuleMemoryStats {
+    pub globals: u64,
+    pub basic_blocks: u64,
+    pub instructions: u64,
+    pub ir_bytes: u64,
+    pub metadata_nodes: u64,
+    pub metadata_bytes: u64,
+    pub constants: u64,
+    pub constant_bytes: u64,
+}
+
+/// LLVMRustColdDowngradeStats
+#[derive(Copy, Clone, Default, Debug)]
+#[repr(C)]
+pub struct ColdDowngradeStats {
+    pub min_size: u64,
+    pub opt_none: u64,
+}
+
+/// LLVMRustModuleCostInfo
+#[derive(Copy, Clone, Default, Debug)]
+#[repr(C)]
+pub struct ModuleCostInfo {
+    pub defined_functions: u64,
+    pub basic_blocks: u64,
+    pub instructions: u64,
+    pub loops: u64,
+    pub weighted_cost: u64,
+}
+
+/// LLVMRustBasicBlockSections
+#[derive(Copy, Clone, PartialEq)]
+#[repr(C)]
+pub enum BasicBlockSections {
+    None,
+    All,
+    List,
+    Labels,
+}
+
+/// LLVMRustMachineOutliner
+#[derive(Copy, Clone, PartialEq)]
+#[repr(C)]
+pub enum MachineOutliner {
+    Never,
+    TargetDefault,
+}
+
+/// LLVMRustPGOAction
+#[derive(Copy, Clone, PartialEq)]
+#[repr(C)]
+pub enum PGOAction {
+    None,
+    IRInstr,
+    IRUse,
+    SampleUse,
+}
+
+/// LLVMRustCSPGOAction
+#[derive(Copy, Clone, PartialEq)]
+#[repr(C)]
+pub enum CSPGOAction {
+    None,
+    CSIRInstr,
+    CSIRUse,
+}
+
+/// LLVMRustPGOOptions
+#[repr(C)]
+pub struct PGOOptions {
+    pub action: PGOAction,
+    pub cs_action: CSPGOAction,
+    pub profile_file: *const c_char,
+    pub cs_profile_gen_file: *const c_char,
+    pub profile_remapping_file: *const c_char,
+    pub debug_info_for_profiling: bool,
+}
+
+/// LLVMRustTuningOptionsVersion
+pub const TUNING_OPTIONS_VERSION: u32 = 2;
+
+/// LLVMRustTuningOptions
+#[repr(C)]
+pub struct TuningOptions {
+    pub version: u32,
+    pub inliner_threshold: c_int,
+    pub call_graph_profile: c_int,
+    pub forget_all_scev_in_loop_unroll: c_int,
+    pub licm_mssa_opt_cap: c_int,
+    pub licm_mssa_no_acc_for_promotion_cap: c_int,
+    pub verify_sample_rate: c_int,
+    pub verify_sample_min: c_int,
+}
+
+impl TuningOptions {
+    /// Options which keep all of LLVM's defaults.
+    pub fn new() -> Self {
+        TuningOptions {
+            version: TUNING_OPTIONS_VERSION,
+            inliner_threshold: -1,
+            call_graph_profile: -1,
+            forget_all_scev_in_loop_unroll: -1,
+            licm_mssa_opt_cap: -1,
+            licm_mssa_no_acc_for_promotion_cap: -1,
+            verify_sample_rate: -1,
+            verify_sample_min: -1,
+        }
+    }
+}
+
+/// LLVMRustSanitizerTuningOptionsVersion
+pub const SANITIZER_TUNING_OPTIONS_VERSION: u32 = 1;
+
+/// LLVMRustSanitizerTuningOptions
+#[repr(C)]
+pub struct SanitizerTuningOptions {
+    pub version: u32,
+    pub address_use_after_scope: c_int,
+}
+
+impl SanitizerTuningOptions {
+    /// Options which keep all of LLVM's defaults.
+    pub fn new() -> Self {
+        SanitizerTuningOptions {
+            version: SANITIZER_TUNING_OPTIONS_VERSION,
+            address_use_after_scope: -1,
+        }
+    }
+}
+
 /// LLVMRustSanitizerOptions
 #[repr(C)]
 pub struct SanitizerOptions {
@@ -444,6 +613,7 @@ pub struct SanitizerOptions {
     pub sanitize_thread: bool,
     pub sanitize_hwaddress: bool,
     pub sanitize_hwaddress_recover: bool,
+    pub tuning: *const SanitizerTuningOptions,
 }
 
 /// LLVMRelocMode
@@ -470,6 +640,15 @@ pub enum CodeModel {
     None,
 }
 
+/// LLVMRustDebugCompression
+#[derive(Copy, Clone)]
+#[repr(C)]
+pub enum DebugCompression {
+    None,
+    Zlib,
+    Zstd,
+}
+
 /// LLVMRustDiagnosticKind
 #[derive(Copy, Clone)]
 #[repr(C)]
@@ -513,6 +692,15 @@ pub enum ArchiveKind {
     K_COFF,
 }
 
+/// LLVMRustArchiveMapMode
+#[derive(Copy, Clone)]
+#[repr(C)]
+pub enum ArchiveMapMode {
+    Default,
+    Read,
+    Mmap,
+}
+
 /// LLVMRustPassKind
 #[derive(Copy, Clone, PartialEq, Debug)]
 #[repr(C)]
@@ -537,6 +725,19 @@ pub enum PassKind {
 pub type ThinLTOModuleNameCallback =
     unsafe extern "C" fn(*mut c_void, *const c_char, *const c_char);
 
+// LLVMRustThinLTOImportCostCallback
+pub type ThinLTOImportCostCallback =
+    unsafe extern "C" fn(*mut c_void, *const c_char, *const c_char, size_t, u64);
+pub type ThinLTOModuleCostCallback = unsafe extern "C" fn(*mut c_void, *const c_char, u64, u64);
+
+/// LLVMRustLTOCacheKeyHash
+#[derive(Copy, Clone, PartialEq)]
+#[repr(C)]
+pub enum LTOCacheKeyHash {
+    SHA1,
+    Fast,
+}
+
 /// LLVMRustThinLTOModule
 #[repr(C)]
 pub struct ThinLTOModule {
@@ -613,6 +814,9 @@ struct InvariantOpaque<'a> {
 extern "C" {
     pub type TargetMachine;
 }
+extern "C" {
+    pub type TargetMachineFactory;
+}
 extern "C" {
     pub type Archive;
 }
@@ -620,6 +824,16 @@ struct InvariantOpaque<'a> {
 pub struct ArchiveIterator<'a>(InvariantOpaque<'a>);
 #[repr(C)]
 pub struct ArchiveChild<'a>(InvariantOpaque<'a>);
+/// LLVMRustArchiveChildInfo
+#[derive(Copy, Clone)]
+#[repr(C)]
+pub struct ArchiveChildInfo {
+    pub name: *const c_char,
+    pub name_len: size_t,
+    pub data: *const c_char,
+    pub data_len: size_t,
+    pub offset: u64,
+}
 extern "C" {
     pub type Twine;
 }
@@ -793,11 +1007,27 @@ impl CounterMappingRegion {
             }
         }
     }
+
+    /// LLVMRustCoverageFunctionMapping
+    ///
+    /// The arguments of one `LLVMRustCoverageWriteMappingToBuffer` call, for
+    /// `LLVMRustCoverageWriteMappingsToBuffer`.
+    #[derive(Copy, Clone, Debug)]
+    #[repr(C)]
+    pub struct FunctionMapping {
+        pub virtual_file_mapping_ids: *const u32,
+        pub num_virtual_file_mapping_ids: u32,
+        pub expressions: *const coverage_map::CounterExpression,
+        pub num_expressions: u32,
+        pub mapping_regions: *const CounterMappingRegion,
+        pub num_mapping_regions: u32,
+    }
 }
 
 pub mod debuginfo {
-    use super::{InvariantOpaque, Metadata};
+    use super::{InvariantOpaque, Metadata, Value};
     use bitflags::bitflags;
+    use libc::{c_char, c_uint, size_t};
 
     #[repr(C)]
     pub struct DIBuilder<'a>(InvariantOpaque<'a>);
@@ -864,6 +1094,32 @@ pub struct DISPFlags: u32 {
         }
     }
 
+    /// LLVMRustDIMemberInfo
+    #[derive(Copy, Clone)]
+    #[repr(C)]
+    pub struct DIMemberInfo<'a> {
+        pub name: *const c_char,
+        pub name_len: size_t,
+        pub file: &'a DIFile,
+        pub line_no: c_uint,
+        pub size_in_bits: u64,
+        pub align_in_bits: u32,
+        pub offset_in_bits: u64,
+        pub discriminant: Option<&'a Value>,
+        pub flags: DIFlags,
+        pub ty: &'a DIType,
+    }
+
+    /// LLVMRustDIEnumeratorInfo
+    #[derive(Copy, Clone)]
+    #[repr(C)]
+    pub struct DIEnumeratorInfo {
+        pub name: *const c_char,
+        pub name_len: size_t,
+        pub value: i64,
+        pub is_unsigned: bool,
+    }
+
     /// LLVMRustDebugEmissionKind
     #[derive(Copy, Clone)]
     #[repr(C)]
@@ -889,8 +1145,27 @@ pub fn from_generic(kind: rustc_session::config::DebugInfo) -> Self {
     pub type ModuleBuffer;
 }
 
+extern "C" {
+    pub type StatisticsSnapshot;
+    pub type PassStatistics;
+}
+
+extern "C" {
+    pub type RemarkFile;
+}
+
+extern "C" {
+    pub type CallGraphProfile;
+}
+
+extern "C" {
+    pub type ContextPool;
+}
+
+pub type SelfProfileRegisterPassCallback =
+    unsafe extern "C" fn(*mut c_void, u32, *const c_char, size_t);
 pub type SelfProfileBeforePassCallback =
-    unsafe extern "C" fn(*mut c_void, *const c_char, *const c_char);
+    unsafe extern "C" fn(*mut c_void, u32, *const c_char, size_t);
 pub type SelfProfileAfterPassCallback = unsafe extern "C" fn(*mut c_void);
 
 extern "C" {
@@ -899,11 +1174,30 @@ pub fn from_generic(kind: rustc_session::config::DebugInfo) -> Self {
     // Create and destroy contexts.
     pub fn LLVMRustContextCreate(shouldDiscardNames: bool) -> &'static mut Context;
     pub fn LLVMContextDispose(C: &'static mut Context);
+    pub fn LLVMRustCreateContextPool(
+        MaxUses: c_uint,
+        MaxContexts: size_t,
+    ) -> &'static mut ContextPool;
+    pub fn LLVMRustContextPoolAcquire(
+        Pool: &ContextPool,
+        shouldDiscardNames: bool,
+    ) -> &'static mut Context;
+    pub fn LLVMRustContextPoolRelease(Pool: &ContextPool, C: &'static mut Context);
+    pub fn LLVMRustFreeContextPool(Pool: &'static mut ContextPool);
+    pub fn LLVMRustContextSetupRemarks(
+        C: &Context,
+        Path: *const c_char,
+        Passes: *const c_char,
+        Format: *const c_char,
+        WithHotness: bool,
+    ) -> Option<&'static mut RemarkFile>;
+    pub fn LLVMRustContextFinishRemarks(C: &Context, File: Option<&'static mut RemarkFile>);
     pub fn LLVMGetMDKindIDInContext(C: &Context, Name: *const c_char, SLen: c_uint) -> c_uint;
 
     // Create modules.
     pub fn LLVMModuleCreateWithNameInContext(ModuleID: *const c_char, C: &Context) -> &Module;
     pub fn LLVMGetModuleContext(M: &Module) -> &Context;
+    pub fn LLVMDisposeModule(M: &Module);
     pub fn LLVMCloneModule(M: &Module) -> &Module;
 
     /// Data layout. See Module::getDataLayout.
@@ -1088,6 +1382,11 @@ pub fn LLVMRustAddFunctionAttrStringValue(
         Value: *const c_char,
     );
     pub fn LLVMRustRemoveFunctionAttributes(Fn: &Value, index: c_uint, attr: Attribute);
+    pub fn LLVMRustAddFunctionAttributes(
+        Fn: &'a Value,
+        Specs: *const AttributeSpec<'a>,
+        NumSpecs: size_t,
+    );
 
     // Operations on parameters
     pub fn LLVMIsAArgument(Val: &Value) -> Option<&Value>;
@@ -1115,6 +1414,11 @@ pub fn LLVMAppendBasicBlockInContext(
     pub fn LLVMRustAddDereferenceableOrNullCallSiteAttr(Instr: &Value, index: c_uint, bytes: u64);
     pub fn LLVMRustAddByValCallSiteAttr(Instr: &Value, index: c_uint, ty: &Type);
     pub fn LLVMRustAddStructRetCallSiteAttr(Instr: &Value, index: c_uint, ty: &Type);
+    pub fn LLVMRustAddCallSiteAttributes(
+        Instr: &'a Value,
+        Specs: *const AttributeSpec<'a>,
+        NumSpecs: size_t,
+    );
 
     // Operations on load/store instructions (only)
     pub fn LLVMSetVolatile(MemoryAccessInst: &Value, volatile: Bool);
@@ -1629,6 +1933,51 @@ pub fn LLVMRustBuildVectorReduceFMin(B: &Builder<'a>, Src: &'a Value, IsNaN: boo
     -> &'a Value;
     pub fn LLVMRustBuildVectorReduceFMax(B: &Builder<'a>, Src: &'a Value, IsNaN: bool)
     -> &'a Value;
+    pub fn LLVMRustBuildVectorReduceFAddUnordered(
+        B: &Builder<'a>,
+        Acc: &'a Value,
+        Src: &'a Value,
+    ) -> &'a Value;
+    pub fn LLVMRustBuildVectorReduceFMulUnordered(
+        B: &Builder<'a>,
+        Acc: &'a Value,
+        Src: &'a Value,
+    ) -> &'a Value;
+
+    pub fn LLVMRustBuildMaskedGather(
+        B: &Builder<'a>,
+        Ty: &'a Type,
+        Ptrs: &'a Value,
+        Align: c_uint,
+        Mask: &'a Value,
+        PassThru: &'a Value,
+    ) -> &'a Value;
+    pub fn LLVMRustBuildMaskedScatter(
+        B: &Builder<'a>,
+        Val: &'a Value,
+        Ptrs: &'a Value,
+        Align: c_uint,
+        Mask: &'a Value,
+    ) -> &'a Value;
+    pub fn LLVMRustBuildFunnelShift(
+        B: &Builder<'a>,
+        Hi: &'a Value,
+        Lo: &'a Value,
+        Amt: &'a Value,
+        Right: bool,
+    ) -> &'a Value;
+    pub fn LLVMRustBuildSaturatingAdd(
+        B: &Builder<'a>,
+        LHS: &'a Value,
+        RHS: &'a Value,
+        IsSigned: bool,
+    ) -> &'a Value;
+    pub fn LLVMRustBuildSaturatingSub(
+        B: &Builder<'a>,
+        LHS: &'a Value,
+        RHS: &'a Value,
+        IsSigned: bool,
+    ) -> &'a Value;
 
     pub fn LLVMRustBuildMinNum(B: &Builder<'a>, LHS: &'a Value, LHS: &'a Value) -> &'a Value;
     pub fn LLVMRustBuildMaxNum(B: &Builder<'a>, LHS: &'a Value, LHS: &'a Value) -> &'a Value;
@@ -1693,6 +2042,10 @@ pub fn LLVMRustBuildAtomicFence(
 
     pub fn LLVMTimeTraceProfilerInitialize();
 
+    pub fn LLVMTimeTraceProfilerInitializeThread();
+
+    pub fn LLVMTimeTraceProfilerFinishThread();
+
     pub fn LLVMTimeTraceProfilerFinish(FileName: *const c_char);
 
     pub fn LLVMAddAnalysisPasses(T: &'a TargetMachine, PM: &PassManager<'a>);
@@ -1781,10 +2134,24 @@ pub fn LLVMRustCoverageWriteMappingToBuffer(
         BufferOut: &RustString,
     );
 
+    #[allow(improper_ctypes)]
+    pub fn LLVMRustCoverageWriteMappingsToBuffer(
+        Functions: *const coverageinfo::FunctionMapping,
+        NumFunctions: size_t,
+        Offsets: *mut size_t,
+        BufferOut: &RustString,
+    );
+
     pub fn LLVMRustCoverageCreatePGOFuncNameVar(F: &'a Value, FuncName: *const c_char)
     -> &'a Value;
     pub fn LLVMRustCoverageHashCString(StrVal: *const c_char) -> u64;
     pub fn LLVMRustCoverageHashByteArray(Bytes: *const c_char, NumBytes: size_t) -> u64;
+    pub fn LLVMRustCoverageHashByteArrays(
+        Bytes: *const *const c_char,
+        NumBytes: *const size_t,
+        Num: size_t,
+        HashesOut: *mut u64,
+    );
 
     #[allow(improper_ctypes)]
     pub fn LLVMRustCoverageWriteMapSectionNameToString(M: &Module, Str: &RustString);
@@ -2090,6 +2457,31 @@ pub fn LLVMRustDICompositeTypeReplaceArrays(
         Params: Option<&'a DIArray>,
     );
 
+    pub fn LLVMRustDICompositeTypeReplaceMembers(
+        Builder: &DIBuilder<'a>,
+        CompositeType: &'a DIType,
+        Members: *const DIMemberInfo<'a>,
+        NumMembers: size_t,
+        ExtraElements: *const Option<&'a DIDescriptor>,
+        NumExtraElements: size_t,
+        Params: Option<&'a DIArray>,
+    );
+
+    pub fn LLVMRustDIBuilderCreateEnumerationTypeWithEnumerators(
+        Builder: &DIBuilder<'a>,
+        Scope: &'a DIScope,
+        Name: *const c_char,
+        NameLen: size_t,
+        File: &'a DIFile,
+        LineNumber: c_uint,
+        SizeInBits: u64,
+        AlignInBits: u32,
+        Enumerators: *const DIEnumeratorInfo,
+        NumEnumerators: size_t,
+        ClassType: &'a DIType,
+        IsScoped: bool,
+    ) -> &'a DIType;
+
     pub fn LLVMRustDIBuilderCreateDebugLocation(
         Line: c_uint,
         Column: c_uint,
@@ -2108,7 +2500,10 @@ pub fn LLVMRustDIBuilderCreateDebugLocation(
 
     pub fn LLVMRustPassKind(Pass: &Pass) -> PassKind;
     pub fn LLVMRustFindAndCreatePass(Pass: *const c_char) -> Option<&'static mut Pass>;
-    pub fn LLVMRustCreateAddressSanitizerFunctionPass(Recover: bool) -> &'static mut Pass;
+    pub fn LLVMRustCreateAddressSanitizerFunctionPass(
+        Recover: bool,
+        UseAfterScope: bool,
+    ) -> &'static mut Pass;
     pub fn LLVMRustCreateModuleAddressSanitizerPass(Recover: bool) -> &'static mut Pass;
     pub fn LLVMRustCreateMemorySanitizerPass(
         TrackOrigins: c_int,
@@ -2133,9 +2528,12 @@ pub fn LLVMRustGetTargetFeature(
         Feature: &mut *const c_char,
         Desc: &mut *const c_char,
     );
+    pub fn LLVMRustGetTargetFeatures(T: &TargetMachine, Str: &RustString) -> bool;
 
     pub fn LLVMRustGetHostCPUName(len: *mut usize) -> *const c_char;
-    pub fn LLVMRustCreateTargetMachine(
+    pub fn LLVMRustGetHostCPUFeatures(Str: &RustString) -> bool;
+    pub fn LLVMRustDisposeTargetMachine(T: &'static mut TargetMachine);
+    pub fn LLVMRustCreateTargetMachineFactory(
         Triple: *const c_char,
         CPU: *const c_char,
         Features: *const c_char,
@@ -2152,9 +2550,27 @@ pub fn LLVMRustCreateTargetMachine(
         EmitStackSizeSection: bool,
         RelaxELFRelocations: bool,
         UseInitArray: bool,
+        DebugCompression: DebugCompression,
+    ) -> Option<&'static mut TargetMachineFactory>;
+    pub fn LLVMRustFreeTargetMachineFactory(F: &'static mut TargetMachineFactory);
+    pub fn LLVMRustCreateTargetMachineFromFactory(
+        F: &TargetMachineFactory,
         SplitDwarfFile: *const c_char,
     ) -> Option<&'static mut TargetMachine>;
-    pub fn LLVMRustDisposeTargetMachine(T: &'static mut TargetMachine);
+    pub fn LLVMRustReleaseTargetMachineToFactory(
+        F: &TargetMachineFactory,
+        T: &'static mut TargetMachine,
+    );
+    pub fn LLVMRustTargetMachineFactorySetCodeLayoutOptions(
+        F: &TargetMachineFactory,
+        SplitMachineFunctions: bool,
+        Sections: BasicBlockSections,
+        ClusterFile: *const c_char,
+    ) -> bool;
+    pub fn LLVMRustTargetMachineFactorySetMachineOutliner(
+        F: &TargetMachineFactory,
+        Mode: MachineOutliner,
+    );
     pub fn LLVMRustAddBuilderLibraryInfo(
         PMB: &'a PassManagerBuilder,
         M: &'a Module,
@@ -2170,6 +2586,10 @@ pub fn LLVMRustConfigurePassManagerBuilder(
         PGOGenPath: *const c_char,
         PGOUsePath: *const c_char,
     );
+    pub fn LLVMRustConfigurePassManagerBuilderPGO(
+        PMB: &PassManagerBuilder,
+        Opts: &PGOOptions,
+    );
     pub fn LLVMRustAddLibraryInfo(
         PM: &PassManager<'a>,
         M: &'a Module,
@@ -2184,6 +2604,45 @@ pub fn LLVMRustWriteOutputFile(
         DwoOutput: *const c_char,
         FileType: FileType,
     ) -> LLVMRustResult;
+    pub fn LLVMRustTargetMachineCanAssemble(T: &TargetMachine) -> bool;
+    pub fn LLVMRustTargetMachineCanEmbedBitcode(T: &TargetMachine) -> bool;
+    pub fn LLVMRustWriteOutputFileWithEmbeddedBitcode(
+        T: &'a TargetMachine,
+        PM: &PassManager<'a>,
+        M: &'a Module,
+        Output: *const c_char,
+        DwoOutput: *const c_char,
+        FileType: FileType,
+        Bitcode: *const c_char,
+        BitcodeLen: size_t,
+        Cmdline: *const c_char,
+        CmdlineLen: size_t,
+    ) -> LLVMRustResult;
+    pub fn LLVMRustWriteAssemblyAndObjectFile(
+        T: &'a TargetMachine,
+        PM: &PassManager<'a>,
+        M: &'a Module,
+        AsmOutput: *const c_char,
+        ObjOutput: *const c_char,
+    ) -> LLVMRustResult;
+    pub fn LLVMRustCreateCallGraphProfile() -> &'static mut CallGraphProfile;
+    pub fn LLVMRustFreeCallGraphProfile(Profile: &'static mut CallGraphProfile);
+    pub fn LLVMRustCallGraphProfileAddModule(Profile: &CallGraphProfile, M: &'a Module);
+    pub fn LLVMRustCallGraphProfileWriteOrderingFile(
+        Profile: &CallGraphProfile,
+        Path: *const c_char,
+    ) -> LLVMRustResult;
+    pub fn LLVMRustDowngradeColdFunctions(M: &Module, Stats: &mut ColdDowngradeStats);
+    pub fn LLVMRustContextEnableMissedRemarkSummary(C: &Context, Forward: bool);
+    pub fn LLVMRustContextFinishMissedRemarkSummary(
+        C: &Context,
+        MaxLocations: size_t,
+        Str: &RustString,
+    );
+    pub fn LLVMRustStatisticsBegin() -> &'static mut StatisticsSnapshot;
+    pub fn LLVMRustStatisticsEnd(Snapshot: &'static mut StatisticsSnapshot, Str: &RustString);
+    pub fn LLVMRustCreatePassStatistics() -> &'static mut PassStatistics;
+    pub fn LLVMRustPassStatisticsEnd(Stats: &'static mut PassStatistics, Str: &RustString);
     pub fn LLVMRustOptimizeWithNewPassManager(
         M: &'a Module,
         TM: &'a TargetMachine,
@@ -2201,13 +2660,18 @@ pub fn LLVMRustOptimizeWithNewPassManager(
         SanitizerOptions: Option<&SanitizerOptions>,
         PGOGenPath: *const c_char,
         PGOUsePath: *const c_char,
+        PGOOpts: Option<&PGOOptions>,
+        TuningOpts: Option<&TuningOptions>,
         InstrumentCoverage: bool,
         InstrumentGCOV: bool,
         llvm_selfprofiler: *mut c_void,
+        register_callback: SelfProfileRegisterPassCallback,
         begin_callback: SelfProfileBeforePassCallback,
         end_callback: SelfProfileAfterPassCallback,
+        PassStatistics: Option<&PassStatistics>,
         ExtraPasses: *const c_char,
         ExtraPassesLen: size_t,
+        ThinLTOData: Option<&ThinLTOData>,
     ) -> LLVMRustResult;
     pub fn LLVMRustPrintModule(
         M: &'a Module,
@@ -2220,13 +2684,25 @@ pub fn LLVMRustPrintModule(
     pub fn LLVMRustSetNormalizedTarget(M: &Module, triple: *const c_char);
     pub fn LLVMRustAddAlwaysInlinePass(P: &PassManagerBuilder, AddLifetimes: bool);
     pub fn LLVMRustRunRestrictionPass(M: &Module, syms: *const *const c_char, len: size_t);
-    pub fn LLVMRustMarkAllFunctionsNounwind(M: &Module);
+    pub fn LLVMRustMarkAllFunctionsNounwind(M: &Module) -> size_t;
 
     pub fn LLVMRustOpenArchive(path: *const c_char) -> Option<&'static mut Archive>;
+    pub fn LLVMRustOpenArchiveWithOptions(
+        path: *const c_char,
+        Mode: ArchiveMapMode,
+        UseCache: bool,
+    ) -> Option<&'static mut Archive>;
+    pub fn LLVMRustClearArchiveCache();
     pub fn LLVMRustArchiveIteratorNew(AR: &'a Archive) -> &'a mut ArchiveIterator<'a>;
     pub fn LLVMRustArchiveIteratorNext(
         AIR: &ArchiveIterator<'a>,
     ) -> Option<&'a mut ArchiveChild<'a>>;
+    pub fn LLVMRustArchiveIteratorNextBatch(
+        AIR: &ArchiveIterator<'a>,
+        Children: *mut ArchiveChildInfo,
+        Capacity: size_t,
+        NumRead: &mut size_t,
+    ) -> LLVMRustResult;
     pub fn LLVMRustArchiveChildName(ACR: &ArchiveChild<'_>, size: &mut size_t) -> *const c_char;
     pub fn LLVMRustArchiveChildData(ACR: &ArchiveChild<'_>, size: &mut size_t) -> *const c_char;
     pub fn LLVMRustArchiveChildFree(ACR: &'a mut ArchiveChild<'a>);
@@ -2289,6 +2765,15 @@ pub fn LLVMRustWriteArchive(
         WriteSymbtab: bool,
         Kind: ArchiveKind,
     ) -> LLVMRustResult;
+    pub fn LLVMRustWriteArchiveParallel(
+        Dst: *const c_char,
+        NumMembers: size_t,
+        Members: *const &RustArchiveMember<'_>,
+        WriteSymbtab: bool,
+        Kind: ArchiveKind,
+        NumThreads: c_uint,
+        ReuseSymbols: bool,
+    ) -> LLVMRustResult;
     pub fn LLVMRustArchiveMemberNew(
         Filename: *const c_char,
         Name: *const c_char,
@@ -2322,12 +2807,18 @@ pub fn LLVMRustBuildOperandBundleDef(
     pub fn LLVMRustSetModulePIELevel(M: &Module);
     pub fn LLVMRustSetModuleCodeModel(M: &Module, Model: CodeModel);
     pub fn LLVMRustModuleBufferCreate(M: &Module) -> &'static mut ModuleBuffer;
+    pub fn LLVMRustModuleBufferRefill(p: &mut ModuleBuffer, M: &Module);
     pub fn LLVMRustModuleBufferPtr(p: &ModuleBuffer) -> *const u8;
     pub fn LLVMRustModuleBufferLen(p: &ModuleBuffer) -> usize;
     pub fn LLVMRustModuleBufferFree(p: &'static mut ModuleBuffer);
     pub fn LLVMRustModuleCost(M: &Module) -> u64;
+    pub fn LLVMRustModuleGetCost(M: &Module, Cost: &mut ModuleCostInfo);
+    pub fn LLVMRustModuleGetMemoryStats(M: &Module, Stats: &mut ModuleMemoryStats);
+    pub fn LLVMRustGetMallocUsage() -> size_t;
 
     pub fn LLVMRustThinLTOBufferCreate(M: &Module) -> &'static mut ThinLTOBuffer;
+    pub fn LLVMRustThinLTOBufferCreateSplit(M: &Module) -> &'static mut ThinLTOBuffer;
+    pub fn LLVMRustThinLTOBufferWriteToFile(M: &Module, Path: *const c_char) -> LLVMRustResult;
     pub fn LLVMRustThinLTOBufferFree(M: &'static mut ThinLTOBuffer);
     pub fn LLVMRustThinLTOBufferPtr(M: &ThinLTOBuffer) -> *const c_char;
     pub fn LLVMRustThinLTOBufferLen(M: &ThinLTOBuffer) -> size_t;
@@ -2337,6 +2828,30 @@ pub fn LLVMRustCreateThinLTOData(
         PreservedSymbols: *const *const c_char,
         PreservedSymbolsLen: c_uint,
     ) -> Option<&'static mut ThinLTOData>;
+    pub fn LLVMRustCreateThinLTODataParallel(
+        Modules: *const ThinLTOModule,
+        NumModules: c_uint,
+        PreservedSymbols: *const *const c_char,
+        PreservedSymbolsLen: c_uint,
+        NumThreads: c_uint,
+    ) -> Option<&'static mut ThinLTOData>;
+    pub fn LLVMRustCreateThinLTODataWithOptions(
+        Modules: *const ThinLTOModule,
+        NumModules: c_uint,
+        PreservedSymbols: *const *const c_char,
+        PreservedSymbolsLen: c_uint,
+        NumThreads: c_uint,
+        WholeProgramDevirt: bool,
+    ) -> Option<&'static mut ThinLTOData>;
+    pub fn LLVMRustCreateThinLTODataCached(
+        Modules: *const ThinLTOModule,
+        NumModules: c_uint,
+        PreservedSymbols: *const *const c_char,
+        PreservedSymbolsLen: c_uint,
+        NumThreads: c_uint,
+        CachePath: *const c_char,
+        CacheHit: &mut bool,
+    ) -> Option<&'static mut ThinLTOData>;
     pub fn LLVMRustPrepareThinLTORename(
         Data: &ThinLTOData,
         Module: &Module,
@@ -2354,7 +2869,24 @@ pub fn LLVMRustGetThinLTOModuleImports(
         ModuleNameCallback: ThinLTOModuleNameCallback,
         CallbackPayload: *mut c_void,
     );
+    pub fn LLVMRustGetThinLTOImportCosts(
+        Data: *const ThinLTOData,
+        ImportCostCallback: ThinLTOImportCostCallback,
+        CallbackPayload: *mut c_void,
+    );
+    pub fn LLVMRustGetThinLTOModuleCosts(
+        Data: *const ThinLTOData,
+        ModuleCostCallback: ThinLTOModuleCostCallback,
+        CallbackPayload: *mut c_void,
+    );
+    pub fn LLVMRustThinLTOApplyImportBudget(Data: &mut ThinLTOData, MaxInstrs: u64);
     pub fn LLVMRustFreeThinLTOData(Data: &'static mut ThinLTOData);
+    pub fn LLVMRustThinLTOWriteIndexFiles(
+        Data: &ThinLTOData,
+        ModId: *const c_char,
+        IndexPath: *const c_char,
+        ImportsPath: *const c_char,
+    ) -> LLVMRustResult;
     pub fn LLVMRustParseBitcodeForLTO(
         Context: &Context,
         Data: *const u8,
@@ -2366,19 +2898,36 @@ pub fn LLVMRustGetBitcodeSliceFromObjectData(
         len: usize,
         out_len: &mut usize,
     ) -> *const u8;
+    pub fn LLVMRustGetBitcodeSliceFromObjectDataFast(
+        Data: *const u8,
+        len: usize,
+        out_len: &mut usize,
+    ) -> *const u8;
     pub fn LLVMRustThinLTOGetDICompileUnit(
         M: &Module,
         CU1: &mut *mut c_void,
         CU2: &mut *mut c_void,
     );
     pub fn LLVMRustThinLTOPatchDICompileUnit(M: &Module, CU: *mut c_void);
+    pub fn LLVMRustThinLTOPatchDICompileUnitFast(
+        M: &Module,
+        CU: *mut c_void,
+        NumThreads: c_uint,
+    ) -> size_t;
 
     pub fn LLVMRustLinkerNew(M: &'a Module) -> &'a mut Linker<'a>;
-    pub fn LLVMRustLinkerAdd(
+    pub fn LLVMRustLinkerAddBorrowed(
         linker: &Linker<'_>,
         bytecode: *const c_char,
         bytecode_len: usize,
     ) -> bool;
+    pub fn LLVMRustLinkerAddBatch(
+        linker: &Linker<'_>,
+        bytecodes: *const *const c_char,
+        bytecode_lens: *const usize,
+        num_bytecodes: usize,
+        num_threads: c_uint,
+    ) -> bool;
     pub fn LLVMRustLinkerFree(linker: &'a mut Linker<'a>);
     #[allow(improper_ctypes)]
     pub fn LLVMRustComputeLTOCacheKey(
@@ -2386,4 +2935,14 @@ pub fn LLVMRustComputeLTOCacheKey(
         mod_id: *const c_char,
         data: &ThinLTOData,
     );
+    #[allow(improper_ctypes)]
+    pub fn LLVMRustComputeLTOCacheKeys(
+        keys_out: &RustString,
+        offsets: *mut size_t,
+        mod_ids: *const *const c_char,
+        num_modules: size_t,
+        data: &ThinLTOData,
+        hash: LTOCacheKeyHash,
+        num_threads: c_uint,
+    );
 }
@@ -150,6 +150,49 @@ pub fn toggle_llfn(&self, idx: AttributePlace, llfn: &Value, set: bool) {
     }
 }
 
+impl AttributeSpec<'a> {
+    pub fn enum_attr(idx: AttributePlace, attr: Attribute) -> Self {
+        AttributeSpec {
+            index: idx.as_uint(),
+            kind: AttributeSpecKind::Enum,
+            attr,
+            value: 0,
+            ty: None,
+        }
+    }
+
+    /// An alignment or dereferenceable attribute of `value` bytes.
+    pub fn int_attr(idx: AttributePlace, kind: AttributeSpecKind, value: u64) -> Self {
+        // `attr` is ignored for everything but `Enum`.
+        AttributeSpec { index: idx.as_uint(), kind, attr: Attribute::AlwaysInline, value, ty: None }
+    }
+
+    /// A `ByVal` or `StructRet` attribute of type `ty`.
+    pub fn type_attr(idx: AttributePlace, kind: AttributeSpecKind, ty: &'a Type) -> Self {
+        AttributeSpec {
+            index: idx.as_uint(),
+            kind,
+            attr: Attribute::AlwaysInline,
+            value: 0,
+            ty: Some(ty),
+        }
+    }
+}
+
+/// Adds all of `specs` to `llfn` at once.
+pub fn add_function_attributes(llfn: &'a Value, specs: &[AttributeSpec<'a>]) {
+    if !specs.is_empty() {
+        unsafe { LLVMRustAddFunctionAttributes(llfn, specs.as_ptr(), specs.len()) }
+    }
+}
+
+/// Adds all of `specs` to `callsite` at once.
+pub fn add_callsite_attributes(callsite: &'a Value, specs: &[AttributeSpec<'a>]) {
+    if !specs.is_empty() {
+        unsafe { LLVMRustAddCallSiteAttributes(callsite, specs.as_ptr(), specs.len()) }
+    }
+}
+
 pub fn set_section(llglobal: &Value, section_name: &str) {
     let section_name_cstr = CString::new(section_name).expect("unexpected CString error");
     unsafe {
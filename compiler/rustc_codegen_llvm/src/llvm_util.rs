@@ -99,6 +99,57 @@ fn llvm_arg_to_arg_name(full_arg: &str) -> &str {
             add("-enable-machine-outliner=never", false);
         }
 
+        // The instrumentation lowering added by the pass builders for `-C profile-generate` has
+        // no options of its own which could be set, so the profile counters are configured for
+        // it and for `-Z instrument-coverage` alike through LLVM's command-line options.
+        if sess.opts.debugging_opts.profile_counter_atomic {
+            add("-instrprof-atomic-counter-update-all", false);
+        }
+        if let Some(promote) = sess.opts.debugging_opts.profile_counter_promotion {
+            let arg =
+                if promote { "-do-counter-promotion=true" } else { "-do-counter-promotion=false" };
+            add(arg, false);
+        }
+        if sess.opts.debugging_opts.profile_counter_relocation {
+            if llvm_util::get_version() >= (11, 0, 0) {
+                add("-runtime-counter-relocation", false);
+            } else {
+                sess.warn("`-Z profile-counter-relocation` requires LLVM 11 or later, ignoring it");
+            }
+        }
+
+        // Unlike use-after-scope detection, which is a parameter of the AddressSanitizer pass,
+        // these sanitizer knobs are only available as LLVM's command-line options.
+        if let Some(globals) = sess.opts.debugging_opts.sanitizer_address_globals {
+            add(if globals { "-asan-globals=true" } else { "-asan-globals=false" }, false);
+        }
+        if let Some(use_after_return) = sess.opts.debugging_opts.sanitizer_address_use_after_return
+        {
+            // Since LLVM 13 the option selects a mode rather than being a flag, where `runtime`
+            // is the former `true`: fake stacks are used if `detect_stack_use_after_return` is
+            // set when the program runs.
+            let arg = if llvm_util::get_version() >= (13, 0, 0) {
+                if use_after_return {
+                    "-asan-use-after-return=runtime"
+                } else {
+                    "-asan-use-after-return=never"
+                }
+            } else if use_after_return {
+                "-asan-use-after-return=true"
+            } else {
+                "-asan-use-after-return=false"
+            };
+            add(arg, false);
+        }
+        if let Some(threshold) = sess.opts.debugging_opts.sanitizer_instrument_with_calls_threshold
+        {
+            add(&format!("-asan-instrumentation-with-call-threshold={}", threshold), false);
+            add(&format!("-msan-instrumentation-with-call-threshold={}", threshold), false);
+            if threshold == 0 {
+                add("-hwasan-instrument-with-calls", false);
+            }
+        }
+
         match sess.opts.debugging_opts.merge_functions.unwrap_or(sess.target.merge_functions) {
             MergeFunctions::Disabled | MergeFunctions::Trampolines => {}
             MergeFunctions::Aliases => {
@@ -123,15 +174,24 @@ fn llvm_arg_to_arg_name(full_arg: &str) -> &str {
     }
 
     if sess.opts.debugging_opts.llvm_time_trace {
-        // time-trace is not thread safe and running it in parallel will cause seg faults.
-        if !sess.opts.debugging_opts.no_parallel_llvm {
-            bug!("`-Z llvm-time-trace` requires `-Z no-parallel-llvm")
+        // Before LLVM 11, there's a single time-trace profiler, which isn't thread safe, and
+        // running it in parallel will cause seg faults.
+        if get_version() < (11, 0, 0) && !sess.opts.debugging_opts.no_parallel_llvm {
+            bug!("`-Z llvm-time-trace` requires `-Z no-parallel-llvm` before LLVM 11")
         }
 
         llvm::LLVMTimeTraceProfilerInitialize();
     }
 
-    llvm::LLVMInitializePasses();
+    // The legacy pass registry is otherwise only populated once a legacy pass manager is
+    // used, see `init_passes`. Options naming legacy passes, and plugins registering
+    // their own, need it before they're parsed or loaded.
+    if !user_specified_args.is_empty()
+        || sess.print_llvm_passes()
+        || !sess.opts.debugging_opts.llvm_plugins.is_empty()
+    {
+        llvm::LLVMInitializePasses();
+    }
 
     for plugin in &sess.opts.debugging_opts.llvm_plugins {
         let path = Path::new(plugin);
@@ -143,11 +203,62 @@ fn llvm_arg_to_arg_name(full_arg: &str) -> &str {
         mem::forget(res);
     }
 
-    rustc_llvm::initialize_available_targets();
+    // Most sessions only generate code for their own target, so only that one is
+    // initialized unless it's not known which LLVM component it belongs to.
+    let initialized = match llvm_component(&sess.target.arch) {
+        Some(component) => rustc_llvm::initialize_target(component),
+        None => false,
+    };
+    if !initialized {
+        rustc_llvm::initialize_available_targets();
+    }
 
     llvm::LLVMRustSetLLVMOptions(llvm_args.len() as c_int, llvm_args.as_ptr());
 }
 
+/// The LLVM component which contains the backend for the target architecture `arch`.
+fn llvm_component(arch: &str) -> Option<&'static str> {
+    Some(match arch {
+        "x86" | "x86_64" => "x86",
+        "arm" => "arm",
+        "aarch64" => "aarch64",
+        "amdgpu" => "amdgpu",
+        "avr" => "avr",
+        "mips" | "mips64" => "mips",
+        "powerpc" | "powerpc64" => "powerpc",
+        "s390x" => "systemz",
+        "msp430" => "msp430",
+        "riscv32" | "riscv64" => "riscv",
+        "sparc" | "sparc64" | "sparcv9" => "sparc",
+        "nvptx" | "nvptx64" => "nvptx",
+        "hexagon" => "hexagon",
+        "wasm32" | "wasm64" => "webassembly",
+        "bpf" => "bpf",
+        _ => return None,
+    })
+}
+
+/// Populates LLVM's legacy pass registry, which has to be done before a legacy pass manager
+/// is used. This is cheap after the first call.
+pub(crate) fn init_passes() {
+    unsafe {
+        llvm::LLVMInitializePasses();
+    }
+}
+
+/// Runs `f` on a thread doing LLVM work, with the time-trace profiler of the thread set up
+/// if `time_trace`. Its trace is merged into the one written by `time_trace_profiler_finish`.
+pub(crate) fn with_time_trace_profiler<T>(time_trace: bool, f: impl FnOnce() -> T) -> T {
+    if time_trace {
+        unsafe { llvm::LLVMTimeTraceProfilerInitializeThread() };
+    }
+    let result = f();
+    if time_trace {
+        unsafe { llvm::LLVMTimeTraceProfilerFinishThread() };
+    }
+    result
+}
+
 pub fn time_trace_profiler_finish(file_name: &str) {
     unsafe {
         let file_name = CString::new(file_name).unwrap();
@@ -189,6 +300,7 @@ pub fn to_llvm_feature<'a>(sess: &Session, s: &'a str) -> &'a str {
 
 pub fn target_features(sess: &Session) -> Vec<Symbol> {
     let target_machine = create_informational_target_machine(sess);
+    let enabled = llvm_enabled_target_features(&target_machine);
     supported_target_features(sess)
         .iter()
         .filter_map(
@@ -198,8 +310,11 @@ pub fn target_features(sess: &Session) -> Vec<Symbol> {
         )
         .filter(|feature| {
             let llvm_feature = to_llvm_feature(sess, feature);
+            if let Some(enabled) = &enabled {
+                return enabled.contains(llvm_feature);
+            }
             let cstr = CString::new(llvm_feature).unwrap();
-            unsafe { llvm::LLVMRustHasFeature(target_machine, cstr.as_ptr()) }
+            unsafe { llvm::LLVMRustHasFeature(&target_machine, cstr.as_ptr()) }
         })
         .map(|feature| Symbol::intern(feature))
         .collect()
@@ -224,6 +339,30 @@ pub fn print_passes() {
     }
 }
 
+/// The names of all the features `tm` has enabled, fetched from LLVM at once, or `None` if this
+/// LLVM can't list them.
+fn llvm_enabled_target_features(tm: &llvm::TargetMachine) -> Option<FxHashSet<String>> {
+    let mut listed = false;
+    let features = llvm::build_string(|s| unsafe {
+        listed = llvm::LLVMRustGetTargetFeatures(tm, s);
+    })
+    .unwrap_or_else(|e| bug!("LLVM returned a non-utf8 feature string: {}", e));
+    if !listed {
+        return None;
+    }
+
+    // Each feature is its name prefixed with `+` or `-`, then its description, all separated by
+    // NULs.
+    let mut fields = features.split('\0');
+    let mut enabled = FxHashSet::default();
+    while let (Some(name), Some(_desc)) = (fields.next(), fields.next()) {
+        if let Some(name) = name.strip_prefix('+') {
+            enabled.insert(name.to_string());
+        }
+    }
+    Some(enabled)
+}
+
 fn llvm_target_features(tm: &llvm::TargetMachine) -> Vec<(&str, &str)> {
     let len = unsafe { llvm::LLVMRustGetTargetFeaturesCount(tm) };
     let mut ret = Vec::with_capacity(len);
@@ -292,8 +431,8 @@ pub(crate) fn print(req: PrintRequest, sess: &Session) {
     require_inited();
     let tm = create_informational_target_machine(sess);
     match req {
-        PrintRequest::TargetCPUs => unsafe { llvm::LLVMRustPrintTargetCPUs(tm) },
-        PrintRequest::TargetFeatures => print_target_features(sess, tm),
+        PrintRequest::TargetCPUs => unsafe { llvm::LLVMRustPrintTargetCPUs(&tm) },
+        PrintRequest::TargetFeatures => print_target_features(sess, &tm),
         _ => bug!("rustc_codegen_llvm can't handle print request: {:?}", req),
     }
 }
@@ -348,23 +487,12 @@ pub fn llvm_global_features(sess: &Session) -> Vec<String> {
     // -Ctarget-cpu=native
     match sess.opts.cg.target_cpu {
         Some(ref s) if s == "native" => {
-            let features_string = unsafe {
-                let ptr = llvm::LLVMGetHostCPUFeatures();
-                let features_string = if !ptr.is_null() {
-                    CStr::from_ptr(ptr)
-                        .to_str()
-                        .unwrap_or_else(|e| {
-                            bug!("LLVM returned a non-utf8 features string: {}", e);
-                        })
-                        .to_owned()
-                } else {
-                    bug!("could not allocate host CPU features, LLVM returned a `null` string");
-                };
-
-                llvm::LLVMDisposeMessage(ptr);
-
-                features_string
-            };
+            // Unlike `LLVMGetHostCPUFeatures`, this sorts the features, so the string doesn't
+            // change between runs on the same host. It's empty if the features can't be detected.
+            let features_string = llvm::build_string(|s| unsafe {
+                llvm::LLVMRustGetHostCPUFeatures(s);
+            })
+            .unwrap_or_else(|e| bug!("LLVM returned a non-utf8 features string: {}", e));
             features.extend(features_string.split(",").map(String::from));
         }
         Some(_) | None => {}
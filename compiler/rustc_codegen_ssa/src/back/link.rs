@@ -472,8 +472,18 @@ fn collate_raw_dylibs(
             let imports = dylib_table.entry(name.clone()).or_default();
             for import in &lib.dll_imports {
                 if let Some(old_import) = imports.insert(import.name, import) {
-                    // FIXME: when we add support for ordinals, figure out if we need to do anything
-                    // if we have two DllImport values with the same name but different ordinals.
+                    // Only one of the declarations ends up in the import library, so they
+                    // must agree on how the function is imported.
+                    if import.ordinal != old_import.ordinal {
+                        sess.span_err(
+                            import.span,
+                            &format!(
+                                "multiple declarations of external function `{}` from \
+                                 library `{}` have different ordinals",
+                                import.name, name,
+                            ),
+                        );
+                    }
                     if import.calling_convention != old_import.calling_convention {
                         sess.span_err(
                             import.span,
@@ -19,9 +19,12 @@ pub fn name(&self) -> &str {
     }
 
     pub fn cost(&self) -> u64 {
-        // Yes, that's correct, we're using the size of the bytecode as an
-        // indicator for how costly this codegen unit is.
-        self.data().len() as u64
+        // If the backend didn't estimate how costly this codegen unit is, use
+        // the size of its bytecode as an indicator instead.
+        match self.shared.module_costs.get(self.idx) {
+            Some(&cost) => cost,
+            None => self.data().len() as u64,
+        }
     }
 
     pub fn data(&self) -> &[u8] {
@@ -38,6 +41,9 @@ pub struct ThinShared<B: WriteBackendMethods> {
     pub thin_buffers: Vec<B::ThinBuffer>,
     pub serialized_modules: Vec<SerializedModule<B::ModuleBuffer>>,
     pub module_names: Vec<CString>,
+    /// The estimated cost of optimizing each of the modules, in the order of
+    /// `module_names`, or empty if the backend has no estimate.
+    pub module_costs: Vec<u64>,
 }
 
 pub enum LtoModuleCodegen<B: WriteBackendMethods> {
@@ -2,6 +2,9 @@
 
 use rustc_data_structures::fx::FxHashSet;
 use rustc_errors::{emitter::HumanReadableErrorType, registry, ColorConfig};
+use rustc_session::config::ArchiveReadMode;
+use rustc_session::config::BasicBlockSections;
+use rustc_session::config::DebugInfoCompression;
 use rustc_session::config::InstrumentCoverage;
 use rustc_session::config::Strip;
 use rustc_session::config::{build_configuration, build_session_options, to_crate_config};
@@ -633,6 +636,8 @@ macro_rules! untracked {
 
     // Make sure that changing an [UNTRACKED] option leaves the hash unchanged.
     // This list is in alphabetical order.
+    untracked!(archive_cache, true);
+    untracked!(archive_read_mode, ArchiveReadMode::Mmap);
     untracked!(ast_json, true);
     untracked!(ast_json_noexpand, true);
     untracked!(borrowck, String::from("other"));
@@ -652,10 +657,14 @@ macro_rules! untracked {
     untracked!(identify_regions, true);
     untracked!(incremental_ignore_spans, true);
     untracked!(incremental_info, true);
+    untracked!(incremental_thinlto_index, true);
     untracked!(incremental_verify_ich, true);
     untracked!(input_stats, true);
     untracked!(keep_hygiene_data, true);
     untracked!(link_native_libraries, false);
+    untracked!(llvm_pass_stats, true);
+    untracked!(llvm_remark_summary, true);
+    untracked!(llvm_stats, true);
     untracked!(llvm_time_trace, true);
     untracked!(ls, true);
     untracked!(macro_backtrace, true);
@@ -671,12 +680,17 @@ macro_rules! untracked {
     untracked!(pre_link_args, vec![String::from("abc"), String::from("def")]);
     untracked!(profile_closures, true);
     untracked!(print_link_args, true);
+    untracked!(print_llvm_module_stats, true);
     untracked!(print_llvm_passes, true);
     untracked!(print_mono_items, Some(String::from("abc")));
+    untracked!(print_thinlto_import_costs, true);
     untracked!(print_type_sizes, true);
     untracked!(proc_macro_backtrace, true);
     untracked!(query_dep_graph, true);
     untracked!(query_stats, true);
+    untracked!(remark_dir, Some(PathBuf::from("/tmp")));
+    untracked!(reuse_archive_symbols, true);
+    untracked!(reuse_llvm_contexts, Some(4));
     untracked!(save_analysis, true);
     untracked!(self_profile, SwitchWithOptPath::Enabled(None));
     untracked!(self_profile_events, Some(vec![String::new()]));
@@ -684,6 +698,8 @@ macro_rules! untracked {
     untracked!(span_free_formats, true);
     untracked!(strip, Strip::Debuginfo);
     untracked!(terminal_width, Some(80));
+    untracked!(thinlto_fast_cache_keys, true);
+    untracked!(thinlto_index_dir, Some(PathBuf::from("/tmp")));
     untracked!(threads, 99);
     untracked!(time, true);
     untracked!(time_llvm_passes, true);
@@ -711,12 +727,18 @@ macro_rules! tracked {
     tracked!(always_encode_mir, true);
     tracked!(assume_incomplete_release, true);
     tracked!(asm_comments, true);
+    tracked!(asm_round_trip, true);
+    tracked!(basic_block_sections, BasicBlockSections::All);
     tracked!(binary_dep_depinfo, true);
+    tracked!(call_graph_ordering_file, Some(PathBuf::from("abc")));
     tracked!(chalk, true);
     tracked!(codegen_backend, Some("abc".to_string()));
     tracked!(crate_attr, vec!["abc".to_string()]);
+    tracked!(debug_info_for_profiling, true);
     tracked!(debug_macros, true);
+    tracked!(debuginfo_compression, DebugInfoCompression::Zlib);
     tracked!(dep_info_omit_d_target, true);
+    tracked!(downgrade_cold_functions, true);
     tracked!(dual_proc_macros, true);
     tracked!(fewer_names, Some(true));
     tracked!(force_overflow_checks, Some(true));
@@ -732,6 +754,8 @@ macro_rules! tracked {
     tracked!(instrument_mcount, true);
     tracked!(link_only, true);
     tracked!(llvm_plugins, vec![String::from("plugin_name")]);
+    tracked!(llvm_threads, 4);
+    tracked!(machine_outliner, Some(false));
     tracked!(merge_functions, Some(MergeFunctions::Disabled));
     tracked!(mir_emit_retag, true);
     tracked!(mir_opt_level, Some(4));
@@ -747,22 +771,35 @@ macro_rules! tracked {
     tracked!(precise_enum_drop_elaboration, false);
     tracked!(print_fuel, Some("abc".to_string()));
     tracked!(profile, true);
+    tracked!(profile_counter_atomic, true);
+    tracked!(profile_counter_promotion, Some(true));
+    tracked!(profile_counter_relocation, true);
     tracked!(profile_emit, Some(PathBuf::from("abc")));
+    tracked!(profile_sample_use, Some(PathBuf::from("abc")));
     tracked!(profiler_runtime, None);
     tracked!(relax_elf_relocations, Some(true));
     tracked!(relro_level, Some(RelroLevel::Full));
     tracked!(simulate_remapped_rust_src_base, Some(PathBuf::from("/rustc/abc")));
     tracked!(report_delayed_bugs, true);
     tracked!(sanitizer, SanitizerSet::ADDRESS);
+    tracked!(sanitizer_address_globals, Some(false));
+    tracked!(sanitizer_address_use_after_return, Some(false));
+    tracked!(sanitizer_address_use_after_scope, Some(false));
+    tracked!(sanitizer_instrument_with_calls_threshold, Some(0));
     tracked!(sanitizer_memory_track_origins, 2);
     tracked!(sanitizer_recover, SanitizerSet::ADDRESS);
     tracked!(saturating_float_casts, Some(true));
     tracked!(share_generics, Some(true));
     tracked!(show_span, Some(String::from("abc")));
+    tracked!(split_machine_functions, true);
+    tracked!(split_thinlto_buffers, true);
     tracked!(src_hash_algorithm, Some(SourceFileHashAlgorithm::Sha1));
     tracked!(symbol_mangling_version, Some(SymbolManglingVersion::V0));
     tracked!(teach, true);
     tracked!(thinlto, Some(true));
+    tracked!(thinlto_fast_debuginfo_patching, Some(1));
+    tracked!(thinlto_import_budget, Some(1));
+    tracked!(thinlto_whole_program_devirt, true);
     tracked!(thir_unsafeck, true);
     tracked!(tune_cpu, Some(String::from("abc")));
     tracked!(tls_model, Some(TlsModel::GeneralDynamic));
@@ -771,6 +808,8 @@ macro_rules! tracked {
     tracked!(unleash_the_miri_inside_of_you, true);
     tracked!(use_ctors_section, Some(true));
     tracked!(verify_llvm_ir, true);
+    tracked!(verify_llvm_ir_sample, Some(10));
+    tracked!(verify_llvm_ir_sample_min, 0);
     tracked!(wasi_exec_model, Some(WasiExecModel::Reactor));
 
     macro_rules! tracked_no_crate_hash {
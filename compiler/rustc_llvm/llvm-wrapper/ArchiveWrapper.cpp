@@ -2,7 +2,19 @@
 
 #include "llvm/Object/Archive.h"
 #include "llvm/Object/ArchiveWriter.h"
+#include "llvm/Object/SymbolicFile.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
+
+#include <mutex>
+
+#ifdef LLVM_ON_UNIX
+#include <sys/mman.h>
+#endif
 
 using namespace llvm;
 using namespace llvm::object;
@@ -20,6 +32,16 @@ struct RustArchiveMember {
   ~RustArchiveMember() {}
 };
 
+// An opened archive.
+struct RustArchive {
+  // The buffer of archives opened through the archive cache, which is shared
+  // with the cache instead of being owned by `Binary`.
+  std::shared_ptr<MemoryBuffer> SharedBuffer;
+  OwningBinary<Archive> Binary;
+
+  RustArchive(OwningBinary<Archive> Binary) : Binary(std::move(Binary)) {}
+};
+
 struct RustArchiveIterator {
   bool First;
   Archive::child_iterator Cur;
@@ -56,7 +78,7 @@ static Archive::Kind fromRust(LLVMRustArchiveKind Kind) {
   }
 }
 
-typedef OwningBinary<Archive> *LLVMRustArchiveRef;
+typedef RustArchive *LLVMRustArchiveRef;
 typedef RustArchiveMember *LLVMRustArchiveMemberRef;
 typedef Archive::Child *LLVMRustArchiveChildRef;
 typedef Archive::Child const *LLVMRustArchiveChildConstRef;
@@ -78,19 +100,213 @@ extern "C" LLVMRustArchiveRef LLVMRustOpenArchive(char *Path) {
     return nullptr;
   }
 
-  OwningBinary<Archive> *Ret = new OwningBinary<Archive>(
-      std::move(ArchiveOr.get()), std::move(BufOr.get()));
+  RustArchive *Ret = new RustArchive(OwningBinary<Archive>(
+      std::move(ArchiveOr.get()), std::move(BufOr.get())));
+
+  return Ret;
+}
+
+enum class LLVMRustArchiveMapMode {
+  Default,
+  Read,
+  Mmap,
+};
+
+namespace {
+// A memory buffer which always maps its file, unlike those of `MemoryBuffer`
+// which decide depending on the size of the file among other things.
+class MappedArchiveBuffer : public MemoryBuffer {
+  sys::fs::mapped_file_region Region;
+  std::string Name;
+
+public:
+  MappedArchiveBuffer(sys::fs::mapped_file_region Region, StringRef Name)
+      : Region(std::move(Region)), Name(Name.str()) {
+    const char *Start = this->Region.const_data();
+    init(Start, Start + this->Region.size(),
+         /* RequiresNullTerminator = */ false);
+  }
+
+  StringRef getBufferIdentifier() const override { return Name; }
 
+  BufferKind getBufferKind() const override { return MemoryBuffer_MMap; }
+};
+} // namespace
+
+static ErrorOr<std::unique_ptr<MemoryBuffer>> mapArchiveFile(const char *Path) {
+  Expected<sys::fs::file_t> FileOrErr = sys::fs::openNativeFileForRead(Path);
+  if (!FileOrErr)
+    return errorToErrorCode(FileOrErr.takeError());
+  sys::fs::file_t File = *FileOrErr;
+
+  sys::fs::file_status Status;
+  std::error_code EC = sys::fs::status(File, Status);
+  // Empty files can't be mapped, which is left to `MemoryBuffer` to deal
+  // with.
+  if (!EC && Status.getSize() == 0) {
+    sys::fs::closeFile(File);
+#if LLVM_VERSION_GE(13, 0)
+    return MemoryBuffer::getFile(Path, /* IsText = */ false,
+                                 /* RequiresNullTerminator = */ false);
+#else
+    return MemoryBuffer::getFile(Path, /* FileSize = */ -1,
+                                 /* RequiresNullTerminator = */ false);
+#endif
+  }
+  std::unique_ptr<MemoryBuffer> Ret;
+  if (!EC) {
+    sys::fs::mapped_file_region Region(File, sys::fs::mapped_file_region::readonly,
+                                       Status.getSize(), 0, EC);
+    if (!EC) {
+#ifdef LLVM_ON_UNIX
+      // Archives are usually read from the start to the end, and all of them.
+      posix_madvise(const_cast<char *>(Region.const_data()), Region.size(),
+                    POSIX_MADV_SEQUENTIAL);
+      posix_madvise(const_cast<char *>(Region.const_data()), Region.size(),
+                    POSIX_MADV_WILLNEED);
+#endif
+      Ret = std::make_unique<MappedArchiveBuffer>(std::move(Region), Path);
+    }
+  }
+  sys::fs::closeFile(File);
+  if (EC)
+    return EC;
   return Ret;
 }
 
+static ErrorOr<std::unique_ptr<MemoryBuffer>>
+readArchiveFile(const char *Path, LLVMRustArchiveMapMode Mode) {
+  switch (Mode) {
+  case LLVMRustArchiveMapMode::Default:
+#if LLVM_VERSION_GE(13, 0)
+    return MemoryBuffer::getFile(Path, /* IsText = */ false,
+                                 /* RequiresNullTerminator = */ false);
+#else
+    return MemoryBuffer::getFile(Path, /* FileSize = */ -1,
+                                 /* RequiresNullTerminator = */ false);
+#endif
+  case LLVMRustArchiveMapMode::Read:
+    // Volatile files are never mapped.
+#if LLVM_VERSION_GE(13, 0)
+    return MemoryBuffer::getFile(Path, /* IsText = */ false,
+                                 /* RequiresNullTerminator = */ false,
+                                 /* IsVolatile = */ true);
+#else
+    return MemoryBuffer::getFile(Path, /* FileSize = */ -1,
+                                 /* RequiresNullTerminator = */ false,
+                                 /* IsVolatile = */ true);
+#endif
+  case LLVMRustArchiveMapMode::Mmap:
+    return mapArchiveFile(Path);
+  default:
+    report_fatal_error("Bad ArchiveMapMode.");
+  }
+}
+
+// The buffers of the archives opened with `UseCache`, so that an archive which
+// is opened several times is only read once per process. Entries are dropped
+// when the file at their path is replaced or changes, when the cache is
+// cleared, and the least recently used one when the cache is full.
+struct ArchiveCacheEntry {
+  std::shared_ptr<MemoryBuffer> Buffer;
+  sys::fs::UniqueID ID;
+  uint64_t Size;
+  sys::TimePoint<> ModificationTime;
+  uint64_t LastUse;
+};
+static const size_t ArchiveCacheCapacity = 64;
+static std::mutex ArchiveCacheLock;
+static StringMap<ArchiveCacheEntry> ArchiveCache;
+static uint64_t ArchiveCacheUses = 0;
+
+static ErrorOr<std::shared_ptr<MemoryBuffer>>
+getCachedArchiveFile(const char *Path, LLVMRustArchiveMapMode Mode) {
+  sys::fs::file_status Status;
+  if (std::error_code EC = sys::fs::status(Path, Status))
+    return EC;
+
+  std::lock_guard<std::mutex> Lock(ArchiveCacheLock);
+  auto It = ArchiveCache.find(Path);
+  if (It != ArchiveCache.end() && It->second.ID == Status.getUniqueID() &&
+      It->second.Size == Status.getSize() &&
+      It->second.ModificationTime == Status.getLastModificationTime()) {
+    It->second.LastUse = ++ArchiveCacheUses;
+    return It->second.Buffer;
+  }
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> BufOr = readArchiveFile(Path, Mode);
+  if (!BufOr)
+    return BufOr.getError();
+  std::shared_ptr<MemoryBuffer> Buffer = std::move(*BufOr);
+  if (It == ArchiveCache.end() && ArchiveCache.size() >= ArchiveCacheCapacity) {
+    auto Oldest = ArchiveCache.begin();
+    for (auto I = ArchiveCache.begin(), E = ArchiveCache.end(); I != E; ++I)
+      if (I->second.LastUse < Oldest->second.LastUse)
+        Oldest = I;
+    ArchiveCache.erase(Oldest);
+  }
+  ArchiveCache[Path] = {Buffer, Status.getUniqueID(), Status.getSize(),
+                        Status.getLastModificationTime(), ++ArchiveCacheUses};
+  return Buffer;
+}
+
+// Same as `LLVMRustOpenArchive`, but with control over how the file is read:
+// either as `MemoryBuffer` sees fit, always by reading it into memory (e.g. on
+// network filesystems) or always by mapping it. With `UseCache`, the contents
+// of the file are shared with all other archives opened from the same path
+// with `UseCache`, through a process-wide cache.
+extern "C" LLVMRustArchiveRef
+LLVMRustOpenArchiveWithOptions(char *Path, LLVMRustArchiveMapMode Mode,
+                               bool UseCache) {
+  std::shared_ptr<MemoryBuffer> SharedBuffer;
+  std::unique_ptr<MemoryBuffer> Buffer;
+  if (UseCache) {
+    ErrorOr<std::shared_ptr<MemoryBuffer>> BufOr =
+        getCachedArchiveFile(Path, Mode);
+    if (!BufOr) {
+      LLVMRustSetLastError(BufOr.getError().message().c_str());
+      return nullptr;
+    }
+    SharedBuffer = std::move(*BufOr);
+  } else {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> BufOr = readArchiveFile(Path, Mode);
+    if (!BufOr) {
+      LLVMRustSetLastError(BufOr.getError().message().c_str());
+      return nullptr;
+    }
+    Buffer = std::move(*BufOr);
+  }
+
+  MemoryBufferRef BufferRef =
+      SharedBuffer ? SharedBuffer->getMemBufferRef() : Buffer->getMemBufferRef();
+  Expected<std::unique_ptr<Archive>> ArchiveOr = Archive::create(BufferRef);
+
+  if (!ArchiveOr) {
+    LLVMRustSetLastError(toString(ArchiveOr.takeError()).c_str());
+    return nullptr;
+  }
+
+  RustArchive *Ret = new RustArchive(OwningBinary<Archive>(
+      std::move(ArchiveOr.get()), std::move(Buffer)));
+  Ret->SharedBuffer = std::move(SharedBuffer);
+
+  return Ret;
+}
+
+// Drops all buffers from the archive cache. Archives still open keep theirs
+// alive until they're destroyed.
+extern "C" void LLVMRustClearArchiveCache() {
+  std::lock_guard<std::mutex> Lock(ArchiveCacheLock);
+  ArchiveCache.clear();
+}
+
 extern "C" void LLVMRustDestroyArchive(LLVMRustArchiveRef RustArchive) {
   delete RustArchive;
 }
 
 extern "C" LLVMRustArchiveIteratorRef
 LLVMRustArchiveIteratorNew(LLVMRustArchiveRef RustArchive) {
-  Archive *Archive = RustArchive->getBinary();
+  Archive *Archive = RustArchive->Binary.getBinary();
   std::unique_ptr<Error> Err = std::make_unique<Error>(Error::success());
   auto Cur = Archive->child_begin(*Err);
   if (*Err) {
@@ -101,8 +317,11 @@ LLVMRustArchiveIteratorNew(LLVMRustArchiveRef RustArchive) {
   return new RustArchiveIterator(Cur, End, std::move(Err));
 }
 
-extern "C" LLVMRustArchiveChildConstRef
-LLVMRustArchiveIteratorNext(LLVMRustArchiveIteratorRef RAI) {
+// Moves the iterator to its next child and returns it, or null once there are
+// no more children or if an error occurred, in which case `Failed` is set.
+static const Archive::Child *
+nextArchiveChild(LLVMRustArchiveIteratorRef RAI, bool &Failed) {
+  Failed = false;
   if (RAI->Cur == RAI->End)
     return nullptr;
 
@@ -116,6 +335,7 @@ LLVMRustArchiveIteratorNext(LLVMRustArchiveIteratorRef RAI) {
     ++RAI->Cur;
     if (*RAI->Err) {
       LLVMRustSetLastError(toString(std::move(*RAI->Err)).c_str());
+      Failed = true;
       return nullptr;
     }
   } else {
@@ -125,12 +345,69 @@ LLVMRustArchiveIteratorNext(LLVMRustArchiveIteratorRef RAI) {
   if (RAI->Cur == RAI->End)
     return nullptr;
 
-  const Archive::Child &Child = *RAI->Cur.operator->();
-  Archive::Child *Ret = new Archive::Child(Child);
+  return RAI->Cur.operator->();
+}
+
+extern "C" LLVMRustArchiveChildConstRef
+LLVMRustArchiveIteratorNext(LLVMRustArchiveIteratorRef RAI) {
+  bool Failed;
+  const Archive::Child *Child = nextArchiveChild(RAI, Failed);
+  if (!Child)
+    return nullptr;
+
+  Archive::Child *Ret = new Archive::Child(*Child);
 
   return Ret;
 }
 
+// Everything about an archive child that `LLVMRustArchiveIteratorNextBatch`
+// fetches at once. `Offset` is the offset of the child's header within the
+// archive.
+struct LLVMRustArchiveChildInfo {
+  const char *Name;
+  size_t NameLen;
+  const char *Data;
+  size_t DataLen;
+  uint64_t Offset;
+};
+
+// Fills `Children` with the next at most `Capacity` children of the archive,
+// without allocating anything for them, and stores how many were read in
+// `NumRead`. Fewer than `Capacity` are only read at the end of the archive.
+extern "C" LLVMRustResult
+LLVMRustArchiveIteratorNextBatch(LLVMRustArchiveIteratorRef RAI,
+                                 LLVMRustArchiveChildInfo *Children,
+                                 size_t Capacity, size_t *NumRead) {
+  *NumRead = 0;
+  while (*NumRead < Capacity) {
+    bool Failed;
+    const Archive::Child *Child = nextArchiveChild(RAI, Failed);
+    if (Failed)
+      return LLVMRustResult::Failure;
+    if (!Child)
+      break;
+
+    Expected<StringRef> NameOrErr = Child->getName();
+    if (!NameOrErr) {
+      LLVMRustSetLastError(toString(NameOrErr.takeError()).c_str());
+      return LLVMRustResult::Failure;
+    }
+    Expected<StringRef> BufOrErr = Child->getBuffer();
+    if (!BufOrErr) {
+      LLVMRustSetLastError(toString(BufOrErr.takeError()).c_str());
+      return LLVMRustResult::Failure;
+    }
+
+    LLVMRustArchiveChildInfo &Info = Children[(*NumRead)++];
+    Info.Name = NameOrErr->data();
+    Info.NameLen = NameOrErr->size();
+    Info.Data = BufOrErr->data();
+    Info.DataLen = BufOrErr->size();
+    Info.Offset = Child->getChildOffset();
+  }
+  return LLVMRustResult::Success;
+}
+
 extern "C" void LLVMRustArchiveChildFree(LLVMRustArchiveChildRef Child) {
   delete Child;
 }
@@ -182,35 +459,359 @@ extern "C" void LLVMRustArchiveMemberFree(LLVMRustArchiveMemberRef Member) {
   delete Member;
 }
 
-extern "C" LLVMRustResult
-LLVMRustWriteArchive(char *Dst, size_t NumMembers,
-                     const LLVMRustArchiveMemberRef *NewMembers,
-                     bool WriteSymbtab, LLVMRustArchiveKind RustKind) {
+static Expected<NewArchiveMember>
+loadArchiveMember(LLVMRustArchiveMemberRef Member) {
+  assert(Member->Name);
+  if (Member->Filename) {
+    Expected<NewArchiveMember> MOrErr =
+        NewArchiveMember::getFile(Member->Filename, true);
+    if (MOrErr)
+      MOrErr->MemberName = sys::path::filename(MOrErr->MemberName);
+    return MOrErr;
+  }
+  return NewArchiveMember::getOldMember(Member->Child, true);
+}
+
+// The symbols the symbol table of an archive lists for one of its members.
+struct ArchiveMemberSymbols {
+  // The names of the symbols, each followed by a NUL.
+  std::string Names;
+  unsigned Count = 0;
+  // Whether the member is an object file, even one without any symbols.
+  bool IsObject = false;
+};
+
+// The symbols of each of the members of an existing archive, as listed by its
+// symbol table, by the offset of the member.
+typedef DenseMap<uint64_t, ArchiveMemberSymbols> OldArchiveSymbols;
+
+static Optional<OldArchiveSymbols> readOldArchiveSymbols(const Archive &Parent) {
+  if (!Parent.hasSymbolTable())
+    return None;
+  OldArchiveSymbols Symbols;
+  for (const Archive::Symbol &Sym : Parent.symbols()) {
+    Expected<Archive::Child> ChildOrErr = Sym.getMember();
+    if (!ChildOrErr) {
+      // The members of this archive are scanned instead.
+      consumeError(ChildOrErr.takeError());
+      return None;
+    }
+    ArchiveMemberSymbols &MemberSymbols =
+        Symbols[ChildOrErr->getChildOffset()];
+    MemberSymbols.Names += Sym.getName();
+    MemberSymbols.Names += '\0';
+    MemberSymbols.Count++;
+    MemberSymbols.IsObject = true;
+  }
+  return Symbols;
+}
+
+// Whether `writeArchive` lists the symbol `Sym` in the symbol table.
+static Expected<bool> isArchiveSymbol(const BasicSymbolRef &Sym) {
+#if LLVM_VERSION_GE(11, 0)
+  Expected<uint32_t> FlagsOrErr = Sym.getFlags();
+  if (!FlagsOrErr)
+    return FlagsOrErr.takeError();
+  uint32_t Flags = *FlagsOrErr;
+#else
+  uint32_t Flags = Sym.getFlags();
+#endif
+  return (Flags & BasicSymbolRef::SF_Global) &&
+         !(Flags & BasicSymbolRef::SF_FormatSpecific) &&
+         !(Flags & BasicSymbolRef::SF_Undefined);
+}
+
+// Finds the symbols of the member `Buf` the same way `writeArchive` does.
+// Bitcode is parsed into a context of its own, so this can run on several
+// threads at once.
+static Error scanArchiveMemberSymbols(MemoryBufferRef Buf,
+                                      ArchiveMemberSymbols &Symbols) {
+  LLVMContext Context;
+  Expected<std::unique_ptr<SymbolicFile>> ObjOrErr =
+      SymbolicFile::createSymbolicFile(Buf, file_magic::unknown, &Context);
+  if (!ObjOrErr) {
+    // Members which aren't object files have no symbols.
+    consumeError(ObjOrErr.takeError());
+    return Error::success();
+  }
+  Symbols.IsObject = true;
+  raw_string_ostream OS(Symbols.Names);
+  for (const BasicSymbolRef &Sym : (*ObjOrErr)->symbols()) {
+    Expected<bool> IsArchiveSymbol = isArchiveSymbol(Sym);
+    if (!IsArchiveSymbol)
+      return IsArchiveSymbol.takeError();
+    if (!*IsArchiveSymbol)
+      continue;
+    if (Error Err = Sym.printName(OS))
+      return Err;
+    OS << '\0';
+    Symbols.Count++;
+  }
+  OS.flush();
+  return Error::success();
+}
+
+// Collects the symbols of the loaded `Members` for the symbol table. Members
+// copied from an existing archive which has a symbol table get the symbols it
+// lists for them, without being scanned again. The others, including those
+// the old symbol table doesn't list at all, as some `ar`s leave out bitcode
+// members, are scanned on up to `NumThreads` threads.
+static Expected<std::vector<ArchiveMemberSymbols>>
+collectArchiveSymbols(const LLVMRustArchiveMemberRef *NewMembers,
+                      ArrayRef<NewArchiveMember> Members,
+                      unsigned NumThreads) {
+  std::vector<ArchiveMemberSymbols> Symbols(Members.size());
+  std::vector<size_t> ToScan;
+  DenseMap<const Archive *, Optional<OldArchiveSymbols>> OldArchives;
+  for (size_t I = 0; I < Members.size(); I++) {
+    const RustArchiveMember *Member = NewMembers[I];
+    if (!Member->Filename) {
+      const Archive *Parent = Member->Child.getParent();
+      auto Inserted = OldArchives.try_emplace(Parent);
+      if (Inserted.second)
+        Inserted.first->second = readOldArchiveSymbols(*Parent);
+      Optional<OldArchiveSymbols> &Old = Inserted.first->second;
+      if (Old) {
+        auto It = Old->find(Member->Child.getChildOffset());
+        if (It != Old->end()) {
+          Symbols[I] = It->second;
+          continue;
+        }
+      }
+    }
+    ToScan.push_back(I);
+  }
+
+  auto Scan = [&Symbols, Members](size_t I) {
+    return scanArchiveMemberSymbols(Members[I].Buf->getMemBufferRef(),
+                                    Symbols[I]);
+  };
+  if (NumThreads == 1 || ToScan.size() <= 1) {
+    for (size_t I : ToScan)
+      if (Error Err = Scan(I))
+        return Err;
+    return Symbols;
+  }
+
+  std::vector<std::string> Errors(Members.size());
+  {
+#if LLVM_VERSION_GE(11, 0)
+    ThreadPool Pool(hardware_concurrency(NumThreads));
+#else
+    ThreadPool Pool(NumThreads);
+#endif
+    for (size_t I : ToScan)
+      Pool.async([&Scan, &Errors, I] {
+        if (Error Err = Scan(I))
+          Errors[I] = toString(std::move(Err));
+      });
+    Pool.wait();
+  }
+  for (const std::string &Error : Errors)
+    if (!Error.empty())
+      return createStringError(inconvertibleErrorCode(), Error);
+  return Symbols;
+}
+
+template <typename T>
+static void printWithSpacePadding(raw_ostream &OS, T Data, unsigned Size) {
+  uint64_t OldPos = OS.tell();
+  OS << Data;
+  unsigned SizeSoFar = OS.tell() - OldPos;
+  assert(SizeSoFar <= Size && "Data doesn't fit in Size");
+  OS.indent(Size - SizeSoFar);
+}
+
+// Prints the header of a member of a GNU archive, with the name field `Name`.
+static void printGNUMemberHeader(raw_ostream &Out, StringRef Name,
+                                 uint64_t ModTime, unsigned UID, unsigned GID,
+                                 unsigned Perms, uint64_t Size) {
+  printWithSpacePadding(Out, Name, 16);
+  printWithSpacePadding(Out, ModTime, 12);
+  // There's only room for 6 digits.
+  printWithSpacePadding(Out, UID % 1000000, 6);
+  printWithSpacePadding(Out, GID % 1000000, 6);
+  printWithSpacePadding(Out, format("%o", Perms), 8);
+  printWithSpacePadding(Out, Size, 10);
+  Out << "`\n";
+}
+
+// Writes a GNU archive of `Members` to `ArcName`, with a symbol table listing
+// `Symbols`, the symbols of the member at the same index. The layout is the
+// same as `writeArchive` gives a deterministic archive. Returns false without
+// writing anything if the archive is too large for the 32-bit offsets of the
+// symbol table.
+static Expected<bool> writeGNUArchive(StringRef ArcName,
+                                      ArrayRef<NewArchiveMember> Members,
+                                      ArrayRef<ArchiveMemberSymbols> Symbols) {
+  // Names which don't fit into the header, or which contain a slash, are put
+  // into the string table and referred to by their offset there.
+  std::string StringTable;
+  std::vector<std::string> NameFields;
+  NameFields.reserve(Members.size());
+  for (const NewArchiveMember &M : Members) {
+    if (M.MemberName.size() >= 16 || M.MemberName.contains('/')) {
+      NameFields.push_back("/" + std::to_string(StringTable.size()));
+      StringTable += M.MemberName;
+      StringTable += "/\n";
+    } else {
+      NameFields.push_back((M.MemberName + "/").str());
+    }
+  }
+
+  uint64_t NumSymbols = 0;
+  std::string SymbolNames;
+  bool HasObject = false;
+  for (const ArchiveMemberSymbols &MemberSymbols : Symbols) {
+    NumSymbols += MemberSymbols.Count;
+    SymbolNames += MemberSymbols.Names;
+    HasObject |= MemberSymbols.IsObject;
+  }
+  // Older Solaris tools expect a symbol table with something in it.
+  if (HasObject && SymbolNames.empty())
+    SymbolNames.append(3, '\0');
+
+  const uint64_t HeaderSize = 60;
+  uint64_t SymbolTableSize = alignTo(4 + 4 * NumSymbols + SymbolNames.size(), 2);
+  uint64_t Pos = 8 + HeaderSize + SymbolTableSize;
+  if (!StringTable.empty())
+    Pos += HeaderSize + alignTo(StringTable.size(), 2);
+  std::vector<uint64_t> Offsets;
+  Offsets.reserve(Members.size());
+  for (const NewArchiveMember &M : Members) {
+    Offsets.push_back(Pos);
+    Pos += HeaderSize + alignTo(M.Buf->getBufferSize(), 2);
+  }
+  if (Pos > UINT32_MAX)
+    return false;
+
+  Expected<sys::fs::TempFile> Temp =
+      sys::fs::TempFile::create(ArcName + ".temp-archive-%%%%%%%.a");
+  if (!Temp)
+    return Temp.takeError();
+  {
+    raw_fd_ostream Out(Temp->FD, /* shouldClose = */ false);
+    Out << "!<arch>\n";
+
+    printGNUMemberHeader(Out, "/", 0, 0, 0, 0, SymbolTableSize);
+    support::endian::write<uint32_t>(Out, NumSymbols, support::big);
+    for (size_t I = 0; I < Members.size(); I++)
+      for (unsigned J = 0; J < Symbols[I].Count; J++)
+        support::endian::write<uint32_t>(Out, Offsets[I], support::big);
+    Out << SymbolNames;
+    if (SymbolNames.size() % 2)
+      Out << '\0';
+
+    if (!StringTable.empty()) {
+      printWithSpacePadding(Out, "//", 48);
+      printWithSpacePadding(Out, alignTo(StringTable.size(), 2), 10);
+      Out << "`\n" << StringTable;
+      if (StringTable.size() % 2)
+        Out << '\n';
+    }
+
+    for (size_t I = 0; I < Members.size(); I++) {
+      const NewArchiveMember &M = Members[I];
+      StringRef Data = M.Buf->getBuffer();
+      printGNUMemberHeader(Out, NameFields[I], sys::toTimeT(M.ModTime), M.UID,
+                           M.GID, M.Perms, Data.size());
+      Out << Data;
+      if (Data.size() % 2)
+        Out << '\n';
+    }
+
+    Out.flush();
+    if (std::error_code EC = Out.error()) {
+      Out.clear_error();
+      consumeError(Temp->discard());
+      return errorCodeToError(EC);
+    }
+  }
+  if (Error Err = Temp->keep(ArcName))
+    return Err;
+  return true;
+}
+
+static LLVMRustResult
+writeRustArchive(char *Dst, size_t NumMembers,
+                 const LLVMRustArchiveMemberRef *NewMembers,
+                 bool WriteSymbtab, LLVMRustArchiveKind RustKind,
+                 unsigned NumThreads, bool ReuseSymbols) {
 
   std::vector<NewArchiveMember> Members;
   auto Kind = fromRust(RustKind);
+  NumThreads = resolveNumThreads(NumThreads);
 
-  for (size_t I = 0; I < NumMembers; I++) {
-    auto Member = NewMembers[I];
-    assert(Member->Name);
-    if (Member->Filename) {
-      Expected<NewArchiveMember> MOrErr =
-          NewArchiveMember::getFile(Member->Filename, true);
+  if (NumThreads == 1 || NumMembers <= 1) {
+    for (size_t I = 0; I < NumMembers; I++) {
+      Expected<NewArchiveMember> MOrErr = loadArchiveMember(NewMembers[I]);
       if (!MOrErr) {
         LLVMRustSetLastError(toString(MOrErr.takeError()).c_str());
         return LLVMRustResult::Failure;
       }
-      MOrErr->MemberName = sys::path::filename(MOrErr->MemberName);
       Members.push_back(std::move(*MOrErr));
-    } else {
-      Expected<NewArchiveMember> MOrErr =
-          NewArchiveMember::getOldMember(Member->Child, true);
-      if (!MOrErr) {
-        LLVMRustSetLastError(toString(MOrErr.takeError()).c_str());
-        return LLVMRustResult::Failure;
+    }
+  } else {
+    std::vector<Optional<Expected<NewArchiveMember>>> Loaded(NumMembers);
+    {
+#if LLVM_VERSION_GE(11, 0)
+      ThreadPool Pool(hardware_concurrency(NumThreads));
+#else
+      ThreadPool Pool(NumThreads);
+#endif
+      for (size_t I = 0; I < NumMembers; I++) {
+        LLVMRustArchiveMemberRef Member = NewMembers[I];
+        if (Member->Filename)
+          Pool.async([&Loaded, I, Member] {
+            Loaded[I].emplace(loadArchiveMember(Member));
+          });
       }
-      Members.push_back(std::move(*MOrErr));
+      // Children of an existing archive are loaded on this thread. Those of a
+      // thin archive are read from their files through the archive, which
+      // keeps their buffers without any synchronization.
+      for (size_t I = 0; I < NumMembers; I++)
+        if (!NewMembers[I]->Filename)
+          Loaded[I].emplace(loadArchiveMember(NewMembers[I]));
+      Pool.wait();
     }
+
+    // Every `Expected` has to be inspected, so keep going after the first
+    // error and only report that one.
+    bool Failed = false;
+    for (auto &MOrErr : Loaded) {
+      if (!*MOrErr) {
+        Error Err = MOrErr->takeError();
+        if (Failed) {
+          consumeError(std::move(Err));
+        } else {
+          LLVMRustSetLastError(toString(std::move(Err)).c_str());
+          Failed = true;
+        }
+        continue;
+      }
+      Members.push_back(std::move(**MOrErr));
+    }
+    if (Failed)
+      return LLVMRustResult::Failure;
+  }
+
+  // LLVM's archive writer scans every member for its symbols again, one after
+  // the other, so with `ReuseSymbols`, GNU archives, which are what most
+  // targets use, are written by `writeGNUArchive` instead.
+  if (ReuseSymbols && WriteSymbtab && Kind == Archive::K_GNU) {
+    Expected<std::vector<ArchiveMemberSymbols>> SymbolsOrErr =
+        collectArchiveSymbols(NewMembers, Members, NumThreads);
+    if (!SymbolsOrErr) {
+      LLVMRustSetLastError(toString(SymbolsOrErr.takeError()).c_str());
+      return LLVMRustResult::Failure;
+    }
+    Expected<bool> Written = writeGNUArchive(Dst, Members, *SymbolsOrErr);
+    if (!Written) {
+      LLVMRustSetLastError(toString(Written.takeError()).c_str());
+      return LLVMRustResult::Failure;
+    }
+    if (*Written)
+      return LLVMRustResult::Success;
   }
 
   auto Result = writeArchive(Dst, Members, WriteSymbtab, Kind, true, false);
@@ -220,3 +821,25 @@ LLVMRustWriteArchive(char *Dst, size_t NumMembers,
 
   return LLVMRustResult::Failure;
 }
+
+extern "C" LLVMRustResult
+LLVMRustWriteArchive(char *Dst, size_t NumMembers,
+                     const LLVMRustArchiveMemberRef *NewMembers,
+                     bool WriteSymbtab, LLVMRustArchiveKind RustKind) {
+  return writeRustArchive(Dst, NumMembers, NewMembers, WriteSymbtab, RustKind,
+                          /* NumThreads = */ 1, /* ReuseSymbols = */ false);
+}
+
+// Same as `LLVMRustWriteArchive`, but reads the members which are files on up
+// to `NumThreads` threads. With `ReuseSymbols`, a GNU archive's symbol table
+// is built by rustc rather than LLVM: members copied from an archive with a
+// symbol table keep their entries in it, and the others are scanned on up to
+// `NumThreads` threads too.
+extern "C" LLVMRustResult
+LLVMRustWriteArchiveParallel(char *Dst, size_t NumMembers,
+                             const LLVMRustArchiveMemberRef *NewMembers,
+                             bool WriteSymbtab, LLVMRustArchiveKind RustKind,
+                             unsigned NumThreads, bool ReuseSymbols) {
+  return writeRustArchive(Dst, NumMembers, NewMembers, WriteSymbtab, RustKind,
+                          NumThreads, ReuseSymbols);
+}
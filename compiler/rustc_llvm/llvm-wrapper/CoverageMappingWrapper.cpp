@@ -19,6 +19,26 @@ struct LLVMRustCounterMappingRegion {
   coverage::CounterMappingRegion::RegionKind Kind;
 };
 
+// A rough upper estimate of the size of an encoded coverage mapping, to reserve
+// room for it in the output buffer. Most of its numbers, all LEB128 encoded,
+// fit in a byte or two.
+static size_t mappingSizeHint(unsigned NumVirtualFileMappingIDs,
+                              unsigned NumExpressions,
+                              unsigned NumMappingRegions) {
+  return 16 + 2 * size_t(NumVirtualFileMappingIDs) +
+         4 * size_t(NumExpressions) + 10 * size_t(NumMappingRegions);
+}
+
+// The same for a filenames section, whose filenames are written as is after
+// their LEB128 encoded lengths, unless compressed.
+template <typename StringT>
+static size_t filenamesSizeHint(ArrayRef<StringT> Filenames) {
+  size_t Size = 16;
+  for (const auto &Filename : Filenames)
+    Size += 2 + Filename.size();
+  return Size;
+}
+
 extern "C" void LLVMRustCoverageWriteFilenamesSectionToBuffer(
     const char* const Filenames[],
     size_t FilenamesLen,
@@ -36,7 +56,8 @@ extern "C" void LLVMRustCoverageWriteFilenamesSectionToBuffer(
 #endif
   auto FilenamesWriter = coverage::CoverageFilenamesSectionWriter(
     makeArrayRef(FilenameRefs));
-  RawRustStringOstream OS(BufferOut);
+  RawRustStringBufferOstream OS(BufferOut,
+                                filenamesSizeHint(makeArrayRef(FilenameRefs)));
   FilenamesWriter.write(OS);
 }
 
@@ -61,10 +82,62 @@ extern "C" void LLVMRustCoverageWriteMappingToBuffer(
       makeArrayRef(VirtualFileMappingIDs, NumVirtualFileMappingIDs),
       makeArrayRef(Expressions, NumExpressions),
       MappingRegions);
-  RawRustStringOstream OS(BufferOut);
+  RawRustStringBufferOstream OS(
+      BufferOut, mappingSizeHint(NumVirtualFileMappingIDs, NumExpressions,
+                                 NumMappingRegions));
   CoverageMappingWriter.write(OS);
 }
 
+// The arguments of one `LLVMRustCoverageWriteMappingToBuffer` call.
+struct LLVMRustCoverageFunctionMapping {
+  const unsigned *VirtualFileMappingIDs;
+  unsigned NumVirtualFileMappingIDs;
+  const coverage::CounterExpression *Expressions;
+  unsigned NumExpressions;
+  const LLVMRustCounterMappingRegion *MappingRegions;
+  unsigned NumMappingRegions;
+};
+
+// Encodes the coverage mappings of all of `Functions` one after the other into
+// `BufferOut`, as `LLVMRustCoverageWriteMappingToBuffer` would for each of
+// them. The encoding of function `i` ends up at `Offsets[i]` up to
+// `Offsets[i + 1]`, so `Offsets` must have room for `NumFunctions + 1` entries.
+extern "C" void LLVMRustCoverageWriteMappingsToBuffer(
+    const LLVMRustCoverageFunctionMapping *Functions,
+    size_t NumFunctions,
+    size_t *Offsets,
+    RustStringRef BufferOut) {
+  size_t SizeHint = 0;
+  for (size_t i = 0; i < NumFunctions; i++) {
+    SizeHint += mappingSizeHint(Functions[i].NumVirtualFileMappingIDs,
+                                Functions[i].NumExpressions,
+                                Functions[i].NumMappingRegions);
+  }
+  RawRustStringBufferOstream OS(BufferOut, SizeHint);
+  // Reused across functions to only allocate for the largest one.
+  SmallVector<coverage::CounterMappingRegion, 0> MappingRegions;
+  for (size_t i = 0; i < NumFunctions; i++) {
+    const LLVMRustCoverageFunctionMapping &Function = Functions[i];
+    MappingRegions.clear();
+    MappingRegions.reserve(Function.NumMappingRegions);
+    for (const auto &Region :
+         makeArrayRef(Function.MappingRegions, Function.NumMappingRegions)) {
+      MappingRegions.emplace_back(
+          Region.Count, Region.FileID, Region.ExpandedFileID,
+          Region.LineStart, Region.ColumnStart, Region.LineEnd,
+          Region.ColumnEnd, Region.Kind);
+    }
+    Offsets[i] = OS.tell();
+    auto CoverageMappingWriter = coverage::CoverageMappingWriter(
+        makeArrayRef(Function.VirtualFileMappingIDs,
+                     Function.NumVirtualFileMappingIDs),
+        makeArrayRef(Function.Expressions, Function.NumExpressions),
+        MappingRegions);
+    CoverageMappingWriter.write(OS);
+  }
+  Offsets[NumFunctions] = OS.tell();
+}
+
 extern "C" LLVMValueRef LLVMRustCoverageCreatePGOFuncNameVar(LLVMValueRef F, const char *FuncName) {
   StringRef FuncNameRef(FuncName);
   return wrap(createPGOFuncNameVar(*cast<Function>(unwrap(F)), FuncNameRef));
@@ -82,6 +155,19 @@ extern "C" uint64_t LLVMRustCoverageHashByteArray(
   return IndexedInstrProf::ComputeHash(StrRef);
 }
 
+// Same as calling `LLVMRustCoverageHashByteArray` on each of the `Num` byte
+// arrays, storing the hashes into `HashesOut`.
+extern "C" void LLVMRustCoverageHashByteArrays(
+    const char *const Bytes[],
+    const size_t *NumBytes,
+    size_t Num,
+    uint64_t *HashesOut) {
+  for (size_t i = 0; i < Num; i++) {
+    HashesOut[i] =
+        IndexedInstrProf::ComputeHash(StringRef(Bytes[i], NumBytes[i]));
+  }
+}
+
 static void WriteSectionNameToString(LLVMModuleRef M,
                                      InstrProfSectKind SK,
                                      RustStringRef Str) {
@@ -29,6 +29,9 @@
 #include "llvm/Transforms/Scalar.h"
 #include "llvm/Transforms/Vectorize.h"
 
+#include <algorithm>
+#include <thread>
+
 #define LLVM_VERSION_GE(major, minor)                                          \
   (LLVM_VERSION_MAJOR > (major) ||                                             \
    LLVM_VERSION_MAJOR == (major) && LLVM_VERSION_MINOR >= (minor))
@@ -82,12 +85,25 @@ enum LLVMRustAttribute {
   WillReturn = 29,
 };
 
+// The number of threads an entry point taking `NumThreads` runs on. rustc
+// resolves `-Z llvm-threads=0` to the number of CPUs before passing it on, but
+// a thread pool without any threads never finishes its work, so 0 is resolved
+// the same way here.
+inline unsigned resolveNumThreads(unsigned NumThreads) {
+  if (NumThreads == 0)
+    return std::max(std::thread::hardware_concurrency(), 1u);
+  return NumThreads;
+}
+
 typedef struct OpaqueRustString *RustStringRef;
 typedef struct LLVMOpaqueTwine *LLVMTwineRef;
 typedef struct LLVMOpaqueSMDiagnostic *LLVMSMDiagnosticRef;
 
 extern "C" void LLVMRustStringWriteImpl(RustStringRef Str, const char *Ptr,
                                         size_t Size);
+extern "C" char *LLVMRustStringReserve(RustStringRef Str, size_t Additional,
+                                       size_t *Capacity);
+extern "C" void LLVMRustStringCommit(RustStringRef Str, size_t Size);
 
 class RawRustStringOstream : public llvm::raw_ostream {
   RustStringRef Str;
@@ -108,3 +124,48 @@ public:
     flush();
   }
 };
+
+// Same as `RawRustStringOstream`, but buffers the output directly in the spare
+// capacity of the Rust string, after reserving room for `SizeHint` bytes up
+// front. Flushing then only has to commit the bytes already written there
+// instead of copying them across. Writes too large for the remaining buffer
+// are appended with `LLVMRustStringWriteImpl` as usual, and the buffer is
+// moved to the new end of the string, growing it as needed.
+//
+// The string must not be written to by anything else while the stream is
+// alive, and the stream must not be made unbuffered, as it is by
+// `formatted_raw_ostream`.
+class RawRustStringBufferOstream : public llvm::raw_ostream {
+  RustStringRef Str;
+  uint64_t Pos;
+
+  static constexpr size_t MinBufferSize = 4096;
+
+  void resetBuffer(size_t Additional) {
+    size_t Capacity;
+    char *Spare = LLVMRustStringReserve(Str, Additional, &Capacity);
+    SetBuffer(Spare, Capacity);
+  }
+
+  void write_impl(const char *Ptr, size_t Size) override {
+    if (Ptr == getBufferStart())
+      LLVMRustStringCommit(Str, Size);
+    else
+      LLVMRustStringWriteImpl(Str, Ptr, Size);
+    Pos += Size;
+    resetBuffer(MinBufferSize);
+  }
+
+  uint64_t current_pos() const override { return Pos; }
+
+public:
+  RawRustStringBufferOstream(RustStringRef Str, size_t SizeHint)
+      : Str(Str), Pos(0) {
+    resetBuffer(SizeHint ? SizeHint : MinBufferSize);
+  }
+
+  ~RawRustStringBufferOstream() {
+    // LLVM requires this.
+    flush();
+  }
+};
@@ -1,4 +1,8 @@
 #include "llvm/Linker/Linker.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/DiagnosticPrinter.h"
+#include "llvm/Support/ThreadPool.h"
 
 #include "LLVMWrapper.h"
 
@@ -26,13 +30,9 @@ LLVMRustLinkerFree(RustLinker *L) {
   delete L;
 }
 
-extern "C" bool
-LLVMRustLinkerAdd(RustLinker *L, char *BC, size_t Len) {
-  std::unique_ptr<MemoryBuffer> Buf =
-      MemoryBuffer::getMemBufferCopy(StringRef(BC, Len));
-
+static bool linkBuffer(RustLinker *L, MemoryBufferRef Buf) {
   Expected<std::unique_ptr<Module>> SrcOrError =
-      llvm::getLazyBitcodeModule(Buf->getMemBufferRef(), L->Ctx);
+      llvm::getLazyBitcodeModule(Buf, L->Ctx);
   if (!SrcOrError) {
     LLVMRustSetLastError(toString(SrcOrError.takeError()).c_str());
     return false;
@@ -46,3 +46,146 @@ LLVMRustLinkerAdd(RustLinker *L, char *BC, size_t Len) {
   }
   return true;
 }
+
+// Links the bitcode in `BC` into the linker's module, reading it from `BC`
+// directly instead of from a copy. The lazily loaded module is fully linked and
+// destroyed before this returns, and nothing in the destination module refers
+// to the buffer, so it only has to be kept alive for the duration of the call.
+extern "C" bool
+LLVMRustLinkerAddBorrowed(RustLinker *L, const char *BC, size_t Len) {
+  return linkBuffer(L, MemoryBufferRef(StringRef(BC, Len), ""));
+}
+
+namespace {
+// The result of linking a contiguous range of the inputs of
+// `LLVMRustLinkerAddBatch` in a context of its own.
+struct LinkGroup {
+  size_t Begin;
+  size_t End;
+  SmallVector<char, 0> Bitcode;
+  std::string Error;
+};
+} // namespace
+
+// Records the errors reported while linking a group, which would otherwise
+// make the default diagnostic handler exit the process.
+static void linkGroupDiagnosticHandler(const DiagnosticInfo &DI, void *Context) {
+  if (DI.getSeverity() != DS_Error)
+    return;
+  std::string &Error = *static_cast<std::string *>(Context);
+  raw_string_ostream OS(Error);
+  DiagnosticPrinterRawOStream DP(OS);
+  DI.print(DP);
+}
+
+static void linkGroup(const char **BCs, const size_t *Lens, LinkGroup &Group) {
+  LLVMContext Ctx;
+  Ctx.setDiagnosticHandlerCallBack(linkGroupDiagnosticHandler, &Group.Error);
+
+  Expected<std::unique_ptr<Module>> DstOrError = parseBitcodeFile(
+      MemoryBufferRef(StringRef(BCs[Group.Begin], Lens[Group.Begin]), ""), Ctx);
+  if (!DstOrError) {
+    Group.Error = toString(DstOrError.takeError());
+    return;
+  }
+  Module &Dst = **DstOrError;
+
+  Linker L(Dst);
+  for (size_t I = Group.Begin + 1; I < Group.End; I++) {
+    Expected<std::unique_ptr<Module>> SrcOrError = getLazyBitcodeModule(
+        MemoryBufferRef(StringRef(BCs[I], Lens[I]), ""), Ctx);
+    if (!SrcOrError) {
+      Group.Error = toString(SrcOrError.takeError());
+      return;
+    }
+    if (L.linkInModule(std::move(*SrcOrError))) {
+      if (Group.Error.empty())
+        Group.Error = "failed to link module";
+      return;
+    }
+  }
+
+  raw_svector_ostream OS(Group.Bitcode);
+  WriteBitcodeToFile(Dst, OS);
+}
+
+// The number of groups `LLVMRustLinkerAddBatch` splits its inputs into. This
+// is a constant rather than the number of threads so that the linked module,
+// whose order of globals and names of renamed types depend on the grouping,
+// is the same however many threads are used.
+static const size_t LinkBatchGroups = 16;
+
+// Links all of the `Num` bitcode buffers `BCs` into the linker's module, as if
+// added one by one with `LLVMRustLinkerAddBorrowed`. The buffers are split into
+// up to `LinkBatchGroups` contiguous groups, balanced by size, whose modules
+// are first linked together on up to `NumThreads` threads, each in its own
+// context. The results are then passed through bitcode to end up in the
+// linker's context and linked into its module there. As the order of the
+// inputs is kept, so is the choice between multiple definitions of a symbol.
+//
+// The buffers are only read during the call. Warnings from linking within the
+// groups are not reported.
+extern "C" bool
+LLVMRustLinkerAddBatch(RustLinker *L, const char **BCs, const size_t *Lens,
+                       size_t Num, unsigned NumThreads) {
+  NumThreads = resolveNumThreads(NumThreads);
+  if (Num <= 2) {
+    for (size_t I = 0; I < Num; I++) {
+      if (!LLVMRustLinkerAddBorrowed(L, BCs[I], Lens[I]))
+        return false;
+    }
+    return true;
+  }
+
+  size_t NumGroups = std::min<size_t>(LinkBatchGroups, Num / 2);
+  uint64_t TotalLen = 0;
+  for (size_t I = 0; I < Num; I++)
+    TotalLen += Lens[I];
+
+  std::vector<LinkGroup> Groups;
+  uint64_t GroupLen = 0;
+  for (size_t I = 0; I < Num; I++) {
+    if (Groups.empty() ||
+        (GroupLen * NumGroups >= TotalLen && Groups.size() < NumGroups)) {
+      Groups.push_back({I, I, {}, {}});
+      GroupLen = 0;
+    }
+    Groups.back().End = I + 1;
+    GroupLen += Lens[I];
+  }
+
+  {
+#if LLVM_VERSION_GE(11, 0)
+    ThreadPool Pool(hardware_concurrency(NumThreads));
+#else
+    ThreadPool Pool(NumThreads);
+#endif
+    for (LinkGroup &Group : Groups) {
+      // A single module can be linked from its own buffer directly.
+      if (Group.End - Group.Begin == 1)
+        continue;
+      LinkGroup *G = &Group;
+      Pool.async([BCs, Lens, G] { linkGroup(BCs, Lens, *G); });
+    }
+    Pool.wait();
+  }
+
+  for (LinkGroup &Group : Groups) {
+    if (!Group.Error.empty()) {
+      LLVMRustSetLastError(Group.Error.c_str());
+      return false;
+    }
+  }
+
+  for (LinkGroup &Group : Groups) {
+    bool Linked = Group.End - Group.Begin == 1
+        ? LLVMRustLinkerAddBorrowed(L, BCs[Group.Begin], Lens[Group.Begin])
+        : LLVMRustLinkerAddBorrowed(L, Group.Bitcode.data(),
+                                    Group.Bitcode.size());
+    if (!Linked)
+      return false;
+    // Free the group's bitcode as soon as it's linked.
+    Group.Bitcode = SmallVector<char, 0>();
+  }
+  return true;
+}
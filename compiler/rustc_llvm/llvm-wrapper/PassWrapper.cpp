@@ -1,30 +1,70 @@
 #include <stdio.h>
 
+#include <chrono>
+#include <mutex>
 #include <vector>
 #include <set>
 
 #include "LLVMWrapper.h"
 
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/BinaryFormat/COFF.h"
+#include "llvm/BinaryFormat/ELF.h"
+#include "llvm/CodeGen/AsmPrinter.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineModuleInfo.h"
+#include "llvm/CodeGen/Passes.h"
+#include "llvm/CodeGen/TargetPassConfig.h"
 #include "llvm/CodeGen/TargetSubtargetInfo.h"
 #include "llvm/InitializePasses.h"
 #include "llvm/IR/AutoUpgrade.h"
 #include "llvm/IR/AssemblyAnnotationWriter.h"
 #include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Mangler.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/MC/MCAsmBackend.h"
+#include "llvm/MC/MCAsmInfo.h"
+#include "llvm/MC/MCCodeEmitter.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCObjectFileInfo.h"
+#include "llvm/MC/MCObjectWriter.h"
+#include "llvm/MC/MCParser/MCAsmParser.h"
+#include "llvm/MC/MCParser/MCTargetAsmParser.h"
+#include "llvm/MC/MCRegisterInfo.h"
+#include "llvm/MC/MCSectionCOFF.h"
+#include "llvm/MC/MCSectionELF.h"
+#include "llvm/MC/MCSectionMachO.h"
+#include "llvm/MC/MCStreamer.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/BinaryFormat/Magic.h"
+#include "llvm/Bitcode/LLVMBitCodes.h"
+#include "llvm/Bitstream/BitstreamReader.h"
+#include "llvm/Object/ELF.h"
 #include "llvm/Object/ObjectFile.h"
 #include "llvm/Object/IRObjectFile.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/StandardInstrumentations.h"
 #include "llvm/Support/CBindingWrapping.h"
+#include "llvm/Support/Compression.h"
+#include "llvm/Support/EndianStream.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Host.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Transforms/IPO/PassManagerBuilder.h"
 #include "llvm/Transforms/IPO/AlwaysInliner.h"
 #include "llvm/Transforms/IPO/FunctionImport.h"
+#include "llvm/Transforms/IPO/WholeProgramDevirt.h"
 #include "llvm/Transforms/Utils/FunctionImportUtils.h"
 #include "llvm/LTO/LTO.h"
 #include "llvm-c/Transforms/PassManagerBuilder.h"
@@ -37,6 +77,7 @@
 #include "llvm/Transforms/Instrumentation/ThreadSanitizer.h"
 #include "llvm/Transforms/Instrumentation/MemorySanitizer.h"
 #include "llvm/Transforms/Instrumentation/HWAddressSanitizer.h"
+#include "llvm/Transforms/Utils/Local.h"
 #include "llvm/Transforms/Utils/CanonicalizeAliases.h"
 #include "llvm/Transforms/Utils/NameAnonGlobals.h"
 
@@ -52,18 +93,24 @@ DEFINE_STDCXX_CONVERSION_FUNCTIONS(PassManagerBuilder,
                                    LLVMPassManagerBuilderRef)
 #endif
 
+// Populates the legacy pass registry. Only the first call does anything, so
+// this can be called lazily from wherever the legacy pass manager is about to
+// be used, from any thread.
 extern "C" void LLVMInitializePasses() {
-  PassRegistry &Registry = *PassRegistry::getPassRegistry();
-  initializeCore(Registry);
-  initializeCodeGen(Registry);
-  initializeScalarOpts(Registry);
-  initializeVectorization(Registry);
-  initializeIPO(Registry);
-  initializeAnalysis(Registry);
-  initializeTransformUtils(Registry);
-  initializeInstCombine(Registry);
-  initializeInstrumentation(Registry);
-  initializeTarget(Registry);
+  static std::once_flag Initialized;
+  std::call_once(Initialized, [] {
+    PassRegistry &Registry = *PassRegistry::getPassRegistry();
+    initializeCore(Registry);
+    initializeCodeGen(Registry);
+    initializeScalarOpts(Registry);
+    initializeVectorization(Registry);
+    initializeIPO(Registry);
+    initializeAnalysis(Registry);
+    initializeTransformUtils(Registry);
+    initializeInstCombine(Registry);
+    initializeInstrumentation(Registry);
+    initializeTarget(Registry);
+  });
 }
 
 extern "C" void LLVMTimeTraceProfilerInitialize() {
@@ -81,6 +128,28 @@ extern "C" void LLVMTimeTraceProfilerFinish(const char* FileName) {
   timeTraceProfilerCleanup();
 }
 
+// Sets up the time-trace profiler of a worker thread, once the main thread's
+// profiler has been set up with `LLVMTimeTraceProfilerInitialize`. Every such
+// thread must call `LLVMTimeTraceProfilerFinishThread` before it exits and
+// before `LLVMTimeTraceProfilerFinish` merges the traces of all threads into
+// one, each with its own thread id.
+//
+// Older versions of LLVM only support a single, global profiler, in which case
+// these don't do anything.
+extern "C" void LLVMTimeTraceProfilerInitializeThread() {
+#if LLVM_VERSION_GE(11, 0)
+  timeTraceProfilerInitialize(
+      /* TimeTraceGranularity */ 0,
+      /* ProcName */ "rustc");
+#endif
+}
+
+extern "C" void LLVMTimeTraceProfilerFinishThread() {
+#if LLVM_VERSION_GE(11, 0)
+  timeTraceProfilerFinishThread();
+#endif
+}
+
 enum class LLVMRustPassKind {
   Other,
   Function,
@@ -109,9 +178,9 @@ extern "C" LLVMPassRef LLVMRustFindAndCreatePass(const char *PassName) {
   return nullptr;
 }
 
-extern "C" LLVMPassRef LLVMRustCreateAddressSanitizerFunctionPass(bool Recover) {
+extern "C" LLVMPassRef LLVMRustCreateAddressSanitizerFunctionPass(bool Recover,
+                                                                   bool UseAfterScope) {
   const bool CompileKernel = false;
-  const bool UseAfterScope = true;
 
   return wrap(createAddressSanitizerFunctionPass(CompileKernel, Recover, UseAfterScope));
 }
@@ -423,6 +492,43 @@ extern "C" void LLVMRustGetTargetFeature(LLVMTargetMachineRef TM, size_t Index,
   *Desc = Feat.Desc;
 }
 
+// The results of `LLVMRustGetTargetFeatures`, by triple, CPU and features of
+// the target machine they were computed for.
+static StringMap<std::string> TargetFeaturesCache;
+static std::mutex TargetFeaturesCacheLock;
+
+// Writes all of the features known for the target of `TM` to `Str` in one
+// go, instead of one at a time as `LLVMRustGetTargetFeature` does. Each is
+// written as `+` if `TM` has it enabled, or `-` if not, followed by its name,
+// a NUL, its description and another NUL. The result is computed once per
+// process for each combination of triple, CPU and features.
+extern "C" bool LLVMRustGetTargetFeatures(LLVMTargetMachineRef TM,
+                                          RustStringRef Str) {
+  const TargetMachine *Target = unwrap(TM);
+  std::string Key = Target->getTargetTriple().str();
+  Key += '\0';
+  Key += Target->getTargetCPU();
+  Key += '\0';
+  Key += Target->getTargetFeatureString();
+
+  std::lock_guard<std::mutex> Lock(TargetFeaturesCacheLock);
+  auto Inserted = TargetFeaturesCache.try_emplace(Key);
+  std::string &Features = Inserted.first->second;
+  if (Inserted.second) {
+    const MCSubtargetInfo *MCInfo = Target->getMCSubtargetInfo();
+    const FeatureBitset &Bits = MCInfo->getFeatureBits();
+    raw_string_ostream OS(Features);
+    for (const SubtargetFeatureKV &Feat : MCInfo->getFeatureTable()) {
+      OS << (Bits[Feat.Value] ? '+' : '-') << Feat.Key << '\0' << Feat.Desc
+         << '\0';
+    }
+    OS.flush();
+  }
+  RawRustStringOstream OS(Str);
+  OS << Features;
+  return true;
+}
+
 #else
 
 extern "C" void LLVMRustPrintTargetCPUs(LLVMTargetMachineRef) {
@@ -434,6 +540,10 @@ extern "C" size_t LLVMRustGetTargetFeaturesCount(LLVMTargetMachineRef) {
 }
 
 extern "C" void LLVMRustGetTargetFeature(LLVMTargetMachineRef, const char**, const char**) {}
+
+extern "C" bool LLVMRustGetTargetFeatures(LLVMTargetMachineRef, RustStringRef) {
+  return false;
+}
 #endif
 
 extern "C" const char* LLVMRustGetHostCPUName(size_t *len) {
@@ -442,7 +552,100 @@ extern "C" const char* LLVMRustGetHostCPUName(size_t *len) {
   return Name.data();
 }
 
-extern "C" LLVMTargetMachineRef LLVMRustCreateTargetMachine(
+// Writes the features of the host CPU to `Str`, in the `+feature,-feature`
+// form of a target feature string, or returns false if they can't be detected
+// on this host.
+extern "C" bool LLVMRustGetHostCPUFeatures(RustStringRef Str) {
+  StringMap<bool> Features;
+  if (!sys::getHostCPUFeatures(Features))
+    return false;
+
+  std::vector<std::string> Sorted;
+  Sorted.reserve(Features.size());
+  for (auto &Feature : Features)
+    Sorted.push_back((Feature.getValue() ? "+" : "-") + Feature.getKey().str());
+  // The order of a `StringMap` isn't stable, but the result might end up in
+  // the target feature string of a module.
+  llvm::sort(Sorted, [](const std::string &A, const std::string &B) {
+    return StringRef(A).drop_front() < StringRef(B).drop_front();
+  });
+
+  RawRustStringOstream OS(Str);
+  for (size_t I = 0; I < Sorted.size(); I++) {
+    if (I)
+      OS << ',';
+    OS << Sorted[I];
+  }
+  return true;
+}
+
+// Which functions the machine outliner outlines from.
+enum class LLVMRustMachineOutliner {
+  Never,
+  // The functions that the target outlines from by default, which on AArch64
+  // are the `minsize` ones, and none on most other targets.
+  TargetDefault,
+};
+
+// A validated target machine configuration, from which any number of target
+// machines can be created without looking up the target or rebuilding the
+// options again. Target machines which are no longer needed are given back to
+// the factory, and handed out again instead of creating new ones. They're
+// only freed together with the factory.
+struct LLVMRustTargetMachineFactory {
+  const llvm::Target *TheTarget;
+  std::string TripleStr;
+  std::string CPU;
+  std::string Feature;
+  TargetOptions Options;
+  Reloc::Model RM;
+  Optional<CodeModel::Model> CM;
+  CodeGenOpt::Level OptLevel;
+  // Targets set up the machine outliner in the constructor of their target
+  // machine, overriding `Options`, so this is applied to the target machines
+  // once they're created.
+  Optional<LLVMRustMachineOutliner> MachineOutliner;
+
+  std::mutex Lock;
+  std::vector<std::unique_ptr<TargetMachine>> Idle;
+
+  TargetMachine *create() const {
+    return TheTarget->createTargetMachine(
+        TripleStr, CPU, Feature, Options, RM, CM, OptLevel);
+  }
+};
+
+enum class LLVMRustDebugCompression {
+  None,
+  Zlib,
+  Zstd,
+};
+
+// Sets how the debug info sections of emitted objects are compressed. This
+// applies to the split DWARF output as well, which is written by the same
+// object writer.
+static bool setDebugCompression(TargetOptions &Options,
+                                LLVMRustDebugCompression Compression) {
+  switch (Compression) {
+  case LLVMRustDebugCompression::None:
+    Options.CompressDebugSections = DebugCompressionType::None;
+    return true;
+  case LLVMRustDebugCompression::Zlib:
+    if (!zlib::isAvailable()) {
+      LLVMRustSetLastError("LLVM was built without zlib support");
+      return false;
+    }
+    Options.CompressDebugSections = DebugCompressionType::Z;
+    return true;
+  case LLVMRustDebugCompression::Zstd:
+    LLVMRustSetLastError("zstd compressed debug sections require LLVM 16 or later");
+    return false;
+  }
+  report_fatal_error("Bad DebugCompression.");
+}
+
+static bool initTargetMachineFactory(
+    LLVMRustTargetMachineFactory &Factory,
     const char *TripleStr, const char *CPU, const char *Feature,
     const char *ABIStr, LLVMRustCodeModel RustCM, LLVMRustRelocModel RustReloc,
     LLVMRustCodeGenOptLevel RustOptLevel, bool UseSoftFloat,
@@ -454,22 +657,24 @@ extern "C" LLVMTargetMachineRef LLVMRustCreateTargetMachine(
     bool EmitStackSizeSection,
     bool RelaxELFRelocations,
     bool UseInitArray,
-    const char *SplitDwarfFile) {
+    LLVMRustDebugCompression DebugCompression) {
 
-  auto OptLevel = fromRust(RustOptLevel);
-  auto RM = fromRust(RustReloc);
-  auto CM = fromRust(RustCM);
+  Factory.OptLevel = fromRust(RustOptLevel);
+  Factory.RM = fromRust(RustReloc);
+  Factory.CM = fromRust(RustCM);
 
   std::string Error;
   Triple Trip(Triple::normalize(TripleStr));
-  const llvm::Target *TheTarget =
-      TargetRegistry::lookupTarget(Trip.getTriple(), Error);
-  if (TheTarget == nullptr) {
+  Factory.TheTarget = TargetRegistry::lookupTarget(Trip.getTriple(), Error);
+  if (Factory.TheTarget == nullptr) {
     LLVMRustSetLastError(Error.c_str());
-    return nullptr;
+    return false;
   }
+  Factory.TripleStr = Trip.getTriple();
+  Factory.CPU = CPU;
+  Factory.Feature = Feature;
 
-  TargetOptions Options;
+  TargetOptions &Options = Factory.Options;
 
   Options.FloatABIType = FloatABI::Default;
   if (UseSoftFloat) {
@@ -480,9 +685,6 @@ extern "C" LLVMTargetMachineRef LLVMRustCreateTargetMachine(
   Options.MCOptions.AsmVerbose = AsmComments;
   Options.MCOptions.PreserveAsmComments = AsmComments;
   Options.MCOptions.ABIName = ABIStr;
-  if (SplitDwarfFile) {
-      Options.MCOptions.SplitDwarfFile = SplitDwarfFile;
-  }
   Options.RelaxELFRelocations = RelaxELFRelocations;
   Options.UseInitArray = UseInitArray;
 
@@ -499,16 +701,179 @@ extern "C" LLVMTargetMachineRef LLVMRustCreateTargetMachine(
   }
 
   Options.EmitStackSizeSection = EmitStackSizeSection;
-
-  TargetMachine *TM = TheTarget->createTargetMachine(
-      Trip.getTriple(), CPU, Feature, Options, RM, CM, OptLevel);
-  return wrap(TM);
+  return setDebugCompression(Options, DebugCompression);
 }
 
 extern "C" void LLVMRustDisposeTargetMachine(LLVMTargetMachineRef TM) {
   delete unwrap(TM);
 }
 
+// The split DWARF file usually differs between the target machines, so it's
+// given to `LLVMRustCreateTargetMachineFromFactory` instead.
+extern "C" LLVMRustTargetMachineFactory *LLVMRustCreateTargetMachineFactory(
+    const char *TripleStr, const char *CPU, const char *Feature,
+    const char *ABIStr, LLVMRustCodeModel RustCM, LLVMRustRelocModel RustReloc,
+    LLVMRustCodeGenOptLevel RustOptLevel, bool UseSoftFloat,
+    bool FunctionSections,
+    bool DataSections,
+    bool TrapUnreachable,
+    bool Singlethread,
+    bool AsmComments,
+    bool EmitStackSizeSection,
+    bool RelaxELFRelocations,
+    bool UseInitArray,
+    LLVMRustDebugCompression DebugCompression) {
+  auto Factory = std::make_unique<LLVMRustTargetMachineFactory>();
+  if (!initTargetMachineFactory(
+          *Factory, TripleStr, CPU, Feature, ABIStr, RustCM, RustReloc,
+          RustOptLevel, UseSoftFloat, FunctionSections, DataSections,
+          TrapUnreachable, Singlethread, AsmComments, EmitStackSizeSection,
+          RelaxELFRelocations, UseInitArray, DebugCompression))
+    return nullptr;
+  return Factory.release();
+}
+
+extern "C" void
+LLVMRustFreeTargetMachineFactory(LLVMRustTargetMachineFactory *Factory) {
+  delete Factory;
+}
+
+// Returns a target machine with the factory's configuration, emitting split
+// DWARF into `SplitDwarfFile` if it isn't empty. It's one released to the
+// factory before if there is one, or a new one otherwise. This may be called
+// from multiple threads at once.
+extern "C" LLVMTargetMachineRef
+LLVMRustCreateTargetMachineFromFactory(LLVMRustTargetMachineFactory *Factory,
+                                       const char *SplitDwarfFile) {
+  std::unique_ptr<TargetMachine> TM;
+  {
+    std::lock_guard<std::mutex> Lock(Factory->Lock);
+    if (!Factory->Idle.empty()) {
+      TM = std::move(Factory->Idle.back());
+      Factory->Idle.pop_back();
+    }
+  }
+  if (!TM) {
+    TM.reset(Factory->create());
+    if (!TM) {
+      LLVMRustSetLastError("the target doesn't support this configuration");
+      return nullptr;
+    }
+    if (Factory->MachineOutliner) {
+      bool Enable =
+          *Factory->MachineOutliner == LLVMRustMachineOutliner::TargetDefault;
+      TM->setMachineOutliner(Enable);
+      if (Enable)
+        TM->setSupportsDefaultOutlining(true);
+    }
+  }
+  // The split DWARF file is the only option which differs between the uses of
+  // a target machine. The rest are set up by the target when it's created.
+  TM->Options.MCOptions.SplitDwarfFile = SplitDwarfFile;
+  return wrap(TM.release());
+}
+
+// Gives a target machine created by `Factory` back to it, to be handed out
+// again by `LLVMRustCreateTargetMachineFromFactory`. The passes and modules
+// using it must be gone by then. This may be called from multiple threads at
+// once.
+extern "C" void
+LLVMRustReleaseTargetMachineToFactory(LLVMRustTargetMachineFactory *Factory,
+                                      LLVMTargetMachineRef TM) {
+  std::unique_ptr<TargetMachine> Released(unwrap(TM));
+  std::lock_guard<std::mutex> Lock(Factory->Lock);
+  Factory->Idle.push_back(std::move(Released));
+}
+
+enum class LLVMRustBasicBlockSections {
+  None,
+  All,
+  List,
+  Labels,
+};
+
+// Sets up the code layout options of `Options`: whether functions are split
+// into hot and cold parts based on their profile, and which basic blocks get
+// sections, or labels, of their own. With `LLVMRustBasicBlockSections::List`,
+// these are taken from the cluster list at `ClusterFile`, in the format that
+// clang's `-fbasic-block-sections=<file>` takes.
+static bool
+setCodeLayoutOptions(TargetOptions &Options, bool SplitMachineFunctions,
+                     LLVMRustBasicBlockSections Sections,
+                     const char *ClusterFile) {
+#if LLVM_VERSION_GE(12, 0)
+  Options.EnableMachineFunctionSplitter = SplitMachineFunctions;
+#else
+  if (SplitMachineFunctions) {
+    LLVMRustSetLastError("machine function splitting requires LLVM 12 or later");
+    return false;
+  }
+#endif
+
+#if LLVM_VERSION_GE(11, 0)
+  switch (Sections) {
+  case LLVMRustBasicBlockSections::None:
+    Options.BBSections = BasicBlockSection::None;
+    break;
+  case LLVMRustBasicBlockSections::All:
+    Options.BBSections = BasicBlockSection::All;
+    break;
+  case LLVMRustBasicBlockSections::Labels:
+    Options.BBSections = BasicBlockSection::Labels;
+    break;
+  case LLVMRustBasicBlockSections::List: {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> BufOr =
+        MemoryBuffer::getFile(ClusterFile);
+    if (!BufOr) {
+      std::string Message = std::string("failed to read ") + ClusterFile +
+                            ": " + BufOr.getError().message();
+      LLVMRustSetLastError(Message.c_str());
+      return false;
+    }
+    Options.BBSections = BasicBlockSection::List;
+    Options.BBSectionsFuncListBuf = std::move(*BufOr);
+    break;
+  }
+  }
+#else
+  if (Sections != LLVMRustBasicBlockSections::None) {
+    LLVMRustSetLastError("basic block sections require LLVM 11 or later");
+    return false;
+  }
+#endif
+  return true;
+}
+
+// Sets the code layout options of the target machines `Factory` creates, see
+// `setCodeLayoutOptions`. Target machines that were already created keep their
+// options, so this has to be called before the first one is created. Returns
+// false if the options are not supported by this LLVM version or the cluster
+// list can't be read.
+extern "C" bool
+LLVMRustTargetMachineFactorySetCodeLayoutOptions(
+    LLVMRustTargetMachineFactory *Factory, bool SplitMachineFunctions,
+    LLVMRustBasicBlockSections Sections, const char *ClusterFile) {
+  return setCodeLayoutOptions(Factory->Options, SplitMachineFunctions,
+                              Sections, ClusterFile);
+}
+
+// Sets which functions the machine outliner outlines repeated instruction
+// sequences from in the target machines `Factory` creates, when code is
+// generated at an optimization level other than none. As with
+// `LLVMRustTargetMachineFactorySetCodeLayoutOptions`, this has to be called
+// before the first target machine is created.
+extern "C" void
+LLVMRustTargetMachineFactorySetMachineOutliner(
+    LLVMRustTargetMachineFactory *Factory, LLVMRustMachineOutliner Mode) {
+  switch (Mode) {
+  case LLVMRustMachineOutliner::Never:
+  case LLVMRustMachineOutliner::TargetDefault:
+    Factory->MachineOutliner = Mode;
+    return;
+  }
+  report_fatal_error("Bad MachineOutliner.");
+}
+
 extern "C" void LLVMRustConfigurePassManagerBuilder(
     LLVMPassManagerBuilderRef PMBR, LLVMRustCodeGenOptLevel OptLevel,
     bool MergeFunctions, bool SLPVectorize, bool LoopVectorize, bool PrepareForThinLTO,
@@ -530,27 +895,148 @@ extern "C" void LLVMRustConfigurePassManagerBuilder(
   }
 }
 
+enum class LLVMRustPGOAction {
+  None,
+  IRInstr,
+  IRUse,
+  SampleUse,
+};
+
+enum class LLVMRustCSPGOAction {
+  None,
+  CSIRInstr,
+  CSIRUse,
+};
+
+// The profile-guided optimization to perform, as a superset of the
+// `PGOGenPath` and `PGOUsePath` arguments. `ProfileFile` is the profile to
+// instrument for or to use, depending on `Action`. `CSIRInstr` writes the
+// context-sensitive profile to `CSProfileGenFile`, and `CSIRUse` reads it from
+// `ProfileFile`, which requires `Action` to be `IRUse`. Unset paths are null.
+struct LLVMRustPGOOptions {
+  LLVMRustPGOAction Action;
+  LLVMRustCSPGOAction CSAction;
+  const char *ProfileFile;
+  const char *CSProfileGenFile;
+  const char *ProfileRemappingFile;
+  bool DebugInfoForProfiling;
+};
+
+static Optional<PGOOptions> toPGOOptions(const LLVMRustPGOOptions &Opts) {
+  PGOOptions::PGOAction Action = PGOOptions::NoAction;
+  switch (Opts.Action) {
+  case LLVMRustPGOAction::None:
+    break;
+  case LLVMRustPGOAction::IRInstr:
+    Action = PGOOptions::IRInstr;
+    break;
+  case LLVMRustPGOAction::IRUse:
+    Action = PGOOptions::IRUse;
+    break;
+  case LLVMRustPGOAction::SampleUse:
+    Action = PGOOptions::SampleUse;
+    break;
+  }
+  PGOOptions::CSPGOAction CSAction = PGOOptions::NoCSAction;
+  switch (Opts.CSAction) {
+  case LLVMRustCSPGOAction::None:
+    break;
+  case LLVMRustCSPGOAction::CSIRInstr:
+    CSAction = PGOOptions::CSIRInstr;
+    break;
+  case LLVMRustCSPGOAction::CSIRUse:
+    CSAction = PGOOptions::CSIRUse;
+    break;
+  }
+  if (Action == PGOOptions::NoAction && CSAction == PGOOptions::NoCSAction &&
+      !Opts.DebugInfoForProfiling)
+    return None;
+
+  PGOOptions PGOOpt(Opts.ProfileFile ? Opts.ProfileFile : "",
+                    Opts.CSProfileGenFile ? Opts.CSProfileGenFile : "",
+                    Opts.ProfileRemappingFile ? Opts.ProfileRemappingFile : "",
+                    Action, CSAction);
+#if LLVM_VERSION_GE(12, 0)
+  PGOOpt.DebugInfoForProfiling = Opts.DebugInfoForProfiling;
+#else
+  PGOOpt.SamplePGOSupport = Opts.DebugInfoForProfiling;
+#endif
+  return PGOOpt;
+}
+
+// Same as the PGO arguments of `LLVMRustConfigurePassManagerBuilder`, but with
+// all of `LLVMRustPGOOptions` except for the remapping file, which the legacy
+// pass manager has no support for.
+extern "C" void LLVMRustConfigurePassManagerBuilderPGO(
+    LLVMPassManagerBuilderRef PMBR, const LLVMRustPGOOptions *Opts) {
+  PassManagerBuilder *PMB = unwrap(PMBR);
+  switch (Opts->Action) {
+  case LLVMRustPGOAction::None:
+    break;
+  case LLVMRustPGOAction::IRInstr:
+    PMB->EnablePGOInstrGen = true;
+    PMB->PGOInstrGen = Opts->ProfileFile;
+    break;
+  case LLVMRustPGOAction::IRUse:
+    PMB->PGOInstrUse = Opts->ProfileFile;
+    break;
+  case LLVMRustPGOAction::SampleUse:
+    PMB->PGOSampleUse = Opts->ProfileFile;
+    break;
+  }
+  switch (Opts->CSAction) {
+  case LLVMRustCSPGOAction::None:
+    break;
+  case LLVMRustCSPGOAction::CSIRInstr:
+    PMB->EnablePGOCSInstrGen = true;
+    PMB->PGOInstrGen = Opts->CSProfileGenFile;
+    break;
+  case LLVMRustCSPGOAction::CSIRUse:
+    PMB->EnablePGOCSInstrUse = true;
+    break;
+  }
+}
+
+// The library information of each target triple, with and without the library
+// functions disabled, computed once per process. The entries are never changed
+// or removed once added, so they can be read without holding the lock.
+static StringMap<std::unique_ptr<TargetLibraryInfoImpl>> TargetLibraryInfoCache;
+static std::mutex TargetLibraryInfoCacheLock;
+
+// Returns the library information for `TargetTriple`, to be copied by the
+// analyses and passes using it.
+static const TargetLibraryInfoImpl &
+getTargetLibraryInfo(const std::string &TargetTriple,
+                     bool DisableSimplifyLibCalls) {
+  std::string Key = TargetTriple;
+  Key += DisableSimplifyLibCalls ? '\1' : '\0';
+
+  std::lock_guard<std::mutex> Lock(TargetLibraryInfoCacheLock);
+  std::unique_ptr<TargetLibraryInfoImpl> &TLII = TargetLibraryInfoCache[Key];
+  if (!TLII) {
+    TLII = std::make_unique<TargetLibraryInfoImpl>(Triple(TargetTriple));
+    if (DisableSimplifyLibCalls)
+      TLII->disableAllFunctions();
+  }
+  return *TLII;
+}
+
 // Unfortunately, the LLVM C API doesn't provide a way to set the `LibraryInfo`
-// field of a PassManagerBuilder, we expose our own method of doing so.
+// field of a PassManagerBuilder, we expose our own method of doing so. The
+// builder takes ownership of it, and frees it when disposed of.
 extern "C" void LLVMRustAddBuilderLibraryInfo(LLVMPassManagerBuilderRef PMBR,
                                               LLVMModuleRef M,
                                               bool DisableSimplifyLibCalls) {
-  Triple TargetTriple(unwrap(M)->getTargetTriple());
-  TargetLibraryInfoImpl *TLI = new TargetLibraryInfoImpl(TargetTriple);
-  if (DisableSimplifyLibCalls)
-    TLI->disableAllFunctions();
-  unwrap(PMBR)->LibraryInfo = TLI;
+  unwrap(PMBR)->LibraryInfo = new TargetLibraryInfoImpl(getTargetLibraryInfo(
+      unwrap(M)->getTargetTriple(), DisableSimplifyLibCalls));
 }
 
 // Unfortunately, the LLVM C API doesn't provide a way to create the
 // TargetLibraryInfo pass, so we use this method to do so.
 extern "C" void LLVMRustAddLibraryInfo(LLVMPassManagerRef PMR, LLVMModuleRef M,
                                        bool DisableSimplifyLibCalls) {
-  Triple TargetTriple(unwrap(M)->getTargetTriple());
-  TargetLibraryInfoImpl TLII(TargetTriple);
-  if (DisableSimplifyLibCalls)
-    TLII.disableAllFunctions();
-  unwrap(PMR)->add(new TargetLibraryInfoWrapperPass(TLII));
+  unwrap(PMR)->add(new TargetLibraryInfoWrapperPass(getTargetLibraryInfo(
+      unwrap(M)->getTargetTriple(), DisableSimplifyLibCalls)));
 }
 
 // Unfortunately, the LLVM C API doesn't provide an easy way of iterating over
@@ -574,6 +1060,14 @@ extern "C" void LLVMRustRunFunctionPassManager(LLVMPassManagerRef PMR,
   P->doFinalization();
 }
 
+// The arguments `LLVMRustSetLLVMOptions` parsed, NUL-separated. Options such
+// as `-import-instr-limit` change the ThinLTO analysis, so the ThinLTO data
+// cache is keyed on them.
+static std::string &llvmOptionsString() {
+  static std::string Options;
+  return Options;
+}
+
 extern "C" void LLVMRustSetLLVMOptions(int Argc, char **Argv) {
   // Initializing the command-line options more than once is not allowed. So,
   // check if they've already been initialized.  (This could happen if we're
@@ -583,6 +1077,10 @@ extern "C" void LLVMRustSetLLVMOptions(int Argc, char **Argv) {
   if (Initialized)
     return;
   Initialized = true;
+  for (int i = 0; i < Argc; i++) {
+    llvmOptionsString() += Argv[i];
+    llvmOptionsString() += '\0';
+  }
   cl::ParseCommandLineOptions(Argc, Argv);
 }
 
@@ -644,35 +1142,382 @@ LLVMRustWriteOutputFile(LLVMTargetMachineRef Target, LLVMPassManagerRef PMR,
   return LLVMRustResult::Success;
 }
 
+// Whether `LLVMRustWriteAssemblyAndObjectFile` can be used with this target
+// machine, i.e. whether its target can parse the assembly it prints, and the
+// round trip through assembly is known to produce the same object file. This
+// is limited to the ELF, COFF and Mach-O object writers; others, such as
+// WebAssembly, print assembly their parser does not fully accept.
+extern "C" bool
+LLVMRustTargetMachineCanAssemble(LLVMTargetMachineRef TM) {
+  TargetMachine *Target = unwrap(TM);
+  const Triple &T = Target->getTargetTriple();
+  if (!T.isOSBinFormatELF() && !T.isOSBinFormatCOFF() &&
+      !T.isOSBinFormatMachO())
+    return false;
+  return Target->getTarget().hasMCAsmParser();
+}
+
+// Assembles `Asm`, as printed by `TM` for `M`, into an object file written to
+// `OS`, the same way the integrated assembler of `clang -cc1as` would.
+//
+// The target machine's own MC layer is used, so that the assembler sees the
+// `MCAsmInfo` set up by `TargetMachine::initAsmInfo` (exception model,
+// relocation relaxation, debug section compression, ...) exactly as a direct
+// object emission would.
+static bool assemble(TargetMachine &TM, const Module &M, StringRef Asm,
+                     raw_pwrite_stream &OS, std::string &Error) {
+  const Target &T = TM.getTarget();
+  const Triple &TheTriple = TM.getTargetTriple();
+  MCTargetOptions MCOptions = TM.Options.MCOptions;
+
+  const MCRegisterInfo *MRI = TM.getMCRegisterInfo();
+  const MCAsmInfo *MAI = TM.getMCAsmInfo();
+  const MCSubtargetInfo *STI = TM.getMCSubtargetInfo();
+  const MCInstrInfo *MCII = TM.getMCInstrInfo();
+  if (!MRI || !MAI || !STI || !MCII) {
+    Error = "unable to create the target's MC layer";
+    return false;
+  }
+
+  SourceMgr SrcMgr;
+  SrcMgr.AddNewSourceBuffer(
+      MemoryBuffer::getMemBuffer(Asm, "<codegen>", false), SMLoc());
+  raw_string_ostream ErrorOS(Error);
+  SrcMgr.setDiagHandler(
+      [](const SMDiagnostic &Diag, void *Context) {
+        if (Diag.getKind() == SourceMgr::DK_Error)
+          Diag.print(nullptr, *static_cast<raw_string_ostream *>(Context),
+                     /* ShowColors = */ false);
+      },
+      &ErrorOS);
+
+  bool PIC = TM.isPositionIndependent();
+  bool LargeCodeModel = TM.getCodeModel() == CodeModel::Large;
+  MCObjectFileInfo MOFI;
+#if LLVM_VERSION_GE(13, 0)
+  MCContext Ctx(TheTriple, MAI, MRI, STI, &SrcMgr, &MCOptions);
+  MOFI.initMCObjectFileInfo(Ctx, PIC, LargeCodeModel);
+  Ctx.setObjectFileInfo(&MOFI);
+#else
+  MCContext Ctx(MAI, MRI, &MOFI, &SrcMgr, &MCOptions);
+  MOFI.InitMCObjectFileInfo(TheTriple, PIC, Ctx, LargeCodeModel);
+#endif
+  // The printer emits `.file`/`.loc` directives and the debug sections for the
+  // module's DWARF version, which the assembler must agree on, as `DwarfDebug`
+  // sets it on the context of a direct emission.
+  if (unsigned DwarfVersion = M.getDwarfVersion())
+    Ctx.setDwarfVersion(DwarfVersion);
+
+  MCCodeEmitter *CE = T.createMCCodeEmitter(*MCII, *MRI, Ctx);
+  MCAsmBackend *MAB = T.createMCAsmBackend(*STI, *MRI, MCOptions);
+  if (!CE || !MAB) {
+    Error = "unable to create the target's object streamer";
+    return false;
+  }
+  std::unique_ptr<MCStreamer> Streamer(T.createMCObjectStreamer(
+      TheTriple, Ctx, std::unique_ptr<MCAsmBackend>(MAB),
+      MAB->createObjectWriter(OS), std::unique_ptr<MCCodeEmitter>(CE), *STI,
+      MCOptions.MCRelaxAll, MCOptions.MCIncrementalLinkerCompatible,
+      /* DWARFMustBeAtTheEnd = */ true));
+
+  std::unique_ptr<MCAsmParser> Parser(
+      createMCAsmParser(SrcMgr, Ctx, *Streamer, *MAI));
+  std::unique_ptr<MCTargetAsmParser> TAP(
+      T.createMCAsmParser(*STI, *Parser, *MCII, MCOptions));
+  if (!TAP) {
+    Error = "target does not support assembly parsing";
+    return false;
+  }
+  Parser->setTargetParser(*TAP);
+  bool Failed = Parser->Run(/* NoInitialTextSection = */ false);
+  ErrorOS.flush();
+  if (Failed && Error.empty())
+    Error = "failed to assemble the emitted assembly";
+  return !Failed;
+}
+
+// Emits both the assembly file `AsmPath` and the object file `ObjPath` for
+// `M`, for `--emit=asm,obj`. Instead of running codegen once per file type,
+// which needs a clone of the module and doubles the time spent in instruction
+// selection and the machine passes, the module is compiled once to assembly,
+// which is then assembled into the object file. This is a round trip through
+// the printed assembly, not a single emission feeding both the printer and an
+// object streamer, which LLVM has no streamer for. The object therefore only
+// matches a direct emission as far as the assembly does not lose information,
+// and this is only used when requested with `-Z asm-round-trip`, and for the
+// targets accepted by `LLVMRustTargetMachineCanAssemble`.
+//
+// Split DWARF is not supported, as the assembler would need the `.dwo`
+// sections to be split off from the printed file.
+extern "C" LLVMRustResult
+LLVMRustWriteAssemblyAndObjectFile(LLVMTargetMachineRef Target,
+                                   LLVMPassManagerRef PMR, LLVMModuleRef M,
+                                   const char *AsmPath, const char *ObjPath) {
+  llvm::legacy::PassManager *PM = unwrap<llvm::legacy::PassManager>(PMR);
+  TargetMachine &TM = *unwrap(Target);
+
+  SmallString<0> Asm;
+  {
+    raw_svector_ostream AsmOS(Asm);
+    TM.addPassesToEmitFile(*PM, AsmOS, nullptr, CGFT_AssemblyFile, false);
+    PM->run(*unwrap(M));
+  }
+  // As in `LLVMRustWriteOutputFile`, the pass manager refers to the stream.
+  LLVMDisposePassManager(PMR);
+
+  std::error_code EC;
+  {
+    raw_fd_ostream OS(AsmPath, EC, sys::fs::OF_None);
+    if (EC) {
+      LLVMRustSetLastError(EC.message().c_str());
+      return LLVMRustResult::Failure;
+    }
+    OS << Asm;
+  }
+
+  raw_fd_ostream OS(ObjPath, EC, sys::fs::OF_None);
+  if (EC) {
+    LLVMRustSetLastError(EC.message().c_str());
+    return LLVMRustResult::Failure;
+  }
+  buffer_ostream BOS(OS);
+  std::string Error;
+  if (!assemble(TM, *unwrap(M), Asm, BOS, Error)) {
+    LLVMRustSetLastError(Error.c_str());
+    return LLVMRustResult::Failure;
+  }
+  return LLVMRustResult::Success;
+}
+
+// Whether `LLVMRustWriteOutputFileWithEmbeddedBitcode` can embed bitcode for
+// this target machine's object file format.
+extern "C" bool
+LLVMRustTargetMachineCanEmbedBitcode(LLVMTargetMachineRef TM) {
+#if LLVM_VERSION_GE(11, 0)
+  const Triple &T = unwrap(TM)->getTargetTriple();
+  return T.isOSBinFormatELF() || T.isOSBinFormatCOFF() ||
+         T.isOSBinFormatMachO();
+#else
+  return false;
+#endif
+}
+
+#if LLVM_VERSION_GE(11, 0)
+namespace {
+// Emits the bitcode and command line passed to
+// `LLVMRustWriteOutputFileWithEmbeddedBitcode` into their sections, straight
+// through the streamer of the asm printer. Passes are initialized in the order
+// they were added, so adding this one after the asm printer makes it run once
+// the printer has initialized the streamer.
+class EmbedBitcodePass : public MachineFunctionPass {
+  MCStreamer &Streamer;
+  Triple TargetTriple;
+  StringRef Bitcode;
+  StringRef Cmdline;
+
+public:
+  static char ID;
+
+  EmbedBitcodePass(MCStreamer &Streamer, const Triple &TargetTriple,
+                   StringRef Bitcode, StringRef Cmdline)
+      : MachineFunctionPass(ID), Streamer(Streamer),
+        TargetTriple(TargetTriple), Bitcode(Bitcode), Cmdline(Cmdline) {}
+
+  StringRef getPassName() const override { return "Rust Embed Bitcode"; }
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.setPreservesAll();
+    MachineFunctionPass::getAnalysisUsage(AU);
+  }
+
+  bool doInitialization(Module &M) override {
+    // The same sections as `embed_bitcode` in rustc creates, with the flags
+    // which keep them out of linked artifacts.
+    MCContext &Ctx = Streamer.getContext();
+    MCSection *BitcodeSection, *CmdlineSection;
+    if (TargetTriple.isOSBinFormatMachO()) {
+      BitcodeSection = Ctx.getMachOSection("__LLVM", "__bitcode", 0,
+                                           SectionKind::getMetadata());
+      CmdlineSection = Ctx.getMachOSection("__LLVM", "__cmdline", 0,
+                                           SectionKind::getMetadata());
+    } else if (TargetTriple.isOSBinFormatCOFF()) {
+      BitcodeSection = Ctx.getCOFFSection(".llvmbc", COFF::IMAGE_SCN_LNK_REMOVE,
+                                          SectionKind::getMetadata());
+      CmdlineSection = Ctx.getCOFFSection(".llvmcmd", COFF::IMAGE_SCN_LNK_REMOVE,
+                                          SectionKind::getMetadata());
+    } else {
+      BitcodeSection = Ctx.getELFSection(".llvmbc", ELF::SHT_PROGBITS,
+                                         ELF::SHF_EXCLUDE);
+      CmdlineSection = Ctx.getELFSection(".llvmcmd", ELF::SHT_PROGBITS,
+                                         ELF::SHF_EXCLUDE);
+    }
+
+    // Functions and globals are emitted into the sections they belong to, but
+    // whatever section the printer left current is restored to be safe.
+    Streamer.PushSection();
+    Streamer.SwitchSection(BitcodeSection);
+    Streamer.emitBytes(Bitcode);
+    Streamer.SwitchSection(CmdlineSection);
+    Streamer.emitBytes(Cmdline);
+    Streamer.PopSection();
+    return false;
+  }
+
+  bool runOnMachineFunction(MachineFunction &MF) override { return false; }
+};
+} // namespace
+
+char EmbedBitcodePass::ID = 0;
+#endif
+
+// Same as `LLVMRustWriteOutputFile`, but also emits the `BitcodeLen` bytes of
+// `Bitcode` into the section that `-C embed-bitcode` uses, along with the
+// command line `Cmdline`. Unlike adding them to the module as constants, which
+// copies the whole buffer into the context to unique it, the bytes are written
+// to the object file straight from the buffer, which only has to be kept alive
+// for the duration of the call.
+//
+// This sets up the codegen pipeline the same way `addPassesToEmitFile` does,
+// to get at the streamer of the asm printer. Should the pipeline be stopped
+// early with `-stop-after` and its kin, no bitcode is embedded.
+extern "C" LLVMRustResult
+LLVMRustWriteOutputFileWithEmbeddedBitcode(
+    LLVMTargetMachineRef Target, LLVMPassManagerRef PMR, LLVMModuleRef M,
+    const char *Path, const char *DwoPath, LLVMRustFileType RustFileType,
+    const char *Bitcode, size_t BitcodeLen, const char *Cmdline,
+    size_t CmdlineLen) {
+#if LLVM_VERSION_GE(11, 0)
+  llvm::legacy::PassManager *PM = unwrap<llvm::legacy::PassManager>(PMR);
+  auto &TM = static_cast<LLVMTargetMachine &>(*unwrap(Target));
+  auto FileType = fromRust(RustFileType);
+
+  std::error_code EC;
+  raw_fd_ostream OS(Path, EC, sys::fs::OF_None);
+  if (EC) {
+    LLVMRustSetLastError(EC.message().c_str());
+    return LLVMRustResult::Failure;
+  }
+  buffer_ostream BOS(OS);
+  std::unique_ptr<raw_fd_ostream> DOS;
+  std::unique_ptr<buffer_ostream> DBOS;
+  if (DwoPath) {
+    DOS = std::make_unique<raw_fd_ostream>(DwoPath, EC, sys::fs::OF_None);
+    if (EC) {
+      LLVMRustSetLastError(EC.message().c_str());
+      return LLVMRustResult::Failure;
+    }
+    DBOS = std::make_unique<buffer_ostream>(*DOS);
+  }
+
+  if (!TargetPassConfig::willCompleteCodeGenPipeline()) {
+    TM.addPassesToEmitFile(*PM, BOS, DBOS.get(), FileType, false);
+  } else {
+    auto *MMIWP = new MachineModuleInfoWrapperPass(&TM);
+    TargetPassConfig *PassConfig = TM.createPassConfig(*PM);
+    PassConfig->setDisableVerify(false);
+    PM->add(PassConfig);
+    PM->add(MMIWP);
+    if (PassConfig->addISelPasses()) {
+      LLVMRustSetLastError("failed to add instruction selection passes");
+      return LLVMRustResult::Failure;
+    }
+    PassConfig->addMachinePasses();
+    PassConfig->setInitialized();
+
+    Expected<std::unique_ptr<MCStreamer>> StreamerOrErr = TM.createMCStreamer(
+        BOS, DBOS.get(), FileType, MMIWP->getMMI().getContext());
+    if (!StreamerOrErr) {
+      LLVMRustSetLastError(toString(StreamerOrErr.takeError()).c_str());
+      return LLVMRustResult::Failure;
+    }
+    // The printer takes ownership of the streamer.
+    MCStreamer &Streamer = **StreamerOrErr;
+    AsmPrinter *Printer =
+        TM.getTarget().createAsmPrinter(TM, std::move(*StreamerOrErr));
+    if (!Printer) {
+      LLVMRustSetLastError("target does not support an asm printer");
+      return LLVMRustResult::Failure;
+    }
+    PM->add(Printer);
+    PM->add(new EmbedBitcodePass(Streamer, TM.getTargetTriple(),
+                                 StringRef(Bitcode, BitcodeLen),
+                                 StringRef(Cmdline, CmdlineLen)));
+    PM->add(createFreeMachineFunctionPass());
+  }
+  PM->run(*unwrap(M));
+
+  // As in `LLVMRustWriteOutputFile`, the pass manager refers to the streams.
+  LLVMDisposePassManager(PMR);
+  return LLVMRustResult::Success;
+#else
+  LLVMRustSetLastError("embedding bitcode at emission requires LLVM 11");
+  return LLVMRustResult::Failure;
+#endif
+}
+
+extern "C" typedef void (*LLVMRustSelfProfileRegisterPassCallback)(void*, // LlvmSelfProfiler
+                                                        uint32_t,    // pass id
+                                                        const char*, // pass name
+                                                        size_t);     // pass name len
 extern "C" typedef void (*LLVMRustSelfProfileBeforePassCallback)(void*, // LlvmSelfProfiler
-                                                      const char*,      // pass name
-                                                      const char*);     // IR name
+                                                      uint32_t,    // pass id
+                                                      const char*, // IR name
+                                                      size_t);     // IR name len
 extern "C" typedef void (*LLVMRustSelfProfileAfterPassCallback)(void*); // LlvmSelfProfiler
 
-std::string LLVMRustwrappedIrGetName(const llvm::Any &WrappedIr) {
-  if (any_isa<const Module *>(WrappedIr))
-    return any_cast<const Module *>(WrappedIr)->getName().str();
-  if (any_isa<const Function *>(WrappedIr))
-    return any_cast<const Function *>(WrappedIr)->getName().str();
-  if (any_isa<const Loop *>(WrappedIr))
-    return any_cast<const Loop *>(WrappedIr)->getName().str();
-  if (any_isa<const LazyCallGraph::SCC *>(WrappedIr))
-    return any_cast<const LazyCallGraph::SCC *>(WrappedIr)->getName();
-  return "<UNKNOWN>";
-}
+// State of the self-profile callbacks. Each pass name is handed to the
+// profiler once, along with the id that is used to refer to it afterwards, so
+// that running a pass doesn't copy its name.
+struct LLVMRustSelfProfileInterner {
+  void *LlvmSelfProfiler;
+  LLVMRustSelfProfileRegisterPassCallback RegisterPassCallback;
+  StringMap<uint32_t> PassIds;
+  // Storage for the names of SCCs, which have to be built as they're not
+  // stored in the IR.
+  std::string SCCName;
+
+  uint32_t getPassId(StringRef Pass) {
+    auto Inserted = PassIds.try_emplace(Pass, PassIds.size());
+    if (Inserted.second)
+      RegisterPassCallback(LlvmSelfProfiler, Inserted.first->second,
+                           Pass.data(), Pass.size());
+    return Inserted.first->second;
+  }
 
+  // Borrows the name where possible.
+  StringRef getIrName(const llvm::Any &WrappedIr) {
+    if (any_isa<const Module *>(WrappedIr))
+      return any_cast<const Module *>(WrappedIr)->getName();
+    if (any_isa<const Function *>(WrappedIr))
+      return any_cast<const Function *>(WrappedIr)->getName();
+    if (any_isa<const Loop *>(WrappedIr))
+      return any_cast<const Loop *>(WrappedIr)->getName();
+    if (any_isa<const LazyCallGraph::SCC *>(WrappedIr)) {
+      SCCName = any_cast<const LazyCallGraph::SCC *>(WrappedIr)->getName();
+      return SCCName;
+    }
+    return "<UNKNOWN>";
+  }
+};
 
+// Registers the self-profile callbacks. The before-pass callback receives the
+// id of a pass name previously handed to the interner's `RegisterPassCallback`,
+// and the IR name as a borrowed string that is only valid for the duration of
+// the call.
 void LLVMSelfProfileInitializeCallbacks(
-    PassInstrumentationCallbacks& PIC, void* LlvmSelfProfiler,
+    PassInstrumentationCallbacks& PIC, LLVMRustSelfProfileInterner *Interner,
     LLVMRustSelfProfileBeforePassCallback BeforePassCallback,
     LLVMRustSelfProfileAfterPassCallback AfterPassCallback) {
+  void *LlvmSelfProfiler = Interner->LlvmSelfProfiler;
+  auto Before = [Interner, BeforePassCallback](StringRef Pass, llvm::Any Ir) {
+    uint32_t Id = Interner->getPassId(Pass);
+    StringRef IrName = Interner->getIrName(Ir);
+    BeforePassCallback(Interner->LlvmSelfProfiler, Id, IrName.data(),
+                       IrName.size());
+  };
+
 #if LLVM_VERSION_GE(12, 0)
-  PIC.registerBeforeNonSkippedPassCallback([LlvmSelfProfiler, BeforePassCallback](
-                                           StringRef Pass, llvm::Any Ir) {
-    std::string PassName = Pass.str();
-    std::string IrName = LLVMRustwrappedIrGetName(Ir);
-    BeforePassCallback(LlvmSelfProfiler, PassName.c_str(), IrName.c_str());
-  });
+  PIC.registerBeforeNonSkippedPassCallback(Before);
 
   PIC.registerAfterPassCallback(
       [LlvmSelfProfiler, AfterPassCallback](StringRef Pass, llvm::Any IR,
@@ -685,11 +1530,8 @@ void LLVMSelfProfileInitializeCallbacks(
         AfterPassCallback(LlvmSelfProfiler);
       });
 #else
-  PIC.registerBeforePassCallback([LlvmSelfProfiler, BeforePassCallback](
-                                     StringRef Pass, llvm::Any Ir) {
-    std::string PassName = Pass.str();
-    std::string IrName = LLVMRustwrappedIrGetName(Ir);
-    BeforePassCallback(LlvmSelfProfiler, PassName.c_str(), IrName.c_str());
+  PIC.registerBeforePassCallback([Before](StringRef Pass, llvm::Any Ir) {
+    Before(Pass, Ir);
     return true;
   });
 
@@ -704,12 +1546,7 @@ void LLVMSelfProfileInitializeCallbacks(
       });
 #endif
 
-  PIC.registerBeforeAnalysisCallback([LlvmSelfProfiler, BeforePassCallback](
-                                         StringRef Pass, llvm::Any Ir) {
-    std::string PassName = Pass.str();
-    std::string IrName = LLVMRustwrappedIrGetName(Ir);
-    BeforePassCallback(LlvmSelfProfiler, PassName.c_str(), IrName.c_str());
-  });
+  PIC.registerBeforeAnalysisCallback(Before);
 
   PIC.registerAfterAnalysisCallback(
       [LlvmSelfProfiler, AfterPassCallback](StringRef Pass, llvm::Any Ir) {
@@ -717,16 +1554,261 @@ void LLVMSelfProfileInitializeCallbacks(
       });
 }
 
-enum class LLVMRustOptStage {
-  PreLinkNoLTO,
-  PreLinkThinLTO,
-  PreLinkFatLTO,
-  ThinLTO,
-  FatLTO,
-};
+// Per-pass statistics collected by `LLVMRustOptimizeWithNewPassManager`: the
+// number of invocations, the wall time and the instruction counts before and
+// after each pass. The wall time of a pass includes the passes nested in it.
+struct LLVMRustPassStatistics {
+  struct Entry {
+    uint64_t Invocations = 0;
+    std::chrono::nanoseconds WallTime{0};
+    uint64_t InstrsBefore = 0;
+    uint64_t InstrsAfter = 0;
+  };
+  struct RunningPass {
+    Entry *E;
+    std::chrono::steady_clock::time_point Start;
+  };
 
-struct LLVMRustSanitizerOptions {
-  bool SanitizeAddress;
+  StringMap<Entry> Entries;
+  // Passes nest, e.g. function passes run within a module pass adaptor, so
+  // the passes currently running are kept as a stack.
+  std::vector<RunningPass> Running;
+
+  static uint64_t getInstructionCount(const llvm::Any &WrappedIr) {
+    if (any_isa<const Module *>(WrappedIr))
+      return any_cast<const Module *>(WrappedIr)->getInstructionCount();
+    if (any_isa<const Function *>(WrappedIr))
+      return any_cast<const Function *>(WrappedIr)->getInstructionCount();
+    uint64_t Count = 0;
+    if (any_isa<const Loop *>(WrappedIr)) {
+      for (const BasicBlock *BB : any_cast<const Loop *>(WrappedIr)->blocks())
+        Count += BB->size();
+    } else if (any_isa<const LazyCallGraph::SCC *>(WrappedIr)) {
+      for (const LazyCallGraph::Node &N :
+           *any_cast<const LazyCallGraph::SCC *>(WrappedIr))
+        Count += N.getFunction().getInstructionCount();
+    }
+    return Count;
+  }
+
+  void before(StringRef Pass, const llvm::Any &Ir) {
+    Entry &E = Entries[Pass];
+    E.Invocations++;
+    E.InstrsBefore += getInstructionCount(Ir);
+    Running.push_back({&E, std::chrono::steady_clock::now()});
+  }
+
+  // `Ir` is null if the pass invalidated the IR it ran on.
+  void after(const llvm::Any *Ir) {
+    if (Running.empty())
+      return;
+    RunningPass R = Running.back();
+    Running.pop_back();
+    R.E->WallTime += std::chrono::steady_clock::now() - R.Start;
+    if (Ir)
+      R.E->InstrsAfter += getInstructionCount(*Ir);
+  }
+};
+
+static void registerPassStatisticsCallbacks(PassInstrumentationCallbacks &PIC,
+                                            LLVMRustPassStatistics *Stats) {
+#if LLVM_VERSION_GE(12, 0)
+  PIC.registerBeforeNonSkippedPassCallback(
+      [Stats](StringRef Pass, llvm::Any Ir) { Stats->before(Pass, Ir); });
+
+  PIC.registerAfterPassCallback(
+      [Stats](StringRef Pass, llvm::Any Ir, const PreservedAnalyses &Preserved) {
+        Stats->after(&Ir);
+      });
+
+  PIC.registerAfterPassInvalidatedCallback(
+      [Stats](StringRef Pass, const PreservedAnalyses &Preserved) {
+        Stats->after(nullptr);
+      });
+#else
+  PIC.registerBeforePassCallback([Stats](StringRef Pass, llvm::Any Ir) {
+    Stats->before(Pass, Ir);
+    return true;
+  });
+
+  PIC.registerAfterPassCallback(
+      [Stats](StringRef Pass, llvm::Any Ir) { Stats->after(&Ir); });
+
+  PIC.registerAfterPassInvalidatedCallback(
+      [Stats](StringRef Pass) { Stats->after(nullptr); });
+#endif
+}
+
+extern "C" LLVMRustPassStatistics *LLVMRustCreatePassStatistics() {
+  return new LLVMRustPassStatistics();
+}
+
+// Writes the statistics to `Str` as a JSON array with one object per pass,
+// sorted by pass name, and frees them.
+extern "C" void LLVMRustPassStatisticsEnd(LLVMRustPassStatistics *Stats,
+                                          RustStringRef Str) {
+  std::unique_ptr<LLVMRustPassStatistics> Owned(Stats);
+  RawRustStringOstream OS(Str);
+  json::OStream J(OS);
+  J.array([&] {
+    std::vector<const StringMapEntry<LLVMRustPassStatistics::Entry> *> Sorted;
+    for (const auto &E : Stats->Entries)
+      Sorted.push_back(&E);
+    llvm::sort(Sorted, [](const auto *A, const auto *B) {
+      return A->getKey() < B->getKey();
+    });
+    for (const auto *E : Sorted) {
+      J.object([&] {
+        J.attribute("pass", E->getKey());
+        J.attribute("invocations", (int64_t)E->getValue().Invocations);
+        J.attribute("wall_time_ns", (int64_t)E->getValue().WallTime.count());
+        J.attribute("instructions_before", (int64_t)E->getValue().InstrsBefore);
+        J.attribute("instructions_after", (int64_t)E->getValue().InstrsAfter);
+      });
+    }
+  });
+}
+
+// The call graph profiles of all the modules of a crate, as recorded in their
+// "CG Profile" module flag by the `CGProfile` pass, which the default
+// optimization pipelines run when there's profile data. The edges are keyed by
+// the linker symbols of the functions. Modules may be added from multiple
+// threads at once.
+struct LLVMRustCallGraphProfile {
+  std::mutex Lock;
+  std::map<std::pair<std::string, std::string>, uint64_t> Edges;
+  StringMap<uint64_t> EntryCounts;
+  StringSet<> Defined;
+};
+
+extern "C" LLVMRustCallGraphProfile *LLVMRustCreateCallGraphProfile() {
+  return new LLVMRustCallGraphProfile();
+}
+
+extern "C" void LLVMRustFreeCallGraphProfile(LLVMRustCallGraphProfile *Profile) {
+  delete Profile;
+}
+
+static std::string getSymbolName(Mangler &Mang, const GlobalValue &GV) {
+  std::string Name;
+  raw_string_ostream OS(Name);
+  Mang.getNameWithPrefix(OS, &GV, /* CannotUsePrivateLabel = */ false);
+  return OS.str();
+}
+
+// Adds the call graph profile and the function entry counts of the optimized
+// module `M` to `Profile`.
+extern "C" void
+LLVMRustCallGraphProfileAddModule(LLVMRustCallGraphProfile *Profile,
+                                  LLVMModuleRef M) {
+  Module *Mod = unwrap(M);
+  Mangler Mang;
+
+  std::vector<std::pair<std::pair<std::string, std::string>, uint64_t>> Edges;
+  if (auto *Flag = dyn_cast_or_null<MDTuple>(Mod->getModuleFlag("CG Profile"))) {
+    for (const MDOperand &Op : Flag->operands()) {
+      auto *Edge = dyn_cast_or_null<MDNode>(Op.get());
+      if (!Edge || Edge->getNumOperands() != 3)
+        continue;
+      // Either side is null if the function has been deleted since.
+      auto *From = mdconst::dyn_extract_or_null<Function>(Edge->getOperand(0));
+      auto *To = mdconst::dyn_extract_or_null<Function>(Edge->getOperand(1));
+      auto *Count = mdconst::dyn_extract_or_null<ConstantInt>(Edge->getOperand(2));
+      if (!From || !To || !Count)
+        continue;
+      Edges.push_back({{getSymbolName(Mang, *From), getSymbolName(Mang, *To)},
+                       Count->getZExtValue()});
+    }
+  }
+
+  std::vector<std::pair<std::string, uint64_t>> Functions;
+  for (const Function &F : *Mod) {
+    if (F.isDeclaration())
+      continue;
+    auto Count = F.getEntryCount();
+    Functions.push_back({getSymbolName(Mang, F), Count ? Count->getCount() : 0});
+  }
+
+  std::lock_guard<std::mutex> Lock(Profile->Lock);
+  for (auto &Edge : Edges)
+    Profile->Edges[std::move(Edge.first)] += Edge.second;
+  for (auto &F : Functions) {
+    Profile->EntryCounts[F.first] += F.second;
+    Profile->Defined.insert(F.first);
+  }
+}
+
+// Writes a symbol ordering file for the linker, such as the one taken by
+// `--symbol-ordering-file`, to `Path`. It lists the functions of all modules
+// added to `Profile` that were called during profiling, hottest first, one
+// per line. The hotness of a function is its entry count, or the weight of
+// the call graph edges into and out of it if that is more.
+extern "C" LLVMRustResult
+LLVMRustCallGraphProfileWriteOrderingFile(LLVMRustCallGraphProfile *Profile,
+                                          const char *Path) {
+  std::lock_guard<std::mutex> Lock(Profile->Lock);
+
+  StringMap<uint64_t> EdgeWeights;
+  for (const auto &Edge : Profile->Edges) {
+    EdgeWeights[Edge.first.first] += Edge.second;
+    EdgeWeights[Edge.first.second] += Edge.second;
+  }
+
+  std::vector<std::pair<uint64_t, StringRef>> Hot;
+  for (const auto &Entry : Profile->Defined) {
+    StringRef Name = Entry.getKey();
+    uint64_t Weight = std::max(Profile->EntryCounts.lookup(Name),
+                               EdgeWeights.lookup(Name));
+    if (Weight)
+      Hot.push_back({Weight, Name});
+  }
+  llvm::sort(Hot, [](const auto &A, const auto &B) {
+    return A.first != B.first ? A.first > B.first : A.second < B.second;
+  });
+
+  std::error_code EC;
+  raw_fd_ostream OS(Path, EC, sys::fs::OF_Text);
+  if (EC) {
+    LLVMRustSetLastError(EC.message().c_str());
+    return LLVMRustResult::Failure;
+  }
+  for (const auto &Entry : Hot)
+    OS << Entry.second << "\n";
+  OS.close();
+  if (OS.has_error()) {
+    LLVMRustSetLastError(OS.error().message().c_str());
+    OS.clear_error();
+    return LLVMRustResult::Failure;
+  }
+  return LLVMRustResult::Success;
+}
+
+enum class LLVMRustOptStage {
+  PreLinkNoLTO,
+  PreLinkThinLTO,
+  PreLinkFatLTO,
+  ThinLTO,
+  FatLTO,
+};
+
+// The version of `LLVMRustSanitizerTuningOptions` that this wrapper was built
+// with, bumped whenever fields are added.
+static const uint32_t LLVMRustSanitizerTuningOptionsVersion = 1;
+
+// Knobs trading the coverage of the sanitizer instrumentation for its cost.
+// As with `LLVMRustTuningOptions`, negative values keep the defaults. Only
+// the knobs which LLVM takes as pass parameters are here: the others, such as
+// the threshold for using callbacks instead of inline checks, are read by the
+// passes from LLVM's process-wide command-line options.
+struct LLVMRustSanitizerTuningOptions {
+  uint32_t Version;
+  // Whether AddressSanitizer detects uses of stack variables after their
+  // scope ended. Defaults to true.
+  int AddressUseAfterScope;
+};
+
+struct LLVMRustSanitizerOptions {
+  bool SanitizeAddress;
   bool SanitizeAddressRecover;
   bool SanitizeMemory;
   bool SanitizeMemoryRecover;
@@ -734,12 +1816,130 @@ struct LLVMRustSanitizerOptions {
   bool SanitizeThread;
   bool SanitizeHWAddress;
   bool SanitizeHWAddressRecover;
+  // Optional, null keeps all the defaults.
+  const LLVMRustSanitizerTuningOptions *Tuning;
 };
 
-extern "C" LLVMRustResult
-LLVMRustOptimizeWithNewPassManager(
-    LLVMModuleRef ModuleRef,
-    LLVMTargetMachineRef TMRef,
+// The version of `LLVMRustTuningOptions` that this wrapper was built with.
+// It's bumped whenever fields are added, so that a mismatched caller is
+// reported instead of being misread.
+static const uint32_t LLVMRustTuningOptionsVersion = 2;
+
+// Overrides of the `PipelineTuningOptions` of one optimization pipeline, on
+// top of those it has through its other arguments. Negative values keep the
+// defaults, which can be changed through the global LLVM options.
+struct LLVMRustTuningOptions {
+  uint32_t Version;
+  // Only with LLVM 12 and later.
+  int InlinerThreshold;
+  // Booleans as 0 or 1.
+  int CallGraphProfile;
+  int ForgetAllSCEVInLoopUnroll;
+  int LicmMssaOptCap;
+  int LicmMssaNoAccForPromotionCap;
+  // With `VerifyIR`, verify only a sample of the functions, see
+  // `SampledVerifierPass`, instead of the whole module. Without a positive
+  // rate, the whole module is verified, and a negative minimum is 0.
+  int VerifySampleRate;
+  int VerifySampleMin;
+};
+
+static LLVMRustResult applyTuningOptions(PipelineTuningOptions &PTO,
+                                         const LLVMRustTuningOptions &Opts) {
+  if (Opts.Version != LLVMRustTuningOptionsVersion) {
+    LLVMRustSetLastError("unsupported version of the tuning options");
+    return LLVMRustResult::Failure;
+  }
+  if (Opts.InlinerThreshold >= 0) {
+#if LLVM_VERSION_GE(12, 0)
+    PTO.InlinerThreshold = Opts.InlinerThreshold;
+#else
+    LLVMRustSetLastError(
+        "the new pass manager's inliner threshold requires LLVM 12");
+    return LLVMRustResult::Failure;
+#endif
+  }
+  if (Opts.CallGraphProfile >= 0) {
+#if LLVM_VERSION_GE(11, 0)
+    PTO.CallGraphProfile = Opts.CallGraphProfile;
+#else
+    LLVMRustSetLastError(
+        "the new pass manager's call graph profile option requires LLVM 11");
+    return LLVMRustResult::Failure;
+#endif
+  }
+  if (Opts.ForgetAllSCEVInLoopUnroll >= 0)
+    PTO.ForgetAllSCEVInLoopUnroll = Opts.ForgetAllSCEVInLoopUnroll;
+  if (Opts.LicmMssaOptCap >= 0)
+    PTO.LicmMssaOptCap = Opts.LicmMssaOptCap;
+  if (Opts.LicmMssaNoAccForPromotionCap >= 0)
+    PTO.LicmMssaNoAccForPromotionCap = Opts.LicmMssaNoAccForPromotionCap;
+  return LLVMRustResult::Success;
+}
+
+namespace {
+// Verifies a deterministic sample of the functions defined in a module, at a
+// fraction of the cost of verifying all of it with `VerifierPass`: those whose
+// GUID is a multiple of `Rate`, so the sample grows with the module, and then
+// the first others in module order until at least `Min` functions have been
+// verified, so that small modules are still verified completely. Only the
+// functions are checked, not the module-level IR such as the globals and the
+// named metadata.
+struct SampledVerifierPass : PassInfoMixin<SampledVerifierPass> {
+  unsigned Rate;
+  unsigned Min;
+
+  SampledVerifierPass(unsigned Rate, unsigned Min) : Rate(Rate), Min(Min) {}
+
+  static void verify(const Function &F) {
+    if (verifyFunction(F, &errs()))
+      report_fatal_error("Broken function found, compilation aborted!");
+  }
+
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &) {
+    std::vector<const Function *> Skipped;
+    unsigned NumVerified = 0;
+    for (const Function &F : M) {
+      if (F.isDeclaration())
+        continue;
+      if (F.getGUID() % Rate == 0) {
+        verify(F);
+        NumVerified++;
+      } else if (NumVerified + Skipped.size() < Min) {
+        Skipped.push_back(&F);
+      }
+    }
+    for (const Function *F : Skipped) {
+      if (NumVerified >= Min)
+        break;
+      verify(*F);
+      NumVerified++;
+    }
+    return PreservedAnalyses::all();
+  }
+};
+} // namespace
+
+// Everything needed to run a new pass manager pipeline, built by
+// `buildPassPipeline`. The members are declared so that they're destroyed in
+// the right order.
+struct LLVMRustPassPipeline {
+  PassInstrumentationCallbacks PIC;
+  std::unique_ptr<StandardInstrumentations> SI;
+  std::unique_ptr<PassBuilder> PB;
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+  ModulePassManager MPM;
+  std::unique_ptr<LLVMRustSelfProfileInterner> Interner;
+};
+
+static LLVMRustResult
+buildPassPipeline(
+    LLVMRustPassPipeline &P,
+    const Triple &TargetTriple,
+    TargetMachine *TM,
     LLVMRustPassBuilderOptLevel OptLevelRust,
     LLVMRustOptStage OptStage,
     bool NoPrepopulatePasses, bool VerifyIR, bool UseThinLTOBuffers,
@@ -747,13 +1947,16 @@ LLVMRustOptimizeWithNewPassManager(
     bool DisableSimplifyLibCalls, bool EmitLifetimeMarkers,
     LLVMRustSanitizerOptions *SanitizerOptions,
     const char *PGOGenPath, const char *PGOUsePath,
+    const LLVMRustPGOOptions *PGOOpts,
+    const LLVMRustTuningOptions *TuningOpts,
     bool InstrumentCoverage, bool InstrumentGCOV,
     void* LlvmSelfProfiler,
+    LLVMRustSelfProfileRegisterPassCallback RegisterPassCallback,
     LLVMRustSelfProfileBeforePassCallback BeforePassCallback,
     LLVMRustSelfProfileAfterPassCallback AfterPassCallback,
-    const char *ExtraPasses, size_t ExtraPassesLen) {
-  Module *TheModule = unwrap(ModuleRef);
-  TargetMachine *TM = unwrap(TMRef);
+    LLVMRustPassStatistics *PassStatistics,
+    const char *ExtraPasses, size_t ExtraPassesLen,
+    const ModuleSummaryIndex *ImportSummary) {
   PassBuilder::OptimizationLevel OptLevel = fromRust(OptLevelRust);
 
 
@@ -768,24 +1971,37 @@ LLVMRustOptimizeWithNewPassManager(
   // MergeFunctions is not supported by NewPM in older LLVM versions.
   (void) MergeFunctions;
 #endif
+  if (TuningOpts &&
+      applyTuningOptions(PTO, *TuningOpts) != LLVMRustResult::Success)
+    return LLVMRustResult::Failure;
 
   // FIXME: We may want to expose this as an option.
   bool DebugPassManager = false;
 
-  PassInstrumentationCallbacks PIC;
+  PassInstrumentationCallbacks &PIC = P.PIC;
 #if LLVM_VERSION_GE(12, 0)
-  StandardInstrumentations SI(DebugPassManager);
+  P.SI = std::make_unique<StandardInstrumentations>(DebugPassManager);
 #else
-  StandardInstrumentations SI;
+  P.SI = std::make_unique<StandardInstrumentations>();
 #endif
-  SI.registerCallbacks(PIC);
-
-  if (LlvmSelfProfiler){
-    LLVMSelfProfileInitializeCallbacks(PIC,LlvmSelfProfiler,BeforePassCallback,AfterPassCallback);
+  P.SI->registerCallbacks(PIC);
+
+  if (LlvmSelfProfiler) {
+    P.Interner = std::make_unique<LLVMRustSelfProfileInterner>();
+    P.Interner->LlvmSelfProfiler = LlvmSelfProfiler;
+    P.Interner->RegisterPassCallback = RegisterPassCallback;
+    LLVMSelfProfileInitializeCallbacks(PIC, P.Interner.get(),
+                                       BeforePassCallback, AfterPassCallback);
   }
 
+  if (PassStatistics)
+    registerPassStatisticsCallbacks(PIC, PassStatistics);
+
   Optional<PGOOptions> PGOOpt;
-  if (PGOGenPath) {
+  if (PGOOpts) {
+    assert(!PGOGenPath && !PGOUsePath);
+    PGOOpt = toPGOOptions(*PGOOpts);
+  } else if (PGOGenPath) {
     assert(!PGOUsePath);
     PGOOpt = PGOOptions(PGOGenPath, "", "", PGOOptions::IRInstr);
   } else if (PGOUsePath) {
@@ -794,30 +2010,25 @@ LLVMRustOptimizeWithNewPassManager(
   }
 
 #if LLVM_VERSION_GE(12, 0) && !LLVM_VERSION_GE(13,0)
-  PassBuilder PB(DebugPassManager, TM, PTO, PGOOpt, &PIC);
+  P.PB = std::make_unique<PassBuilder>(DebugPassManager, TM, PTO, PGOOpt, &PIC);
 #else
-  PassBuilder PB(TM, PTO, PGOOpt, &PIC);
+  P.PB = std::make_unique<PassBuilder>(TM, PTO, PGOOpt, &PIC);
 #endif
+  PassBuilder &PB = *P.PB;
 
-#if LLVM_VERSION_GE(13, 0)
-  LoopAnalysisManager LAM;
-  FunctionAnalysisManager FAM;
-  CGSCCAnalysisManager CGAM;
-  ModuleAnalysisManager MAM;
-#else
-  LoopAnalysisManager LAM(DebugPassManager);
-  FunctionAnalysisManager FAM(DebugPassManager);
-  CGSCCAnalysisManager CGAM(DebugPassManager);
-  ModuleAnalysisManager MAM(DebugPassManager);
-#endif
+  // The analysis managers are default constructed, which matches
+  // `DebugPassManager` being false.
+  LoopAnalysisManager &LAM = P.LAM;
+  FunctionAnalysisManager &FAM = P.FAM;
+  CGSCCAnalysisManager &CGAM = P.CGAM;
+  ModuleAnalysisManager &MAM = P.MAM;
 
-  FAM.registerPass([&] { return PB.buildDefaultAAPipeline(); });
+  PassBuilder *PBPtr = P.PB.get();
+  FAM.registerPass([PBPtr] { return PBPtr->buildDefaultAAPipeline(); });
 
-  Triple TargetTriple(TheModule->getTargetTriple());
-  std::unique_ptr<TargetLibraryInfoImpl> TLII(new TargetLibraryInfoImpl(TargetTriple));
-  if (DisableSimplifyLibCalls)
-    TLII->disableAllFunctions();
-  FAM.registerPass([&] { return TargetLibraryAnalysis(*TLII); });
+  const TargetLibraryInfoImpl *TLII =
+      &getTargetLibraryInfo(TargetTriple.str(), DisableSimplifyLibCalls);
+  FAM.registerPass([TLII] { return TargetLibraryAnalysis(*TLII); });
 
   PB.registerModuleAnalyses(MAM);
   PB.registerCGSCCAnalyses(CGAM);
@@ -837,7 +2048,15 @@ LLVMRustOptimizeWithNewPassManager(
       OptimizerLastEPCallbacks;
 #endif
 
-  if (VerifyIR) {
+  if (VerifyIR && TuningOpts && TuningOpts->VerifySampleRate > 0) {
+    unsigned Rate = TuningOpts->VerifySampleRate;
+    unsigned Min = std::max(TuningOpts->VerifySampleMin, 0);
+    PipelineStartEPCallbacks.push_back(
+      [Rate, Min](ModulePassManager &MPM, PassBuilder::OptimizationLevel Level) {
+        MPM.addPass(SampledVerifierPass(Rate, Min));
+      }
+    );
+  } else if (VerifyIR) {
     PipelineStartEPCallbacks.push_back(
       [VerifyIR](ModulePassManager &MPM, PassBuilder::OptimizationLevel Level) {
         MPM.addPass(VerifierPass());
@@ -863,6 +2082,17 @@ LLVMRustOptimizeWithNewPassManager(
   }
 
   if (SanitizerOptions) {
+    bool AddressUseAfterScope = true;
+    if (const LLVMRustSanitizerTuningOptions *Tuning = SanitizerOptions->Tuning) {
+      if (Tuning->Version != LLVMRustSanitizerTuningOptionsVersion) {
+        LLVMRustSetLastError(
+            "unsupported version of the sanitizer tuning options");
+        return LLVMRustResult::Failure;
+      }
+      if (Tuning->AddressUseAfterScope >= 0)
+        AddressUseAfterScope = Tuning->AddressUseAfterScope;
+    }
+
     if (SanitizerOptions->SanitizeMemory) {
       MemorySanitizerOptions Options(
           SanitizerOptions->SanitizeMemoryTrackOrigins,
@@ -914,13 +2144,14 @@ LLVMRustOptimizeWithNewPassManager(
     if (SanitizerOptions->SanitizeAddress) {
 #if LLVM_VERSION_GE(11, 0)
       OptimizerLastEPCallbacks.push_back(
-        [SanitizerOptions](ModulePassManager &MPM, PassBuilder::OptimizationLevel Level) {
+        [SanitizerOptions, AddressUseAfterScope](ModulePassManager &MPM,
+                                                 PassBuilder::OptimizationLevel Level) {
           MPM.addPass(RequireAnalysisPass<ASanGlobalsMetadataAnalysis, Module>());
           MPM.addPass(ModuleAddressSanitizerPass(
               /*CompileKernel=*/false, SanitizerOptions->SanitizeAddressRecover));
           MPM.addPass(createModuleToFunctionPassAdaptor(AddressSanitizerPass(
               /*CompileKernel=*/false, SanitizerOptions->SanitizeAddressRecover,
-              /*UseAfterScope=*/true)));
+              AddressUseAfterScope)));
         }
       );
 #else
@@ -930,10 +2161,11 @@ LLVMRustOptimizeWithNewPassManager(
         }
       );
       OptimizerLastEPCallbacks.push_back(
-        [SanitizerOptions](FunctionPassManager &FPM, PassBuilder::OptimizationLevel Level) {
+        [SanitizerOptions, AddressUseAfterScope](FunctionPassManager &FPM,
+                                                 PassBuilder::OptimizationLevel Level) {
           FPM.addPass(AddressSanitizerPass(
               /*CompileKernel=*/false, SanitizerOptions->SanitizeAddressRecover,
-              /*UseAfterScope=*/true));
+              AddressUseAfterScope));
         }
       );
       PipelineStartEPCallbacks.push_back(
@@ -963,11 +2195,7 @@ LLVMRustOptimizeWithNewPassManager(
     }
   }
 
-#if LLVM_VERSION_GE(13, 0)
-  ModulePassManager MPM;
-#else
-  ModulePassManager MPM(DebugPassManager);
-#endif
+  ModulePassManager &MPM = P.MPM;
   bool NeedThinLTOBufferPasses = UseThinLTOBuffers;
   if (!NoPrepopulatePasses) {
     if (OptLevel == PassBuilder::OptimizationLevel::O0) {
@@ -997,7 +2225,8 @@ LLVMRustOptimizeWithNewPassManager(
 
       MPM.addPass(AlwaysInlinerPass(EmitLifetimeMarkers));
 
-      if (PGOOpt) {
+      if (PGOOpt && (PGOOpt->Action == PGOOptions::IRInstr ||
+                     PGOOpt->Action == PGOOptions::IRUse)) {
         PB.addPGOInstrPassesForO0(
             MPM, DebugPassManager, PGOOpt->Action == PGOOptions::IRInstr,
             /*IsCS=*/false, PGOOpt->ProfileFile, PGOOpt->ProfileRemappingFile);
@@ -1055,12 +2284,14 @@ LLVMRustOptimizeWithNewPassManager(
 #endif
         break;
       case LLVMRustOptStage::ThinLTO:
-        // FIXME: Does it make sense to pass the ModuleSummaryIndex?
-        // It only seems to be needed for C++ specific optimizations.
+        // With the combined index, the whole program devirtualization and
+        // type test lowering passes apply the resolutions recorded in it by
+        // `LLVMRustCreateThinLTODataWithOptions`.
 #if LLVM_VERSION_GE(12, 0)
-        MPM = PB.buildThinLTODefaultPipeline(OptLevel, nullptr);
+        MPM = PB.buildThinLTODefaultPipeline(OptLevel, ImportSummary);
 #else
-        MPM = PB.buildThinLTODefaultPipeline(OptLevel, DebugPassManager, nullptr);
+        MPM = PB.buildThinLTODefaultPipeline(OptLevel, DebugPassManager,
+                                             ImportSummary);
 #endif
         break;
       case LLVMRustOptStage::FatLTO:
@@ -1087,14 +2318,193 @@ LLVMRustOptimizeWithNewPassManager(
     MPM.addPass(NameAnonGlobalPass());
   }
 
+  return LLVMRustResult::Success;
+}
+
+static void runPassPipeline(LLVMRustPassPipeline &P, Module *TheModule) {
   // Upgrade all calls to old intrinsics first.
   for (Module::iterator I = TheModule->begin(), E = TheModule->end(); I != E;)
     UpgradeCallsToIntrinsic(&*I++); // must be post-increment, as we remove
 
-  MPM.run(*TheModule, MAM);
+  P.MPM.run(*TheModule, P.MAM);
+}
+
+// The number of functions `LLVMRustDowngradeColdFunctions` marked.
+struct LLVMRustColdDowngradeStats {
+  uint64_t MinSize;
+  uint64_t OptNone;
+};
+
+// Returns whether `F` has a profile entry count of zero. The `prof` metadata is
+// read directly, as `Function::getEntryCount` changed its type over time.
+static bool hasZeroEntryCount(const Function &F) {
+  MDNode *MD = F.getMetadata(LLVMContext::MD_prof);
+  if (!MD || MD->getNumOperands() < 2)
+    return false;
+  auto *Kind = dyn_cast<MDString>(MD->getOperand(0));
+  if (!Kind || Kind->getString() != "function_entry_count")
+    return false;
+  auto *Count = mdconst::dyn_extract<ConstantInt>(MD->getOperand(1));
+  return Count && Count->isZero();
+}
+
+// Marks the cold function definitions of `M` `minsize`, to be run before the
+// optimization pipeline so that it spends less time on them. Cold ones are
+// those marked `cold`, which they are for `#[cold]`, and, if `M` has a profile
+// summary, those whose entry count the summary considers cold. Functions which
+// the profile shows never ran are made `optnone` instead, so they aren't
+// optimized at all. Functions which are always inlined or already `optnone`
+// are left as they are.
+//
+// The entry counts and the profile summary are only attached by the PGO or
+// sample profile annotation of the pre-link pipeline, so before that pipeline
+// only `cold` functions are found. The profile based ones are found when this
+// runs again before the LTO pipelines.
+extern "C" void
+LLVMRustDowngradeColdFunctions(LLVMModuleRef M,
+                               LLVMRustColdDowngradeStats *Stats) {
+  Module *TheModule = unwrap(M);
+  ProfileSummaryInfo PSI(*TheModule);
+  bool HasProfile = PSI.hasProfileSummary();
+  *Stats = {};
+  for (Function &F : *TheModule) {
+    if (F.isDeclaration() || F.hasFnAttribute(Attribute::AlwaysInline) ||
+        F.hasFnAttribute(Attribute::OptimizeNone))
+      continue;
+
+    if (HasProfile && hasZeroEntryCount(F)) {
+      // `optnone` requires `noinline`, and excludes the size attributes.
+      F.removeFnAttr(Attribute::MinSize);
+      F.removeFnAttr(Attribute::OptimizeForSize);
+      F.addFnAttr(Attribute::NoInline);
+      F.addFnAttr(Attribute::OptimizeNone);
+      Stats->OptNone++;
+      continue;
+    }
+
+    bool Cold = F.hasFnAttribute(Attribute::Cold) ||
+                (HasProfile && PSI.isFunctionEntryCold(&F));
+    if (Cold && !F.hasFnAttribute(Attribute::MinSize)) {
+      F.addFnAttr(Attribute::MinSize);
+      F.addFnAttr(Attribute::OptimizeForSize);
+      Stats->MinSize++;
+    }
+  }
+}
+
+struct LLVMRustThinLTOData;
+static const ModuleSummaryIndex *getThinLTOIndex(const LLVMRustThinLTOData *Data);
+
+// With `ThinLTOData` given, its combined index is used by the ThinLTO stage's
+// pipeline. With `PassStatistics` given, the statistics of the passes that run
+// are added to it.
+extern "C" LLVMRustResult
+LLVMRustOptimizeWithNewPassManager(
+    LLVMModuleRef ModuleRef,
+    LLVMTargetMachineRef TMRef,
+    LLVMRustPassBuilderOptLevel OptLevelRust,
+    LLVMRustOptStage OptStage,
+    bool NoPrepopulatePasses, bool VerifyIR, bool UseThinLTOBuffers,
+    bool MergeFunctions, bool UnrollLoops, bool SLPVectorize, bool LoopVectorize,
+    bool DisableSimplifyLibCalls, bool EmitLifetimeMarkers,
+    LLVMRustSanitizerOptions *SanitizerOptions,
+    const char *PGOGenPath, const char *PGOUsePath,
+    const LLVMRustPGOOptions *PGOOpts,
+    const LLVMRustTuningOptions *TuningOpts,
+    bool InstrumentCoverage, bool InstrumentGCOV,
+    void* LlvmSelfProfiler,
+    LLVMRustSelfProfileRegisterPassCallback RegisterPassCallback,
+    LLVMRustSelfProfileBeforePassCallback BeforePassCallback,
+    LLVMRustSelfProfileAfterPassCallback AfterPassCallback,
+    LLVMRustPassStatistics *PassStatistics,
+    const char *ExtraPasses, size_t ExtraPassesLen,
+    const LLVMRustThinLTOData *ThinLTOData) {
+  Module *TheModule = unwrap(ModuleRef);
+  LLVMRustPassPipeline P;
+  if (buildPassPipeline(
+          P, Triple(TheModule->getTargetTriple()), unwrap(TMRef), OptLevelRust,
+          OptStage, NoPrepopulatePasses, VerifyIR, UseThinLTOBuffers,
+          MergeFunctions, UnrollLoops, SLPVectorize, LoopVectorize,
+          DisableSimplifyLibCalls, EmitLifetimeMarkers, SanitizerOptions,
+          PGOGenPath, PGOUsePath, PGOOpts, TuningOpts, InstrumentCoverage,
+          InstrumentGCOV,
+          LlvmSelfProfiler, RegisterPassCallback, BeforePassCallback,
+          AfterPassCallback, PassStatistics,
+          ExtraPasses, ExtraPassesLen,
+          ThinLTOData ? getThinLTOIndex(ThinLTOData) : nullptr)
+          != LLVMRustResult::Success)
+    return LLVMRustResult::Failure;
+  runPassPipeline(P, TheModule);
   return LLVMRustResult::Success;
 }
 
+// The values of LLVM's statistics counters at the time of
+// `LLVMRustStatisticsBegin`.
+struct LLVMRustStatisticsSnapshot {
+  StringMap<int64_t> Values;
+};
+
+// Reads all of the statistics counters, by their `<debug type>.<name>`.
+static void readStatistics(StringMap<int64_t> &Values) {
+  std::string Printed;
+  raw_string_ostream OS(Printed);
+  // This is the only way to read the counters along with their debug type.
+  PrintStatisticsJSON(OS);
+  OS.flush();
+  Expected<json::Value> Parsed = json::parse(Printed);
+  if (!Parsed) {
+    consumeError(Parsed.takeError());
+    return;
+  }
+  if (const json::Object *Obj = Parsed->getAsObject()) {
+    for (const auto &KV : *Obj) {
+      // Timers are printed along with the counters, as floating point.
+      if (Optional<int64_t> Value = KV.second.getAsInteger())
+        Values[KV.first] = *Value;
+    }
+  }
+}
+
+// Enables LLVM's `-stats` counters without printing them at exit, and takes a
+// snapshot of them to be compared against by `LLVMRustStatisticsEnd`. The
+// counters are global, so what changed in between can only be attributed to
+// one invocation if nothing else runs in LLVM at the same time, which is why
+// rustc makes `-Z llvm-stats` imply `-Z no-parallel-llvm`. They only count in
+// LLVM builds with assertions or `LLVM_FORCE_ENABLE_STATS`.
+extern "C" LLVMRustStatisticsSnapshot *LLVMRustStatisticsBegin() {
+  EnableStatistics(/* DoPrintOnExit = */ false);
+  auto *Snapshot = new LLVMRustStatisticsSnapshot;
+  readStatistics(Snapshot->Values);
+  return Snapshot;
+}
+
+// Writes the counters which changed since `Snapshot` was taken to `Str`, as a
+// JSON object of their increments by `<debug type>.<name>`, sorted by key, and
+// frees `Snapshot`.
+extern "C" void LLVMRustStatisticsEnd(LLVMRustStatisticsSnapshot *Snapshot,
+                                      RustStringRef Str) {
+  std::unique_ptr<LLVMRustStatisticsSnapshot> Before(Snapshot);
+  StringMap<int64_t> After;
+  readStatistics(After);
+
+  std::vector<std::pair<StringRef, int64_t>> Changed;
+  for (const auto &E : After) {
+    int64_t Delta = E.getValue() - Before->Values.lookup(E.getKey());
+    if (Delta != 0)
+      Changed.push_back({E.getKey(), Delta});
+  }
+  llvm::sort(Changed, [](const auto &A, const auto &B) {
+    return A.first < B.first;
+  });
+
+  RawRustStringOstream OS(Str);
+  json::OStream J(OS);
+  J.object([&] {
+    for (const auto &C : Changed)
+      J.attribute(C.first, C.second);
+  });
+}
+
 // Callback to demangle function name
 // Parameters:
 // * name to be demangled
@@ -1110,6 +2520,9 @@ namespace {
 class RustAssemblyAnnotationWriter : public AssemblyAnnotationWriter {
   DemangleFn Demangle;
   std::vector<char> Buf;
+  // The demangled names by mangled name, as the same callees tend to be
+  // called over and over again. Empty if there's nothing to print.
+  StringMap<std::string> Cache;
 
 public:
   RustAssemblyAnnotationWriter(DemangleFn Demangle) : Demangle(Demangle) {}
@@ -1121,6 +2534,12 @@ public:
       return StringRef();
     }
 
+    auto Inserted = Cache.try_emplace(name);
+    std::string &Cached = Inserted.first->second;
+    if (!Inserted.second) {
+      return Cached;
+    }
+
     if (Buf.size() < name.size() * 2) {
       // Semangled name usually shorter than mangled,
       // but allocate twice as much memory just in case
@@ -1139,7 +2558,8 @@ public:
       return StringRef();
     }
 
-    return Demangled;
+    Cached = Demangled.str();
+    return Cached;
   }
 
   void emitFunctionAnnot(const Function *F,
@@ -1195,6 +2615,9 @@ LLVMRustPrintModule(LLVMModuleRef M, const char *Path, DemangleFn Demangle) {
     return LLVMRustResult::Failure;
   }
 
+  // `formatted_raw_ostream` takes over the buffer of the stream it wraps, so
+  // this is the buffer the whole module is printed through.
+  OS.SetBufferSize(1 << 20);
   RustAssemblyAnnotationWriter AAW(Demangle);
   formatted_raw_ostream FOS(OS);
   unwrap(M)->print(FOS, &AAW);
@@ -1231,13 +2654,12 @@ extern "C" void LLVMRustRunRestrictionPass(LLVMModuleRef M, char **Symbols,
                                            size_t Len) {
   llvm::legacy::PassManager passes;
 
-  auto PreserveFunctions = [=](const GlobalValue &GV) {
-    for (size_t I = 0; I < Len; I++) {
-      if (GV.getName() == Symbols[I]) {
-        return true;
-      }
-    }
-    return false;
+  StringSet<> Preserved;
+  for (size_t I = 0; I < Len; I++)
+    Preserved.insert(Symbols[I]);
+
+  auto PreserveFunctions = [&](const GlobalValue &GV) {
+    return Preserved.count(GV.getName()) != 0;
   };
 
   passes.add(llvm::createInternalizePass(PreserveFunctions));
@@ -1245,23 +2667,35 @@ extern "C" void LLVMRustRunRestrictionPass(LLVMModuleRef M, char **Symbols,
   passes.run(*unwrap(M));
 }
 
-extern "C" void LLVMRustMarkAllFunctionsNounwind(LLVMModuleRef M) {
-  for (Module::iterator GV = unwrap(M)->begin(), E = unwrap(M)->end(); GV != E;
-       ++GV) {
-    GV->setDoesNotThrow();
-    Function *F = dyn_cast<Function>(GV);
-    if (F == nullptr)
+// Marks every function nounwind and replaces the invokes by calls, so that the
+// landing pads they unwound to, which are unreachable afterwards, are deleted
+// right away. Only the bodies of functions with a personality are scanned, as
+// other functions can't have any invokes. Returns the number of invokes which
+// were converted.
+extern "C" size_t LLVMRustMarkAllFunctionsNounwind(LLVMModuleRef M) {
+  size_t NumConverted = 0;
+  SmallVector<InvokeInst *, 16> Invokes;
+  for (Function &F : *unwrap(M)) {
+    F.setDoesNotThrow();
+    if (F.isDeclaration() || !F.hasPersonalityFn())
       continue;
 
-    for (Function::iterator B = F->begin(), BE = F->end(); B != BE; ++B) {
-      for (BasicBlock::iterator I = B->begin(), IE = B->end(); I != IE; ++I) {
-        if (isa<InvokeInst>(I)) {
-          InvokeInst *CI = cast<InvokeInst>(I);
-          CI->setDoesNotThrow();
-        }
-      }
+    Invokes.clear();
+    for (BasicBlock &BB : F) {
+      if (auto *II = dyn_cast_or_null<InvokeInst>(BB.getTerminator()))
+        Invokes.push_back(II);
+    }
+    if (Invokes.empty())
+      continue;
+
+    for (InvokeInst *II : Invokes) {
+      II->setDoesNotThrow();
+      changeToCall(II);
     }
+    removeUnreachableBlocks(F);
+    NumConverted += Invokes.size();
   }
+  return NumConverted;
 }
 
 extern "C" void
@@ -1340,9 +2774,45 @@ struct LLVMRustThinLTOData {
   StringMap<GVSummaryMapTy> ModuleToDefinedGVSummaries;
   StringMap<std::map<GlobalValue::GUID, GlobalValue::LinkageTypes>> ResolvedODR;
 
+  // The bitcode modules found in the buffers of `ModuleMap`, populated lazily
+  // by `getThinLTOBitcodeModule` the first time a module is imported from.
+  // Locating the module inside a buffer means scanning its block structure,
+  // and popular modules are imported from by almost every other module.
+  mutable std::mutex BitcodeModulesLock;
+  mutable StringMap<BitcodeModule> BitcodeModules;
+
+  // The GUIDs of the CFI function definitions and declarations of `Index`,
+  // which are part of the LTO cache key of every module.
+  std::set<GlobalValue::GUID> CfiFunctionDefs;
+  std::set<GlobalValue::GUID> CfiFunctionDecls;
+
   LLVMRustThinLTOData() : Index(/* HaveGVs = */ false) {}
 };
 
+static const ModuleSummaryIndex *getThinLTOIndex(const LLVMRustThinLTOData *Data) {
+  return &Data->Index;
+}
+
+// Returns the entry for `Key` in `Map`, or an empty value if there's none,
+// without copying it like `lookup` does.
+template <typename T>
+static const T &lookupOrEmpty(const StringMap<T> &Map, StringRef Key) {
+  static const T Empty;
+  auto It = Map.find(Key);
+  return It == Map.end() ? Empty : It->second;
+}
+
+// Fills the CFI function sets of `Data` from its index.
+static void computeCfiFunctionGUIDs(LLVMRustThinLTOData *Data) {
+  // Based on the 'InProcessThinBackend' constructor in LLVM
+  for (auto &Name : Data->Index.cfiFunctionDefs())
+    Data->CfiFunctionDefs.insert(
+        GlobalValue::getGUID(GlobalValue::dropLLVMManglingEscape(Name)));
+  for (auto &Name : Data->Index.cfiFunctionDecls())
+    Data->CfiFunctionDecls.insert(
+        GlobalValue::getGUID(GlobalValue::dropLLVMManglingEscape(Name)));
+}
+
 // Just an argument to the `LLVMRustCreateThinLTOData` function below.
 struct LLVMRustThinLTOModule {
   const char *identifier;
@@ -1350,6 +2820,57 @@ struct LLVMRustThinLTOModule {
   size_t len;
 };
 
+// Split ThinLTO buffers, written by `LLVMRustThinLTOBufferCreateSplit`, start
+// with this magic, followed by the little-endian header fields below. The
+// summary, a thin link bitcode file with the module's summary but without any
+// function bodies, comes first, followed by the full ThinLTO bitcode of the
+// module. Building the combined index only reads the former, and importing
+// and optimizing a module only the latter.
+static const char SplitThinLTOBufferMagic[4] = {'R', 'T', 'L', 'S'};
+static const uint32_t SplitThinLTOBufferVersion = 1;
+// The magic, the version, and the offsets and sizes of the summary and of the
+// module.
+static const size_t SplitThinLTOBufferHeaderSize = 4 + 4 + 4 * 8;
+
+// Finds the summary and the module bitcode of the split ThinLTO buffer `Data`.
+// Returns false if it isn't one, or if it's malformed.
+static bool splitThinLTOBuffer(StringRef Data, StringRef &Summary,
+                               StringRef &Module) {
+  if (Data.size() < SplitThinLTOBufferHeaderSize ||
+      !Data.startswith(StringRef(SplitThinLTOBufferMagic, 4)))
+    return false;
+  auto Read64 = [&](size_t Offset) {
+    return support::endian::read64le(Data.data() + Offset);
+  };
+  if (support::endian::read32le(Data.data() + 4) != SplitThinLTOBufferVersion)
+    return false;
+  uint64_t SummaryOffset = Read64(8), SummarySize = Read64(16);
+  uint64_t ModuleOffset = Read64(24), ModuleSize = Read64(32);
+  if (SummaryOffset > Data.size() || SummarySize > Data.size() - SummaryOffset ||
+      ModuleOffset > Data.size() || ModuleSize > Data.size() - ModuleOffset)
+    return false;
+  Summary = Data.substr(SummaryOffset, SummarySize);
+  Module = Data.substr(ModuleOffset, ModuleSize);
+  return true;
+}
+
+// The module bitcode of a ThinLTO buffer, split or not.
+static StringRef thinLTOModuleBitcode(StringRef Data) {
+  StringRef Summary, Module;
+  return splitThinLTOBuffer(Data, Summary, Module) ? Module : Data;
+}
+
+// The bitcode to read the summary of a ThinLTO buffer from, split or not.
+static StringRef thinLTOSummaryBitcode(StringRef Data) {
+  StringRef Summary, Module;
+  return splitThinLTOBuffer(Data, Summary, Module) ? Summary : Data;
+}
+
+static MemoryBufferRef thinLTOModuleBuffer(const LLVMRustThinLTOModule &M) {
+  return MemoryBufferRef(thinLTOModuleBitcode(StringRef(M.data, M.len)),
+                         M.identifier);
+}
+
 // This is copied from `lib/LTO/ThinLTOCodeGenerator.cpp`, not sure what it
 // does.
 static const GlobalValueSummary *
@@ -1373,30 +2894,223 @@ getFirstDefinitionForLinker(const GlobalValueSummaryList &GVSummaryList) {
   return FirstDefForLinker->get();
 }
 
-// The main entry point for creating the global ThinLTO analysis. The structure
-// here is basically the same as before threads are spawned in the `run`
-// function of `lib/LTO/ThinLTOCodeGenerator.cpp`.
-extern "C" LLVMRustThinLTOData*
-LLVMRustCreateThinLTOData(LLVMRustThinLTOModule *modules,
-                          int num_modules,
-                          const char **preserved_symbols,
-                          int num_symbols) {
-  auto Ret = std::make_unique<LLVMRustThinLTOData>();
-
-  // Load each module's summary and merge it into one combined index
-  for (int i = 0; i < num_modules; i++) {
-    auto module = &modules[i];
-    StringRef buffer(module->data, module->len);
-    MemoryBufferRef mem_buffer(buffer, module->identifier);
-
-    Ret->ModuleMap[module->identifier] = mem_buffer;
+// Copies all summaries of the per-module index `Src` into the combined index
+// `Dst`, registering them under `ModId`. This produces the same result as
+// reading the module's summary straight into `Dst` with
+// `readModuleSummaryIndex`, except that `Src` may have been parsed on another
+// thread.
+//
+// Summaries refer to each other through `ValueInfo`s, which point into the
+// value map of the index they were created in, so everything referenced from
+// a summary has to be re-resolved against `Dst` here.
+static void mergeModuleSummaryIndex(ModuleSummaryIndex &Dst,
+                                    const ModuleSummaryIndex &Src,
+                                    StringRef ModulePath, uint64_t ModId) {
+  ModuleHash Hash = {{0}};
+  auto SrcModule = Src.modulePaths().find(ModulePath);
+  if (SrcModule != Src.modulePaths().end())
+    Hash = SrcModule->second.second;
+  StringRef DstModulePath = Dst.addModule(ModulePath, ModId, Hash)->first();
+
+  // The reader sets the index flags and adds up the block counts of all the
+  // summaries it reads into an index.
+  Dst.setFlags(Src.getFlags());
+  Dst.addBlockCount(Src.getBlockCount());
+  Dst.cfiFunctionDefs().insert(Src.cfiFunctionDefs().begin(),
+                               Src.cfiFunctionDefs().end());
+  Dst.cfiFunctionDecls().insert(Src.cfiFunctionDecls().begin(),
+                                Src.cfiFunctionDecls().end());
+
+  auto Remap = [&](ValueInfo VI) {
+    ValueInfo Ret = Dst.getOrInsertValueInfo(VI.getGUID());
+    if (Ret.name().empty() && !VI.name().empty())
+      Ret = Dst.getOrInsertValueInfo(VI.getGUID(), Dst.saveString(VI.name()));
+    if (VI.isReadOnly())
+      Ret.setReadOnly();
+    else if (VI.isWriteOnly())
+      Ret.setWriteOnly();
+    return Ret;
+  };
+  auto RemapRefs = [&](ArrayRef<ValueInfo> Refs) {
+    std::vector<ValueInfo> Ret;
+    Ret.reserve(Refs.size());
+    for (ValueInfo VI : Refs)
+      Ret.push_back(Remap(VI));
+    return Ret;
+  };
 
-    if (Error Err = readModuleSummaryIndex(mem_buffer, Ret->Index, i)) {
-      LLVMRustSetLastError(toString(std::move(Err)).c_str());
-      return nullptr;
+  // Aliases point directly at their aliasee's summary, so they're copied
+  // after everything else once the new location of the aliasee is known.
+  DenseMap<const GlobalValueSummary *, GlobalValueSummary *> Copied;
+  std::vector<std::pair<GlobalValue::GUID, const AliasSummary *>> Aliases;
+
+  for (const auto &Entry : Src) {
+    ValueInfo VI = Remap(Src.getValueInfo(Entry));
+    for (const auto &Summary : Entry.second.SummaryList) {
+      std::unique_ptr<GlobalValueSummary> New;
+      if (auto *FS = dyn_cast<FunctionSummary>(Summary.get())) {
+        std::vector<FunctionSummary::EdgeTy> Calls;
+        Calls.reserve(FS->calls().size());
+        for (const auto &Edge : FS->calls())
+          Calls.emplace_back(Remap(Edge.first), Edge.second);
+#if LLVM_VERSION_GE(11, 0)
+        std::vector<FunctionSummary::ParamAccess> Params(
+            FS->paramAccesses().begin(), FS->paramAccesses().end());
+        for (auto &Param : Params)
+          for (auto &Call : Param.Calls)
+            Call.Callee = Remap(Call.Callee);
+#endif
+        New = std::make_unique<FunctionSummary>(
+            FS->flags(), FS->instCount(), FS->fflags(), FS->entryCount(),
+            RemapRefs(FS->refs()), std::move(Calls),
+            std::vector<GlobalValue::GUID>(FS->type_tests().begin(),
+                                           FS->type_tests().end()),
+            std::vector<FunctionSummary::VFuncId>(
+                FS->type_test_assume_vcalls().begin(),
+                FS->type_test_assume_vcalls().end()),
+            std::vector<FunctionSummary::VFuncId>(
+                FS->type_checked_load_vcalls().begin(),
+                FS->type_checked_load_vcalls().end()),
+            std::vector<FunctionSummary::ConstVCall>(
+                FS->type_test_assume_const_vcalls().begin(),
+                FS->type_test_assume_const_vcalls().end()),
+            std::vector<FunctionSummary::ConstVCall>(
+                FS->type_checked_load_const_vcalls().begin(),
+                FS->type_checked_load_const_vcalls().end())
+#if LLVM_VERSION_GE(11, 0)
+            , std::move(Params)
+#endif
+            );
+      } else if (auto *GVS = dyn_cast<GlobalVarSummary>(Summary.get())) {
+        auto NewGVS = std::make_unique<GlobalVarSummary>(
+            GVS->flags(), GVS->varflags(), RemapRefs(GVS->refs()));
+        if (!GVS->vTableFuncs().empty()) {
+          VTableFuncList Funcs;
+          for (const auto &Func : GVS->vTableFuncs())
+            Funcs.emplace_back(Remap(Func.FuncVI), Func.VTableOffset);
+          NewGVS->setVTableFuncs(std::move(Funcs));
+        }
+        New = std::move(NewGVS);
+      } else {
+        Aliases.emplace_back(Entry.first, cast<AliasSummary>(Summary.get()));
+        continue;
+      }
+      New->setModulePath(DstModulePath);
+      New->setOriginalName(Summary->getOriginalName());
+      Copied[Summary.get()] = New.get();
+      Dst.addGlobalValueSummary(VI, std::move(New));
+    }
+  }
+
+  for (const auto &Alias : Aliases) {
+    const AliasSummary *AS = Alias.second;
+    auto New = std::make_unique<AliasSummary>(AS->flags());
+    ValueInfo AliaseeVI = Remap(AS->getAliaseeVI());
+    New->setAliasee(AliaseeVI, Copied.lookup(&AS->getAliasee()));
+    New->setModulePath(DstModulePath);
+    New->setOriginalName(AS->getOriginalName());
+    Dst.addGlobalValueSummary(Dst.getOrInsertValueInfo(Alias.first),
+                              std::move(New));
+  }
+
+  for (const auto &TypeId : Src.typeIdCompatibleVtableMap()) {
+    auto &Info = Dst.getOrInsertTypeIdCompatibleVtableSummary(TypeId.first);
+    for (const auto &VTable : TypeId.second)
+      Info.emplace_back(VTable.AddressPointOffset, Remap(VTable.VTableVI));
+  }
+  for (const auto &TypeId : Src.typeIds())
+    Dst.getOrInsertTypeIdSummary(TypeId.second.first) = TypeId.second.second;
+}
+
+// Load each module's summary and merge it into one combined index.
+//
+// With `num_threads > 1` the summaries are parsed concurrently on a thread
+// pool, each into an index of its own, and afterwards merged into the
+// combined index in module order so the result is deterministic.
+static bool
+loadThinLTOSummaries(LLVMRustThinLTOData *Data, LLVMRustThinLTOModule *modules,
+                     int num_modules, unsigned num_threads) {
+  num_threads = resolveNumThreads(num_threads);
+  for (int i = 0; i < num_modules; i++) {
+    auto module = &modules[i];
+    Data->ModuleMap[module->identifier] = thinLTOModuleBuffer(*module);
+  }
+
+  // The summaries of split buffers are read from their own part, which is
+  // identified the same as the module.
+  auto SummaryBuffer = [modules](int i) {
+    return MemoryBufferRef(
+        thinLTOSummaryBitcode(StringRef(modules[i].data, modules[i].len)),
+        modules[i].identifier);
+  };
+
+  if (num_threads <= 1 || num_modules <= 1) {
+    for (int i = 0; i < num_modules; i++) {
+      MemoryBufferRef mem_buffer = SummaryBuffer(i);
+      if (Error Err = readModuleSummaryIndex(mem_buffer, Data->Index, i)) {
+        LLVMRustSetLastError(toString(std::move(Err)).c_str());
+        return false;
+      }
     }
+    return true;
   }
 
+  std::vector<Optional<Expected<std::unique_ptr<ModuleSummaryIndex>>>>
+      Indices(num_modules);
+  {
+#if LLVM_VERSION_GE(11, 0)
+    ThreadPool Pool(hardware_concurrency(num_threads));
+#else
+    ThreadPool Pool(num_threads);
+#endif
+    for (int i = 0; i < num_modules; i++) {
+      MemoryBufferRef mem_buffer = SummaryBuffer(i);
+      Pool.async([&Indices, i, mem_buffer] {
+        Indices[i].emplace(getModuleSummaryIndex(mem_buffer));
+      });
+    }
+    Pool.wait();
+  }
+
+  // Every `Expected` has to be inspected, so keep going after the first error
+  // and only report that one.
+  bool Failed = false;
+  for (int i = 0; i < num_modules; i++) {
+    auto &IndexOrErr = *Indices[i];
+    if (!IndexOrErr) {
+      Error Err = IndexOrErr.takeError();
+      if (Failed) {
+        consumeError(std::move(Err));
+      } else {
+        LLVMRustSetLastError(toString(std::move(Err)).c_str());
+        Failed = true;
+      }
+      continue;
+    }
+    if (!Failed)
+      mergeModuleSummaryIndex(Data->Index, **IndexOrErr,
+                              modules[i].identifier, i);
+    // Free the per-module index as soon as it's merged.
+    IndexOrErr->reset();
+  }
+  return !Failed;
+}
+
+// The main entry point for creating the global ThinLTO analysis. The structure
+// here is basically the same as before threads are spawned in the `run`
+// function of `lib/LTO/ThinLTOCodeGenerator.cpp`.
+static LLVMRustThinLTOData*
+createThinLTOData(LLVMRustThinLTOModule *modules,
+                  int num_modules,
+                  const char **preserved_symbols,
+                  int num_symbols,
+                  unsigned num_threads,
+                  bool whole_program_devirt) {
+  auto Ret = std::make_unique<LLVMRustThinLTOData>();
+
+  if (!loadThinLTOSummaries(Ret.get(), modules, num_modules, num_threads))
+    return nullptr;
+
   // Collect for each module the list of function it defines (GUID -> Summary)
   Ret->Index.collectDefinedGVSummariesPerModule(Ret->ModuleToDefinedGVSummaries);
 
@@ -1419,6 +3133,21 @@ LLVMRustCreateThinLTOData(LLVMRustThinLTOModule *modules,
   // Otherwise, we sometimes lose `static` values -- see #60184.
   computeDeadSymbolsWithConstProp(Ret->Index, Ret->GUIDPreservedSymbols,
                                   deadIsPrevailing, /* ImportEnabled = */ false);
+
+  // Summary-based whole program devirtualization, as done by `runThinLTO` in
+  // `lib/LTO/LTO.cpp`. The resolutions are recorded in the index, and applied
+  // to each module by the ThinLTO pipeline given the index.
+  std::set<GlobalValue::GUID> DevirtExportedGUIDs;
+  std::map<ValueInfo, std::vector<VTableSlotSummary>> LocalWPDTargetsMap;
+  if (whole_program_devirt) {
+#if LLVM_VERSION_GE(11, 0)
+    updateVCallVisibilityInIndex(Ret->Index,
+                                 /* WholeProgramVisibilityEnabledInLTO = */ false);
+#endif
+    runWholeProgramDevirtOnIndex(Ret->Index, DevirtExportedGUIDs,
+                                 LocalWPDTargetsMap);
+  }
+
   ComputeCrossModuleImport(
     Ret->Index,
     Ret->ModuleToDefinedGVSummaries,
@@ -1478,18 +3207,484 @@ LLVMRustCreateThinLTOData(LLVMRustThinLTOModule *modules,
     const auto &ExportList = Ret->ExportLists.find(ModuleIdentifier);
     return (ExportList != Ret->ExportLists.end() &&
       ExportList->second.count(VI)) ||
-      ExportedGUIDs.count(VI.getGUID());
+      ExportedGUIDs.count(VI.getGUID()) ||
+      DevirtExportedGUIDs.count(VI.getGUID());
   };
+  if (whole_program_devirt)
+    updateIndexWPDForExports(Ret->Index, isExported, LocalWPDTargetsMap);
   thinLTOInternalizeAndPromoteInIndex(Ret->Index, isExported, isPrevailing);
 
+  computeCfiFunctionGUIDs(Ret.get());
   return Ret.release();
 }
 
+extern "C" LLVMRustThinLTOData*
+LLVMRustCreateThinLTOData(LLVMRustThinLTOModule *modules,
+                          int num_modules,
+                          const char **preserved_symbols,
+                          int num_symbols) {
+  return createThinLTOData(modules, num_modules, preserved_symbols, num_symbols,
+                           /* num_threads = */ 1,
+                           /* whole_program_devirt = */ false);
+}
+
+// Same as `LLVMRustCreateThinLTOData`, but parses the module summaries on up
+// to `num_threads` threads.
+extern "C" LLVMRustThinLTOData*
+LLVMRustCreateThinLTODataParallel(LLVMRustThinLTOModule *modules,
+                                  int num_modules,
+                                  const char **preserved_symbols,
+                                  int num_symbols,
+                                  unsigned num_threads) {
+  return createThinLTOData(modules, num_modules, preserved_symbols, num_symbols,
+                           num_threads, /* whole_program_devirt = */ false);
+}
+
+// Same as `LLVMRustCreateThinLTODataParallel`, but if `whole_program_devirt` is
+// set, virtual calls are devirtualized based on the summaries in the combined
+// index. This only has an effect on modules with type metadata, and the
+// resolutions are only applied if the data is passed on to the ThinLTO stage
+// pipeline.
+extern "C" LLVMRustThinLTOData*
+LLVMRustCreateThinLTODataWithOptions(LLVMRustThinLTOModule *modules,
+                                     int num_modules,
+                                     const char **preserved_symbols,
+                                     int num_symbols,
+                                     unsigned num_threads,
+                                     bool whole_program_devirt) {
+  return createThinLTOData(modules, num_modules, preserved_symbols, num_symbols,
+                           num_threads, whole_program_devirt);
+}
+
+// An optional on-disk cache of the global analysis done by
+// `LLVMRustCreateThinLTOData`.
+//
+// The cache file starts with the identifier and content hash of every input
+// module plus a hash of the preserved symbols and the LLVM command-line
+// options (`-C llvm-args`). If all of those match the current inputs the rest
+// of the file is loaded instead of redoing the analysis. The content hash of a
+// module is the one the bitcode writer stores in ThinLTO bitcode, which is read
+// without parsing or hashing the rest of the module. The analysis (dead
+// symbols, import lists, ...) is global over all modules, so the entry is only
+// used if every module matches.
+//
+// The combined index is stored in LLVM's own combined summary bitcode format,
+// followed by everything else in `LLVMRustThinLTOData` that can't be derived
+// from it. `ModuleToDefinedGVSummaries` is recomputed from the index on load.
+static const char ThinLTODataCacheMagic[8] = {'R', 'S', 'T', 'L', 'T', 'O', 'D', 'C'};
+static const uint32_t ThinLTODataCacheVersion = 2;
+
+typedef std::array<uint8_t, 20> ThinLTODataCacheHash;
+
+// Reads the hash of the contents of the first module of `Bitcode`, which the
+// bitcode writer stores at the end of the module block of ThinLTO bitcode.
+// The nested blocks, such as function bodies and metadata, are skipped over
+// without being parsed. Returns false if there's no such hash.
+static bool readModuleHash(StringRef Bitcode, ModuleHash &Hash) {
+  const unsigned char *BufPtr = Bitcode.bytes_begin();
+  const unsigned char *BufEnd = Bitcode.bytes_end();
+  if (isBitcodeWrapper(BufPtr, BufEnd) &&
+      SkipBitcodeWrapperHeader(BufPtr, BufEnd, /* VerifyBufferSize = */ true))
+    return false;
+  if (!isRawBitcode(BufPtr, BufEnd))
+    return false;
+
+  auto Failed = [](Error Err) {
+    if (!Err)
+      return false;
+    consumeError(std::move(Err));
+    return true;
+  };
+
+  BitstreamCursor Stream(ArrayRef<uint8_t>(BufPtr, BufEnd));
+  // Skip the magic, which `isRawBitcode` checked.
+  Expected<SimpleBitstreamCursor::word_t> Magic = Stream.Read(32);
+  if (!Magic) {
+    consumeError(Magic.takeError());
+    return false;
+  }
+
+  BitstreamBlockInfo BlockInfo;
+  bool InModule = false;
+  SmallVector<uint64_t, 64> Record;
+  while (true) {
+    Expected<BitstreamEntry> MaybeEntry = Stream.advance();
+    if (!MaybeEntry) {
+      consumeError(MaybeEntry.takeError());
+      return false;
+    }
+    BitstreamEntry Entry = *MaybeEntry;
+    switch (Entry.Kind) {
+    case BitstreamEntry::Error:
+    case BitstreamEntry::EndBlock:
+      return false;
+    case BitstreamEntry::SubBlock:
+      if (!InModule && Entry.ID == bitc::MODULE_BLOCK_ID) {
+        if (Failed(Stream.EnterSubBlock(bitc::MODULE_BLOCK_ID)))
+          return false;
+        InModule = true;
+      } else if (Entry.ID == bitc::BLOCKINFO_BLOCK_ID) {
+        Expected<Optional<BitstreamBlockInfo>> MaybeInfo =
+            Stream.ReadBlockInfoBlock();
+        if (!MaybeInfo) {
+          consumeError(MaybeInfo.takeError());
+          return false;
+        }
+        if (!*MaybeInfo)
+          return false;
+        BlockInfo = std::move(**MaybeInfo);
+        Stream.setBlockInfo(&BlockInfo);
+      } else if (Failed(Stream.SkipBlock())) {
+        return false;
+      }
+      break;
+    case BitstreamEntry::Record: {
+      Record.clear();
+      Expected<unsigned> Code = Stream.readRecord(Entry.ID, Record);
+      if (!Code) {
+        consumeError(Code.takeError());
+        return false;
+      }
+      if (InModule && *Code == bitc::MODULE_CODE_HASH) {
+        if (Record.size() != Hash.size())
+          return false;
+        for (size_t I = 0; I < Hash.size(); I++)
+          Hash[I] = Record[I];
+        return true;
+      }
+      break;
+    }
+    }
+  }
+}
+
+static void
+computeThinLTODataCacheKey(LLVMRustThinLTOModule *modules, int num_modules,
+                           const char **preserved_symbols, int num_symbols,
+                           std::vector<ThinLTODataCacheHash> &ModuleHashes,
+                           ThinLTODataCacheHash &ConfigHash) {
+  ModuleHashes.resize(num_modules);
+  for (int i = 0; i < num_modules; i++) {
+    StringRef Bitcode =
+        thinLTOModuleBitcode(StringRef(modules[i].data, modules[i].len));
+    ModuleHash Hash;
+    if (readModuleHash(Bitcode, Hash)) {
+      for (size_t I = 0; I < Hash.size(); I++)
+        support::endian::write32le(&ModuleHashes[i][I * 4], Hash[I]);
+    } else {
+      // Bitcode without a module hash has to be hashed in full.
+      ModuleHashes[i] = SHA1::hash(makeArrayRef(
+          reinterpret_cast<const uint8_t *>(Bitcode.data()), Bitcode.size()));
+    }
+  }
+
+  SHA1 Hasher;
+  for (int i = 0; i < num_symbols; i++) {
+    Hasher.update(preserved_symbols[i]);
+    Hasher.update(ArrayRef<uint8_t>((const uint8_t *)"\0", 1));
+  }
+  Hasher.update(llvmOptionsString());
+  StringRef Result = Hasher.result();
+  std::copy(Result.begin(), Result.end(), ConfigHash.begin());
+}
+
+namespace {
+
+// A bounds-checked little-endian reader over a cache file. Reads past the end
+// of the data return zeroes and flag the reader as failed.
+struct ThinLTODataCacheReader {
+  StringRef Data;
+  bool Failed = false;
+
+  explicit ThinLTODataCacheReader(StringRef Data) : Data(Data) {}
+
+  StringRef readBytes(uint64_t Len) {
+    if (Failed || Data.size() < Len) {
+      Failed = true;
+      return StringRef();
+    }
+    StringRef Ret = Data.take_front(Len);
+    Data = Data.drop_front(Len);
+    return Ret;
+  }
+
+  template <typename T> T read() {
+    StringRef Bytes = readBytes(sizeof(T));
+    if (Failed)
+      return 0;
+    return support::endian::read<T, support::little, support::unaligned>(
+        Bytes.data());
+  }
+
+  StringRef readString() { return readBytes(read<uint32_t>()); }
+};
+
+} // namespace
+
+static void writeThinLTODataCacheString(support::endian::Writer &W, StringRef Str) {
+  W.write<uint32_t>(Str.size());
+  W.OS << Str;
+}
+
+static bool
+writeThinLTODataCache(const LLVMRustThinLTOData *Data, const char *Path,
+                      LLVMRustThinLTOModule *modules, int num_modules,
+                      const std::vector<ThinLTODataCacheHash> &ModuleHashes,
+                      const ThinLTODataCacheHash &ConfigHash) {
+  std::string Buf;
+  raw_string_ostream OS(Buf);
+  support::endian::Writer W(OS, support::little);
+
+  OS.write(ThinLTODataCacheMagic, sizeof(ThinLTODataCacheMagic));
+  W.write<uint32_t>(ThinLTODataCacheVersion);
+  W.write<uint32_t>(LLVM_VERSION_MAJOR);
+  W.write<uint32_t>(LLVM_VERSION_MINOR);
+  W.write<uint32_t>(LLVM_VERSION_PATCH);
+
+  W.write<uint32_t>(num_modules);
+  for (int i = 0; i < num_modules; i++) {
+    writeThinLTODataCacheString(W, modules[i].identifier);
+    OS.write((const char *)ModuleHashes[i].data(), ModuleHashes[i].size());
+  }
+  OS.write((const char *)ConfigHash.data(), ConfigHash.size());
+
+  W.write<uint64_t>(Data->GUIDPreservedSymbols.size());
+  for (auto GUID : Data->GUIDPreservedSymbols)
+    W.write<uint64_t>(GUID);
+
+  W.write<uint32_t>(Data->ImportLists.size());
+  for (const auto &ImportList : Data->ImportLists) {
+    writeThinLTODataCacheString(W, ImportList.getKey());
+    W.write<uint32_t>(ImportList.getValue().size());
+    for (const auto &Source : ImportList.getValue()) {
+      writeThinLTODataCacheString(W, Source.getKey());
+      W.write<uint64_t>(Source.getValue().size());
+      for (auto GUID : Source.getValue())
+        W.write<uint64_t>(GUID);
+    }
+  }
+
+  W.write<uint32_t>(Data->ExportLists.size());
+  for (const auto &ExportList : Data->ExportLists) {
+    writeThinLTODataCacheString(W, ExportList.getKey());
+    W.write<uint64_t>(ExportList.getValue().size());
+    for (const auto &VI : ExportList.getValue())
+      W.write<uint64_t>(VI.getGUID());
+  }
+
+  W.write<uint32_t>(Data->ResolvedODR.size());
+  for (const auto &Resolved : Data->ResolvedODR) {
+    writeThinLTODataCacheString(W, Resolved.getKey());
+    W.write<uint64_t>(Resolved.getValue().size());
+    for (const auto &Entry : Resolved.getValue()) {
+      W.write<uint64_t>(Entry.first);
+      W.write<uint8_t>(Entry.second);
+    }
+  }
+
+  std::string IndexBuf;
+  raw_string_ostream IndexOS(IndexBuf);
+  writeIndexToFile(Data->Index, IndexOS);
+  IndexOS.flush();
+  W.write<uint64_t>(IndexBuf.size());
+  OS << IndexBuf;
+  OS.flush();
+
+  // Write to a temporary file first so a concurrent or interrupted build never
+  // observes a partially written cache entry.
+  SmallString<128> TmpPath;
+  int FD;
+  if (sys::fs::createUniqueFile(Twine(Path) + "-%%%%%%%%.tmp", FD, TmpPath))
+    return false;
+  {
+    raw_fd_ostream FileOS(FD, /* shouldClose = */ true);
+    FileOS << Buf;
+    FileOS.close();
+    if (FileOS.has_error()) {
+      FileOS.clear_error();
+      sys::fs::remove(TmpPath);
+      return false;
+    }
+  }
+  if (sys::fs::rename(TmpPath, Path)) {
+    sys::fs::remove(TmpPath);
+    return false;
+  }
+  return true;
+}
+
+// Fills `Data` from the cache file at `Path`. Returns `false` if the file is
+// missing, malformed or was written for different inputs, in which case `Data`
+// must be thrown away.
+static bool
+readThinLTODataCache(LLVMRustThinLTOData *Data, const char *Path,
+                     LLVMRustThinLTOModule *modules, int num_modules,
+                     const std::vector<ThinLTODataCacheHash> &ModuleHashes,
+                     const ThinLTODataCacheHash &ConfigHash) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> BufOr = MemoryBuffer::getFile(Path);
+  if (!BufOr)
+    return false;
+  ThinLTODataCacheReader R((*BufOr)->getBuffer());
+
+  if (R.readBytes(sizeof(ThinLTODataCacheMagic)) !=
+          StringRef(ThinLTODataCacheMagic, sizeof(ThinLTODataCacheMagic)) ||
+      R.read<uint32_t>() != ThinLTODataCacheVersion ||
+      R.read<uint32_t>() != LLVM_VERSION_MAJOR ||
+      R.read<uint32_t>() != LLVM_VERSION_MINOR ||
+      R.read<uint32_t>() != LLVM_VERSION_PATCH)
+    return false;
+
+  if (R.read<uint32_t>() != (uint32_t)num_modules)
+    return false;
+  for (int i = 0; i < num_modules; i++) {
+    if (R.readString() != modules[i].identifier)
+      return false;
+    StringRef Hash = R.readBytes(ModuleHashes[i].size());
+    if (R.Failed || !std::equal(Hash.begin(), Hash.end(),
+                                (const char *)ModuleHashes[i].data()))
+      return false;
+  }
+  StringRef Hash = R.readBytes(ConfigHash.size());
+  if (R.Failed || !std::equal(Hash.begin(), Hash.end(),
+                              (const char *)ConfigHash.data()))
+    return false;
+
+  for (uint64_t N = R.read<uint64_t>(); N > 0 && !R.Failed; N--)
+    Data->GUIDPreservedSymbols.insert(R.read<uint64_t>());
+
+  for (uint32_t N = R.read<uint32_t>(); N > 0 && !R.Failed; N--) {
+    auto &ImportList = Data->ImportLists[R.readString()];
+    for (uint32_t M = R.read<uint32_t>(); M > 0 && !R.Failed; M--) {
+      auto &Functions = ImportList[R.readString()];
+      for (uint64_t K = R.read<uint64_t>(); K > 0 && !R.Failed; K--)
+        Functions.insert(R.read<uint64_t>());
+    }
+  }
+
+  // Export lists refer to `ValueInfo`s of the index, so they're only resolved
+  // once the index itself has been read below.
+  std::vector<std::pair<StringRef, std::vector<GlobalValue::GUID>>> Exports;
+  for (uint32_t N = R.read<uint32_t>(); N > 0 && !R.Failed; N--) {
+    Exports.emplace_back(R.readString(), std::vector<GlobalValue::GUID>());
+    for (uint64_t K = R.read<uint64_t>(); K > 0 && !R.Failed; K--)
+      Exports.back().second.push_back(R.read<uint64_t>());
+  }
+
+  for (uint32_t N = R.read<uint32_t>(); N > 0 && !R.Failed; N--) {
+    auto &Resolved = Data->ResolvedODR[R.readString()];
+    for (uint64_t K = R.read<uint64_t>(); K > 0 && !R.Failed; K--) {
+      auto GUID = R.read<uint64_t>();
+      Resolved[GUID] = (GlobalValue::LinkageTypes)R.read<uint8_t>();
+    }
+  }
+
+  StringRef IndexData = R.readBytes(R.read<uint64_t>());
+  if (R.Failed)
+    return false;
+  MemoryBufferRef IndexBuffer(IndexData, Path);
+  if (Error Err = readModuleSummaryIndex(IndexBuffer, Data->Index, 0)) {
+    consumeError(std::move(Err));
+    return false;
+  }
+
+  for (const auto &Export : Exports) {
+    auto &ExportList = Data->ExportLists[Export.first];
+    for (auto GUID : Export.second) {
+      ValueInfo VI = Data->Index.getValueInfo(GUID);
+      if (!VI)
+        return false;
+      ExportList.insert(VI);
+    }
+  }
+
+  Data->Index.collectDefinedGVSummariesPerModule(Data->ModuleToDefinedGVSummaries);
+  return true;
+}
+
+// Same as `LLVMRustCreateThinLTODataParallel`, but first tries to load the
+// analysis from the cache file at `cache_path`, and stores it there when it had
+// to be recomputed. `cache_hit` is set to whether the cached data was used.
+// Failing to write the cache is not an error.
+extern "C" LLVMRustThinLTOData*
+LLVMRustCreateThinLTODataCached(LLVMRustThinLTOModule *modules,
+                                int num_modules,
+                                const char **preserved_symbols,
+                                int num_symbols,
+                                unsigned num_threads,
+                                const char *cache_path,
+                                bool *cache_hit) {
+  *cache_hit = false;
+
+  std::vector<ThinLTODataCacheHash> ModuleHashes;
+  ThinLTODataCacheHash ConfigHash;
+  computeThinLTODataCacheKey(modules, num_modules, preserved_symbols,
+                             num_symbols, ModuleHashes, ConfigHash);
+
+  auto Cached = std::make_unique<LLVMRustThinLTOData>();
+  if (readThinLTODataCache(Cached.get(), cache_path, modules, num_modules,
+                           ModuleHashes, ConfigHash)) {
+    for (int i = 0; i < num_modules; i++) {
+      auto module = &modules[i];
+      Cached->ModuleMap[module->identifier] = thinLTOModuleBuffer(*module);
+    }
+    computeCfiFunctionGUIDs(Cached.get());
+    *cache_hit = true;
+    return Cached.release();
+  }
+  Cached.reset();
+
+  LLVMRustThinLTOData *Data = createThinLTOData(
+      modules, num_modules, preserved_symbols, num_symbols, num_threads,
+      /* whole_program_devirt = */ false);
+  if (Data)
+    writeThinLTODataCache(Data, cache_path, modules, num_modules,
+                          ModuleHashes, ConfigHash);
+  return Data;
+}
+
 extern "C" void
 LLVMRustFreeThinLTOData(LLVMRustThinLTOData *Data) {
   delete Data;
 }
 
+// Writes the files LLVM's distributed ThinLTO (`-thinlto-index-only`) emits
+// for the module `ModId` of `Data`: the summary index shard with everything
+// the module's backend needs to `IndexPath`, and, unless `ImportsPath` is
+// null, the list of modules it imports from to `ImportsPath`, one per line.
+extern "C" LLVMRustResult
+LLVMRustThinLTOWriteIndexFiles(const LLVMRustThinLTOData *Data,
+                               const char *ModId,
+                               const char *IndexPath,
+                               const char *ImportsPath) {
+  std::map<std::string, GVSummaryMapTy> ModuleToSummariesForIndex;
+  gatherImportedSummariesForModule(ModId, Data->ModuleToDefinedGVSummaries,
+                                   lookupOrEmpty(Data->ImportLists, ModId),
+                                   ModuleToSummariesForIndex);
+
+  std::error_code EC;
+  raw_fd_ostream OS(IndexPath, EC, sys::fs::OF_None);
+  if (EC) {
+    LLVMRustSetLastError(EC.message().c_str());
+    return LLVMRustResult::Failure;
+  }
+  writeIndexToFile(Data->Index, OS, &ModuleToSummariesForIndex);
+  OS.close();
+  if (OS.has_error()) {
+    LLVMRustSetLastError(OS.error().message().c_str());
+    OS.clear_error();
+    return LLVMRustResult::Failure;
+  }
+
+  if (ImportsPath) {
+    EC = EmitImportsFiles(ModId, ImportsPath, ModuleToSummariesForIndex);
+    if (EC) {
+      LLVMRustSetLastError(EC.message().c_str());
+      return LLVMRustResult::Failure;
+    }
+  }
+  return LLVMRustResult::Success;
+}
+
 // Below are the various passes that happen *per module* when doing ThinLTO.
 //
 // In other words, these are the functions that are all run concurrently
@@ -1511,20 +3706,21 @@ clearDSOLocalOnDeclarations(Module &Mod, TargetMachine &TM) {
 }
 #endif
 
-extern "C" bool
-LLVMRustPrepareThinLTORename(const LLVMRustThinLTOData *Data, LLVMModuleRef M,
-                             LLVMTargetMachineRef TM) {
-  Module &Mod = *unwrap(M);
-  TargetMachine &Target = *unwrap(TM);
-
+static bool
+renameThinLTOModule(const LLVMRustThinLTOData *Data, Module &Mod,
+                    TargetMachine &Target) {
 #if LLVM_VERSION_GE(11, 0)
   bool ClearDSOLocal = clearDSOLocalOnDeclarations(Mod, Target);
-  bool error = renameModuleForThinLTO(Mod, Data->Index, ClearDSOLocal);
+  return !renameModuleForThinLTO(Mod, Data->Index, ClearDSOLocal);
 #else
-  bool error = renameModuleForThinLTO(Mod, Data->Index);
+  return !renameModuleForThinLTO(Mod, Data->Index);
 #endif
+}
 
-  if (error) {
+extern "C" bool
+LLVMRustPrepareThinLTORename(const LLVMRustThinLTOData *Data, LLVMModuleRef M,
+                             LLVMTargetMachineRef TM) {
+  if (!renameThinLTOModule(Data, *unwrap(M), *unwrap(TM))) {
     LLVMRustSetLastError("renameModuleForThinLTO failed");
     return false;
   }
@@ -1534,7 +3730,8 @@ LLVMRustPrepareThinLTORename(const LLVMRustThinLTOData *Data, LLVMModuleRef M,
 extern "C" bool
 LLVMRustPrepareThinLTOResolveWeak(const LLVMRustThinLTOData *Data, LLVMModuleRef M) {
   Module &Mod = *unwrap(M);
-  const auto &DefinedGlobals = Data->ModuleToDefinedGVSummaries.lookup(Mod.getModuleIdentifier());
+  const auto &DefinedGlobals = lookupOrEmpty(Data->ModuleToDefinedGVSummaries,
+                                             Mod.getModuleIdentifier());
   thinLTOResolvePrevailingInModule(Mod, DefinedGlobals);
   return true;
 }
@@ -1542,22 +3739,54 @@ LLVMRustPrepareThinLTOResolveWeak(const LLVMRustThinLTOData *Data, LLVMModuleRef
 extern "C" bool
 LLVMRustPrepareThinLTOInternalize(const LLVMRustThinLTOData *Data, LLVMModuleRef M) {
   Module &Mod = *unwrap(M);
-  const auto &DefinedGlobals = Data->ModuleToDefinedGVSummaries.lookup(Mod.getModuleIdentifier());
+  const auto &DefinedGlobals = lookupOrEmpty(Data->ModuleToDefinedGVSummaries,
+                                             Mod.getModuleIdentifier());
   thinLTOInternalizeModule(Mod, DefinedGlobals);
   return true;
 }
 
-extern "C" bool
-LLVMRustPrepareThinLTOImport(const LLVMRustThinLTOData *Data, LLVMModuleRef M,
-                             LLVMTargetMachineRef TM) {
-  Module &Mod = *unwrap(M);
-  TargetMachine &Target = *unwrap(TM);
+// Returns the bitcode module stored in the ThinLTO input `Identifier`. This is
+// shared between all threads: only the lookup of the module within its buffer
+// is cached, the module itself still has to be loaded into each importing
+// module's context, which then takes ownership of it.
+//
+// Caching the loaded module per context wouldn't save anything: the function
+// importer loads each source module once per importing module, renames and
+// moves the imported globals out of it, and every ThinLTO module is imported
+// into in a context of its own, so no context ever loads the same source
+// module twice.
+static Expected<BitcodeModule>
+getThinLTOBitcodeModule(const LLVMRustThinLTOData *Data, StringRef Identifier) {
+  {
+    std::lock_guard<std::mutex> Lock(Data->BitcodeModulesLock);
+    auto It = Data->BitcodeModules.find(Identifier);
+    if (It != Data->BitcodeModules.end())
+      return It->second;
+  }
+
+  Expected<std::vector<BitcodeModule>> ModulesOrErr =
+      getBitcodeModuleList(Data->ModuleMap.lookup(Identifier));
+  if (!ModulesOrErr)
+    return ModulesOrErr.takeError();
+  if (ModulesOrErr->size() != 1)
+    return createStringError(inconvertibleErrorCode(),
+                             "Expected a single module");
+
+  std::lock_guard<std::mutex> Lock(Data->BitcodeModulesLock);
+  return Data->BitcodeModules.try_emplace(Identifier, (*ModulesOrErr)[0])
+      .first->second;
+}
 
-  const auto &ImportList = Data->ImportLists.lookup(Mod.getModuleIdentifier());
-  auto Loader = [&](StringRef Identifier) {
-    const auto &Memory = Data->ModuleMap.lookup(Identifier);
+static Error
+importThinLTOFunctions(const LLVMRustThinLTOData *Data, Module &Mod,
+                       TargetMachine &Target,
+                       const FunctionImporter::ImportMapTy &ImportList) {
+  auto Loader = [&](StringRef Identifier) -> Expected<std::unique_ptr<Module>> {
+    Expected<BitcodeModule> BMOrErr = getThinLTOBitcodeModule(Data, Identifier);
+    if (!BMOrErr)
+      return BMOrErr.takeError();
     auto &Context = Mod.getContext();
-    auto MOrErr = getLazyBitcodeModule(Memory, Context, true, true);
+    auto MOrErr = BMOrErr->getLazyModule(Context, true, true);
 
     if (!MOrErr)
       return MOrErr;
@@ -1594,8 +3823,19 @@ LLVMRustPrepareThinLTOImport(const LLVMRustThinLTOData *Data, LLVMModuleRef M,
   FunctionImporter Importer(Data->Index, Loader);
 #endif
   Expected<bool> Result = Importer.importFunctions(Mod, ImportList);
-  if (!Result) {
-    LLVMRustSetLastError(toString(Result.takeError()).c_str());
+  if (!Result)
+    return Result.takeError();
+  return Error::success();
+}
+
+extern "C" bool
+LLVMRustPrepareThinLTOImport(const LLVMRustThinLTOData *Data, LLVMModuleRef M,
+                             LLVMTargetMachineRef TM) {
+  Module &Mod = *unwrap(M);
+  const auto &ImportList =
+      lookupOrEmpty(Data->ImportLists, Mod.getModuleIdentifier());
+  if (Error Err = importThinLTOFunctions(Data, Mod, *unwrap(TM), ImportList)) {
+    LLVMRustSetLastError(toString(std::move(Err)).c_str());
     return false;
   }
   return true;
@@ -1623,6 +3863,143 @@ LLVMRustGetThinLTOModules(const LLVMRustThinLTOData *data,
   }
 }
 
+// Returns the estimated instruction count of importing `GUID` from the module
+// `SourceModule`, or 0 if it's not a function.
+static uint64_t
+getThinLTOImportCost(const ModuleSummaryIndex &Index,
+                     GlobalValue::GUID GUID, StringRef SourceModule) {
+  GlobalValueSummary *S = Index.findSummaryInModule(GUID, SourceModule);
+  if (!S)
+    return 0;
+  if (auto *FS = dyn_cast<FunctionSummary>(S->getBaseObject()))
+    return FS->instCount();
+  return 0;
+}
+
+extern "C" typedef void (*LLVMRustThinLTOImportCostCallback)(void*, // payload
+                                                             const char*, // importing module name
+                                                             const char*, // imported module name
+                                                             size_t, // number of functions imported
+                                                             uint64_t); // their instruction count
+
+// Like `LLVMRustGetThinLTOModules`, but also provides the number of functions
+// imported along each edge and their estimated instruction count, as recorded
+// in the summaries.
+extern "C" void
+LLVMRustGetThinLTOImportCosts(const LLVMRustThinLTOData *data,
+                              LLVMRustThinLTOImportCostCallback callback,
+                              void* callback_payload) {
+  for (const auto& importing_module : data->ImportLists) {
+    const std::string importing_module_id = importing_module.getKey().str();
+    for (const auto& imported_module : importing_module.getValue()) {
+      const std::string imported_module_id = imported_module.getKey().str();
+      size_t NumFunctions = 0;
+      uint64_t NumInstrs = 0;
+      for (auto GUID : imported_module.getValue()) {
+        uint64_t Cost = getThinLTOImportCost(data->Index, GUID,
+                                             imported_module.getKey());
+        if (Cost == 0)
+          continue;
+        NumFunctions++;
+        NumInstrs += Cost;
+      }
+      callback(callback_payload,
+               importing_module_id.c_str(),
+               imported_module_id.c_str(),
+               NumFunctions,
+               NumInstrs);
+    }
+  }
+}
+
+extern "C" typedef void (*LLVMRustThinLTOModuleCostCallback)(void*, // payload
+                                                             const char*, // module name
+                                                             uint64_t, // instruction count of its definitions
+                                                             uint64_t); // instruction count of its imports
+
+// Provides, for each module of the ThinLTO data, the estimated instruction
+// count of the functions it defines and of those it imports, as recorded in
+// the summaries. This is known before any module is loaded, so it can be used
+// to start with the most expensive modules.
+extern "C" void
+LLVMRustGetThinLTOModuleCosts(const LLVMRustThinLTOData *data,
+                              LLVMRustThinLTOModuleCostCallback callback,
+                              void* callback_payload) {
+  for (const auto& module : data->ModuleMap) {
+    uint64_t DefinedInstrs = 0;
+    auto DefinedGlobals =
+        data->ModuleToDefinedGVSummaries.find(module.getKey());
+    if (DefinedGlobals != data->ModuleToDefinedGVSummaries.end()) {
+      for (const auto& Summary : DefinedGlobals->second) {
+        if (auto *FS = dyn_cast<FunctionSummary>(Summary.second))
+          DefinedInstrs += FS->instCount();
+      }
+    }
+
+    uint64_t ImportedInstrs = 0;
+    auto ImportList = data->ImportLists.find(module.getKey());
+    if (ImportList != data->ImportLists.end()) {
+      for (const auto& imported_module : ImportList->getValue()) {
+        for (auto GUID : imported_module.getValue())
+          ImportedInstrs += getThinLTOImportCost(data->Index, GUID,
+                                                 imported_module.getKey());
+      }
+    }
+
+    const std::string module_id = module.getKey().str();
+    callback(callback_payload, module_id.c_str(), DefinedInstrs,
+             ImportedInstrs);
+  }
+}
+
+// Caps the estimated instruction count of the functions imported into each
+// module at `max_instrs`. This has to be called right after the ThinLTO data
+// is created, before any module is prepared with it.
+//
+// The smallest functions are kept first, as they're the most likely to be
+// inlined. Imports are only ever removed, so the export lists computed by
+// `ComputeCrossModuleImport` remain correct, though possibly conservative.
+// Global variables are always kept as they're cheap and their import may have
+// been relied on when computing read-only attributes.
+extern "C" void
+LLVMRustThinLTOApplyImportBudget(LLVMRustThinLTOData *Data,
+                                 uint64_t max_instrs) {
+  struct Import {
+    uint64_t Cost;
+    GlobalValue::GUID GUID;
+    FunctionImporter::FunctionsToImportTy *Functions;
+  };
+  for (auto &ImportList : Data->ImportLists) {
+    std::vector<Import> Imports;
+    for (auto &Source : ImportList.getValue()) {
+      for (auto GUID : Source.getValue()) {
+        uint64_t Cost = getThinLTOImportCost(Data->Index, GUID, Source.getKey());
+        if (Cost != 0)
+          Imports.push_back({Cost, GUID, &Source.getValue()});
+      }
+    }
+    llvm::sort(Imports, [](const Import &A, const Import &B) {
+      return std::tie(A.Cost, A.GUID) < std::tie(B.Cost, B.GUID);
+    });
+
+    uint64_t Total = 0;
+    for (const Import &I : Imports) {
+      Total += I.Cost;
+      if (Total > max_instrs)
+        I.Functions->erase(I.GUID);
+    }
+
+    // Don't leave behind sources without anything left to import, the loader
+    // would otherwise parse them for nothing.
+    for (auto It = ImportList.getValue().begin(),
+              End = ImportList.getValue().end(); It != End;) {
+      auto Cur = It++;
+      if (Cur->getValue().empty())
+        ImportList.getValue().erase(Cur);
+    }
+  }
+}
+
 // This struct and various functions are sort of a hack right now, but the
 // problem is that we've got in-memory LLVM modules after we generate and
 // optimize all codegen-units for one compilation in rustc. To be compatible
@@ -1649,6 +4026,63 @@ LLVMRustThinLTOBufferCreate(LLVMModuleRef M) {
   return Ret.release();
 }
 
+// Same as `LLVMRustThinLTOBufferCreate`, but creates a split buffer, see
+// `splitThinLTOBuffer`, whose summary can be read without touching the rest of
+// the module. Split buffers can be passed everywhere the wrapper reads ThinLTO
+// buffers, but they aren't bitcode files, so they can't be written as the
+// bitcode output or embedded into objects.
+extern "C" LLVMRustThinLTOBuffer*
+LLVMRustThinLTOBufferCreateSplit(LLVMModuleRef M) {
+  std::string Summary;
+  std::string Module;
+  {
+    raw_string_ostream SummaryOS(Summary);
+    raw_string_ostream ModuleOS(Module);
+    legacy::PassManager PM;
+    PM.add(createWriteThinLTOBitcodePass(ModuleOS, &SummaryOS));
+    PM.run(*unwrap(M));
+  }
+
+  auto Ret = std::make_unique<LLVMRustThinLTOBuffer>();
+  Ret->data.reserve(SplitThinLTOBufferHeaderSize + Summary.size() +
+                    Module.size());
+  raw_string_ostream OS(Ret->data);
+  support::endian::Writer W(OS, support::little);
+  OS.write(SplitThinLTOBufferMagic, sizeof(SplitThinLTOBufferMagic));
+  W.write<uint32_t>(SplitThinLTOBufferVersion);
+  W.write<uint64_t>(SplitThinLTOBufferHeaderSize);
+  W.write<uint64_t>(Summary.size());
+  W.write<uint64_t>(SplitThinLTOBufferHeaderSize + Summary.size());
+  W.write<uint64_t>(Module.size());
+  OS << Summary << Module;
+  OS.flush();
+  return Ret.release();
+}
+
+// Same as `LLVMRustThinLTOBufferCreate`, but writes the bitcode straight to
+// the file at `Path` instead of going through an in-memory buffer.
+extern "C" LLVMRustResult
+LLVMRustThinLTOBufferWriteToFile(LLVMModuleRef M, const char *Path) {
+  std::error_code EC;
+  raw_fd_ostream OS(Path, EC, sys::fs::OF_None);
+  if (EC) {
+    LLVMRustSetLastError(EC.message().c_str());
+    return LLVMRustResult::Failure;
+  }
+  {
+    legacy::PassManager PM;
+    PM.add(createWriteThinLTOBitcodePass(OS));
+    PM.run(*unwrap(M));
+  }
+  OS.close();
+  if (OS.has_error()) {
+    LLVMRustSetLastError(OS.error().message().c_str());
+    OS.clear_error();
+    return LLVMRustResult::Failure;
+  }
+  return LLVMRustResult::Success;
+}
+
 extern "C" void
 LLVMRustThinLTOBufferFree(LLVMRustThinLTOBuffer *Buffer) {
   delete Buffer;
@@ -1672,7 +4106,7 @@ LLVMRustParseBitcodeForLTO(LLVMContextRef Context,
                            const char *data,
                            size_t len,
                            const char *identifier) {
-  StringRef Data(data, len);
+  StringRef Data = thinLTOModuleBitcode(StringRef(data, len));
   MemoryBufferRef Buffer(Data, identifier);
   unwrap(Context)->enableDebugTypeODRUniquing();
   Expected<std::unique_ptr<Module>> SrcOrError =
@@ -1710,6 +4144,93 @@ LLVMRustGetBitcodeSliceFromObjectData(const char *data,
   return BitcodeOrError->getBufferStart();
 }
 
+// Looks the `.llvmbc` section up in the section header table of the ELF
+// object `Data`, without creating an `ObjectFile` for it. Returns `None` if
+// the section is missing or the headers can't be read, leaving any error to
+// be reported by the slow path.
+template <class ELFT>
+static Optional<StringRef> findBitcodeInELF(StringRef Data) {
+  auto ELFOrError = object::ELFFile<ELFT>::create(Data);
+  if (!ELFOrError) {
+    consumeError(ELFOrError.takeError());
+    return None;
+  }
+  auto SectionsOrError = ELFOrError->sections();
+  if (!SectionsOrError) {
+    consumeError(SectionsOrError.takeError());
+    return None;
+  }
+  for (const auto &Section : *SectionsOrError) {
+#if LLVM_VERSION_GE(12, 0)
+    auto NameOrError = ELFOrError->getSectionName(Section);
+#else
+    auto NameOrError = ELFOrError->getSectionName(&Section);
+#endif
+    if (!NameOrError) {
+      consumeError(NameOrError.takeError());
+      return None;
+    }
+    if (*NameOrError != ".llvmbc")
+      continue;
+#if LLVM_VERSION_GE(12, 0)
+    auto ContentsOrError = ELFOrError->getSectionContents(Section);
+#else
+    auto ContentsOrError = ELFOrError->getSectionContents(&Section);
+#endif
+    if (!ContentsOrError) {
+      consumeError(ContentsOrError.takeError());
+      return None;
+    }
+    return toStringRef(*ContentsOrError);
+  }
+  return None;
+}
+
+static Expected<StringRef> findBitcodeSlice(StringRef Data) {
+  // ELF objects, the most common case by far, only need their section
+  // headers to be read. Everything else goes through `IRObjectFile`.
+  Optional<StringRef> Slice;
+  if (identify_magic(Data) == file_magic::elf_relocatable &&
+      Data.size() > ELF::EI_DATA) {
+    bool Is64 = Data[ELF::EI_CLASS] == ELF::ELFCLASS64;
+    bool IsLE = Data[ELF::EI_DATA] == ELF::ELFDATA2LSB;
+    if (Is64 && IsLE)
+      Slice = findBitcodeInELF<object::ELF64LE>(Data);
+    else if (Is64)
+      Slice = findBitcodeInELF<object::ELF64BE>(Data);
+    else if (IsLE)
+      Slice = findBitcodeInELF<object::ELF32LE>(Data);
+    else
+      Slice = findBitcodeInELF<object::ELF32BE>(Data);
+  }
+  if (Slice && !Slice->empty())
+    return *Slice;
+
+  Expected<MemoryBufferRef> BitcodeOrError =
+    object::IRObjectFile::findBitcodeInMemBuffer(MemoryBufferRef(Data, ""));
+  if (!BitcodeOrError)
+    return BitcodeOrError.takeError();
+  return BitcodeOrError->getBuffer();
+}
+
+// Same as `LLVMRustGetBitcodeSliceFromObjectData`, but the bitcode section of
+// ELF objects is found from their section headers alone.
+extern "C" const char*
+LLVMRustGetBitcodeSliceFromObjectDataFast(const char *data,
+                                          size_t len,
+                                          size_t *out_len) {
+  *out_len = 0;
+
+  Expected<StringRef> SliceOrError = findBitcodeSlice(StringRef(data, len));
+  if (!SliceOrError) {
+    LLVMRustSetLastError(toString(SliceOrError.takeError()).c_str());
+    return nullptr;
+  }
+
+  *out_len = SliceOrError->size();
+  return SliceOrError->data();
+}
+
 // Rewrite all `DICompileUnit` pointers to the `DICompileUnit` specified. See
 // the comment in `back/lto.rs` for why this exists.
 extern "C" void
@@ -1728,23 +4249,39 @@ LLVMRustThinLTOGetDICompileUnit(LLVMModuleRef Mod,
   }
 }
 
-// Rewrite all `DICompileUnit` pointers to the `DICompileUnit` specified. See
-// the comment in `back/lto.rs` for why this exists.
-extern "C" void
-LLVMRustThinLTOPatchDICompileUnit(LLVMModuleRef Mod, DICompileUnit *Unit) {
-  Module *M = unwrap(Mod);
-
+// Returns the `DICompileUnit` to merge all the compile units of `M` into,
+// which is `Unit` unless that is null.
+static DICompileUnit *getPatchedCompileUnit(Module *M, DICompileUnit *Unit) {
   // If the original source module didn't have a `DICompileUnit` then try to
   // merge all the existing compile units. If there aren't actually any though
-  // then there's not much for us to do so return.
+  // then there's not much for us to do.
   if (Unit == nullptr) {
     for (DICompileUnit *CU : M->debug_compile_units()) {
       Unit = CU;
       break;
     }
-    if (Unit == nullptr)
-      return;
   }
+  return Unit;
+}
+
+// Erase any other references to other `DICompileUnit` instances, the verifier
+// will later ensure that we don't actually have any other stale references to
+// worry about.
+static void resetCompileUnits(Module *M, DICompileUnit *Unit) {
+  auto *MD = M->getNamedMetadata("llvm.dbg.cu");
+  MD->clearOperands();
+  MD->addOperand(Unit);
+}
+
+// Rewrite all `DICompileUnit` pointers to the `DICompileUnit` specified. See
+// the comment in `back/lto.rs` for why this exists.
+extern "C" void
+LLVMRustThinLTOPatchDICompileUnit(LLVMModuleRef Mod, DICompileUnit *Unit) {
+  Module *M = unwrap(Mod);
+
+  Unit = getPatchedCompileUnit(M, Unit);
+  if (Unit == nullptr)
+    return;
 
   // Use LLVM's built-in `DebugInfoFinder` to find a bunch of debuginfo and
   // process it recursively. Note that we used to specifically iterate over
@@ -1759,12 +4296,288 @@ LLVMRustThinLTOPatchDICompileUnit(LLVMModuleRef Mod, DICompileUnit *Unit) {
     F->replaceUnit(Unit);
   }
 
-  // Erase any other references to other `DICompileUnit` instances, the verifier
-  // will later ensure that we don't actually have any other stale references to
-  // worry about.
-  auto *MD = M->getNamedMetadata("llvm.dbg.cu");
-  MD->clearOperands();
-  MD->addOperand(Unit);
+  resetCompileUnits(M, Unit);
+}
+
+// Adds to `Subprograms` the subprogram attached to `F` along with those of the
+// scopes of the debug locations of its instructions, which covers the
+// subprograms of functions inlined into it.
+static void collectSubprograms(const Function &F,
+                               SmallPtrSetImpl<DISubprogram *> &Subprograms) {
+  if (DISubprogram *SP = F.getSubprogram())
+    Subprograms.insert(SP);
+  for (const BasicBlock &BB : F) {
+    for (const Instruction &I : BB) {
+      for (DILocation *Loc = I.getDebugLoc(); Loc; Loc = Loc->getInlinedAt()) {
+        if (DISubprogram *SP = Loc->getScope()->getSubprogram())
+          Subprograms.insert(SP);
+      }
+    }
+  }
+}
+
+// A cheaper version of `LLVMRustThinLTOPatchDICompileUnit`, which only
+// rewrites the subprograms reachable from the function definitions of the
+// module and their debug locations instead of walking its whole metadata
+// graph. The functions are scanned on up to `NumThreads` threads; the
+// metadata is only modified afterwards, on the calling thread. Returns the
+// number of subprograms which were moved to `Unit`.
+extern "C" size_t
+LLVMRustThinLTOPatchDICompileUnitFast(LLVMModuleRef Mod, DICompileUnit *Unit,
+                                      unsigned NumThreads) {
+  Module *M = unwrap(Mod);
+
+  Unit = getPatchedCompileUnit(M, Unit);
+  if (Unit == nullptr)
+    return 0;
+
+  std::vector<const Function *> Functions;
+  for (const Function &F : *M) {
+    if (!F.isDeclaration())
+      Functions.push_back(&F);
+  }
+
+  NumThreads = resolveNumThreads(NumThreads);
+  size_t NumChunks = std::max<size_t>(
+      1, std::min<size_t>(NumThreads, Functions.size()));
+  std::vector<SmallPtrSet<DISubprogram *, 16>> Chunks(NumChunks);
+  auto ScanChunk = [&](size_t Chunk) {
+    for (size_t I = Chunk; I < Functions.size(); I += NumChunks)
+      collectSubprograms(*Functions[I], Chunks[Chunk]);
+  };
+  if (NumChunks == 1) {
+    ScanChunk(0);
+  } else {
+#if LLVM_VERSION_GE(11, 0)
+    ThreadPool Pool(hardware_concurrency(NumChunks));
+#else
+    ThreadPool Pool(NumChunks);
+#endif
+    for (size_t Chunk = 0; Chunk < NumChunks; Chunk++)
+      Pool.async(ScanChunk, Chunk);
+    Pool.wait();
+  }
+
+  size_t NumPatched = 0;
+  SmallPtrSet<DISubprogram *, 16> Patched;
+  for (auto &Chunk : Chunks) {
+    for (DISubprogram *SP : Chunk) {
+      if (!Patched.insert(SP).second || !SP->getUnit() || SP->getUnit() == Unit)
+        continue;
+      SP->replaceUnit(Unit);
+      NumPatched++;
+    }
+  }
+
+  resetCompileUnits(M, Unit);
+  return NumPatched;
+}
+
+static void computeLTOCacheKey(SmallString<40> &Key,
+                               const llvm::lto::Config &Conf, StringRef ModId,
+                               const LLVMRustThinLTOData *Data) {
+  const auto &ImportList = lookupOrEmpty(Data->ImportLists, ModId);
+  const auto &ExportList = lookupOrEmpty(Data->ExportLists, ModId);
+  const auto &ResolvedODR = lookupOrEmpty(Data->ResolvedODR, ModId);
+  const auto &DefinedGlobals =
+      lookupOrEmpty(Data->ModuleToDefinedGVSummaries, ModId);
+
+  llvm::computeLTOCacheKey(Key, Conf, Data->Index, ModId,
+      ImportList, ExportList, ResolvedODR, DefinedGlobals,
+      Data->CfiFunctionDefs, Data->CfiFunctionDecls
+  );
+}
+
+// The hash functions LTO cache keys can be computed with.
+enum class LLVMRustLTOCacheKeyHash {
+  // The SHA-1 based key of `computeLTOCacheKey`.
+  SHA1,
+  // A cheaper key over the same inputs.
+  Fast,
+};
+
+namespace {
+// Feeds the inputs of an LTO cache key to MD5, encoded the same way that
+// `computeLTOCacheKey` encodes them.
+struct LTOCacheKeyHasher {
+  MD5 Hasher;
+
+  void addBytes(const void *Ptr, size_t Size) {
+    Hasher.update(ArrayRef<uint8_t>(static_cast<const uint8_t *>(Ptr), Size));
+  }
+  void addString(StringRef Str) {
+    Hasher.update(Str);
+    Hasher.update(ArrayRef<uint8_t>{0});
+  }
+  void addUnsigned(unsigned I) {
+    uint8_t Bytes[4];
+    support::endian::write32le(Bytes, I);
+    addBytes(Bytes, sizeof(Bytes));
+  }
+  void addUint64(uint64_t I) {
+    uint8_t Bytes[8];
+    support::endian::write64le(Bytes, I);
+    addBytes(Bytes, sizeof(Bytes));
+  }
+  void addModuleHash(const ModuleHash &Hash) {
+    for (uint32_t Word : Hash)
+      addUnsigned(Word);
+  }
+};
+} // namespace
+
+// Same as `computeLTOCacheKey`, which follows LLVM's own function of the same
+// name, but with MD5 rather than SHA-1. The key is prefixed with the version of
+// its format, which keeps it apart from the bare SHA-1 keys. As rustc always
+// uses the default `lto::Config`, the configuration isn't part of the key.
+static void computeFastLTOCacheKey(SmallString<40> &Key, StringRef ModId,
+                                   const LLVMRustThinLTOData *Data) {
+  const ModuleSummaryIndex &Index = Data->Index;
+  const auto &ImportList = lookupOrEmpty(Data->ImportLists, ModId);
+  const auto &ExportList = lookupOrEmpty(Data->ExportLists, ModId);
+  const auto &ResolvedODR = lookupOrEmpty(Data->ResolvedODR, ModId);
+  const auto &DefinedGlobals =
+      lookupOrEmpty(Data->ModuleToDefinedGVSummaries, ModId);
+
+  LTOCacheKeyHasher H;
+  H.addString(LLVM_VERSION_STRING);
+  H.addModuleHash(Index.getModuleHash(ModId));
+
+  // The summary maps are unordered, so everything is sorted first to keep the
+  // key stable.
+  std::vector<uint64_t> ExportedGUIDs;
+  for (const auto &VI : ExportList)
+    ExportedGUIDs.push_back(VI.getGUID());
+  llvm::sort(ExportedGUIDs);
+  for (uint64_t GUID : ExportedGUIDs)
+    H.addUint64(GUID);
+
+  std::vector<StringRef> ImportedModules;
+  for (const auto &Entry : ImportList)
+    ImportedModules.push_back(Entry.getKey());
+  llvm::sort(ImportedModules);
+  std::vector<std::vector<uint64_t>> ImportedGUIDs;
+  for (StringRef Imported : ImportedModules) {
+    H.addModuleHash(Index.getModuleHash(Imported));
+    const auto &Functions = ImportList.find(Imported)->second;
+    ImportedGUIDs.emplace_back(Functions.begin(), Functions.end());
+    llvm::sort(ImportedGUIDs.back());
+    for (uint64_t GUID : ImportedGUIDs.back())
+      H.addUint64(GUID);
+  }
+
+  for (const auto &Entry : ResolvedODR) {
+    H.addUint64(Entry.first);
+    H.addUnsigned(Entry.second);
+  }
+
+  std::set<GlobalValue::GUID> UsedCfiDefs;
+  std::set<GlobalValue::GUID> UsedCfiDecls;
+  std::set<GlobalValue::GUID> UsedTypeIds;
+  auto AddUsedCfiGlobal = [&](GlobalValue::GUID ValueGUID) {
+    if (Data->CfiFunctionDefs.count(ValueGUID))
+      UsedCfiDefs.insert(ValueGUID);
+    if (Data->CfiFunctionDecls.count(ValueGUID))
+      UsedCfiDecls.insert(ValueGUID);
+  };
+  auto AddValueInfo = [&](const ValueInfo &VI) {
+#if LLVM_VERSION_GE(13, 0)
+    H.addUnsigned(VI.isDSOLocal(Index.withDSOLocalPropagation()));
+#else
+    H.addUnsigned(VI.isDSOLocal());
+#endif
+    AddUsedCfiGlobal(VI.getGUID());
+  };
+  auto AddUsedThings = [&](const GlobalValueSummary *GS) {
+    if (!GS)
+      return;
+    H.addUnsigned(GS->isLive());
+    H.addUnsigned(GS->canAutoHide());
+    H.addUnsigned(GS->isDSOLocal());
+    for (const ValueInfo &VI : GS->refs())
+      AddValueInfo(VI);
+    if (auto *GVS = dyn_cast<GlobalVarSummary>(GS)) {
+      H.addUnsigned(GVS->maybeReadOnly());
+      H.addUnsigned(GVS->maybeWriteOnly());
+    }
+    if (auto *FS = dyn_cast<FunctionSummary>(GS)) {
+      for (auto &TT : FS->type_tests())
+        UsedTypeIds.insert(TT);
+      for (auto &TT : FS->type_test_assume_vcalls())
+        UsedTypeIds.insert(TT.GUID);
+      for (auto &TT : FS->type_checked_load_vcalls())
+        UsedTypeIds.insert(TT.GUID);
+      for (auto &TT : FS->type_test_assume_const_vcalls())
+        UsedTypeIds.insert(TT.VFunc.GUID);
+      for (auto &TT : FS->type_checked_load_const_vcalls())
+        UsedTypeIds.insert(TT.VFunc.GUID);
+      for (auto &ET : FS->calls())
+        AddValueInfo(ET.first);
+    }
+  };
+
+  std::vector<std::pair<GlobalValue::GUID, GlobalValueSummary *>> Defined(
+      DefinedGlobals.begin(), DefinedGlobals.end());
+  llvm::sort(Defined, [](const auto &A, const auto &B) {
+    return A.first < B.first;
+  });
+  for (const auto &GS : Defined) {
+    H.addUnsigned(GS.second->linkage());
+    AddUsedCfiGlobal(GS.first);
+    AddUsedThings(GS.second);
+  }
+
+  for (size_t I = 0; I < ImportedModules.size(); I++) {
+    for (uint64_t GUID : ImportedGUIDs[I]) {
+      const GlobalValueSummary *S =
+          Index.findSummaryInModule(GUID, ImportedModules[I]);
+      AddUsedThings(S);
+      if (auto *AS = dyn_cast_or_null<AliasSummary>(S))
+        AddUsedThings(AS->getBaseObject());
+    }
+  }
+
+  for (GlobalValue::GUID TId : UsedTypeIds) {
+    auto Range = Index.typeIds().equal_range(TId);
+    for (auto It = Range.first; It != Range.second; ++It) {
+      const TypeIdSummary &Summary = It->second.second;
+      H.addString(It->second.first);
+      H.addUnsigned(Summary.TTRes.TheKind);
+      H.addUnsigned(Summary.TTRes.SizeM1BitWidth);
+      H.addUint64(Summary.TTRes.AlignLog2);
+      H.addUint64(Summary.TTRes.SizeM1);
+      H.addUint64(Summary.TTRes.BitMask);
+      H.addUint64(Summary.TTRes.InlineBits);
+      H.addUint64(Summary.WPDRes.size());
+      for (const auto &WPD : Summary.WPDRes) {
+        H.addUint64(WPD.first);
+        H.addUnsigned(WPD.second.TheKind);
+        H.addString(WPD.second.SingleImplName);
+        H.addUint64(WPD.second.ResByArg.size());
+        for (const auto &ByArg : WPD.second.ResByArg) {
+          H.addUint64(ByArg.first.size());
+          for (uint64_t Arg : ByArg.first)
+            H.addUint64(Arg);
+          H.addUnsigned(ByArg.second.TheKind);
+          H.addUint64(ByArg.second.Info);
+          H.addUnsigned(ByArg.second.Byte);
+          H.addUnsigned(ByArg.second.Bit);
+        }
+      }
+    }
+  }
+
+  H.addUnsigned(UsedCfiDefs.size());
+  for (auto &V : UsedCfiDefs)
+    H.addUint64(V);
+  H.addUnsigned(UsedCfiDecls.size());
+  for (auto &V : UsedCfiDecls)
+    H.addUint64(V);
+
+  MD5::MD5Result Result;
+  H.Hasher.final(Result);
+  Key = "2-";
+  Key += Result.digest();
 }
 
 // Computes the LTO cache key for the provided 'ModId' in the given 'Data',
@@ -1778,24 +4591,50 @@ extern "C" void
 LLVMRustComputeLTOCacheKey(RustStringRef KeyOut, const char *ModId, LLVMRustThinLTOData *Data) {
   SmallString<40> Key;
   llvm::lto::Config conf;
-  const auto &ImportList = Data->ImportLists.lookup(ModId);
-  const auto &ExportList = Data->ExportLists.lookup(ModId);
-  const auto &ResolvedODR = Data->ResolvedODR.lookup(ModId);
-  const auto &DefinedGlobals = Data->ModuleToDefinedGVSummaries.lookup(ModId);
-  std::set<GlobalValue::GUID> CfiFunctionDefs;
-  std::set<GlobalValue::GUID> CfiFunctionDecls;
+  computeLTOCacheKey(Key, conf, ModId, Data);
 
-  // Based on the 'InProcessThinBackend' constructor in LLVM
-  for (auto &Name : Data->Index.cfiFunctionDefs())
-    CfiFunctionDefs.insert(
-        GlobalValue::getGUID(GlobalValue::dropLLVMManglingEscape(Name)));
-  for (auto &Name : Data->Index.cfiFunctionDecls())
-    CfiFunctionDecls.insert(
-        GlobalValue::getGUID(GlobalValue::dropLLVMManglingEscape(Name)));
+  LLVMRustStringWriteImpl(KeyOut, Key.c_str(), Key.size());
+}
 
-  llvm::computeLTOCacheKey(Key, conf, Data->Index, ModId,
-      ImportList, ExportList, ResolvedODR, DefinedGlobals, CfiFunctionDefs, CfiFunctionDecls
-  );
+// Same as calling `LLVMRustComputeLTOCacheKey` for each of the `NumModules`
+// modules `ModIds`, but with the key computed by `Hash` and on up to
+// `NumThreads` threads. The keys are written one after the other to
+// `KeysOut`, the key of module `i` being found from `Offsets[i]` up to
+// `Offsets[i + 1]`, so `Offsets` must have room for `NumModules + 1` entries.
+extern "C" void
+LLVMRustComputeLTOCacheKeys(RustStringRef KeysOut, size_t *Offsets,
+                            const char **ModIds, size_t NumModules,
+                            const LLVMRustThinLTOData *Data,
+                            LLVMRustLTOCacheKeyHash Hash,
+                            unsigned NumThreads) {
+  NumThreads = resolveNumThreads(NumThreads);
+  const llvm::lto::Config Conf;
+  std::vector<SmallString<40>> Keys(NumModules);
+  auto ComputeKey = [&](size_t I) {
+    if (Hash == LLVMRustLTOCacheKeyHash::Fast)
+      computeFastLTOCacheKey(Keys[I], ModIds[I], Data);
+    else
+      computeLTOCacheKey(Keys[I], Conf, ModIds[I], Data);
+  };
+  if (NumThreads == 1 || NumModules <= 1) {
+    for (size_t I = 0; I < NumModules; I++)
+      ComputeKey(I);
+  } else {
+#if LLVM_VERSION_GE(11, 0)
+    ThreadPool Pool(hardware_concurrency(NumThreads));
+#else
+    ThreadPool Pool(NumThreads);
+#endif
+    for (size_t I = 0; I < NumModules; I++)
+      Pool.async(ComputeKey, I);
+    Pool.wait();
+  }
 
-  LLVMRustStringWriteImpl(KeyOut, Key.c_str(), Key.size());
+  size_t Offset = 0;
+  for (size_t I = 0; I < NumModules; I++) {
+    Offsets[I] = Offset;
+    LLVMRustStringWriteImpl(KeysOut, Keys[I].c_str(), Keys[I].size());
+    Offset += Keys[I].size();
+  }
+  Offsets[NumModules] = Offset;
 }
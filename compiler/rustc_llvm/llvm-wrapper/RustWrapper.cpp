@@ -1,15 +1,27 @@
 #include "LLVMWrapper.h"
+#include "llvm/Analysis/CFG.h"
+#include "llvm/Analysis/InlineCost.h"
 #include "llvm/IR/DebugInfoMetadata.h"
 #include "llvm/IR/DiagnosticInfo.h"
 #include "llvm/IR/DiagnosticPrinter.h"
 #include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Intrinsics.h"
+#if LLVM_VERSION_GE(11, 0)
+#include "llvm/IR/LLVMRemarkStreamer.h"
+#include "llvm/Remarks/RemarkStreamer.h"
+#else
+#include "llvm/IR/RemarkStreamer.h"
+#endif
 #include "llvm/Object/Archive.h"
 #include "llvm/Object/COFFImportFile.h"
 #include "llvm/Object/ObjectFile.h"
 #include "llvm/Bitcode/BitcodeWriterPass.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/JSON.h"
 #include "llvm/Support/Signals.h"
+#include "llvm/Support/ToolOutputFile.h"
 #include "llvm/ADT/Optional.h"
 
 #include <iostream>
@@ -92,6 +104,133 @@ extern "C" LLVMContextRef LLVMRustContextCreate(bool shouldDiscardNames) {
   return wrap(ctx);
 }
 
+// A pool of contexts to be reused by codegen units, so that the types,
+// constants, metadata strings and attributes a context has uniqued are
+// already there for the next module created in it. A context is retired once
+// it has been used `MaxUses` times, to bound how much a single context can
+// accumulate, and at most `MaxContexts` idle ones are kept.
+//
+// Named struct types are never freed, so a reused context renames the struct
+// types of later modules if they're already taken, e.g. `%Foo` to `%Foo.0`.
+struct LLVMRustContextPool {
+  struct Entry {
+    std::unique_ptr<LLVMContext> Context;
+    unsigned Uses;
+  };
+
+  std::mutex Lock;
+  std::vector<Entry> Idle;
+  DenseMap<LLVMContext *, unsigned> Uses;
+  unsigned MaxUses;
+  size_t MaxContexts;
+
+  LLVMRustContextPool(unsigned MaxUses, size_t MaxContexts)
+      : MaxUses(MaxUses), MaxContexts(MaxContexts) {}
+};
+
+extern "C" LLVMRustContextPool *
+LLVMRustCreateContextPool(unsigned MaxUses, size_t MaxContexts) {
+  return new LLVMRustContextPool(MaxUses, MaxContexts);
+}
+
+// Frees `Pool` and its idle contexts. All the contexts acquired from it must
+// have been given back first.
+extern "C" void LLVMRustFreeContextPool(LLVMRustContextPool *Pool) {
+  delete Pool;
+}
+
+// Same as `LLVMRustContextCreate`, but returns an idle context of `Pool` if
+// there is one. Everything that the wrapper lets rustc configure on a context
+// is reset to how a new context has it. This may be called from multiple
+// threads at once.
+extern "C" LLVMContextRef
+LLVMRustContextPoolAcquire(LLVMRustContextPool *Pool, bool shouldDiscardNames) {
+  LLVMRustContextPool::Entry E;
+  {
+    std::lock_guard<std::mutex> Lock(Pool->Lock);
+    if (!Pool->Idle.empty()) {
+      E = std::move(Pool->Idle.back());
+      Pool->Idle.pop_back();
+    } else {
+      E = {std::make_unique<LLVMContext>(), 0};
+    }
+    Pool->Uses[E.Context.get()] = E.Uses + 1;
+  }
+
+  LLVMContext *Ctx = E.Context.release();
+  Ctx->setDiscardValueNames(shouldDiscardNames);
+  return wrap(Ctx);
+}
+
+// Gives a context acquired from `Pool` back to it, or disposes of it if it's
+// been used too often or the pool is full. All the modules created in the
+// context must have been disposed of first.
+extern "C" void LLVMRustContextPoolRelease(LLVMRustContextPool *Pool,
+                                           LLVMContextRef C) {
+  std::unique_ptr<LLVMContext> Ctx(unwrap(C));
+  Ctx->setDiagnosticHandler(std::make_unique<DiagnosticHandler>());
+#if !LLVM_VERSION_GE(13, 0)
+  Ctx->setInlineAsmDiagnosticHandler(nullptr);
+#endif
+  Ctx->setYieldCallback(nullptr, nullptr);
+  Ctx->setDiagnosticsHotnessRequested(false);
+  Ctx->disableDebugTypeODRUniquing();
+#if LLVM_VERSION_GE(11, 0)
+  Ctx->setLLVMRemarkStreamer(nullptr);
+  Ctx->setMainRemarkStreamer(nullptr);
+#else
+  Ctx->setRemarkStreamer(nullptr);
+#endif
+
+  std::lock_guard<std::mutex> Lock(Pool->Lock);
+  unsigned Uses = Pool->Uses.lookup(Ctx.get());
+  Pool->Uses.erase(Ctx.get());
+  if (Uses < Pool->MaxUses && Pool->Idle.size() < Pool->MaxContexts)
+    Pool->Idle.push_back({std::move(Ctx), Uses});
+}
+
+// Makes the optimization remarks emitted in `C` be serialized to the file at
+// `Path`, in `Format` ("yaml" or "bitstream"), instead of only reaching the
+// diagnostic handler. If `Passes` isn't empty, only the remarks of the passes
+// whose name matches that regex are emitted. Returns the file to give to
+// `LLVMRustContextFinishRemarks` once done, or null on error.
+//
+// The diagnostic handler is still called for each remark, so it should ignore
+// them rather than unpacking them again.
+extern "C" ToolOutputFile *
+LLVMRustContextSetupRemarks(LLVMContextRef C, const char *Path,
+                            const char *Passes, const char *Format,
+                            bool WithHotness) {
+#if LLVM_VERSION_GE(11, 0)
+  Expected<std::unique_ptr<ToolOutputFile>> FileOrErr =
+      setupLLVMOptimizationRemarks(*unwrap(C), Path, Passes, Format,
+                                   WithHotness);
+#else
+  Expected<std::unique_ptr<ToolOutputFile>> FileOrErr =
+      setupOptimizationRemarks(*unwrap(C), Path, Passes, Format, WithHotness);
+#endif
+  if (!FileOrErr) {
+    LLVMRustSetLastError(toString(FileOrErr.takeError()).c_str());
+    return nullptr;
+  }
+  return FileOrErr->release();
+}
+
+// Stops streaming the remarks of `C` and closes `File`, which is kept.
+extern "C" void LLVMRustContextFinishRemarks(LLVMContextRef C,
+                                             ToolOutputFile *File) {
+#if LLVM_VERSION_GE(11, 0)
+  unwrap(C)->setLLVMRemarkStreamer(nullptr);
+  unwrap(C)->setMainRemarkStreamer(nullptr);
+#else
+  unwrap(C)->setRemarkStreamer(nullptr);
+#endif
+  if (File) {
+    File->keep();
+    delete File;
+  }
+}
+
 extern "C" void LLVMRustSetNormalizedTarget(LLVMModuleRef M,
                                             const char *Triple) {
   unwrap(M)->setTargetTriple(Triple::normalize(Triple));
@@ -339,6 +478,97 @@ extern "C" void LLVMRustRemoveFunctionAttributes(LLVMValueRef Fn,
   F->setAttributes(PALNew);
 }
 
+enum class LLVMRustAttributeSpecKind {
+  Enum,
+  Alignment,
+  Dereferenceable,
+  DereferenceableOrNull,
+  ByVal,
+  StructRet,
+};
+
+// One attribute to apply through `LLVMRustAddFunctionAttributes` or
+// `LLVMRustAddCallSiteAttributes`. `Attr` is only used by `Enum` attributes,
+// `Value` by the alignment and dereferenceable ones, and `Ty` by `ByVal` and
+// `StructRet`.
+struct LLVMRustAttributeSpec {
+  unsigned Index;
+  LLVMRustAttributeSpecKind Kind;
+  LLVMRustAttribute Attr;
+  uint64_t Value;
+  LLVMTypeRef Ty;
+};
+
+static void addAttributeSpec(AttrBuilder &B, const LLVMRustAttributeSpec &Spec) {
+  switch (Spec.Kind) {
+  case LLVMRustAttributeSpecKind::Enum:
+    B.addAttribute(fromRust(Spec.Attr));
+    return;
+  case LLVMRustAttributeSpecKind::Alignment:
+    B.addAlignmentAttr(Spec.Value);
+    return;
+  case LLVMRustAttributeSpecKind::Dereferenceable:
+    B.addDereferenceableAttr(Spec.Value);
+    return;
+  case LLVMRustAttributeSpecKind::DereferenceableOrNull:
+    B.addDereferenceableOrNullAttr(Spec.Value);
+    return;
+  case LLVMRustAttributeSpecKind::ByVal:
+    B.addByValAttr(unwrap(Spec.Ty));
+    return;
+  case LLVMRustAttributeSpecKind::StructRet:
+#if LLVM_VERSION_GE(12, 0)
+    B.addStructRetAttr(unwrap(Spec.Ty));
+#else
+    B.addAttribute(Attribute::StructRet);
+#endif
+    return;
+  }
+  report_fatal_error("bad LLVMRustAttributeSpecKind");
+}
+
+// Adds all of `Specs` to `AL`. The attributes are first gathered per index,
+// so a new list is only interned once per index that gets attributes rather
+// than once per attribute.
+static AttributeList addAttributeSpecs(LLVMContext &C, AttributeList AL,
+                                       const LLVMRustAttributeSpec *Specs,
+                                       size_t NumSpecs) {
+  SmallVector<std::pair<unsigned, AttrBuilder>, 8> Builders;
+  for (size_t I = 0; I < NumSpecs; I++) {
+    auto It = llvm::find_if(Builders, [&](const auto &Entry) {
+      return Entry.first == Specs[I].Index;
+    });
+    if (It == Builders.end()) {
+      Builders.emplace_back(Specs[I].Index, AttrBuilder());
+      It = std::prev(Builders.end());
+    }
+    addAttributeSpec(It->second, Specs[I]);
+  }
+  for (auto &Entry : Builders)
+    AL = AL.addAttributes(C, Entry.first, Entry.second);
+  return AL;
+}
+
+// Same as calling the `LLVMRustAdd*Attr` functions for each of `Specs` in
+// turn, but the function's attribute list is only rebuilt once.
+extern "C" void LLVMRustAddFunctionAttributes(LLVMValueRef Fn,
+                                              const LLVMRustAttributeSpec *Specs,
+                                              size_t NumSpecs) {
+  Function *F = unwrap<Function>(Fn);
+  F->setAttributes(addAttributeSpecs(F->getContext(), F->getAttributes(),
+                                     Specs, NumSpecs));
+}
+
+// Same as calling the `LLVMRustAdd*CallSiteAttr` functions for each of `Specs`
+// in turn, but the call's attribute list is only rebuilt once.
+extern "C" void LLVMRustAddCallSiteAttributes(LLVMValueRef Instr,
+                                              const LLVMRustAttributeSpec *Specs,
+                                              size_t NumSpecs) {
+  CallBase *Call = unwrap<CallBase>(Instr);
+  Call->setAttributes(addAttributeSpecs(Call->getContext(),
+                                        Call->getAttributes(), Specs, NumSpecs));
+}
+
 // Enable a fast-math flag
 //
 // https://llvm.org/docs/LangRef.html#fast-math-flags
@@ -1022,6 +1252,82 @@ LLVMRustDICompositeTypeReplaceArrays(LLVMRustDIBuilderRef Builder,
                          DINodeArray(unwrap<MDTuple>(Params)));
 }
 
+// The arguments of one `LLVMRustDIBuilderCreateVariantMemberType` call, for
+// `LLVMRustDICompositeTypeReplaceMembers`.
+struct LLVMRustDIMemberInfo {
+  const char *Name;
+  size_t NameLen;
+  LLVMMetadataRef File;
+  unsigned LineNo;
+  uint64_t SizeInBits;
+  uint32_t AlignInBits;
+  uint64_t OffsetInBits;
+  LLVMValueRef Discriminant;
+  LLVMRustDIFlags Flags;
+  LLVMMetadataRef Ty;
+};
+
+// The arguments of one `LLVMRustDIBuilderCreateEnumerator` call.
+struct LLVMRustDIEnumeratorInfo {
+  const char *Name;
+  size_t NameLen;
+  int64_t Value;
+  bool IsUnsigned;
+};
+
+// Creates the `NumMembers` members of `CompositeTy`, scoped to it, and sets
+// them followed by `ExtraElements` as its elements, as
+// `LLVMRustDICompositeTypeReplaceArrays` would. This is meant for the members
+// of a type whose stub was created beforehand.
+extern "C" void LLVMRustDICompositeTypeReplaceMembers(
+    LLVMRustDIBuilderRef Builder, LLVMMetadataRef CompositeTy,
+    const LLVMRustDIMemberInfo *Members, size_t NumMembers,
+    LLVMMetadataRef *ExtraElements, size_t NumExtraElements,
+    LLVMMetadataRef Params) {
+  DICompositeType *Ty = unwrapDI<DICompositeType>(CompositeTy);
+  SmallVector<Metadata *, 16> Elements;
+  Elements.reserve(NumMembers + NumExtraElements);
+  for (size_t I = 0; I < NumMembers; I++) {
+    const LLVMRustDIMemberInfo &Member = Members[I];
+    llvm::ConstantInt *D = nullptr;
+    if (Member.Discriminant)
+      D = unwrap<llvm::ConstantInt>(Member.Discriminant);
+    Elements.push_back(Builder->createVariantMemberType(
+        Ty, StringRef(Member.Name, Member.NameLen),
+        unwrapDI<DIFile>(Member.File), Member.LineNo, Member.SizeInBits,
+        Member.AlignInBits, Member.OffsetInBits, D, fromRust(Member.Flags),
+        unwrapDI<DIType>(Member.Ty)));
+  }
+  for (size_t I = 0; I < NumExtraElements; I++)
+    Elements.push_back(unwrap(ExtraElements[I]));
+  Builder->replaceArrays(Ty, Builder->getOrCreateArray(Elements),
+                         DINodeArray(unwrap<MDTuple>(Params)));
+}
+
+// Same as `LLVMRustDIBuilderCreateEnumerationType`, but the elements of the
+// enumeration are the enumerators described by `Enumerators`, which are
+// created along with it.
+extern "C" LLVMMetadataRef LLVMRustDIBuilderCreateEnumerationTypeWithEnumerators(
+    LLVMRustDIBuilderRef Builder, LLVMMetadataRef Scope,
+    const char *Name, size_t NameLen,
+    LLVMMetadataRef File, unsigned LineNumber, uint64_t SizeInBits,
+    uint32_t AlignInBits, const LLVMRustDIEnumeratorInfo *Enumerators,
+    size_t NumEnumerators, LLVMMetadataRef ClassTy, bool IsScoped) {
+  SmallVector<Metadata *, 16> Elements;
+  Elements.reserve(NumEnumerators);
+  for (size_t I = 0; I < NumEnumerators; I++) {
+    const LLVMRustDIEnumeratorInfo &Enumerator = Enumerators[I];
+    Elements.push_back(Builder->createEnumerator(
+        StringRef(Enumerator.Name, Enumerator.NameLen), Enumerator.Value,
+        Enumerator.IsUnsigned));
+  }
+  return wrap(Builder->createEnumerationType(
+      unwrapDI<DIDescriptor>(Scope), StringRef(Name, NameLen),
+      unwrapDI<DIFile>(File), LineNumber,
+      SizeInBits, AlignInBits, Builder->getOrCreateArray(Elements),
+      unwrapDI<DIType>(ClassTy), "", IsScoped));
+}
+
 extern "C" LLVMMetadataRef
 LLVMRustDIBuilderCreateDebugLocation(unsigned Line, unsigned Column,
                                      LLVMMetadataRef ScopeRef,
@@ -1144,7 +1450,7 @@ LLVMRustUnpackInlineAsmDiagnostic(LLVMDiagnosticInfoRef DI,
 
 extern "C" void LLVMRustWriteDiagnosticInfoToString(LLVMDiagnosticInfoRef DI,
                                                     RustStringRef Str) {
-  RawRustStringOstream OS(Str);
+  RawRustStringBufferOstream OS(Str, 256);
   DiagnosticPrinterRawOStream DP(OS);
   unwrap(DI)->print(DP);
 }
@@ -1205,6 +1511,165 @@ LLVMRustGetDiagInfoKind(LLVMDiagnosticInfoRef DI) {
   return toRust((DiagnosticKind)unwrap(DI)->getKind());
 }
 
+namespace {
+// Aggregates the missed and analysis remarks of the vectorizers and the
+// inliner per function, see `LLVMRustContextEnableMissedRemarkSummary`. Every
+// other diagnostic is handled the way the handler it replaced would have.
+class RemarkSummaryHandler : public DiagnosticHandler {
+public:
+  struct FunctionSummary {
+    uint64_t Count = 0;
+    // By `<pass>:<remark name>`.
+    StringMap<uint64_t> Reasons;
+    // By `<file>:<line>:<column>`.
+    StringMap<uint64_t> Locations;
+  };
+
+  std::unique_ptr<DiagnosticHandler> Prev;
+  bool Forward;
+  StringMap<FunctionSummary> Functions;
+
+  RemarkSummaryHandler(std::unique_ptr<DiagnosticHandler> Prev, bool Forward)
+      : Prev(std::move(Prev)), Forward(Forward) {
+    // The C API sets the callback of whichever handler is installed, so it's
+    // taken over from the previous one, and used instead of it.
+    DiagHandlerCallback = this->Prev->DiagHandlerCallback;
+    DiagnosticContext = this->Prev->DiagnosticContext;
+  }
+
+  static bool isSummarizedPass(StringRef PassName) {
+    return PassName == "loop-vectorize" || PassName == "slp-vectorizer" ||
+           PassName == "inline";
+  }
+
+  bool summarize(const DiagnosticInfo &DI) {
+    if (DI.getKind() != DK_OptimizationRemarkMissed &&
+        DI.getKind() != DK_OptimizationRemarkAnalysis)
+      return false;
+    auto &Remark = cast<DiagnosticInfoOptimizationBase>(DI);
+    if (!isSummarizedPass(Remark.getPassName()))
+      return false;
+
+    FunctionSummary &Summary = Functions[Remark.getFunction().getName()];
+    Summary.Count++;
+    Summary.Reasons[(Twine(Remark.getPassName()) + ":" +
+                     Remark.getRemarkName()).str()]++;
+    if (Remark.isLocationAvailable()) {
+      const DiagnosticLocation &Loc = Remark.getLocation();
+      Summary.Locations[(Loc.getRelativePath() + ":" + Twine(Loc.getLine()) +
+                         ":" + Twine(Loc.getColumn())).str()]++;
+    }
+    return true;
+  }
+
+  bool handleDiagnostics(const DiagnosticInfo &DI) override {
+    if (summarize(DI) && !Forward)
+      return true;
+    if (DiagHandlerCallback) {
+      DiagHandlerCallback(DI, DiagnosticContext);
+      return true;
+    }
+    return Prev->handleDiagnostics(DI);
+  }
+
+  bool isAnalysisRemarkEnabled(StringRef PassName) const override {
+    return isSummarizedPass(PassName) ||
+           Prev->isAnalysisRemarkEnabled(PassName);
+  }
+  bool isMissedOptRemarkEnabled(StringRef PassName) const override {
+    return isSummarizedPass(PassName) ||
+           Prev->isMissedOptRemarkEnabled(PassName);
+  }
+  bool isPassedOptRemarkEnabled(StringRef PassName) const override {
+    return Prev->isPassedOptRemarkEnabled(PassName);
+  }
+  bool isAnyRemarkEnabled() const override { return true; }
+};
+} // namespace
+
+// Makes the missed and analysis remarks of the loop and SLP vectorizers and of
+// the inliner be counted per function of the modules in `C`, until the
+// summary is taken with `LLVMRustContextFinishMissedRemarkSummary`. These
+// remarks are still passed on to the current diagnostic handler if `Forward`
+// is set. Remarks are counted no matter which ones are otherwise enabled.
+extern "C" void LLVMRustContextEnableMissedRemarkSummary(LLVMContextRef C,
+                                                         bool Forward) {
+  LLVMContext &Ctx = *unwrap(C);
+  Ctx.setDiagnosticHandler(std::make_unique<RemarkSummaryHandler>(
+      Ctx.getDiagnosticHandler(), Forward));
+}
+
+// Writes the summary of the remarks counted since
+// `LLVMRustContextEnableMissedRemarkSummary` to `Str` as a JSON array, with an
+// object for each function that has any, the most remarked first. Each has
+// the number of remarks by pass and remark name, and the `MaxLocations`
+// source locations with most remarks. The handler which was replaced is
+// installed again, with the callback set on the context in the meantime. The
+// summary handler must still be the one installed on `C`.
+extern "C" void LLVMRustContextFinishMissedRemarkSummary(LLVMContextRef C,
+                                                         size_t MaxLocations,
+                                                         RustStringRef Str) {
+  LLVMContext &Ctx = *unwrap(C);
+  std::unique_ptr<RemarkSummaryHandler> Summary(
+      static_cast<RemarkSummaryHandler *>(
+          Ctx.getDiagnosticHandler().release()));
+
+  RawRustStringOstream OS(Str);
+  json::OStream J(OS);
+  J.array([&] {
+    using Entry = StringMapEntry<RemarkSummaryHandler::FunctionSummary>;
+    std::vector<const Entry *> Sorted;
+    for (const Entry &E : Summary->Functions)
+      Sorted.push_back(&E);
+    llvm::sort(Sorted, [](const Entry *A, const Entry *B) {
+      if (A->getValue().Count != B->getValue().Count)
+        return A->getValue().Count > B->getValue().Count;
+      return A->getKey() < B->getKey();
+    });
+
+    for (const Entry *E : Sorted) {
+      const RemarkSummaryHandler::FunctionSummary &F = E->getValue();
+      std::vector<std::pair<StringRef, uint64_t>> Locations;
+      for (const auto &L : F.Locations)
+        Locations.push_back({L.getKey(), L.getValue()});
+      llvm::sort(Locations, [](const auto &A, const auto &B) {
+        if (A.second != B.second)
+          return A.second > B.second;
+        return A.first < B.first;
+      });
+      if (Locations.size() > MaxLocations)
+        Locations.resize(MaxLocations);
+
+      std::vector<std::pair<StringRef, uint64_t>> Reasons;
+      for (const auto &R : F.Reasons)
+        Reasons.push_back({R.getKey(), R.getValue()});
+      llvm::sort(Reasons);
+
+      J.object([&] {
+        J.attribute("function", E->getKey());
+        J.attribute("count", (int64_t)F.Count);
+        J.attributeObject("reasons", [&] {
+          for (const auto &R : Reasons)
+            J.attribute(R.first, (int64_t)R.second);
+        });
+        J.attributeArray("locations", [&] {
+          for (const auto &L : Locations) {
+            J.object([&] {
+              J.attribute("location", L.first);
+              J.attribute("count", (int64_t)L.second);
+            });
+          }
+        });
+      });
+    }
+  });
+
+  std::unique_ptr<DiagnosticHandler> Prev = std::move(Summary->Prev);
+  Prev->DiagHandlerCallback = Summary->DiagHandlerCallback;
+  Prev->DiagnosticContext = Summary->DiagnosticContext;
+  Ctx.setDiagnosticHandler(std::move(Prev));
+}
+
 // This is kept distinct from LLVMGetTypeKind, because when
 // a new type kind is added, the Rust-side enum must be
 // updated or UB will result.
@@ -1621,20 +2086,30 @@ struct LLVMRustModuleBuffer {
   std::string data;
 };
 
+static void writeModuleBuffer(LLVMRustModuleBuffer *Buffer, LLVMModuleRef M) {
+  raw_string_ostream OS(Buffer->data);
+  {
+    legacy::PassManager PM;
+    PM.add(createBitcodeWriterPass(OS));
+    PM.run(*unwrap(M));
+  }
+}
+
 extern "C" LLVMRustModuleBuffer*
 LLVMRustModuleBufferCreate(LLVMModuleRef M) {
   auto Ret = std::make_unique<LLVMRustModuleBuffer>();
-  {
-    raw_string_ostream OS(Ret->data);
-    {
-      legacy::PassManager PM;
-      PM.add(createBitcodeWriterPass(OS));
-      PM.run(*unwrap(M));
-    }
-  }
+  writeModuleBuffer(Ret.get(), M);
   return Ret.release();
 }
 
+// Replaces the contents of `Buffer` with the bitcode of `M`, reusing the memory
+// already allocated for it.
+extern "C" void
+LLVMRustModuleBufferRefill(LLVMRustModuleBuffer *Buffer, LLVMModuleRef M) {
+  Buffer->data.clear();
+  writeModuleBuffer(Buffer, M);
+}
+
 extern "C" void
 LLVMRustModuleBufferFree(LLVMRustModuleBuffer *Buffer) {
   delete Buffer;
@@ -1656,6 +2131,179 @@ LLVMRustModuleCost(LLVMModuleRef M) {
   return std::distance(std::begin(f), std::end(f));
 }
 
+// The size of the code a module defines, see `LLVMRustModuleGetCost`.
+struct LLVMRustModuleCostInfo {
+  uint64_t DefinedFunctions;
+  uint64_t BasicBlocks;
+  uint64_t Instructions;
+  // Counted by the blocks that CFG back edges lead to, which for reducible
+  // control flow are the headers of the loops.
+  uint64_t Loops;
+  // The instructions weighted like the inliner's cost model does, with each
+  // call costing the call penalty on top. Debug info intrinsics are free.
+  uint64_t WeightedCost;
+};
+
+// Computes the cost of the function definitions of `M` in a single walk over
+// its code. Declarations aren't counted, unlike with `LLVMRustModuleCost`.
+extern "C" void LLVMRustModuleGetCost(LLVMModuleRef M,
+                                      LLVMRustModuleCostInfo *Cost) {
+  *Cost = {};
+  SmallVector<std::pair<const BasicBlock *, const BasicBlock *>, 8> BackEdges;
+  SmallPtrSet<const BasicBlock *, 8> LoopHeaders;
+  for (const Function &F : unwrap(M)->functions()) {
+    if (F.isDeclaration())
+      continue;
+    Cost->DefinedFunctions++;
+    for (const BasicBlock &BB : F) {
+      Cost->BasicBlocks++;
+      for (const Instruction &I : BB) {
+        Cost->Instructions++;
+        if (isa<DbgInfoIntrinsic>(I))
+          continue;
+        Cost->WeightedCost += InlineConstants::InstrCost;
+        if (isa<CallBase>(I) && !isa<IntrinsicInst>(I))
+          Cost->WeightedCost += InlineConstants::CallPenalty;
+      }
+    }
+
+    BackEdges.clear();
+    LoopHeaders.clear();
+    FindFunctionBackedges(F, BackEdges);
+    for (auto &Edge : BackEdges)
+      LoopHeaders.insert(Edge.second);
+    Cost->Loops += LoopHeaders.size();
+  }
+}
+
+// An estimate of the memory used by a module, see
+// `LLVMRustModuleGetMemoryStats`.
+struct LLVMRustModuleMemoryStats {
+  uint64_t Globals;
+  uint64_t BasicBlocks;
+  uint64_t Instructions;
+  // The IR objects themselves, together with their operand lists and names.
+  uint64_t IRBytes;
+  uint64_t MetadataNodes;
+  // The metadata nodes and strings reachable from the module.
+  uint64_t MetadataBytes;
+  uint64_t Constants;
+  // The constants other than global values used by the module.
+  uint64_t ConstantBytes;
+};
+
+namespace {
+struct ModuleMemoryWalker {
+  LLVMRustModuleMemoryStats &Stats;
+  SmallPtrSet<const Metadata *, 32> SeenMetadata;
+  SmallPtrSet<const Constant *, 32> SeenConstants;
+  SmallVector<const MDNode *, 64> MDWorklist;
+
+  void addMetadata(const Metadata *MD) {
+    if (!MD || !SeenMetadata.insert(MD).second)
+      return;
+    if (auto *S = dyn_cast<MDString>(MD)) {
+      Stats.MetadataBytes += sizeof(MDString) + S->getLength();
+    } else if (auto *N = dyn_cast<MDNode>(MD)) {
+      Stats.MetadataNodes++;
+      Stats.MetadataBytes += sizeof(MDNode) + N->getNumOperands() * sizeof(MDOperand);
+      MDWorklist.push_back(N);
+    } else if (auto *V = dyn_cast<ValueAsMetadata>(MD)) {
+      Stats.MetadataBytes += sizeof(ValueAsMetadata);
+      if (auto *C = dyn_cast<Constant>(V->getValue()))
+        addConstant(C);
+    }
+  }
+
+  void addConstant(const Constant *C) {
+    if (isa<GlobalValue>(C) || !SeenConstants.insert(C).second)
+      return;
+    Stats.Constants++;
+    Stats.ConstantBytes += sizeof(Constant) + C->getNumOperands() * sizeof(Use);
+    if (auto *CDS = dyn_cast<ConstantDataSequential>(C))
+      Stats.ConstantBytes += CDS->getRawDataValues().size();
+    for (const Use &Op : C->operands())
+      addConstant(cast<Constant>(Op.get()));
+  }
+
+  void addOperand(const Value *V) {
+    if (auto *C = dyn_cast<Constant>(V))
+      addConstant(C);
+    else if (auto *MV = dyn_cast<MetadataAsValue>(V))
+      addMetadata(MV->getMetadata());
+  }
+
+  void addAttachments(const SmallVectorImpl<std::pair<unsigned, MDNode *>> &MDs) {
+    for (const auto &MD : MDs)
+      addMetadata(MD.second);
+  }
+
+  void drainMetadata() {
+    while (!MDWorklist.empty()) {
+      const MDNode *N = MDWorklist.pop_back_val();
+      for (const MDOperand &Op : N->operands())
+        addMetadata(Op.get());
+    }
+  }
+};
+} // namespace
+
+// Fills `Stats` with an estimate of the memory used by `M`: the globals,
+// basic blocks and instructions it owns, and the constants and metadata it
+// refers to, which are owned by its context. Shared constants and metadata are
+// counted for every module using them. The sizes are based on the common base
+// classes and don't include allocator overhead, or the context's own uniquing
+// tables, so they're lower bounds. Use `LLVMRustGetMallocUsage` for the memory
+// actually allocated by the process.
+extern "C" void LLVMRustModuleGetMemoryStats(LLVMModuleRef M,
+                                             LLVMRustModuleMemoryStats *Stats) {
+  *Stats = {};
+  Module *Mod = unwrap(M);
+  ModuleMemoryWalker W{*Stats, {}, {}, {}};
+  SmallVector<std::pair<unsigned, MDNode *>, 8> MDs;
+
+  for (const GlobalValue &GV : Mod->global_values()) {
+    Stats->Globals++;
+    Stats->IRBytes += sizeof(GlobalObject) + GV.getNumOperands() * sizeof(Use) +
+                      GV.getName().size();
+    for (const Use &Op : GV.operands())
+      W.addOperand(Op.get());
+    if (auto *GO = dyn_cast<GlobalObject>(&GV)) {
+      MDs.clear();
+      GO->getAllMetadata(MDs);
+      W.addAttachments(MDs);
+    }
+  }
+
+  for (const Function &F : *Mod) {
+    for (const BasicBlock &BB : F) {
+      Stats->BasicBlocks++;
+      Stats->IRBytes += sizeof(BasicBlock) + BB.getName().size();
+      for (const Instruction &I : BB) {
+        Stats->Instructions++;
+        Stats->IRBytes += sizeof(Instruction) +
+                          I.getNumOperands() * sizeof(Use) + I.getName().size();
+        for (const Use &Op : I.operands())
+          W.addOperand(Op.get());
+        MDs.clear();
+        I.getAllMetadata(MDs);
+        W.addAttachments(MDs);
+      }
+    }
+  }
+
+  for (const NamedMDNode &NMD : Mod->named_metadata())
+    for (const MDNode *N : NMD.operands())
+      W.addMetadata(N);
+  W.drainMetadata();
+}
+
+// Returns the number of bytes currently allocated with malloc by the whole
+// process, or zero if that isn't known on this platform.
+extern "C" size_t LLVMRustGetMallocUsage() {
+  return sys::Process::GetMallocUsage();
+}
+
 // Vector reductions:
 extern "C" LLVMValueRef
 LLVMRustBuildVectorReduceFAdd(LLVMBuilderRef B, LLVMValueRef Acc, LLVMValueRef Src) {
@@ -1714,6 +2362,85 @@ LLVMRustBuildVectorReduceFMax(LLVMBuilderRef B, LLVMValueRef Src, bool NoNaN) {
 #endif
 }
 
+// Same as `LLVMRustBuildVectorReduceFAdd` and `LLVMRustBuildVectorReduceFMul`,
+// but the elements may be combined in any order, without any of the other
+// fast-math assumptions.
+extern "C" LLVMValueRef
+LLVMRustBuildVectorReduceFAddUnordered(LLVMBuilderRef B, LLVMValueRef Acc,
+                                       LLVMValueRef Src) {
+  CallInst *I = unwrap(B)->CreateFAddReduce(unwrap(Acc), unwrap(Src));
+  I->setHasAllowReassoc(true);
+  return wrap(I);
+}
+extern "C" LLVMValueRef
+LLVMRustBuildVectorReduceFMulUnordered(LLVMBuilderRef B, LLVMValueRef Acc,
+                                       LLVMValueRef Src) {
+  CallInst *I = unwrap(B)->CreateFMulReduce(unwrap(Acc), unwrap(Src));
+  I->setHasAllowReassoc(true);
+  return wrap(I);
+}
+
+// Masked gather, which loads each lane from the pointer in the same lane of
+// `Ptrs`. `Ty` is the type of the loaded vector, `Mask` a vector of `i1` with
+// as many elements, and the lanes which are masked off are taken from
+// `PassThru`.
+extern "C" LLVMValueRef
+LLVMRustBuildMaskedGather(LLVMBuilderRef B, LLVMTypeRef Ty, LLVMValueRef Ptrs,
+                          unsigned Alignment, LLVMValueRef Mask,
+                          LLVMValueRef PassThru) {
+#if LLVM_VERSION_GE(13, 0)
+  return wrap(unwrap(B)->CreateMaskedGather(unwrap(Ty), unwrap(Ptrs),
+                                            Align(Alignment), unwrap(Mask),
+                                            unwrap(PassThru)));
+#elif LLVM_VERSION_GE(11, 0)
+  return wrap(unwrap(B)->CreateMaskedGather(unwrap(Ptrs), Align(Alignment),
+                                            unwrap(Mask), unwrap(PassThru)));
+#else
+  return wrap(unwrap(B)->CreateMaskedGather(unwrap(Ptrs), Alignment,
+                                            unwrap(Mask), unwrap(PassThru)));
+#endif
+}
+
+extern "C" LLVMValueRef
+LLVMRustBuildMaskedScatter(LLVMBuilderRef B, LLVMValueRef Val,
+                           LLVMValueRef Ptrs, unsigned Alignment,
+                           LLVMValueRef Mask) {
+#if LLVM_VERSION_GE(11, 0)
+  return wrap(unwrap(B)->CreateMaskedScatter(unwrap(Val), unwrap(Ptrs),
+                                             Align(Alignment), unwrap(Mask)));
+#else
+  return wrap(unwrap(B)->CreateMaskedScatter(unwrap(Val), unwrap(Ptrs),
+                                             Alignment, unwrap(Mask)));
+#endif
+}
+
+// Builds `llvm.fshl`, or `llvm.fshr` if `Right` is set, on integers or
+// vectors of integers.
+extern "C" LLVMValueRef
+LLVMRustBuildFunnelShift(LLVMBuilderRef B, LLVMValueRef Hi, LLVMValueRef Lo,
+                         LLVMValueRef Amt, bool Right) {
+  Value *V = unwrap(Hi);
+  return wrap(unwrap(B)->CreateIntrinsic(
+      Right ? Intrinsic::fshr : Intrinsic::fshl, {V->getType()},
+      {V, unwrap(Lo), unwrap(Amt)}));
+}
+
+// Saturating arithmetic on integers or vectors of integers.
+extern "C" LLVMValueRef
+LLVMRustBuildSaturatingAdd(LLVMBuilderRef B, LLVMValueRef LHS, LLVMValueRef RHS,
+                           bool IsSigned) {
+  return wrap(unwrap(B)->CreateBinaryIntrinsic(
+      IsSigned ? Intrinsic::sadd_sat : Intrinsic::uadd_sat, unwrap(LHS),
+      unwrap(RHS)));
+}
+extern "C" LLVMValueRef
+LLVMRustBuildSaturatingSub(LLVMBuilderRef B, LLVMValueRef LHS, LLVMValueRef RHS,
+                           bool IsSigned) {
+  return wrap(unwrap(B)->CreateBinaryIntrinsic(
+      IsSigned ? Intrinsic::ssub_sat : Intrinsic::usub_sat, unwrap(LHS),
+      unwrap(RHS)));
+}
+
 extern "C" LLVMValueRef
 LLVMRustBuildMinNum(LLVMBuilderRef B, LLVMValueRef LHS, LLVMValueRef RHS) {
     return wrap(unwrap(B)->CreateMinNum(unwrap(LHS),unwrap(RHS)));
@@ -1724,10 +2451,13 @@ LLVMRustBuildMaxNum(LLVMBuilderRef B, LLVMValueRef LHS, LLVMValueRef RHS) {
 }
 
 // This struct contains all necessary info about a symbol exported from a DLL.
-// At the moment, it's just the symbol's name, but we use a separate struct to
-// make it easier to add other information like ordinal later.
 struct LLVMRustCOFFShortExport {
   const char* name;
+  bool ordinal_present;
+  // The value of `ordinal` is only meaningful if `ordinal_present` is true.
+  uint16_t ordinal;
+  // Whether the symbol is a variable rather than a function.
+  bool data;
 };
 
 // Machine must be a COFF machine type, as defined in PE specs.
@@ -1743,17 +2473,14 @@ extern "C" LLVMRustResult LLVMRustWriteImportLibrary(
   ConvertedExports.reserve(NumExports);
 
   for (size_t i = 0; i < NumExports; ++i) {
-    ConvertedExports.push_back(llvm::object::COFFShortExport{
-      Exports[i].name,  // Name
-      std::string{},    // ExtName
-      std::string{},    // SymbolName
-      std::string{},    // AliasTarget
-      0,                // Ordinal
-      false,            // Noname
-      false,            // Data
-      false,            // Private
-      false             // Constant
-    });
+    ConvertedExports.emplace_back();
+    llvm::object::COFFShortExport &Export = ConvertedExports.back();
+    Export.Name = Exports[i].name;
+    if (Exports[i].ordinal_present) {
+      Export.Ordinal = Exports[i].ordinal;
+      Export.Noname = true;
+    }
+    Export.Data = Exports[i].data;
   }
 
   auto Error = llvm::object::writeImportLibrary(
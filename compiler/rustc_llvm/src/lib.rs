@@ -31,23 +31,64 @@ pub fn len(&self) -> usize {
     sr.bytes.borrow_mut().extend_from_slice(slice);
 }
 
+/// Reserving room in a Rust string for at least `additional` more bytes, which
+/// can then be written directly -- used by RawRustStringBufferOstream. Returns
+/// the start of the spare capacity of the string and stores its size into
+/// `capacity`. The pointer is only valid until the string is next changed.
+#[no_mangle]
+pub unsafe extern "C" fn LLVMRustStringReserve(
+    sr: &RustString,
+    additional: size_t,
+    capacity: &mut size_t,
+) -> *mut c_char {
+    let mut bytes = sr.bytes.borrow_mut();
+    bytes.reserve(additional);
+    let len = bytes.len();
+    *capacity = bytes.capacity() - len;
+    bytes.as_mut_ptr().add(len) as *mut c_char
+}
+
+/// Appending the first `size` bytes of the spare capacity of a Rust string,
+/// which have been written through `LLVMRustStringReserve`, to the string.
+#[no_mangle]
+pub unsafe extern "C" fn LLVMRustStringCommit(sr: &RustString, size: size_t) {
+    let mut bytes = sr.bytes.borrow_mut();
+    let len = bytes.len();
+    assert!(size <= bytes.capacity() - len);
+    bytes.set_len(len + size);
+}
+
 /// Initialize targets enabled by the build script via `cfg(llvm_component = "...")`.
 /// N.B., this function can't be moved to `rustc_codegen_llvm` because of the `cfg`s.
 pub fn initialize_available_targets() {
+    initialize_targets(&|_| true);
+}
+
+/// Initialize only the target of the LLVM component `component`, such as `"x86"`, if it
+/// was enabled by the build script. Returns whether it was.
+pub fn initialize_target(component: &str) -> bool {
+    initialize_targets(&|c| c == component)
+}
+
+fn initialize_targets(filter: &dyn Fn(&str) -> bool) -> bool {
+    let mut initialized = false;
     macro_rules! init_target(
-        ($cfg:meta, $($method:ident),*) => { {
-            #[cfg($cfg)]
-            fn init() {
+        (llvm_component = $component:literal, $($method:ident),*) => { {
+            #[cfg(llvm_component = $component)]
+            fn init() -> bool {
                 extern "C" {
                     $(fn $method();)*
                 }
                 unsafe {
                     $($method();)*
                 }
+                true
+            }
+            #[cfg(not(llvm_component = $component))]
+            fn init() -> bool { false }
+            if filter($component) {
+                initialized |= init();
             }
-            #[cfg(not($cfg))]
-            fn init() { }
-            init();
         } }
     );
     init_target!(
@@ -175,4 +216,5 @@ fn init() { }
         LLVMInitializeBPFAsmPrinter,
         LLVMInitializeBPFAsmParser
     );
+    initialized
 }
@@ -2,6 +2,7 @@
 use rustc_data_structures::fx::FxHashSet;
 use rustc_errors::struct_span_err;
 use rustc_hir as hir;
+use rustc_hir::def::DefKind;
 use rustc_hir::itemlikevisit::ItemLikeVisitor;
 use rustc_middle::middle::cstore::{DllCallingConvention, DllImport, NativeLib};
 use rustc_middle::ty::{List, ParamEnv, ParamEnvAnd, Ty, TyCtxt};
@@ -436,6 +437,12 @@ fn build_dll_import(&self, abi: Abi, item: &hir::ForeignItemRef<'_>) -> DllImpor
                 }
             }
         };
-        DllImport { name: item.ident.name, ordinal: None, calling_convention, span: item.span }
+        DllImport {
+            name: item.ident.name,
+            ordinal: self.tcx.codegen_fn_attrs(item.id.def_id.to_def_id()).link_ordinal,
+            calling_convention,
+            is_fn: self.tcx.def_kind(item.id.def_id) == DefKind::Fn,
+            span: item.span,
+        }
     }
 }
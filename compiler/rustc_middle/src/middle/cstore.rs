@@ -84,6 +84,9 @@ pub struct DllImport {
     /// On x86_64, this is always `DllCallingConvention::C`; on i686, it can be any
     /// of the values, and we use `DllCallingConvention::C` to represent `"cdecl"`.
     pub calling_convention: DllCallingConvention,
+    /// Whether this is a function rather than a static. Statics are imported as data, without an
+    /// import thunk.
+    pub is_fn: bool,
     /// Span of import's "extern" declaration; used for diagnostics.
     pub span: Span,
 }
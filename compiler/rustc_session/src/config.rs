@@ -197,6 +197,33 @@ pub enum SymbolManglingVersion {
 
 impl_stable_hash_via_hash!(SymbolManglingVersion);
 
+/// How the backend reads archives, see `-Z archive-read-mode`.
+#[derive(Copy, Clone, Debug, PartialEq, Eq, Hash)]
+pub enum ArchiveReadMode {
+    Default,
+    Read,
+    Mmap,
+}
+
+/// The compression applied to the debug info sections of object files.
+#[derive(Copy, Clone, Debug, PartialEq, Eq, Hash)]
+pub enum DebugInfoCompression {
+    None,
+    Zlib,
+    Zstd,
+}
+
+/// Which basic blocks are placed in sections of their own, see `-Z basic-block-sections`.
+#[derive(Clone, Debug, PartialEq, Eq, Hash)]
+pub enum BasicBlockSections {
+    None,
+    All,
+    /// Emit the address of every basic block instead of splitting any of them off.
+    Labels,
+    /// The clusters listed in the given file, in the format of clang's `-fbasic-block-sections`.
+    List(PathBuf),
+}
+
 #[derive(Clone, Copy, Debug, PartialEq, Hash)]
 pub enum DebugInfo {
     None,
@@ -1959,6 +1986,12 @@ pub fn build_session_options(matches: &getopts::Matches) -> Options {
 
     check_thread_count(&debugging_opts, error_format);
 
+    // LLVM's statistics counters are global, so the changes to them can only be attributed to a
+    // codegen unit if nothing else runs in LLVM at the same time.
+    if debugging_opts.llvm_stats {
+        debugging_opts.no_parallel_llvm = true;
+    }
+
     let incremental = cg.incremental.as_ref().map(PathBuf::from);
 
     if debugging_opts.profile && incremental.is_some() {
@@ -1967,6 +2000,14 @@ pub fn build_session_options(matches: &getopts::Matches) -> Options {
             "can't instrument with gcov profiling when compiling incrementally",
         );
     }
+    // The functions of codegen units reused from the incremental cache aren't codegened, so they
+    // would be missing from the ordering file.
+    if debugging_opts.call_graph_ordering_file.is_some() && incremental.is_some() {
+        early_error(
+            error_format,
+            "can't write a call graph ordering file when compiling incrementally",
+        );
+    }
     if debugging_opts.profile {
         match codegen_units {
             Some(1) => {}
@@ -1985,6 +2026,16 @@ pub fn build_session_options(matches: &getopts::Matches) -> Options {
         );
     }
 
+    if debugging_opts.profile_sample_use.is_some()
+        && (cg.profile_generate.enabled() || cg.profile_use.is_some())
+    {
+        early_error(
+            error_format,
+            "option `-Z profile-sample-use` cannot be used with `-C profile-generate` or \
+            `-C profile-use`",
+        );
+    }
+
     if debugging_opts.instrument_coverage.is_some()
         && debugging_opts.instrument_coverage != Some(InstrumentCoverage::Off)
     {
@@ -2375,9 +2426,9 @@ pub fn needs_analysis(&self) -> bool {
 crate mod dep_tracking {
     use super::LdImpl;
     use super::{
-        CFGuard, CrateType, DebugInfo, ErrorOutputType, InstrumentCoverage, LinkerPluginLto,
-        LtoCli, OptLevel, OutputType, OutputTypes, Passes, SourceFileHashAlgorithm,
-        SwitchWithOptPath, SymbolManglingVersion, TrimmedDefPaths,
+        BasicBlockSections, CFGuard, CrateType, DebugInfo, DebugInfoCompression, ErrorOutputType,
+        InstrumentCoverage, LinkerPluginLto, LtoCli, OptLevel, OutputType, OutputTypes, Passes,
+        SourceFileHashAlgorithm, SwitchWithOptPath, SymbolManglingVersion, TrimmedDefPaths,
     };
     use crate::lint;
     use crate::options::WasiExecModel;
@@ -2450,6 +2501,8 @@ fn hash(
         OptLevel,
         LtoCli,
         DebugInfo,
+        DebugInfoCompression,
+        BasicBlockSections,
         UnstableFeatures,
         NativeLib,
         NativeLibKind,
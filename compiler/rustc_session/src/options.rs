@@ -368,6 +368,10 @@ mod desc {
     pub const parse_merge_functions: &str = "one of: `disabled`, `trampolines`, or `aliases`";
     pub const parse_symbol_mangling_version: &str = "either `legacy` or `v0` (RFC 2603)";
     pub const parse_src_file_hash: &str = "either `md5` or `sha1`";
+    pub const parse_debuginfo_compression: &str = "one of `none`, `zlib`, or `zstd`";
+    pub const parse_basic_block_sections: &str =
+        "one of `none`, `all`, `labels`, or `list=<file>`";
+    pub const parse_archive_read_mode: &str = "one of `default`, `read`, or `mmap`";
     pub const parse_relocation_model: &str =
         "one of supported relocation models (`rustc --print relocation-models`)";
     pub const parse_code_model: &str = "one of supported code models (`rustc --print code-models`)";
@@ -831,6 +835,40 @@ mod parse {
         true
     }
 
+    crate fn parse_archive_read_mode(slot: &mut ArchiveReadMode, v: Option<&str>) -> bool {
+        *slot = match v {
+            Some("default") => ArchiveReadMode::Default,
+            Some("read") => ArchiveReadMode::Read,
+            Some("mmap") => ArchiveReadMode::Mmap,
+            _ => return false,
+        };
+        true
+    }
+
+    crate fn parse_debuginfo_compression(slot: &mut DebugInfoCompression, v: Option<&str>) -> bool {
+        *slot = match v {
+            Some("none") => DebugInfoCompression::None,
+            Some("zlib") => DebugInfoCompression::Zlib,
+            Some("zstd") => DebugInfoCompression::Zstd,
+            _ => return false,
+        };
+        true
+    }
+
+    crate fn parse_basic_block_sections(slot: &mut BasicBlockSections, v: Option<&str>) -> bool {
+        *slot = match v {
+            Some("none") => BasicBlockSections::None,
+            Some("all") => BasicBlockSections::All,
+            Some("labels") => BasicBlockSections::Labels,
+            Some(s) => match s.strip_prefix("list=") {
+                Some(path) if !path.is_empty() => BasicBlockSections::List(PathBuf::from(path)),
+                _ => return false,
+            },
+            None => return false,
+        };
+        true
+    }
+
     crate fn parse_src_file_hash(
         slot: &mut Option<SourceFileHashAlgorithm>,
         v: Option<&str>,
@@ -1005,17 +1043,37 @@ mod parse {
         "encode MIR of all functions into the crate metadata (default: no)"),
     assume_incomplete_release: bool = (false, parse_bool, [TRACKED],
         "make cfg(version) treat the current version as incomplete (default: no)"),
+    archive_cache: bool = (false, parse_bool, [UNTRACKED],
+        "read each archive only once, even if it's opened several times, e.g. an rlib by LTO \
+        and when building a staticlib (default: no)"),
+    archive_read_mode: ArchiveReadMode = (ArchiveReadMode::Default, parse_archive_read_mode,
+        [UNTRACKED],
+        "read archives as LLVM sees fit (`default`), always into memory (`read`), e.g. on \
+        network filesystems, or always by mapping them (`mmap`) (default: `default`)"),
     asm_comments: bool = (false, parse_bool, [TRACKED],
         "generate comments into the assembly (may change behavior) (default: no)"),
+    asm_round_trip: bool = (false, parse_bool, [TRACKED],
+        "with `--emit=asm,obj`, run codegen once to print the assembly, and assemble the \
+        object file from that printed assembly instead of running codegen a second time; \
+        the object can differ from a direct emission where the assembly loses information \
+        (default: no)"),
     ast_json: bool = (false, parse_bool, [UNTRACKED],
         "print the AST as JSON and halt (default: no)"),
     ast_json_noexpand: bool = (false, parse_bool, [UNTRACKED],
         "print the pre-expansion AST as JSON and halt (default: no)"),
+    basic_block_sections: BasicBlockSections = (BasicBlockSections::None,
+        parse_basic_block_sections, [TRACKED],
+        "place basic blocks in sections of their own: `none` (default), `all`, `labels` to only \
+        emit their addresses for post-link optimizers such as BOLT, or `list=<file>` for the \
+        clusters listed in a file"),
     binary_dep_depinfo: bool = (false, parse_bool, [TRACKED],
         "include artifacts (sysroot, crate dependencies) used during compilation in dep-info \
         (default: no)"),
     borrowck: String = ("migrate".to_string(), parse_string, [UNTRACKED],
         "select which borrowck is used (`mir` or `migrate`) (default: `migrate`)"),
+    call_graph_ordering_file: Option<PathBuf> = (None, parse_opt_pathbuf, [TRACKED],
+        "write the functions that ran during profiling, hottest first, to the given file, for \
+        the linker's `--symbol-ordering-file` (default: no)"),
     cgu_partitioning_strategy: Option<String> = (None, parse_opt_string, [TRACKED],
         "the codegen unit partitioning strategy to use"),
     chalk: bool = (false, parse_bool, [TRACKED],
@@ -1026,8 +1084,14 @@ mod parse {
         "combine CGUs into a single one"),
     crate_attr: Vec<String> = (Vec::new(), parse_string_push, [TRACKED],
         "inject the given attribute in the crate"),
+    debug_info_for_profiling: bool = (false, parse_bool, [TRACKED],
+        "emit discriminators and other data necessary for AutoFDO (default: no)"),
     debug_macros: bool = (false, parse_bool, [TRACKED],
         "emit line numbers debug info inside macros (default: no)"),
+    debuginfo_compression: DebugInfoCompression = (DebugInfoCompression::None,
+        parse_debuginfo_compression, [TRACKED],
+        "compress the debug info sections of object files, including split DWARF ones, \
+        with `zlib` or `zstd` (default: `none`)"),
     deduplicate_diagnostics: bool = (true, parse_bool, [UNTRACKED],
         "deduplicate identical diagnostics (default: yes)"),
     dep_info_omit_d_target: bool = (false, parse_bool, [TRACKED],
@@ -1036,6 +1100,10 @@ mod parse {
     dep_tasks: bool = (false, parse_bool, [UNTRACKED],
         "print tasks that execute and the color their dep node gets (requires debug build) \
         (default: no)"),
+    downgrade_cold_functions: bool = (false, parse_bool, [TRACKED],
+        "before optimizing, mark cold functions `minsize`, and those a profile shows never ran \
+        `optnone`; as profile data is only attached by the pre-link pipeline, the functions \
+        found cold from the profile are only marked before the LTO pipelines (default: no)"),
     dont_buffer_diagnostics: bool = (false, parse_bool, [UNTRACKED],
         "emit diagnostics rather than buffering (breaks NLL error downgrading, sorting) \
         (default: no)"),
@@ -1102,6 +1170,9 @@ mod parse {
     incremental_info: bool = (false, parse_bool, [UNTRACKED],
         "print high-level information about incremental reuse (or the lack thereof) \
         (default: no)"),
+    incremental_thinlto_index: bool = (false, parse_bool, [UNTRACKED],
+        "with incremental compilation, reuse the ThinLTO index of the previous session when \
+        none of the modules it covers changed (default: no)"),
     incremental_verify_ich: bool = (false, parse_bool, [UNTRACKED],
         "verify incr. comp. hashes of green query instances (default: no)"),
     inline_mir: Option<bool> = (None, parse_opt_bool, [TRACKED],
@@ -1130,12 +1201,34 @@ mod parse {
         "link native libraries in the linker invocation (default: yes)"),
     link_only: bool = (false, parse_bool, [TRACKED],
         "link the `.rlink` file generated by `-Z no-link` (default: no)"),
+    llvm_pass_stats: bool = (false, parse_bool, [UNTRACKED],
+        "write the number of invocations, the wall time and the instruction counts before and \
+        after each LLVM pass which ran while optimizing each codegen unit to \
+        `<codegen unit>.llvm-pass-stats.json` (requires `-Z new-llvm-pass-manager`, \
+        default: no)"),
     llvm_plugins: Vec<String> = (Vec::new(), parse_list, [TRACKED],
         "a list LLVM plugins to enable (space separated)"),
+    llvm_remark_summary: bool = (false, parse_bool, [UNTRACKED],
+        "write a per-function summary of the missed vectorization and inlining remarks of each \
+        codegen unit to `<codegen unit>.remark-summary.json`, with either pass manager \
+        (default: no)"),
+    llvm_stats: bool = (false, parse_bool, [UNTRACKED],
+        "write the LLVM statistics counters which changed while optimizing each codegen unit to \
+        `<codegen unit>.llvm-stats.json`, running the LLVM work of one codegen unit at a time \
+        as the counters are global, like `-Z no-parallel-llvm` (requires an LLVM with \
+        statistics, default: no)"),
+    llvm_threads: usize = (1, parse_threads, [TRACKED],
+        "use up to this many threads for the work LLVM does over the whole crate at once, \
+        such as building the ThinLTO index, linking the modules of fat LTO or writing archives \
+        (0 = number of CPUs, default: 1)"),
     llvm_time_trace: bool = (false, parse_bool, [UNTRACKED],
         "generate JSON tracing data file from LLVM data (default: no)"),
     ls: bool = (false, parse_bool, [UNTRACKED],
         "list the symbols defined by a library crate (default: no)"),
+    machine_outliner: Option<bool> = (None, parse_opt_bool, [TRACKED],
+        "run the machine outliner on the functions the target outlines by default, which are \
+        the `minsize` ones on AArch64 and none on most other targets, such as x86 \
+        (default: the target's default)"),
     macro_backtrace: bool = (false, parse_bool, [UNTRACKED],
         "show macro backtraces (default: no)"),
     merge_functions: Option<MergeFunctions> = (None, parse_merge_functions, [TRACKED],
@@ -1202,10 +1295,16 @@ mod parse {
         "make rustc print the total optimization fuel used by a crate"),
     print_link_args: bool = (false, parse_bool, [UNTRACKED],
         "print the arguments passed to the linker (default: no)"),
+    print_llvm_module_stats: bool = (false, parse_bool, [UNTRACKED],
+        "print the estimated size of each LLVM module before and after it is optimized, along \
+        with the memory allocated by the process (default: no)"),
     print_llvm_passes: bool = (false, parse_bool, [UNTRACKED],
         "print the LLVM optimization passes being run (default: no)"),
     print_mono_items: Option<String> = (None, parse_opt_string, [UNTRACKED],
         "print the result of the monomorphization collection pass"),
+    print_thinlto_import_costs: bool = (false, parse_bool, [UNTRACKED],
+        "print the number and estimated instruction count of the functions each ThinLTO \
+        module imports from each other module (default: no)"),
     print_type_sizes: bool = (false, parse_bool, [UNTRACKED],
         "print layout information for each type encountered (default: no)"),
     proc_macro_backtrace: bool = (false, parse_bool, [UNTRACKED],
@@ -1214,9 +1313,21 @@ mod parse {
         "insert profiling code (default: no)"),
     profile_closures: bool = (false, parse_no_flag, [UNTRACKED],
         "profile size of closures"),
+    profile_counter_atomic: bool = (false, parse_bool, [TRACKED],
+        "update the counters of `-C profile-generate` and `-Z instrument-coverage` \
+        atomically, so that they aren't lost when several threads race on them (default: no)"),
+    profile_counter_promotion: Option<bool> = (None, parse_opt_bool, [TRACKED],
+        "update the profile counters of loops in registers and only store them to memory \
+        after the loop, which also makes them much cheaper to update atomically \
+        (default: only for `-C profile-generate` with the new pass manager)"),
+    profile_counter_relocation: bool = (false, parse_bool, [TRACKED],
+        "make the profile counters relocatable at runtime, as required for the profiler \
+        runtime's continuous mode (`%c` in `LLVM_PROFILE_FILE`) on most targets (default: no)"),
     profile_emit: Option<PathBuf> = (None, parse_opt_pathbuf, [TRACKED],
         "file path to emit profiling data at runtime when using 'profile' \
         (default based on relative source path)"),
+    profile_sample_use: Option<PathBuf> = (None, parse_opt_pathbuf, [TRACKED],
+        "use the given `.prof` file for sampled profile-guided optimization (also known as AutoFDO)"),
     profiler_runtime: Option<String> = (Some(String::from("profiler_builtins")), parse_opt_string, [TRACKED],
         "name of the profiler runtime crate to automatically inject, or None to disable"),
     query_dep_graph: bool = (false, parse_bool, [UNTRACKED],
@@ -1227,13 +1338,37 @@ mod parse {
         "whether ELF relocations can be relaxed"),
     relro_level: Option<RelroLevel> = (None, parse_relro_level, [TRACKED],
         "choose which RELRO level to use"),
+    remark_dir: Option<PathBuf> = (None, parse_opt_pathbuf, [UNTRACKED],
+        "directory into which to stream the optimization remarks selected by `-C remark`, as \
+        one `<codegen unit>.<stage>.opt.yaml` file per LLVM stage of each codegen unit, instead \
+        of printing them as notes"),
     simulate_remapped_rust_src_base: Option<PathBuf> = (None, parse_opt_pathbuf, [TRACKED],
         "simulate the effect of remap-debuginfo = true at bootstrapping by remapping path \
         to rust's source base directory. only meant for testing purposes"),
     report_delayed_bugs: bool = (false, parse_bool, [TRACKED],
         "immediately print bugs registered with `delay_span_bug` (default: no)"),
+    reuse_archive_symbols: bool = (false, parse_bool, [UNTRACKED],
+        "build the symbol table of GNU archives in rustc rather than LLVM, reusing the entries of \
+        members copied from an existing archive and scanning the others on `-Z llvm-threads` \
+        threads (default: no)"),
+    reuse_llvm_contexts: Option<u32> = (None, parse_opt_number, [UNTRACKED],
+        "reuse each LLVM context for up to this many codegen units, keeping the types and \
+        constants it has already created (default: no)"),
     sanitizer: SanitizerSet = (SanitizerSet::empty(), parse_sanitizers, [TRACKED],
         "use a sanitizer"),
+    sanitizer_address_globals: Option<bool> = (None, parse_opt_bool, [TRACKED],
+        "instrument global variables with AddressSanitizer (default: yes)"),
+    sanitizer_address_use_after_return: Option<bool> = (None, parse_opt_bool, [TRACKED],
+        "instrument functions with AddressSanitizer so that uses of their stack variables \
+        after they returned can be detected, if enabled in the runtime (default: yes)"),
+    sanitizer_address_use_after_scope: Option<bool> = (None, parse_opt_bool, [TRACKED],
+        "detect uses of stack variables after their scope ended with AddressSanitizer \
+        (default: yes)"),
+    sanitizer_instrument_with_calls_threshold: Option<usize> = (None, parse_opt_number, [TRACKED],
+        "check the memory accesses of functions with more than this many of them by calling \
+        the sanitizer runtime instead of inline, saving code size and compile time at the cost \
+        of run time, with AddressSanitizer, MemorySanitizer and, set to 0, \
+        HWAddressSanitizer (default: LLVM's own thresholds)"),
     sanitizer_memory_track_origins: usize = (0, parse_sanitizer_memory_track_origins, [TRACKED],
         "enable origins tracking in MemorySanitizer"),
     sanitizer_recover: SanitizerSet = (SanitizerSet::empty(), parse_sanitizers, [TRACKED],
@@ -1269,6 +1404,13 @@ mod parse {
     split_dwarf_inlining: bool = (true, parse_bool, [UNTRACKED],
         "provide minimal debug info in the object/executable to facilitate online \
          symbolication/stack traces in the absence of .dwo/.dwp files when using Split DWARF"),
+    split_machine_functions: bool = (false, parse_bool, [TRACKED],
+        "split the cold blocks of functions with profile data off into separate sections \
+        (default: no)"),
+    split_thinlto_buffers: bool = (false, parse_bool, [TRACKED],
+        "keep the ThinLTO summary of each codegen unit apart from, and ahead of, its function \
+        bodies, so that the summaries can be read on their own; the pre-LTO bitcode files \
+        in the incremental cache aren't bitcode files anymore then (default: no)"),
     symbol_mangling_version: Option<SymbolManglingVersion> = (None,
         parse_symbol_mangling_version, [TRACKED],
         "which mangling version to use for symbol names ('legacy' (default) or 'v0')"),
@@ -1280,6 +1422,20 @@ mod parse {
         "select processor to schedule for (`rustc --print target-cpus` for details)"),
     thinlto: Option<bool> = (None, parse_opt_bool, [TRACKED],
         "enable ThinLTO when possible"),
+    thinlto_fast_debuginfo_patching: Option<usize> = (None, parse_opt_number, [TRACKED],
+        "merge the compile units of ThinLTO modules by only walking the subprograms of \
+        their function definitions, on this many threads (default: walk all debuginfo)"),
+    thinlto_fast_cache_keys: bool = (false, parse_bool, [UNTRACKED],
+        "hash the incremental ThinLTO cache keys with MD5 instead of SHA-1 (default: no)"),
+    thinlto_import_budget: Option<u64> = (None, parse_opt_number, [TRACKED],
+        "cap the estimated instruction count of the functions imported into each ThinLTO \
+        module, keeping the smallest ones (default: no cap)"),
+    thinlto_index_dir: Option<PathBuf> = (None, parse_opt_pathbuf, [UNTRACKED],
+        "directory into which to write the summary index shard and the imports file of each \
+        ThinLTO module, as LLVM's distributed ThinLTO does"),
+    thinlto_whole_program_devirt: bool = (false, parse_bool, [TRACKED],
+        "devirtualize virtual calls based on the combined ThinLTO summary index, for modules \
+        with type metadata; requires `-Z new-llvm-pass-manager` (default: no)"),
     thir_unsafeck: bool = (false, parse_bool, [TRACKED],
         "use the work-in-progress THIR unsafety checker. NOTE: this is unsound (default: no)"),
     /// We default to 1 here since we want to behave like
@@ -1332,6 +1488,13 @@ mod parse {
         "in general, enable more debug printouts (default: no)"),
     verify_llvm_ir: bool = (false, parse_bool, [TRACKED],
         "verify LLVM IR (default: no)"),
+    verify_llvm_ir_sample: Option<usize> = (None, parse_opt_number, [TRACKED],
+        "with `-Z verify-llvm-ir` and the new pass manager, only verify about one in this many \
+        of the functions of each module before optimizing it, chosen deterministically, \
+        rather than the whole module (default: verify everything)"),
+    verify_llvm_ir_sample_min: usize = (64, parse_number, [TRACKED],
+        "with `-Z verify-llvm-ir-sample`, still verify at least this many functions of each \
+        module (default: 64)"),
     wasi_exec_model: Option<WasiExecModel> = (None, parse_wasi_exec_model, [TRACKED],
         "whether to build a wasi command or reactor"),
 
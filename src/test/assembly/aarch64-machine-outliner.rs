@@ -0,0 +1,61 @@
+// Checks that `-Z machine-outliner=no` keeps the machine outliner from outlining the repeated
+// stores of these `minsize` functions, which it does by default on AArch64.
+//
+// revisions: default no
+// assembly-output: emit-asm
+// compile-flags: --target aarch64-unknown-linux-gnu -C opt-level=z
+// [no] compile-flags: -Z machine-outliner=no
+// needs-llvm-components: aarch64
+
+#![feature(no_core, lang_items)]
+#![no_core]
+#![crate_type = "rlib"]
+
+#[lang = "sized"]
+trait Sized {}
+
+pub struct Fields {
+    a: u64,
+    b: u64,
+    c: u64,
+    d: u64,
+    e: u64,
+    f: u64,
+    g: u64,
+}
+
+// CHECK-LABEL: first:
+// default: OUTLINED_FUNCTION_
+// no-NOT: OUTLINED_FUNCTION_
+#[no_mangle]
+pub fn first(s: &mut Fields) {
+    s.a = 0x1234_5678_9abc_def0;
+    s.b = 0x0fed_cba9_8765_4321;
+    s.c = 0x1122_3344_5566_7788;
+    s.d = 0x8877_6655_4433_2211;
+    s.e = 0x0102_0304_0506_0708;
+    s.f = 0x0807_0605_0403_0201;
+    s.g = 1;
+}
+
+#[no_mangle]
+pub fn second(s: &mut Fields) {
+    s.a = 0x1234_5678_9abc_def0;
+    s.b = 0x0fed_cba9_8765_4321;
+    s.c = 0x1122_3344_5566_7788;
+    s.d = 0x8877_6655_4433_2211;
+    s.e = 0x0102_0304_0506_0708;
+    s.f = 0x0807_0605_0403_0201;
+    s.g = 2;
+}
+
+#[no_mangle]
+pub fn third(s: &mut Fields) {
+    s.a = 0x1234_5678_9abc_def0;
+    s.b = 0x0fed_cba9_8765_4321;
+    s.c = 0x1122_3344_5566_7788;
+    s.d = 0x8877_6655_4433_2211;
+    s.e = 0x0102_0304_0506_0708;
+    s.f = 0x0807_0605_0403_0201;
+    s.g = 3;
+}
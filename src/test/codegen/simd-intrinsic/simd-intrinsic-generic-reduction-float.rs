@@ -0,0 +1,49 @@
+// Checks the fast-math flags of floating point reductions: the ordered ones have none, and the
+// unordered ones may only be reassociated, without assuming that there are no NaNs or infinities.
+
+// compile-flags: -C no-prepopulate-passes
+// min-llvm-version: 12.0
+
+#![crate_type = "lib"]
+
+#![feature(repr_simd, platform_intrinsics)]
+#![allow(non_camel_case_types)]
+
+#[repr(simd)]
+#[derive(Copy, Clone, PartialEq, Debug)]
+pub struct f32x4(pub f32, pub f32, pub f32, pub f32);
+
+extern "platform-intrinsic" {
+    fn simd_reduce_add_ordered<T, U>(x: T, acc: U) -> U;
+    fn simd_reduce_mul_ordered<T, U>(x: T, acc: U) -> U;
+    fn simd_reduce_add_unordered<T, U>(x: T) -> U;
+    fn simd_reduce_mul_unordered<T, U>(x: T) -> U;
+}
+
+// CHECK-LABEL: @add_ordered
+#[no_mangle]
+pub unsafe fn add_ordered(a: f32x4, b: f32) -> f32 {
+    // CHECK: call float @llvm.vector.reduce.fadd.v4f32(float %{{.*}},
+    simd_reduce_add_ordered(a, b)
+}
+
+// CHECK-LABEL: @mul_ordered
+#[no_mangle]
+pub unsafe fn mul_ordered(a: f32x4, b: f32) -> f32 {
+    // CHECK: call float @llvm.vector.reduce.fmul.v4f32(float %{{.*}},
+    simd_reduce_mul_ordered(a, b)
+}
+
+// CHECK-LABEL: @add_unordered
+#[no_mangle]
+pub unsafe fn add_unordered(a: f32x4) -> f32 {
+    // CHECK: call reassoc float @llvm.vector.reduce.fadd.v4f32(float 0.000000e+00,
+    simd_reduce_add_unordered(a)
+}
+
+// CHECK-LABEL: @mul_unordered
+#[no_mangle]
+pub unsafe fn mul_unordered(a: f32x4) -> f32 {
+    // CHECK: call reassoc float @llvm.vector.reduce.fmul.v4f32(float 1.000000e+00,
+    simd_reduce_mul_unordered(a)
+}
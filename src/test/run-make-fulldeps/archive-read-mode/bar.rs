@@ -0,0 +1,10 @@
+extern crate foo;
+
+#[no_mangle]
+pub extern "C" fn bar() -> u32 {
+    foo::foo()
+}
+
+fn main() {
+    assert_eq!(bar(), 42);
+}
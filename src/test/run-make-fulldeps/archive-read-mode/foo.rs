@@ -0,0 +1,5 @@
+#![crate_type = "rlib"]
+
+pub fn foo() -> u32 {
+    42
+}
@@ -0,0 +1,6 @@
+int native_answer(void);
+int rust_answer(void);
+
+int main(void) {
+    return native_answer() == 21 && rust_answer() == 42 ? 0 : 1;
+}
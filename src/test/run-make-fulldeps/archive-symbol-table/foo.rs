@@ -0,0 +1,11 @@
+#![crate_type = "staticlib"]
+
+#[link(name = "native", kind = "static")]
+extern "C" {
+    fn native_answer() -> i32;
+}
+
+#[no_mangle]
+pub extern "C" fn rust_answer() -> i32 {
+    unsafe { native_answer() * 2 }
+}
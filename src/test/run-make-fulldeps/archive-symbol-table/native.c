@@ -0,0 +1,3 @@
+int native_answer(void) {
+    return 21;
+}
@@ -0,0 +1,5 @@
+extern crate foo;
+
+fn main() {
+    assert_eq!(foo::baz(), 3);
+}
@@ -0,0 +1,11 @@
+#![crate_type = "rlib"]
+
+#[link(name = "foo", kind = "static")]
+extern "C" {
+    fn foo() -> i32;
+    fn bar() -> i32;
+}
+
+pub fn baz() -> i32 {
+    unsafe { foo() + bar() }
+}
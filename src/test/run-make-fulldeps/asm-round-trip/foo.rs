@@ -0,0 +1,7 @@
+use std::thread;
+
+fn main() {
+    let v: Vec<u64> = (0..16).collect();
+    let sum = thread::spawn(move || v.iter().sum::<u64>()).join().unwrap();
+    assert_eq!(sum, 120);
+}
@@ -0,0 +1,19 @@
+mod a {
+    #[inline(never)]
+    pub fn square(x: u64) -> u64 {
+        x * x
+    }
+}
+
+mod b {
+    pub fn sum_of_squares(n: u64) -> u64 {
+        (0..n).map(crate::a::square).sum()
+    }
+}
+
+fn main() {
+    // The Makefile changes `square` between sessions, so it passes the
+    // expected result.
+    let expected: u64 = std::env::args().nth(1).unwrap().parse().unwrap();
+    assert_eq!(b::sum_of_squares(2), expected);
+}
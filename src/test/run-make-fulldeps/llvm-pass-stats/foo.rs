@@ -0,0 +1,5 @@
+#![crate_type = "lib"]
+
+pub fn sum(xs: &[u32]) -> u32 {
+    xs.iter().sum()
+}
@@ -0,0 +1,13 @@
+#![crate_type = "lib"]
+
+pub mod a {
+    pub fn square(x: u64) -> u64 {
+        x * x
+    }
+}
+
+pub mod b {
+    pub fn sum_of_squares(xs: &[u64]) -> u64 {
+        xs.iter().map(|&x| crate::a::square(x)).sum()
+    }
+}
@@ -0,0 +1,21 @@
+mod a {
+    pub fn square(x: u64) -> u64 {
+        x * x
+    }
+}
+
+mod b {
+    pub fn sum_of_squares(xs: &[u64]) -> u64 {
+        xs.iter().map(|&x| crate::a::square(x)).sum()
+    }
+}
+
+mod c {
+    pub fn numbers() -> Vec<u64> {
+        (1..=10).collect()
+    }
+}
+
+fn main() {
+    assert_eq!(b::sum_of_squares(&c::numbers()), 385);
+}
@@ -0,0 +1,11 @@
+#![crate_type = "lib"]
+
+#[inline]
+fn add(a: u32, b: u32) -> u32 {
+    a.wrapping_add(b)
+}
+
+#[no_mangle]
+pub fn sum(values: &[u32]) -> u32 {
+    values.iter().fold(0, |acc, &v| add(acc, v))
+}
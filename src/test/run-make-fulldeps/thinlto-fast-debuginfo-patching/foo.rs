@@ -0,0 +1,34 @@
+use std::collections::BTreeMap;
+use std::fmt::Write;
+
+mod a {
+    #[inline]
+    pub fn describe(n: u32) -> String {
+        struct Local(u32);
+        impl std::fmt::Display for Local {
+            fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+                write!(f, "<{}>", self.0)
+            }
+        }
+        format!("{}", Local(n))
+    }
+}
+
+mod b {
+    pub fn count(words: &[&str]) -> std::collections::BTreeMap<String, usize> {
+        let mut map = std::collections::BTreeMap::new();
+        for w in words {
+            *map.entry(w.to_string()).or_insert(0) += 1;
+        }
+        map
+    }
+}
+
+fn main() {
+    let map: BTreeMap<String, usize> = b::count(&["a", "b", "a"]);
+    let mut out = String::new();
+    for (k, v) in &map {
+        write!(out, "{}={} ", k, a::describe(*v as u32)).unwrap();
+    }
+    assert_eq!(out, "a=<2> b=<1> ");
+}
@@ -0,0 +1,16 @@
+mod a {
+    pub fn square(x: usize) -> usize {
+        x * x
+    }
+}
+
+mod b {
+    pub fn sum_of_squares(n: usize) -> usize {
+        (0..n).map(crate::a::square).sum()
+    }
+}
+
+fn main() {
+    let n = std::env::args().count() + 3;
+    assert_eq!(b::sum_of_squares(n), 14);
+}
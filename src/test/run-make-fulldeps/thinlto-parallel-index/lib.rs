@@ -0,0 +1,28 @@
+#![crate_type = "rlib"]
+
+pub mod a {
+    #[inline(never)]
+    pub fn square(x: u64) -> u64 {
+        x * x
+    }
+}
+
+pub mod b {
+    pub fn sum_of_squares(n: u64) -> u64 {
+        (0..n).map(crate::a::square).sum()
+    }
+}
+
+pub mod c {
+    pub trait Shape {
+        fn area(&self) -> u64;
+    }
+
+    pub struct Square(pub u64);
+
+    impl Shape for Square {
+        fn area(&self) -> u64 {
+            crate::a::square(self.0)
+        }
+    }
+}
@@ -0,0 +1,9 @@
+extern crate lib;
+
+use lib::c::Shape;
+
+fn main() {
+    assert_eq!(lib::b::sum_of_squares(4), 14);
+    let shapes: Vec<Box<dyn Shape>> = vec![Box::new(lib::c::Square(3))];
+    assert_eq!(shapes.iter().map(|s| s.area()).sum::<u64>(), 9);
+}
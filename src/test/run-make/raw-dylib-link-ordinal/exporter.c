@@ -0,0 +1,6 @@
+#include <stdio.h>
+
+void exported_function() {
+    printf("exported_function\n");
+    fflush(stdout);
+}
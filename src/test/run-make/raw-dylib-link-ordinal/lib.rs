@@ -0,0 +1,15 @@
+#![feature(raw_dylib)]
+
+#[link(name = "exporter", kind = "raw-dylib")]
+extern {
+    #[link_ordinal(13)]
+    fn imported_function();
+}
+
+pub fn library_function() {
+    // `imported_function` is only exported by ordinal, with the name
+    // `exported_function` not being visible to the linker.
+    unsafe {
+        imported_function();
+    }
+}